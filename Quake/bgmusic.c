@@ -75,6 +75,173 @@ static music_handler_t *music_handlers = NULL;
 
 static snd_stream_t *bgmstream = NULL;
 
+/* Music is decoded ahead of playback by a thread of its own into a
+ * single-producer/single-consumer ring, BGM_UpdateStream only copies
+ * decoded samples to the raw buffer. The decoder holds the lock while
+ * it uses bgmstream, so the main thread takes it to change the stream
+ * and stops the thread before closing it. The decoder can't print:
+ * problems are left in status for the main thread to report. */
+#define BGM_RINGSIZE	(1 << 18)	/* bytes, about 1.5 s of 44.1 kHz stereo */
+#define BGM_CHUNKSIZE	16384		/* max bytes decoded at once */
+
+typedef enum
+{
+	BGM_DECODING,
+	BGM_DECODED,		/* no more data */
+	BGM_ERR_READ,
+	BGM_ERR_SEEK,
+	BGM_ERR_EOF		/* the stream keeps returning EOF */
+} bgm_decstatus_t;
+
+static struct
+{
+	byte		data[BGM_RINGSIZE];
+	SDL_atomic_t	head;	/* bytes played, written by the main thread */
+	SDL_atomic_t	tail;	/* bytes decoded, written by the decoder */
+	SDL_atomic_t	status;	/* bgm_decstatus_t */
+	SDL_atomic_t	quit;
+	int		error;	/* codec result for BGM_ERR_READ and BGM_ERR_SEEK */
+	char		message[128];	/* codec message for the main thread to print */
+	qboolean	message_dev;
+	SDL_atomic_t	hasmessage;
+	qboolean	did_rewind;
+	SDL_mutex	*lock;
+	SDL_Thread	*thread;
+} bgm_decoder;
+
+static void BGM_LockStream (void)
+{
+	if (bgm_decoder.lock)
+		SDL_LockMutex (bgm_decoder.lock);
+}
+
+static void BGM_UnlockStream (void)
+{
+	if (bgm_decoder.lock)
+		SDL_UnlockMutex (bgm_decoder.lock);
+}
+
+/* hands a message left by the codec over to the main thread,
+ * dropping it if the previous one wasn't printed yet */
+static void BGM_TakeCodecError (void)
+{
+	if (!bgmstream->error[0])
+		return;
+	if (!SDL_AtomicGet(&bgm_decoder.hasmessage))
+	{
+		q_strlcpy(bgm_decoder.message, bgmstream->error, sizeof(bgm_decoder.message));
+		bgm_decoder.message_dev = bgmstream->error_dev;
+		SDL_AtomicSet(&bgm_decoder.hasmessage, 1);
+	}
+	bgmstream->error[0] = 0;
+}
+
+static void BGM_PrintCodecError (void)
+{
+	if (!SDL_AtomicGet(&bgm_decoder.hasmessage))
+		return;
+	if (bgm_decoder.message_dev)
+		Con_DPrintf("%s", bgm_decoder.message);
+	else
+		Con_Printf("%s", bgm_decoder.message);
+	SDL_AtomicSet(&bgm_decoder.hasmessage, 0);
+}
+
+/* decodes one chunk into the ring, returns false if there was no room
+ * or nothing left to decode */
+static qboolean BGM_DecodeChunk (void)
+{
+	unsigned int	head, tail, chunk;
+	int	framesize, res;
+
+	if (SDL_AtomicGet(&bgm_decoder.status) != BGM_DECODING)
+		return false;
+
+	framesize = bgmstream->info.width * bgmstream->info.channels;
+	head = (unsigned int) SDL_AtomicGet(&bgm_decoder.head);
+	tail = (unsigned int) SDL_AtomicGet(&bgm_decoder.tail);
+	chunk = BGM_RINGSIZE - (tail - head);
+	chunk = q_min(chunk, BGM_RINGSIZE - (tail & (BGM_RINGSIZE - 1)));
+	chunk = q_min(chunk, BGM_CHUNKSIZE);
+	chunk -= chunk % framesize;
+	if (!chunk)
+		return false;
+
+	res = S_CodecReadStream(bgmstream, chunk, bgm_decoder.data + (tail & (BGM_RINGSIZE - 1)));
+	BGM_TakeCodecError ();
+	if (res > 0)	/* data: add to the ring */
+	{
+		res -= res % framesize;
+		SDL_AtomicSet(&bgm_decoder.tail, (int) (tail + res));
+		bgm_decoder.did_rewind = false;
+	}
+	else if (res == 0)	/* EOF */
+	{
+		if (!bgmloop)
+			SDL_AtomicSet(&bgm_decoder.status, BGM_DECODED);
+		else if (bgm_decoder.did_rewind)
+			SDL_AtomicSet(&bgm_decoder.status, BGM_ERR_EOF);
+		else
+		{
+			res = S_CodecRewindStream(bgmstream);
+			BGM_TakeCodecError ();
+			if (res != 0)
+			{
+				bgm_decoder.error = res;
+				SDL_AtomicSet(&bgm_decoder.status, BGM_ERR_SEEK);
+			}
+			else
+				bgm_decoder.did_rewind = true;
+		}
+	}
+	else	/* res < 0: some read error */
+	{
+		bgm_decoder.error = res;
+		SDL_AtomicSet(&bgm_decoder.status, BGM_ERR_READ);
+	}
+
+	return SDL_AtomicGet(&bgm_decoder.status) == BGM_DECODING;
+}
+
+static int SDLCALL BGM_DecoderThread (void *unused)
+{
+	qboolean busy;
+
+	while (!SDL_AtomicGet(&bgm_decoder.quit))
+	{
+		BGM_LockStream ();
+		busy = BGM_DecodeChunk ();
+		BGM_UnlockStream ();
+		if (!busy)
+			SDL_Delay (10);
+	}
+	return 0;
+}
+
+/* opens a stream and starts decoding it, decodes on the main thread
+ * if the decoder thread can't be started */
+static qboolean BGM_OpenStream (const char *filename, unsigned int type)
+{
+	bgmstream = S_CodecOpenStreamType(filename, type, bgmloop);
+	if (!bgmstream)
+		return false;
+
+	SDL_AtomicSet(&bgm_decoder.head, 0);
+	SDL_AtomicSet(&bgm_decoder.tail, 0);
+	SDL_AtomicSet(&bgm_decoder.status, BGM_DECODING);
+	SDL_AtomicSet(&bgm_decoder.quit, 0);
+	SDL_AtomicSet(&bgm_decoder.hasmessage, 0);
+	bgm_decoder.did_rewind = false;
+	bgm_decoder.error = 0;
+
+	if (bgm_decoder.lock)
+		bgm_decoder.thread = SDL_CreateThread(BGM_DecoderThread, "Music decoder", NULL);
+	if (!bgm_decoder.thread)
+		Con_DPrintf("Couldn't start the music decoder thread, decoding on the main thread\n");
+
+	return true;
+}
+
 static void BGM_Play_f (void)
 {
 	if (Cmd_Argc() == 2) {
@@ -114,7 +281,12 @@ static void BGM_Loop_f (void)
 		else if (q_strcasecmp(Cmd_Argv(1),"toggle") == 0)
 			bgmloop = !bgmloop;
 
-		if (bgmstream) bgmstream->loop = bgmloop;
+		if (bgmstream)
+		{
+			BGM_LockStream ();
+			bgmstream->loop = bgmloop;
+			BGM_UnlockStream ();
+		}
 	}
 
 	if (bgmloop)
@@ -134,7 +306,15 @@ static void BGM_Jump_f (void)
 		Con_Printf ("music_jump <ordernum>\n");
 	}
 	else if (bgmstream) {
+		BGM_LockStream ();
 		S_CodecJumpToOrder(bgmstream, atoi(Cmd_Argv(1)));
+		BGM_TakeCodecError ();
+	/* drop what was decoded from the old position */
+		SDL_AtomicSet(&bgm_decoder.head, SDL_AtomicGet(&bgm_decoder.tail));
+		SDL_AtomicSet(&bgm_decoder.status, BGM_DECODING);
+		bgm_decoder.did_rewind = false;
+		BGM_UnlockStream ();
+		BGM_PrintCodecError ();
 	}
 }
 
@@ -154,6 +334,8 @@ qboolean BGM_Init (void)
 	if (COM_CheckParm("-noextmusic") != 0)
 		no_extmusic = true;
 
+	bgm_decoder.lock = SDL_CreateMutex();
+
 	bgmloop = true;
 
 	for (i = 0; wanted_handlers[i].type != CODECTYPE_NONE; i++)
@@ -192,6 +374,11 @@ qboolean BGM_Init (void)
 void BGM_Shutdown (void)
 {
 	BGM_Stop();
+	if (bgm_decoder.lock)
+	{
+		SDL_DestroyMutex(bgm_decoder.lock);
+		bgm_decoder.lock = NULL;
+	}
 /* sever our connections to
  * midi_drv and snd_codec */
 	music_handlers = NULL;
@@ -223,8 +410,7 @@ static void BGM_Play_noext (const char *filename, unsigned int allowed_types)
 		/* not supported in quake */
 			break;
 		case BGM_STREAMER:
-			bgmstream = S_CodecOpenStreamType(tmp, handler->type, bgmloop);
-			if (bgmstream)
+			if (BGM_OpenStream(tmp, handler->type))
 				return;		/* success */
 			break;
 		case BGM_NONE:
@@ -281,8 +467,7 @@ void BGM_Play (const char *filename)
 	/* not supported in quake */
 		break;
 	case BGM_STREAMER:
-		bgmstream = S_CodecOpenStreamType(tmp, handler->type, bgmloop);
-		if (bgmstream)
+		if (BGM_OpenStream(tmp, handler->type))
 			return;		/* success */
 		break;
 	case BGM_NONE:
@@ -357,8 +542,7 @@ void BGM_PlayCDtrack (byte track, qboolean looping)
 	{
 		q_snprintf(tmp, sizeof(tmp), "%s/track%02d.%s",
 				MUSIC_DIRNAME, (int)track, ext);
-		bgmstream = S_CodecOpenStreamType(tmp, type, bgmloop);
-		if (! bgmstream)
+		if (!BGM_OpenStream(tmp, type))
 			Con_Printf("Couldn't handle music file %s\n", tmp);
 	}
 }
@@ -367,10 +551,16 @@ void BGM_Stop (void)
 {
 	if (bgmstream)
 	{
+		if (bgm_decoder.thread)
+		{
+			SDL_AtomicSet(&bgm_decoder.quit, 1);
+			SDL_WaitThread(bgm_decoder.thread, NULL);
+			bgm_decoder.thread = NULL;
+		}
 		bgmstream->status = STREAM_NONE;
 		S_CodecCloseStream(bgmstream);
 		bgmstream = NULL;
-		s_rawend = 0;
+		S_ClearRawSamples ();
 	}
 }
 
@@ -397,12 +587,13 @@ void BGM_Resume (void)
 
 static void BGM_UpdateStream (void)
 {
-	qboolean did_rewind = false;
-	int	res;	/* Number of bytes read. */
+	unsigned int	head, tail;
 	int	bufferSamples;
 	int	fileSamples;
 	int	fileBytes;
-	byte	raw[16384];
+	int	framesize;
+
+	BGM_PrintCodecError ();
 
 	if (bgmstream->status != STREAM_PLAY)
 		return;
@@ -411,83 +602,64 @@ static void BGM_UpdateStream (void)
 	if (bgmvolume.value <= 0)
 		return;
 
-	/* see how many samples should be copied into the raw buffer */
-	if (s_rawend < paintedtime)
-		s_rawend = paintedtime;
+	framesize = bgmstream->info.width * bgmstream->info.channels;
 
-	while (s_rawend < paintedtime + MAX_RAW_SAMPLES)
+	/* see how many samples should be copied into the raw buffer */
+	while ((bufferSamples = S_RawSamplesSpace ()) > 0)
 	{
-		bufferSamples = MAX_RAW_SAMPLES - (s_rawend - paintedtime);
-
-		/* ramp up volume after stream was paused */
-		if (bgmstream->volume < 1.f)
-		{
-			bgmstream->volume += bufferSamples / (bgmstream->info.rate * 1.f);
-			bgmstream->volume = q_min (1.f, bgmstream->volume);
-		}
-
 		/* decide how much data needs to be read from the file */
 		fileSamples = bufferSamples * bgmstream->info.rate / shm->speed;
 		if (!fileSamples)
 			return;
 
-		/* our max buffer size */
-		fileBytes = fileSamples * (bgmstream->info.width * bgmstream->info.channels);
-		if (fileBytes > (int) sizeof(raw))
-		{
-			fileBytes = (int) sizeof(raw);
-			fileSamples = fileBytes /
-					  (bgmstream->info.width * bgmstream->info.channels);
-		}
+		/* no decoder thread: decode here */
+		if (!bgm_decoder.thread)
+			BGM_DecodeChunk ();
 
-		/* Read */
-		res = S_CodecReadStream(bgmstream, fileBytes, raw);
-		if (res < fileBytes)
-		{
-			fileBytes = res;
-			fileSamples = res / (bgmstream->info.width * bgmstream->info.channels);
-		}
+		/* take what the decoder has ready, up to the end of the ring */
+		head = (unsigned int) SDL_AtomicGet(&bgm_decoder.head);
+		tail = (unsigned int) SDL_AtomicGet(&bgm_decoder.tail);
+		fileBytes = fileSamples * framesize;
+		fileBytes = q_min(fileBytes, (int) (tail - head));
+		fileBytes = q_min(fileBytes, BGM_RINGSIZE - (int) (head & (BGM_RINGSIZE - 1)));
 
-		if (res > 0)	/* data: add to raw buffer */
+		if (!fileBytes)
 		{
-			S_RawSamples(fileSamples, bgmstream->info.rate,
-							bgmstream->info.width,
-							bgmstream->info.channels,
-							raw, bgmvolume.value * bgmstream->volume);
-			did_rewind = false;
-		}
-		else if (res == 0)	/* EOF */
-		{
-			if (bgmloop)
-			{
-				if (did_rewind)
-				{
-					Con_Printf("Stream keeps returning EOF.\n");
-					BGM_Stop();
-					return;
-				}
-
-				res = S_CodecRewindStream(bgmstream);
-				if (res != 0)
-				{
-					Con_Printf("Stream seek error (%i), stopping.\n", res);
-					BGM_Stop();
-					return;
-				}
-				did_rewind = true;
-			}
-			else
+			BGM_PrintCodecError ();
+			switch (SDL_AtomicGet(&bgm_decoder.status))
 			{
-				BGM_Stop();
+			case BGM_DECODING:	/* decoder is behind, try again next frame */
 				return;
+			case BGM_ERR_EOF:
+				Con_Printf("Stream keeps returning EOF.\n");
+				break;
+			case BGM_ERR_SEEK:
+				Con_Printf("Stream seek error (%i), stopping.\n", bgm_decoder.error);
+				break;
+			case BGM_ERR_READ:
+				Con_Printf("Stream read error (%i), stopping.\n", bgm_decoder.error);
+				break;
+			default:	/* BGM_DECODED: played to the end */
+				break;
 			}
-		}
-		else	/* res < 0: some read error */
-		{
-			Con_Printf("Stream read error (%i), stopping.\n", res);
 			BGM_Stop();
 			return;
 		}
+		fileSamples = fileBytes / framesize;
+
+		/* ramp up volume after stream was paused */
+		if (bgmstream->volume < 1.f)
+		{
+			bgmstream->volume += bufferSamples / (bgmstream->info.rate * 1.f);
+			bgmstream->volume = q_min (1.f, bgmstream->volume);
+		}
+
+		S_RawSamples(fileSamples, bgmstream->info.rate,
+						bgmstream->info.width,
+						bgmstream->info.channels,
+						bgm_decoder.data + (head & (BGM_RINGSIZE - 1)),
+						bgmvolume.value * bgmstream->volume);
+		SDL_AtomicSet(&bgm_decoder.head, (int) (head + fileBytes));
 	}
 }
 
@@ -629,7 +629,7 @@ void CL_Record_f (void)
 	Con_LinkPrintf (name, "%s", relname);
 	Con_SafePrintf (".\n");
 
-	cls.demofile = Sys_fopen (name, "wb");
+	cls.demofile = COM_CreateFile (name, "wb");
 	if (!cls.demofile)
 	{
 		Con_Printf ("ERROR: couldn't create %s\n", relname);
@@ -100,6 +100,8 @@ void CL_ClearState (void)
 	if (!sv.active)
 		Host_ClearMemory ();
 
+	S_ClearPrecache ();
+
 // wipe the entire cl structure
 	CL_FreeState ();
 
@@ -134,6 +136,7 @@ void CL_Disconnect (void)
 
 // stop sounds (especially looping!)
 	S_StopAllSounds (true);
+	S_ClearPrecache ();
 	BGM_Pause ();
 
 // if running a local server, shut it down
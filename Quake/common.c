@@ -1681,6 +1681,158 @@ THREAD_LOCAL int	file_from_pak;		// ZOID: global indicating that file came from
 searchpath_t	*com_searchpaths;
 searchpath_t	*com_base_searchpaths;
 
+cvar_t	fs_dircache = {"fs_dircache","0",CVAR_NONE};
+cvar_t	fs_negcache = {"fs_negcache","1",CVAR_NONE};
+cvar_t	fs_zipcache = {"fs_zipcache","16",CVAR_NONE};	// MB of decompressed pk3 files to keep around
+
+#ifdef _WIN32
+#define COM_FileNameCompare	q_strcasecmp
+#else
+#define COM_FileNameCompare	strcmp
+#endif
+
+// filesystem lookup counters, reported by fs_stats
+static struct
+{
+	SDL_atomic_t	lookups;		// COM_FindFile calls
+	SDL_atomic_t	misses;			// COM_FindFile calls that found nothing
+	SDL_atomic_t	pakprobes;		// pak hash table lookups
+	SDL_atomic_t	pakcompares;	// string compares inside pak hash tables
+	SDL_atomic_t	stats;			// Sys_FileType calls for loose files
+	SDL_atomic_t	dircachehits;	// loose file lookups answered by the directory cache
+	SDL_atomic_t	dircachemisses;	// loose file lookups rejected by the directory cache
+	SDL_atomic_t	dirscans;		// directories listed to fill the directory cache
+	SDL_atomic_t	neghits;		// lookups answered by the negative cache
+	SDL_atomic_t	mapped;			// files handed out as memory-mapped views
+	SDL_atomic_t	inflated;		// pk3 entries decompressed
+	SDL_atomic_t	zipcachehits;	// pk3 entries served from the decompressed file cache
+} fs_stats;
+
+//
+// cache of recently decompressed pk3 entries
+//
+typedef struct zipcache_s
+{
+	struct zipcache_s	*prev, *next;	// most recently used first
+	const pack_t		*pack;
+	const packfile_t	*entry;
+	byte				*data;
+} zipcache_t;
+
+static SDL_mutex	*fs_zip_mutex;		// guards the zip cache, pk3 local header lookups and reads through shared pak handles
+static zipcache_t	*fs_zipcache_head;
+static size_t		fs_zipcache_size;
+
+//
+// memory-mapped file views handed out by COM_MapFile
+//
+typedef struct filemap_s
+{
+	struct filemap_s	*next;
+	byte				*data;
+	void				*base;
+	size_t				basesize;
+} filemap_t;
+
+static SDL_mutex	*com_filemap_mutex;
+static filemap_t	*com_filemaps;
+static qboolean		com_nommap;
+static THREAD_LOCAL qfileofs_t com_fileoffset;	// offset of the last file found by COM_FindFile
+static THREAD_LOCAL pack_t		*com_filepack;		// pak of the last file found by COM_FindFile, if any
+static THREAD_LOCAL packfile_t	*com_filepackentry;
+
+//
+// optional cache of loose directory listings
+//
+typedef struct fsdirlist_s
+{
+	struct fsdirlist_s	*next;
+	unsigned			hash;
+	char				path[MAX_OSPATH];
+	int					numfiles;
+	unsigned			hashsize;	// power of two
+	int					*hashtable;	// 1-based indices into offsets, 0 = empty slot
+	int					*offsets;	// file name offsets into names
+	char				*names;
+} fsdirlist_t;
+
+#define DIRCACHE_BUCKETS	256
+
+//
+// negative lookup cache: names that weren't found in any searchpath
+// of the current game directories
+//
+typedef struct fsnegentry_s
+{
+	struct fsnegentry_s	*next;
+	unsigned			hash;
+	char				name[1];	// variable sized
+} fsnegentry_t;
+
+#define NEGCACHE_BUCKETS	1024
+#define NEGCACHE_MAXENTRIES	32768
+
+static SDL_mutex	*fs_cache_mutex;	// guards both the directory cache and the negative cache
+static fsdirlist_t	*fs_dircache_buckets[DIRCACHE_BUCKETS];
+static fsnegentry_t	*fs_negcache_buckets[NEGCACHE_BUCKETS];
+static int			fs_negcache_count;
+
+/*
+============
+COM_HashFileName
+
+Hashes a file name the same way COM_FileNameCompare compares them
+============
+*/
+static unsigned COM_HashFileName (const char *name)
+{
+	unsigned hash = 0x811c9dc5u;
+	while (*name)
+	{
+#ifdef _WIN32
+		hash ^= (byte) q_tolower (*name++);
+#else
+		hash ^= (byte) *name++;
+#endif
+		hash *= 0x01000193u;
+	}
+	return hash;
+}
+
+/*
+============
+COM_HashTableSize
+
+Returns a power-of-two table size with a load factor of at most 50%
+============
+*/
+static unsigned COM_HashTableSize (int count)
+{
+	unsigned size = 16;
+	while (size < (unsigned) count * 2)
+		size <<= 1;
+	return size;
+}
+
+/*
+============
+COM_HashTableInsert
+
+Inserts a 1-based index into an open-addressing hash table.
+Duplicates are placed after existing entries, so lookups keep
+returning the first one, just like a linear scan would.
+============
+*/
+static void COM_HashTableInsert (int *table, unsigned size, unsigned hash, int index)
+{
+	unsigned mask = size - 1;
+	unsigned pos = hash & mask;
+
+	while (table[pos])
+		pos = (pos + 1) & mask;
+	table[pos] = index;
+}
+
 /*
 ============
 COM_Path_f
@@ -1702,6 +1854,46 @@ static void COM_Path_f (void)
 	}
 }
 
+/*
+============
+COM_FSStats_f
+============
+*/
+static void COM_FSStats_f (void)
+{
+	int lookups, misses, negnames;
+
+	if (Cmd_Argc () > 1 && !q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		memset (&fs_stats, 0, sizeof (fs_stats));
+		Con_Printf ("Filesystem stats reset\n");
+		return;
+	}
+
+	lookups = SDL_AtomicGet (&fs_stats.lookups);
+	misses = SDL_AtomicGet (&fs_stats.misses);
+	negnames = 0;
+	if (fs_cache_mutex)
+	{
+		SDL_LockMutex (fs_cache_mutex);
+		negnames = fs_negcache_count;
+		SDL_UnlockMutex (fs_cache_mutex);
+	}
+
+	Con_Printf ("lookups : %i (%i found, %i missing)\n", lookups, lookups - misses, misses);
+	Con_Printf ("pak     : %i probes, %i name compares\n",
+		SDL_AtomicGet (&fs_stats.pakprobes), SDL_AtomicGet (&fs_stats.pakcompares));
+	Con_Printf ("loose   : %i stat calls\n", SDL_AtomicGet (&fs_stats.stats));
+	Con_Printf ("dircache: %i hits, %i rejects, %i dirs scanned%s\n",
+		SDL_AtomicGet (&fs_stats.dircachehits), SDL_AtomicGet (&fs_stats.dircachemisses),
+		SDL_AtomicGet (&fs_stats.dirscans), fs_dircache.value ? "" : " (disabled)");
+	Con_Printf ("negcache: %i hits, %i names%s\n",
+		SDL_AtomicGet (&fs_stats.neghits), negnames, fs_negcache.value ? "" : " (disabled)");
+	Con_Printf ("mmap    : %i files%s\n", SDL_AtomicGet (&fs_stats.mapped), com_nommap ? " (disabled)" : "");
+	Con_Printf ("pk3     : %i inflated, %i cache hits, %i KB cached\n",
+		SDL_AtomicGet (&fs_stats.inflated), SDL_AtomicGet (&fs_stats.zipcachehits), (int) (fs_zipcache_size >> 10));
+}
+
 /*
 ============
 COM_WriteFile
@@ -1726,6 +1918,7 @@ void COM_WriteFile (const char *filename, const void *data, int len)
 	Sys_Printf ("COM_WriteFile: %s\n", name);
 	Sys_FileWrite (handle, data, len);
 	Sys_FileClose (handle);
+	COM_FlushFileCaches ();
 }
 
 /*
@@ -1736,7 +1929,7 @@ COM_WriteFile_OSPath
 qboolean COM_WriteFile_OSPath (const char *filename, const void *data, size_t len)
 {
 	qboolean	ret = false;
-	FILE		*f = Sys_fopen (filename, "wb");
+	FILE		*f = COM_CreateFile (filename, "wb");
 
 	if (f)
 	{
@@ -1749,6 +1942,25 @@ qboolean COM_WriteFile_OSPath (const char *filename, const void *data, size_t le
 	return ret;
 }
 
+/*
+============
+COM_CreateFile
+
+Opens a file for writing, given its full path. Goes through here rather than
+Sys_fopen so that the file caches are flushed: an earlier lookup may have
+cached the name as missing, or listed the directory before the file existed.
+============
+*/
+FILE *COM_CreateFile (const char *path, const char *mode)
+{
+	FILE *f = Sys_fopen (path, mode);
+
+	if (f)
+		COM_FlushFileCaches ();
+
+	return f;
+}
+
 /*
 ============
 COM_TempSuffix
@@ -1860,6 +2072,526 @@ qfileofs_t COM_filelength (FILE *f)
 	return end;
 }
 
+/*
+============
+COM_ScanDirectory
+
+Lists the files (but not the subdirectories) of an OS directory.
+A missing directory yields an empty listing.
+============
+*/
+static fsdirlist_t *COM_ScanDirectory (const char *path, unsigned hash)
+{
+	findfile_t	*find;
+	fsdirlist_t	*list;
+	int			i;
+
+	list = (fsdirlist_t *) calloc (1, sizeof (*list));
+	if (!list)
+		Sys_Error ("COM_ScanDirectory: out of memory");
+	q_strlcpy (list->path, path, sizeof (list->path));
+	list->hash = hash;
+
+	for (find = Sys_FindFirst (path, NULL); find; find = Sys_FindNext (find))
+	{
+		if (find->attribs & FA_DIRECTORY)
+			continue;
+		VEC_PUSH (list->offsets, (int) VEC_SIZE (list->names));
+		MultiString_Append (&list->names, find->name);
+	}
+	list->numfiles = (int) VEC_SIZE (list->offsets);
+
+	list->hashsize = COM_HashTableSize (list->numfiles);
+	list->hashtable = (int *) calloc (list->hashsize, sizeof (*list->hashtable));
+	if (!list->hashtable)
+		Sys_Error ("COM_ScanDirectory: out of memory");
+	for (i = 0; i < list->numfiles; i++)
+		COM_HashTableInsert (list->hashtable, list->hashsize, COM_HashFileName (list->names + list->offsets[i]), i + 1);
+
+	SDL_AtomicIncRef (&fs_stats.dirscans);
+
+	return list;
+}
+
+/*
+============
+COM_DirCacheCheck
+
+Looks up a file in the cached listing of a loose directory.
+Returns FS_ENT_FILE if the listing contains the file, FS_ENT_NONE
+if it doesn't, or -1 if the cache can't answer for this path.
+============
+*/
+static int COM_DirCacheCheck (const char *dir, const char *filename)
+{
+	char		path[MAX_OSPATH];
+	const char	*base;
+	unsigned	hash, mask, pos;
+	fsdirlist_t	*list;
+	int			idx, result;
+
+	if (!fs_dircache.value || !fs_cache_mutex)
+		return -1;
+	if (strchr (filename, '\\') || strstr (filename, "./") || strstr (filename, "//"))
+		return -1;
+
+	base = strrchr (filename, '/');
+	if (base)
+	{
+		if ((size_t) q_snprintf (path, sizeof (path), "%s/%.*s", dir, (int) (base - filename), filename) >= sizeof (path))
+			return -1;
+		base++;
+	}
+	else
+	{
+		if (q_strlcpy (path, dir, sizeof (path)) >= sizeof (path))
+			return -1;
+		base = filename;
+	}
+	if (!*base)
+		return -1;
+
+	hash = COM_HashFileName (path);
+
+	SDL_LockMutex (fs_cache_mutex);
+
+	for (list = fs_dircache_buckets[hash % DIRCACHE_BUCKETS]; list; list = list->next)
+		if (list->hash == hash && !COM_FileNameCompare (list->path, path))
+			break;
+
+	if (!list)
+	{
+		list = COM_ScanDirectory (path, hash);
+		list->next = fs_dircache_buckets[hash % DIRCACHE_BUCKETS];
+		fs_dircache_buckets[hash % DIRCACHE_BUCKETS] = list;
+	}
+
+	result = FS_ENT_NONE;
+	hash = COM_HashFileName (base);
+	mask = list->hashsize - 1;
+	for (pos = hash & mask; (idx = list->hashtable[pos]) != 0; pos = (pos + 1) & mask)
+	{
+		if (!COM_FileNameCompare (list->names + list->offsets[idx - 1], base))
+		{
+			result = FS_ENT_FILE;
+			break;
+		}
+	}
+
+	SDL_UnlockMutex (fs_cache_mutex);
+
+	SDL_AtomicIncRef (result == FS_ENT_FILE ? &fs_stats.dircachehits : &fs_stats.dircachemisses);
+
+	return result;
+}
+
+/*
+============
+COM_FlushDirCache
+
+Forgets all cached directory listings, e.g. because files
+may have been added or removed behind our back
+============
+*/
+void COM_FlushDirCache (void)
+{
+	int			i;
+	fsdirlist_t	*list;
+
+	if (!fs_cache_mutex)
+		return;
+
+	SDL_LockMutex (fs_cache_mutex);
+	for (i = 0; i < DIRCACHE_BUCKETS; i++)
+	{
+		while (fs_dircache_buckets[i])
+		{
+			list = fs_dircache_buckets[i];
+			fs_dircache_buckets[i] = list->next;
+			VEC_FREE (list->offsets);
+			VEC_FREE (list->names);
+			free (list->hashtable);
+			free (list);
+		}
+	}
+	SDL_UnlockMutex (fs_cache_mutex);
+}
+
+static void COM_DirCache_f (cvar_t *var)
+{
+	COM_FlushDirCache ();
+}
+
+/*
+============
+COM_FlushNegativeCache
+
+Forgets all file names previously recorded as missing
+============
+*/
+static void COM_FlushNegativeCache (void)
+{
+	int				i;
+	fsnegentry_t	*entry;
+
+	if (!fs_cache_mutex)
+		return;
+
+	SDL_LockMutex (fs_cache_mutex);
+	for (i = 0; i < NEGCACHE_BUCKETS; i++)
+	{
+		while (fs_negcache_buckets[i])
+		{
+			entry = fs_negcache_buckets[i];
+			fs_negcache_buckets[i] = entry->next;
+			free (entry);
+		}
+	}
+	fs_negcache_count = 0;
+	SDL_UnlockMutex (fs_cache_mutex);
+}
+
+static void COM_NegCache_f (cvar_t *var)
+{
+	COM_FlushNegativeCache ();
+}
+
+/*
+============
+COM_FlushFileCaches
+
+Called when the contents of the searchpaths may have changed
+============
+*/
+void COM_FlushFileCaches (void)
+{
+	COM_FlushDirCache ();
+	COM_FlushNegativeCache ();
+}
+
+/*
+============
+COM_IsKnownMissing
+
+Returns true if a previous lookup for this name failed
+============
+*/
+static qboolean COM_IsKnownMissing (const char *filename, unsigned hash)
+{
+	fsnegentry_t	*entry;
+
+	if (!fs_negcache.value || !fs_cache_mutex)
+		return false;
+
+	SDL_LockMutex (fs_cache_mutex);
+	for (entry = fs_negcache_buckets[hash % NEGCACHE_BUCKETS]; entry; entry = entry->next)
+		if (entry->hash == hash && !strcmp (entry->name, filename))
+			break;
+	SDL_UnlockMutex (fs_cache_mutex);
+
+	return entry != NULL;
+}
+
+/*
+============
+COM_AddKnownMissing
+
+Records a name that wasn't found in any searchpath
+============
+*/
+static void COM_AddKnownMissing (const char *filename, unsigned hash)
+{
+	fsnegentry_t	*entry;
+	size_t			len;
+
+	if (!fs_negcache.value || !fs_cache_mutex)
+		return;
+
+	len = strlen (filename);
+	entry = (fsnegentry_t *) malloc (sizeof (*entry) + len);
+	if (!entry)
+		return;
+	entry->hash = hash;
+	memcpy (entry->name, filename, len + 1);
+
+	SDL_LockMutex (fs_cache_mutex);
+	// keep memory use bounded if something keeps probing unique names
+	// (the mutex is recursive, so flushing with it held is fine)
+	if (fs_negcache_count >= NEGCACHE_MAXENTRIES)
+		COM_FlushNegativeCache ();
+	entry->next = fs_negcache_buckets[hash % NEGCACHE_BUCKETS];
+	fs_negcache_buckets[hash % NEGCACHE_BUCKETS] = entry;
+	fs_negcache_count++;
+	SDL_UnlockMutex (fs_cache_mutex);
+}
+
+/*
+===========
+COM_FindPackFile
+
+Returns the index of the first pak entry with the given name, or -1
+===========
+*/
+static int COM_FindPackFile (const pack_t *pak, const char *filename, unsigned hash)
+{
+	unsigned	mask = pak->hashsize - 1;
+	unsigned	pos;
+	int			idx;
+
+	SDL_AtomicIncRef (&fs_stats.pakprobes);
+
+	for (pos = hash & mask; (idx = pak->hashtable[pos]) != 0; pos = (pos + 1) & mask)
+	{
+		SDL_AtomicIncRef (&fs_stats.pakcompares);
+		if (!strcmp (pak->files[idx - 1].name, filename))
+			return idx - 1;
+	}
+
+	return -1;
+}
+
+/*
+===========
+COM_FlushZipCache
+
+Drops all cached decompressed pk3 entries
+===========
+*/
+static void COM_FlushZipCache (void)
+{
+	zipcache_t *item;
+
+	if (!fs_zip_mutex)
+		return;
+
+	SDL_LockMutex (fs_zip_mutex);
+	while (fs_zipcache_head)
+	{
+		item = fs_zipcache_head;
+		fs_zipcache_head = item->next;
+		free (item->data);
+		free (item);
+	}
+	fs_zipcache_size = 0;
+	SDL_UnlockMutex (fs_zip_mutex);
+}
+
+static void COM_ZipCache_f (cvar_t *var)
+{
+	COM_FlushZipCache ();
+}
+
+/*
+===========
+COM_ResolvePackFile
+
+Reads the local header of a pk3 entry to find where its data starts
+===========
+*/
+static qboolean COM_ResolvePackFile (pack_t *pak, packfile_t *entry)
+{
+	byte		header[30];
+	qboolean	ok = false;
+
+	// headerpos and filepos are only touched with the lock held,
+	// which also orders the caller's reads of filepos after ours
+	SDL_LockMutex (fs_zip_mutex);
+	if (entry->headerpos < 0)
+		ok = true;	// already resolved
+	else
+	{
+		Sys_FileSeek (pak->handle, entry->headerpos);
+		if (Sys_FileRead (pak->handle, header, sizeof (header)) == (int) sizeof (header) &&
+			header[0] == 'P' && header[1] == 'K' && header[2] == 3 && header[3] == 4)
+		{
+			entry->filepos = entry->headerpos + (int) sizeof (header) +
+				(header[26] | (header[27] << 8)) +	// file name length
+				(header[28] | (header[29] << 8));	// extra field length
+			entry->headerpos = -1;
+			ok = true;
+		}
+		else
+			Con_Printf ("Bad local header for %s in %s\n", entry->name, pak->filename);
+	}
+	SDL_UnlockMutex (fs_zip_mutex);
+
+	return ok;
+}
+
+/*
+===========
+COM_InflatePackFile
+
+Decompresses a deflated pk3 entry into dest (entry->filelen bytes)
+===========
+*/
+static qboolean COM_InflatePackFile (pack_t *pak, const packfile_t *entry, byte *dest)
+{
+	tinfl_decompressor	*inflator;
+	tinfl_status		status;
+	zipcache_t			*item;
+	byte				*src, *buf = NULL;
+	void				*base = NULL;
+	size_t				basesize = 0, insize, outsize;
+
+	// check the cache first
+	SDL_LockMutex (fs_zip_mutex);
+	for (item = fs_zipcache_head; item; item = item->next)
+	{
+		if (item->pack == pak && item->entry == entry)
+		{
+			memcpy (dest, item->data, entry->filelen);
+			if (item != fs_zipcache_head)
+			{	// move to front
+				item->prev->next = item->next;
+				if (item->next)
+					item->next->prev = item->prev;
+				item->prev = NULL;
+				item->next = fs_zipcache_head;
+				fs_zipcache_head->prev = item;
+				fs_zipcache_head = item;
+			}
+			SDL_UnlockMutex (fs_zip_mutex);
+			SDL_AtomicIncRef (&fs_stats.zipcachehits);
+			return true;
+		}
+	}
+	SDL_UnlockMutex (fs_zip_mutex);
+
+	// read the compressed data, preferably without touching the shared file position
+	src = com_nommap ? NULL : (byte *) Sys_MapFile (pak->handle, entry->filepos, entry->complen, &base, &basesize);
+	if (!src)
+	{
+		buf = (byte *) malloc (entry->complen);
+		if (!buf)
+			return false;
+		SDL_LockMutex (fs_zip_mutex);
+		Sys_FileSeek (pak->handle, entry->filepos);
+		insize = Sys_FileRead (pak->handle, buf, entry->complen);
+		SDL_UnlockMutex (fs_zip_mutex);
+		if (insize != (size_t) entry->complen)
+		{
+			free (buf);
+			return false;
+		}
+		src = buf;
+	}
+
+	inflator = (tinfl_decompressor *) malloc (sizeof (*inflator));
+	if (!inflator)
+		Sys_Error ("COM_InflatePackFile: out of memory");
+	tinfl_init (inflator);
+	insize = entry->complen;
+	outsize = entry->filelen;
+	status = tinfl_decompress (inflator, src, &insize, dest, dest, &outsize, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+	free (inflator);
+
+	if (buf)
+		free (buf);
+	else
+		Sys_UnmapFile (base, basesize);
+
+	if (status != TINFL_STATUS_DONE || outsize != (size_t) entry->filelen)
+	{
+		Con_Printf ("Error decompressing %s from %s\n", entry->name, pak->filename);
+		return false;
+	}
+
+	SDL_AtomicIncRef (&fs_stats.inflated);
+
+	// keep a copy around if it fits
+	if ((size_t) entry->filelen <= (size_t) (fs_zipcache.value * 1024 * 1024))
+	{
+		item = (zipcache_t *) calloc (1, sizeof (*item));
+		if (item)
+			item->data = (byte *) malloc (entry->filelen);
+		if (item && item->data)
+		{
+			memcpy (item->data, dest, entry->filelen);
+			item->pack = pak;
+			item->entry = entry;
+
+			SDL_LockMutex (fs_zip_mutex);
+			item->next = fs_zipcache_head;
+			if (fs_zipcache_head)
+				fs_zipcache_head->prev = item;
+			fs_zipcache_head = item;
+			fs_zipcache_size += entry->filelen;
+
+			// evict least recently used entries
+			while (fs_zipcache_size > (size_t) (fs_zipcache.value * 1024 * 1024) && fs_zipcache_head->next)
+			{
+				zipcache_t *last = fs_zipcache_head;
+				while (last->next)
+					last = last->next;
+				last->prev->next = NULL;
+				fs_zipcache_size -= last->entry->filelen;
+				free (last->data);
+				free (last);
+			}
+			SDL_UnlockMutex (fs_zip_mutex);
+		}
+		else if (item)
+			free (item);
+	}
+
+	return true;
+}
+
+/*
+===========
+COM_ExtractPackFile
+
+Decompresses a deflated pk3 entry into a temporary file
+and returns either a Sys_ handle or a FILE pointer to it
+===========
+*/
+static qboolean COM_ExtractPackFile (pack_t *pak, const packfile_t *entry, int *handle, FILE **file)
+{
+	byte		*data;
+	qboolean	ok = false;
+
+	data = (byte *) malloc (entry->filelen ? entry->filelen : 1);
+	if (!data)
+		return false;
+
+	if (COM_InflatePackFile (pak, entry, data))
+	{
+		if (handle)
+		{
+			*handle = Sys_FileOpenTemp ();
+			if (*handle != -1)
+			{
+				ok = Sys_FileWrite (*handle, data, entry->filelen) == entry->filelen;
+				Sys_FileSeek (*handle, 0);
+				if (!ok)
+				{
+					Sys_FileClose (*handle);
+					*handle = -1;
+				}
+			}
+		}
+		else if (file)
+		{
+			*file = Sys_tmpfile ();
+			if (*file)
+			{
+				ok = fwrite (data, 1, entry->filelen, *file) == (size_t) entry->filelen;
+				rewind (*file);
+				if (!ok)
+				{
+					fclose (*file);
+					*file = NULL;
+				}
+			}
+		}
+	}
+
+	free (data);
+
+	return ok;
+}
+
 /*
 ===========
 COM_FindFile
@@ -1868,20 +2600,35 @@ Finds the file in the search path.
 Sets com_filesize and one of handle or file
 If neither of file or handle is set, this
 can be used for detecting a file's presence.
+Compressed pk3 entries are extracted to a temporary
+file, unless allowcompressed is set: then nothing is
+opened and the caller must use COM_InflatePackFile.
 ===========
 */
 static int COM_FindFile (const char *filename, int *handle, FILE **file,
-							unsigned int *path_id)
+							unsigned int *path_id, qboolean allowcompressed)
 {
 	searchpath_t	*search;
 	char		netpath[MAX_OSPATH];
 	pack_t		*pak;
+	unsigned	hash;
 	int			i;
 
 	if (file && handle)
 		Sys_Error ("COM_FindFile: both handle and file set");
 
 	file_from_pak = 0;
+	com_filepack = NULL;
+	com_filepackentry = NULL;
+	hash = COM_HashString (filename);
+
+	SDL_AtomicIncRef (&fs_stats.lookups);
+
+	if (COM_IsKnownMissing (filename, hash))
+	{
+		SDL_AtomicIncRef (&fs_stats.neghits);
+		goto notfound;
+	}
 
 //
 // search through the path, one element at a time
@@ -1891,32 +2638,48 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 		if (search->pack)	/* look through all the pak file elements */
 		{
 			pak = search->pack;
-			for (i = 0; i < pak->numfiles; i++)
+			i = COM_FindPackFile (pak, filename, hash);
+			if (i < 0 || !COM_ResolvePackFile (pak, &pak->files[i]))
+				continue;
+
+			// found it!
+			com_filesize = pak->files[i].filelen;
+			com_fileoffset = pak->files[i].filepos;
+			com_filepack = pak;
+			com_filepackentry = &pak->files[i];
+			file_from_pak = 1;
+			if (path_id)
+				*path_id = search->path_id;
+			if (pak->files[i].complen && (handle || file))
 			{
-				if (strcmp(pak->files[i].name, filename) != 0)
-					continue;
-				// found it!
-				com_filesize = pak->files[i].filelen;
-				file_from_pak = 1;
-				if (path_id)
-					*path_id = search->path_id;
-				if (handle)
+				if (allowcompressed)
 				{
-					*handle = pak->handle;
-					Sys_FileSeek (pak->handle, pak->files[i].filepos);
-					return com_filesize;
+					if (handle)
+						*handle = -1;
 				}
-				else if (file)
-				{ /* open a new file on the pakfile */
-					*file = Sys_fopen (pak->filename, "rb");
-					if (*file)
-						fseek (*file, pak->files[i].filepos, SEEK_SET);
-					return com_filesize;
-				}
-				else /* for COM_FileExists() */
+				else if (!COM_ExtractPackFile (pak, &pak->files[i], handle, file))
 				{
-					return com_filesize;
+					com_filesize = -1;
+					file_from_pak = 0;
 				}
+				return com_filesize;
+			}
+			if (handle)
+			{
+				*handle = pak->handle;
+				Sys_FileSeek (pak->handle, pak->files[i].filepos);
+				return com_filesize;
+			}
+			else if (file)
+			{ /* open a new file on the pakfile */
+				*file = Sys_fopen (pak->filename, "rb");
+				if (*file)
+					fseek (*file, pak->files[i].filepos, SEEK_SET);
+				return com_filesize;
+			}
+			else /* for COM_FileExists() */
+			{
+				return com_filesize;
 			}
 		}
 		else	/* check a file in the directory tree */
@@ -1927,12 +2690,17 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 					continue;
 			}
 
+			if (COM_DirCacheCheck (search->filename, filename) == FS_ENT_NONE)
+				continue;
+
 			q_snprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
+			SDL_AtomicIncRef (&fs_stats.stats);
 			if (! (Sys_FileType(netpath) & FS_ENT_FILE))
 				continue;
 
 			if (path_id)
 				*path_id = search->path_id;
+			com_fileoffset = 0;
 			if (handle)
 			{
 				com_filesize = Sys_FileOpenRead (netpath, &i);
@@ -1952,6 +2720,11 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 		}
 	}
 
+	COM_AddKnownMissing (filename, hash);
+
+notfound:
+	SDL_AtomicIncRef (&fs_stats.misses);
+
 	if (developer.value)
 	{
 		const char *ext = COM_FileGetExtension (filename);
@@ -1984,7 +2757,7 @@ Returns whether the file is found in the quake filesystem.
 */
 qboolean COM_FileExists (const char *filename, unsigned int *path_id)
 {
-	int ret = COM_FindFile (filename, NULL, NULL, path_id);
+	int ret = COM_FindFile (filename, NULL, NULL, path_id, false);
 	return (ret == -1) ? false : true;
 }
 
@@ -1999,7 +2772,7 @@ it may actually be inside a pak file
 */
 int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id)
 {
-	return COM_FindFile (filename, handle, NULL, path_id);
+	return COM_FindFile (filename, handle, NULL, path_id, false);
 }
 
 /*
@@ -2012,7 +2785,7 @@ into the file.
 */
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id)
 {
-	return COM_FindFile (filename, NULL, file, path_id);
+	return COM_FindFile (filename, NULL, file, path_id, false);
 }
 
 /*
@@ -2055,8 +2828,8 @@ byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 	buf = NULL;	// quiet compiler warning
 
 // look for it in the filesystem or pack files
-	len = COM_OpenFile (path, &h, path_id);
-	if (h == -1)
+	len = COM_FindFile (path, &h, NULL, path_id, true);
+	if (len == -1)
 		return NULL;
 
 // extract the filename base name for hunk tag
@@ -2079,7 +2852,23 @@ byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 
 	((byte *)buf)[len] = 0;
 
-	nread = Sys_FileRead (h, buf, len);
+	if (h == -1) // compressed pk3 entry
+	{
+		if (!COM_InflatePackFile (com_filepack, com_filepackentry, buf))
+			Sys_Error ("COM_LoadFile: Error decompressing %s", path);
+		return buf;
+	}
+
+	if (com_filepack)
+	{
+	// the pak handle is shared with other threads, seek again with the lock held
+		SDL_LockMutex (fs_zip_mutex);
+		Sys_FileSeek (h, com_fileoffset);
+		nread = Sys_FileRead (h, buf, len);
+		SDL_UnlockMutex (fs_zip_mutex);
+	}
+	else
+		nread = Sys_FileRead (h, buf, len);
 	COM_CloseFile (h);
 	if (nread != len)
 		Sys_Error ("COM_LoadFile: Error reading %s", path);
@@ -2098,6 +2887,96 @@ byte *COM_LoadMallocFile (const char *path, unsigned int *path_id)
 	return COM_LoadFile (path, LOADFILE_MALLOC, path_id);
 }
 
+/*
+============
+COM_MapFile
+
+Like COM_LoadMallocFile, but maps the file straight out of its pak
+(or loose file) instead of copying it, falling back to a regular load
+if that's not possible. The view is private, so in-place edits are
+allowed and never reach the disk. Unlike COM_LoadMallocFile, the data
+is NOT '\0'-terminated. Release it with COM_UnmapFile.
+============
+*/
+byte *COM_MapFile (const char *path, unsigned int *path_id)
+{
+	int			h;
+	int			len;
+	byte		*data;
+	void		*base;
+	size_t		basesize;
+	filemap_t	*map;
+
+	if (com_nommap || !com_filemap_mutex)
+		return COM_LoadMallocFile (path, path_id);
+
+	len = COM_FindFile (path, &h, NULL, path_id, true);
+	if (len == -1)
+		return NULL;
+	if (h == -1) // compressed pk3 entry, nothing to map
+		return COM_LoadMallocFile (path, path_id);
+
+	data = (byte *) Sys_MapFile (h, com_fileoffset, len, &base, &basesize);
+	COM_CloseFile (h);
+	if (!data)
+		return COM_LoadMallocFile (path, path_id);
+
+	map = (filemap_t *) malloc (sizeof (*map));
+	if (!map)
+		Sys_Error ("COM_MapFile: out of memory");
+	map->data = data;
+	map->base = base;
+	map->basesize = basesize;
+
+	SDL_LockMutex (com_filemap_mutex);
+	map->next = com_filemaps;
+	com_filemaps = map;
+	SDL_UnlockMutex (com_filemap_mutex);
+
+	SDL_AtomicIncRef (&fs_stats.mapped);
+	com_filesize = len;
+
+	return data;
+}
+
+/*
+============
+COM_UnmapFile
+
+Releases data returned by COM_MapFile
+============
+*/
+void COM_UnmapFile (byte *data)
+{
+	filemap_t	**link, *map = NULL;
+
+	if (!data)
+		return;
+
+	if (com_filemap_mutex)
+	{
+		SDL_LockMutex (com_filemap_mutex);
+		for (link = &com_filemaps; *link; link = &(*link)->next)
+		{
+			if ((*link)->data == data)
+			{
+				map = *link;
+				*link = map->next;
+				break;
+			}
+		}
+		SDL_UnlockMutex (com_filemap_mutex);
+	}
+
+	if (map)
+	{
+		Sys_UnmapFile (map->base, map->basesize);
+		free (map);
+	}
+	else // COM_MapFile fell back to COM_LoadMallocFile
+		free (data);
+}
+
 byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
 {
 	FILE	*f;
@@ -2206,6 +3085,25 @@ const char *COM_ParseStringNewline(const char *buffer)
 	return buffer + i;
 }
 
+/*
+=================
+COM_HashPack
+
+Builds the hash table used by COM_FindPackFile
+=================
+*/
+static void COM_HashPack (pack_t *pack)
+{
+	int i;
+
+	pack->hashsize = COM_HashTableSize (pack->numfiles);
+	pack->hashtable = (int *) calloc (pack->hashsize, sizeof (*pack->hashtable));
+	if (!pack->hashtable)
+		Sys_Error ("COM_HashPack: out of memory");
+	for (i = 0; i < pack->numfiles; i++)
+		COM_HashTableInsert (pack->hashtable, pack->hashsize, COM_HashString (pack->files[i].name), i + 1);
+}
+
 /*
 =================
 COM_LoadPackFile -- johnfitz -- modified based on topaz's tutorial
@@ -2255,7 +3153,9 @@ static pack_t *COM_LoadPackFile (const char *packfile)
 	if (numpackfiles != PAK0_COUNT)
 		com_modified = true;	// not the original file
 
-	newfiles = (packfile_t *) Z_Malloc(numpackfiles * sizeof(packfile_t));
+	newfiles = (packfile_t *) calloc (numpackfiles, sizeof(packfile_t));
+	if (!newfiles)
+		Sys_Error ("COM_LoadPackFile: out of memory");
 
 	Sys_FileSeek (packhandle, header.dirofs);
 	if (Sys_FileRead(packhandle, info, header.dirlen) != header.dirlen)
@@ -2275,6 +3175,7 @@ static pack_t *COM_LoadPackFile (const char *packfile)
 		q_strlcpy (newfiles[i].name, info[i].name, sizeof(newfiles[i].name));
 		newfiles[i].filepos = LittleLong(info[i].filepos);
 		newfiles[i].filelen = LittleLong(info[i].filelen);
+		newfiles[i].headerpos = -1;
 	}
 
 	pack = (pack_t *) Z_Malloc (sizeof (pack_t));
@@ -2282,11 +3183,167 @@ static pack_t *COM_LoadPackFile (const char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	COM_HashPack (pack);
 
 	//Sys_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
 }
 
+static size_t COM_ZipRead (void *opaque, mz_uint64 ofs, void *buf, size_t n)
+{
+	int handle = *(const int *) opaque;
+	Sys_FileSeek (handle, (int) ofs);
+	return Sys_FileRead (handle, buf, (int) n);
+}
+
+/*
+=================
+COM_LoadPK3File
+
+Takes an explicit (not game tree related) path to a pk3 (zip) file.
+
+Only the central directory is read here, local headers are
+looked up on first access. Stored entries are read just like
+pak entries, deflated ones are decompressed on demand.
+=================
+*/
+static pack_t *COM_LoadPK3File (const char *packfile)
+{
+	mz_zip_archive				archive;
+	mz_zip_archive_file_stat	stat;
+	packfile_t					*newfiles;
+	pack_t						*pack;
+	qfileofs_t					packsize;
+	int							packhandle;
+	int							i, numentries, numpackfiles;
+
+	packsize = Sys_FileOpenRead (packfile, &packhandle);
+	if (packsize <= 0)
+	{
+		if (packhandle != -1)
+			Sys_FileClose (packhandle);
+		return NULL;
+	}
+	if (packsize > INT_MAX)
+	{
+		Sys_Printf ("WARNING: %s is too large, ignored\n", packfile);
+		Sys_FileClose (packhandle);
+		return NULL;
+	}
+
+	memset (&archive, 0, sizeof (archive));
+	archive.m_pRead = COM_ZipRead;
+	archive.m_pIO_opaque = &packhandle;
+	if (!mz_zip_reader_init (&archive, packsize, MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY))
+	{
+		Sys_Printf ("WARNING: %s is not a valid pk3 file, ignored\n", packfile);
+		Sys_FileClose (packhandle);
+		return NULL;
+	}
+
+	numentries = (int) archive.m_total_files;
+	newfiles = (packfile_t *) calloc (q_max (numentries, 1), sizeof (packfile_t));
+	if (!newfiles)
+		Sys_Error ("COM_LoadPK3File: out of memory");
+
+	for (i = 0, numpackfiles = 0; i < numentries; i++)
+	{
+		packfile_t *file = &newfiles[numpackfiles];
+
+		if (!mz_zip_reader_file_stat (&archive, i, &stat) || stat.m_is_directory)
+			continue;
+		if (!stat.m_is_supported || (stat.m_method != 0 && stat.m_method != MZ_DEFLATED) ||
+			stat.m_comp_size > INT_MAX || stat.m_uncomp_size > INT_MAX || stat.m_local_header_ofs > INT_MAX)
+		{
+			Con_DPrintf ("%s: skipping unsupported entry %s\n", packfile, stat.m_filename);
+			continue;
+		}
+		if (q_strlcpy (file->name, stat.m_filename, sizeof (file->name)) >= sizeof (file->name))
+		{
+			Con_DPrintf ("%s: skipping entry with long name %s\n", packfile, stat.m_filename);
+			continue;
+		}
+
+		file->filelen = (int) stat.m_uncomp_size;
+		file->complen = stat.m_method == MZ_DEFLATED ? (int) stat.m_comp_size : 0;
+		file->headerpos = (int) stat.m_local_header_ofs;
+		file->filepos = -1;
+		numpackfiles++;
+	}
+
+	mz_zip_reader_end (&archive);
+
+	if (!numpackfiles)
+	{
+		Sys_Printf ("WARNING: %s has no files, ignored\n", packfile);
+		free (newfiles);
+		Sys_FileClose (packhandle);
+		return NULL;
+	}
+
+	com_modified = true;	// not the original file
+
+	pack = (pack_t *) Z_Malloc (sizeof (pack_t));
+	q_strlcpy (pack->filename, packfile, sizeof(pack->filename));
+	pack->handle = packhandle;
+	pack->numfiles = numpackfiles;
+	pack->files = newfiles;
+	COM_HashPack (pack);
+
+	return pack;
+}
+
+static int COM_SortStrings (const void *a, const void *b)
+{
+	return strcmp (*(const char **) a, *(const char **) b);
+}
+
+/*
+=================
+COM_AddPK3Files
+
+Adds all pk3 files in a directory to the search path.
+They are mounted in alphabetical order, so later ones take priority.
+=================
+*/
+static void COM_AddPK3Files (const char *dir, unsigned int path_id)
+{
+	findfile_t		*find;
+	char			**names = NULL;
+	char			pakfile[MAX_OSPATH];
+	searchpath_t	*search;
+	pack_t			*pak;
+	size_t			i;
+
+	for (find = Sys_FindFirst (dir, "pk3"); find; find = Sys_FindNext (find))
+	{
+		if (!(find->attribs & FA_DIRECTORY))
+			VEC_PUSH (names, strdup (find->name));
+	}
+
+	if (!names)
+		return;
+
+	qsort (names, VEC_SIZE (names), sizeof (names[0]), COM_SortStrings);
+
+	for (i = 0; i < VEC_SIZE (names); i++)
+	{
+		q_snprintf (pakfile, sizeof (pakfile), "%s/%s", dir, names[i]);
+		pak = COM_LoadPK3File (pakfile);
+		free (names[i]);
+		if (!pak)
+			continue;
+
+		search = (searchpath_t *) Z_Malloc(sizeof(searchpath_t));
+		search->path_id = path_id;
+		search->pack = pak;
+		search->next = com_searchpaths;
+		com_searchpaths = search;
+	}
+
+	VEC_FREE (names);
+}
+
 const char *COM_GetGameNames(qboolean full)
 {
 	if (full)
@@ -2379,6 +3436,9 @@ void COM_AddGameDirectory (const char *dir)
 		quake64 = true;
 	}
 
+	// names that were missing so far may live in the new directory
+	COM_FlushNegativeCache ();
+
 	// assign a path_id to this game directory
 	if (com_searchpaths)
 		path_id = com_searchpaths->path_id << 1;
@@ -2415,6 +3475,9 @@ void COM_AddGameDirectory (const char *dir)
 			if (i == 0 && j == 0 && path_id == 1u && !fitzmode)
 				COM_AddEnginePak ();
 		}
+
+		// add any pk3 files, which take priority over the pak files
+		COM_AddPK3Files (com_gamedir, path_id);
 	}
 }
 
@@ -2422,13 +3485,16 @@ void COM_ResetGameDirectories(const char *newgamedirs)
 {
 	const char *newpath, *path;
 	searchpath_t *search;
+	// cached pk3 data refers to the paks we're about to free
+	COM_FlushZipCache ();
 	//Kill the extra game if it is loaded
 	while (com_searchpaths != com_base_searchpaths)
 	{
 		if (com_searchpaths->pack)
 		{
 			Sys_FileClose (com_searchpaths->pack->handle);
-			Z_Free (com_searchpaths->pack->files);
+			free (com_searchpaths->pack->hashtable);
+			free (com_searchpaths->pack->files);
 			Z_Free (com_searchpaths->pack);
 		}
 		search = com_searchpaths->next;
@@ -2439,6 +3505,7 @@ void COM_ResetGameDirectories(const char *newgamedirs)
 	rogue = false;
 	quake64 = false;
 	standard_quake = true;
+	COM_FlushFileCaches ();
 	//wipe the list of mod gamedirs
 	*com_gamenames = 0;
 	//reset this too
@@ -3222,7 +4289,19 @@ void COM_InitFilesystem (void) //johnfitz -- modified based on topaz's tutorial
 
 	Cvar_RegisterVariable (&registered);
 	Cvar_RegisterVariable (&cmdline);
+	Cvar_RegisterVariable (&fs_dircache);
+	Cvar_SetCallback (&fs_dircache, COM_DirCache_f);
+	Cvar_RegisterVariable (&fs_negcache);
+	Cvar_SetCallback (&fs_negcache, COM_NegCache_f);
+	Cvar_RegisterVariable (&fs_zipcache);
+	Cvar_SetCallback (&fs_zipcache, COM_ZipCache_f);
 	Cmd_AddCommand ("path", COM_Path_f);
+	Cmd_AddCommand ("fs_stats", COM_FSStats_f);
+
+	fs_cache_mutex = SDL_CreateMutex ();
+	com_filemap_mutex = SDL_CreateMutex ();
+	fs_zip_mutex = SDL_CreateMutex ();
+	com_nommap = COM_CheckParm ("-nommap") != 0;
 	Cmd_AddCommand ("game", COM_Game_f); //johnfitz
 
 	startarg = (com_argc == 2 && Sys_FileType (com_argv[1]) != FS_ENT_NONE) ? com_argv[1] : NULL;
@@ -375,6 +375,8 @@ typedef struct
 {
 	char	name[MAX_QPATH];
 	int		filepos, filelen;
+	int		complen;	// pk3: size of the deflated data, 0 if stored uncompressed
+	int		headerpos;	// pk3: offset of the local header until filepos is known, else -1
 } packfile_t;
 
 typedef struct pack_s
@@ -383,6 +385,8 @@ typedef struct pack_s
 	int		handle;
 	int		numfiles;
 	packfile_t	*files;
+	unsigned	hashsize;	// power of two
+	int		*hashtable;	// 1-based indices into files, 0 = empty slot
 } pack_t;
 
 typedef struct searchpath_s
@@ -411,10 +415,13 @@ extern	THREAD_LOCAL int	file_from_pak;	// global indicating that file came from
 
 void COM_WriteFile (const char *filename, const void *data, int len);
 qboolean COM_WriteFile_OSPath (const char *filename, const void *data, size_t len);
+FILE *COM_CreateFile (const char *path, const char *mode); // flushes the file caches
 int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id);
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id);
 qboolean COM_FileExists (const char *filename, unsigned int *path_id);
 void COM_CloseFile (int h);
+void COM_FlushDirCache (void);
+void COM_FlushFileCaches (void);
 
 // these procedures open a file using COM_FindFile and loads it into a proper
 // buffer. the buffer is allocated with a total size of com_filesize + 1. the
@@ -424,6 +431,12 @@ byte *COM_LoadHunkFile (const char *path, unsigned int *path_id);
 byte *COM_LoadMallocFile (const char *path, unsigned int *path_id);
 	// allocates the buffer on the system mem (malloc).
 
+// maps the file into memory instead of copying it when possible.
+// the buffer is private but NOT '\0'-terminated, and must be
+// released with COM_UnmapFile.
+byte *COM_MapFile (const char *path, unsigned int *path_id);
+void COM_UnmapFile (byte *data);
+
 // Opens the given path directly, ignoring search paths.
 // Returns NULL on failure, or else a '\0'-terminated malloc'ed buffer.
 // Loads in "t" mode so CRLF to LF translation is performed on Windows.
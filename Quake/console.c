@@ -851,7 +851,7 @@ static void Con_Dump_f (void)
 	q_strlcpy (relname, Cmd_Argc () >= 2 ? Cmd_Argv (1) : "condump.txt", sizeof (relname));
 	COM_AddExtension (relname, ".txt", sizeof (relname));
 	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, relname);
-	f = Sys_fopen (name, "w");
+	f = COM_CreateFile (name, "w");
 	if (!f)
 	{
 		Con_Printf ("ERROR: couldn't open file %s.\n", relname);
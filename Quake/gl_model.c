@@ -34,6 +34,7 @@ static void Mod_LoadBrushModel (qmodel_t *mod, void *buffer);
 static void Mod_LoadAliasModel (qmodel_t *mod, void *buffer);
 static void Mod_LoadMD5MeshModel (qmodel_t *mod, const char *buffer);
 static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash);
+static void Mod_FreeTextureJobs (void);
 
 static void Mod_Print (void);
 
@@ -47,6 +48,44 @@ static int	mod_novis_capacity;
 static byte	*mod_decompressed;
 static int	mod_decompressed_capacity;
 
+// decompressed PVS rows of the most recently used leafs of one model,
+// bounded to VISCACHE_BUDGET bytes of rows
+#define VISCACHE_BUDGET		(4 * 1024 * 1024)
+#define VISCACHE_MINROWS	16
+
+static struct
+{
+	qmodel_t	*model;
+	mleaf_t		*leafs;			// to notice the model being reloaded
+	int			numleafs;
+	int			rowbytes;		// multiple of VIS_ALIGN
+	int			numslots;
+	int			numused;
+	byte		*rows;			// [numslots * rowbytes]
+	int			*slotleaf;		// [numslots], leaf number cached in each slot
+	int			*leafslot;		// [numleafs + 1], slot of each leaf or -1
+	int			*prev, *next;	// [numslots], LRU order, most recent first
+	int			head, tail;
+} mod_viscache;
+
+// brush model work running on the task system; kept in static storage since
+// a Host_Error can unwind Mod_LoadBrushModel while jobs are still in flight
+static taskgroup_t	mod_loadtasks;
+
+static struct
+{
+	qmodel_t		*model;
+	SDL_atomic_t	badextents;
+} mod_facejob;
+
+static struct
+{
+	qmodel_t		*model;
+	const void		*in;
+	qboolean		bsp2;
+	SDL_atomic_t	badplanenum;
+} mod_clipjob;
+
 #define	MAX_MOD_KNOWN	4096 /*johnfitz -- was 512 */
 static qmodel_t	mod_known[MAX_MOD_KNOWN];
 static int		mod_numknown;
@@ -166,26 +205,22 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, qmodel_t *model)
 
 /*
 ===================
-Mod_DecompressVis
+Mod_DecompressVisRow
+
+Decompresses (numleafs+7)>>3 bytes of vis into out, returns false if the
+data was corrupt. Thread-safe.
 ===================
 */
-static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
+static qboolean Mod_DecompressVisRow (byte *in, qmodel_t *model, byte *out)
 {
 	int		c;
-	byte	*out;
+	byte	*outstart;
 	byte	*outend;
 	int		row;
 
 	row = (model->numleafs+7)>>3;
-	if (mod_decompressed == NULL || row > mod_decompressed_capacity)
-	{
-		mod_decompressed_capacity = (row + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK;
-		mod_decompressed = (byte *) realloc (mod_decompressed, mod_decompressed_capacity);
-		if (!mod_decompressed)
-			Sys_Error ("Mod_DecompressVis: realloc() failed on %d bytes", mod_decompressed_capacity);
-	}
-	out = mod_decompressed;
-	outend = mod_decompressed + row;
+	outstart = out;
+	outend = out + row;
 
 	if (!in)
 	{	// no vis info, so make all visible
@@ -194,7 +229,7 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 			*out++ = 0xff;
 			row--;
 		}
-		return mod_decompressed;
+		return true;
 	}
 
 	do
@@ -207,31 +242,170 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 
 		c = in[1];
 		in += 2;
-		if (c > row - (out - mod_decompressed))
-			c = row - (out - mod_decompressed);	//now that we're dynamically allocating pvs buffers, we have to be more careful to avoid heap overflows with buggy maps.
+		if (c > row - (out - outstart))
+			c = row - (out - outstart);	//now that we're dynamically allocating pvs buffers, we have to be more careful to avoid heap overflows with buggy maps.
 		while (c)
 		{
 			if (out == outend)
-			{
-				if(!model->viswarn) {
-					model->viswarn = true;
-					Con_Warning("Mod_DecompressVis: output overrun on model \"%s\"\n", model->name);
-				}
-				return mod_decompressed;
-			}
+				return false;
 			*out++ = 0;
 			c--;
 		}
-	} while (out - mod_decompressed < row);
+	} while (out - outstart < row);
+
+	return true;
+}
+
+/*
+===================
+Mod_DecompressVis
+===================
+*/
+static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
+{
+	int		row;
+
+	row = (model->numleafs+7)>>3;
+	if (mod_decompressed == NULL || row > mod_decompressed_capacity)
+	{
+		mod_decompressed_capacity = (row + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK;
+		mod_decompressed = (byte *) realloc (mod_decompressed, mod_decompressed_capacity);
+		if (!mod_decompressed)
+			Sys_Error ("Mod_DecompressVis: realloc() failed on %d bytes", mod_decompressed_capacity);
+	}
+
+	if (!Mod_DecompressVisRow (in, model, mod_decompressed) && !model->viswarn)
+	{
+		model->viswarn = true;
+		Con_Warning("Mod_DecompressVis: output overrun on model \"%s\"\n", model->name);
+	}
 
 	return mod_decompressed;
 }
 
-byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
+/*
+===================
+Mod_DecompressLeafPVS
+
+Thread-safe version of Mod_LeafPVS, writes (numleafs+7)>>3 bytes to out
+===================
+*/
+void Mod_DecompressLeafPVS (mleaf_t *leaf, qmodel_t *model, byte *out)
 {
 	if (leaf == model->leafs)
+		memset (out, 0xff, (model->numleafs+7)>>3);
+	else
+		Mod_DecompressVisRow (leaf->compressed_vis, model, out);
+}
+
+/*
+===================
+Mod_FlushVisCache
+===================
+*/
+static void Mod_FlushVisCache (void)
+{
+	free (mod_viscache.rows);
+	free (mod_viscache.slotleaf);
+	free (mod_viscache.leafslot);
+	free (mod_viscache.prev);
+	free (mod_viscache.next);
+	memset (&mod_viscache, 0, sizeof (mod_viscache));
+}
+
+/*
+===================
+Mod_CachedPVS
+
+Returns the decompressed PVS of a leaf from the row cache, evicting the least
+recently used row if needed. The row stays valid until it is evicted, which
+takes at least VISCACHE_MINROWS calls for other leafs.
+===================
+*/
+static byte *Mod_CachedPVS (mleaf_t *leaf, qmodel_t *model)
+{
+	int		leafnum, slot, i;
+	byte	*row;
+
+	if (mod_viscache.model != model || mod_viscache.leafs != model->leafs || mod_viscache.numleafs != model->numleafs)
+	{
+		Mod_FlushVisCache ();
+		mod_viscache.model = model;
+		mod_viscache.leafs = model->leafs;
+		mod_viscache.numleafs = model->numleafs;
+		mod_viscache.rowbytes = (((model->numleafs+7)>>3) + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK;
+		mod_viscache.numslots = q_min (model->numleafs, q_max (VISCACHE_BUDGET / mod_viscache.rowbytes, VISCACHE_MINROWS));
+		mod_viscache.rows = (byte *) calloc (mod_viscache.numslots, mod_viscache.rowbytes);
+		mod_viscache.slotleaf = (int *) malloc (mod_viscache.numslots * sizeof (int));
+		mod_viscache.leafslot = (int *) malloc ((model->numleafs + 1) * sizeof (int));
+		mod_viscache.prev = (int *) malloc (mod_viscache.numslots * sizeof (int));
+		mod_viscache.next = (int *) malloc (mod_viscache.numslots * sizeof (int));
+		if (!mod_viscache.rows || !mod_viscache.slotleaf || !mod_viscache.leafslot || !mod_viscache.prev || !mod_viscache.next)
+			Sys_Error ("Mod_CachedPVS: out of memory");
+		for (i = 0; i <= model->numleafs; i++)
+			mod_viscache.leafslot[i] = -1;
+		mod_viscache.head = mod_viscache.tail = -1;
+	}
+
+	leafnum = leaf - model->leafs;
+	slot = mod_viscache.leafslot[leafnum];
+	if (slot >= 0)
+	{
+		// move to the front of the LRU list
+		if (slot != mod_viscache.head)
+		{
+			mod_viscache.next[mod_viscache.prev[slot]] = mod_viscache.next[slot];
+			if (mod_viscache.next[slot] >= 0)
+				mod_viscache.prev[mod_viscache.next[slot]] = mod_viscache.prev[slot];
+			else
+				mod_viscache.tail = mod_viscache.prev[slot];
+			mod_viscache.prev[slot] = -1;
+			mod_viscache.next[slot] = mod_viscache.head;
+			mod_viscache.prev[mod_viscache.head] = slot;
+			mod_viscache.head = slot;
+		}
+		return mod_viscache.rows + slot * mod_viscache.rowbytes;
+	}
+
+	if (mod_viscache.numused < mod_viscache.numslots)
+		slot = mod_viscache.numused++;
+	else
+	{
+		// evict the least recently used row
+		slot = mod_viscache.tail;
+		mod_viscache.leafslot[mod_viscache.slotleaf[slot]] = -1;
+		mod_viscache.tail = mod_viscache.prev[slot];
+		if (mod_viscache.tail >= 0)
+			mod_viscache.next[mod_viscache.tail] = -1;
+		else
+			mod_viscache.head = -1;
+	}
+
+	row = mod_viscache.rows + slot * mod_viscache.rowbytes;
+	if (!Mod_DecompressVisRow (leaf->compressed_vis, model, row) && !model->viswarn)
+	{
+		model->viswarn = true;
+		Con_Warning("Mod_DecompressVis: output overrun on model \"%s\"\n", model->name);
+	}
+
+	mod_viscache.slotleaf[slot] = leafnum;
+	mod_viscache.leafslot[leafnum] = slot;
+	mod_viscache.prev[slot] = -1;
+	mod_viscache.next[slot] = mod_viscache.head;
+	if (mod_viscache.head >= 0)
+		mod_viscache.prev[mod_viscache.head] = slot;
+	else
+		mod_viscache.tail = slot;
+	mod_viscache.head = slot;
+
+	return row;
+}
+
+byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
+{
+	if (leaf == model->leafs || !leaf->compressed_vis)
 		return Mod_NoVisPVS (model);
-	return Mod_DecompressVis (leaf->compressed_vis, model);
+	return Mod_CachedPVS (leaf, model);
 }
 
 byte *Mod_NoVisPVS (qmodel_t *model)
@@ -262,6 +436,10 @@ void Mod_ClearAll (void)
 	int		i;
 	qmodel_t	*mod;
 
+	Task_Wait (&mod_loadtasks);
+	Mod_FreeTextureJobs ();
+	Mod_FlushVisCache ();
+
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 	{
 		if (mod->type != mod_alias)
@@ -277,6 +455,10 @@ void Mod_ResetAll (void)
 	int		i;
 	qmodel_t	*mod;
 
+	Task_Wait (&mod_loadtasks);
+	Mod_FreeTextureJobs ();
+	Mod_FlushVisCache ();
+
 	//ericw -- free alias model VBOs
 	GLMesh_DeleteVertexBuffers ();
 
@@ -377,7 +559,7 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 //
 // load the file
 //
-	buf = COM_LoadMallocFile (mod->name, &mod->path_id);
+	buf = COM_MapFile (mod->name, &mod->path_id);
 	if (!buf)
 	{
 		if (crash)
@@ -415,7 +597,7 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 		break;
 	}
 
-	free (buf);
+	COM_UnmapFile (buf);
 
 	return mod;
 }
@@ -508,6 +690,251 @@ static textype_t Mod_TextureTypeFromName (const char *texname)
 	return TEXTYPE_DEFAULT;
 }
 
+#define MOD_TEXJOBS_PER_THREAD	4	// textures decoded ahead of the upload, per thread
+
+typedef struct
+{
+	char			names[2][MAX_OSPATH];	// candidates, in order of preference
+	char			filename[MAX_OSPATH];	// the one that was found
+	byte			*data;					// malloc'ed, unless deferred
+	int				width, height;
+	enum srcformat	fmt;
+	qboolean		deferred;				// has to be loaded on the main thread
+} modextimage_t;
+
+typedef struct
+{
+	texture_t		*tx;
+	src_offset_t	offset;
+	int				pixels;
+	qboolean		wantglow;
+	modextimage_t	image;
+	modextimage_t	glow;
+	taskgroup_t		group;
+} modtexjob_t;
+
+// the texture jobs of the model being loaded, kept in static storage
+// for the same reason as mod_loadtasks
+static modtexjob_t	*mod_texjobs;
+static int			mod_numtexjobs;
+
+/*
+=================
+Mod_FindExternalImage -- looks for an external image in order of preference
+
+Called from worker threads
+=================
+*/
+static void Mod_FindExternalImage (modextimage_t *img)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		img->data = Image_DecodeImage (img->names[i], &img->width, &img->height, &img->fmt, &img->deferred);
+		if (img->data || img->deferred)
+		{
+			q_strlcpy (img->filename, img->names[i], sizeof(img->filename));
+			return;
+		}
+	}
+}
+
+/*
+=================
+Mod_LoadExternalImage -- returns the image found by Mod_FindExternalImage,
+loading it here if it couldn't be decoded on a worker thread
+=================
+*/
+static byte *Mod_LoadExternalImage (modextimage_t *img)
+{
+	int i;
+
+	if (!img->deferred)
+		return img->data;
+
+	for (i = 0; i < 2; i++)
+	{
+		byte *data = Image_LoadImage (img->names[i], &img->width, &img->height, &img->fmt);
+		if (data)
+		{
+			q_strlcpy (img->filename, img->names[i], sizeof(img->filename));
+			return data;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+=================
+Mod_FreeExternalImage
+=================
+*/
+static void Mod_FreeExternalImage (modextimage_t *img)
+{
+	if (!img->deferred)
+		free (img->data);
+	img->data = NULL;
+}
+
+/*
+=================
+Mod_DecodeTextureTask
+=================
+*/
+static void Mod_DecodeTextureTask (void *param, int first, int last)
+{
+	modtexjob_t *job = (modtexjob_t *) param;
+
+	Mod_FindExternalImage (&job->image);
+
+	//now try to load glow/luma image from the same place
+	if (job->wantglow && job->image.data)
+	{
+		q_snprintf (job->glow.names[0], sizeof(job->glow.names[0]), "%s_glow", job->image.filename);
+		q_snprintf (job->glow.names[1], sizeof(job->glow.names[1]), "%s_luma", job->image.filename);
+		Mod_FindExternalImage (&job->glow);
+	}
+}
+
+/*
+=================
+Mod_UploadTexture -- uploads either the external images or the texture from the bsp file
+=================
+*/
+static void Mod_UploadTexture (modtexjob_t *job)
+{
+	texture_t	*tx = job->tx;
+	char		texturename[64];
+	byte		*data;
+	int			mark;
+
+	mark = Hunk_LowMark ();
+	data = Mod_LoadExternalImage (&job->image);
+
+	if (TEXTYPE_ISLIQUID (tx->type))
+	{
+		//now load whatever we found
+		if (data) //load external image
+		{
+			q_strlcpy (texturename, job->image.filename, sizeof(texturename));
+			tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, job->image.width, job->image.height,
+				job->image.fmt, data, job->image.filename, 0, TEXPREF_MIPMAP | TEXPREF_BINDLESS);
+		}
+		else //use the texture from the bsp file
+		{
+			q_snprintf (texturename, sizeof(texturename), "%s:%s", loadmodel->name, tx->name);
+			tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
+				SRC_INDEXED, (byte *)(tx+1), loadmodel->name, job->offset, TEXPREF_MIPMAP | TEXPREF_BINDLESS);
+		}
+	}
+	else //regular texture
+	{
+		int	extraflags = TEXPREF_BINDLESS;
+		if (tx->type == TEXTYPE_CUTOUT)
+			extraflags |= TEXPREF_ALPHA;
+
+		//now load whatever we found
+		if (data) //load external image
+		{
+			tx->gltexture = TexMgr_LoadImage (loadmodel, job->image.filename, job->image.width, job->image.height,
+				job->image.fmt, data, job->image.filename, 0, TEXPREF_MIPMAP | extraflags );
+
+			//now try to load glow/luma image from the same place
+			Mod_FreeExternalImage (&job->image);
+			Hunk_FreeToLowMark (mark);
+			if (job->image.deferred)
+			{	// the worker didn't get that far
+				q_snprintf (job->glow.names[0], sizeof(job->glow.names[0]), "%s_glow", job->image.filename);
+				q_snprintf (job->glow.names[1], sizeof(job->glow.names[1]), "%s_luma", job->image.filename);
+				job->glow.deferred = true;
+			}
+			data = Mod_LoadExternalImage (&job->glow);
+
+			if (data)
+				tx->fullbright = TexMgr_LoadImage (loadmodel, job->glow.filename, job->glow.width, job->glow.height,
+					job->glow.fmt, data, job->glow.filename, 0, TEXPREF_MIPMAP | extraflags );
+		}
+		else //use the texture from the bsp file
+		{
+			q_snprintf (texturename, sizeof(texturename), "%s:%s", loadmodel->name, tx->name);
+			if (Mod_CheckFullbrights ((byte *)(tx+1), job->pixels))
+			{
+				if (tx->type != TEXTYPE_CUTOUT)
+				{
+					tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
+						SRC_INDEXED, (byte *)(tx+1), loadmodel->name, job->offset, TEXPREF_MIPMAP | TEXPREF_ALPHABRIGHT | extraflags);
+				}
+				else
+				{
+					tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
+						SRC_INDEXED, (byte *)(tx+1), loadmodel->name, job->offset, TEXPREF_MIPMAP | TEXPREF_NOBRIGHT | extraflags);
+					q_snprintf (texturename, sizeof(texturename), "%s:%s_glow", loadmodel->name, tx->name);
+					tx->fullbright = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
+						SRC_INDEXED, (byte *)(tx+1), loadmodel->name, job->offset, TEXPREF_MIPMAP | TEXPREF_FULLBRIGHT | extraflags);
+				}
+			}
+			else
+			{
+				tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
+					SRC_INDEXED, (byte *)(tx+1), loadmodel->name, job->offset, TEXPREF_MIPMAP | extraflags);
+			}
+		}
+	}
+
+	Mod_FreeExternalImage (&job->image);
+	Mod_FreeExternalImage (&job->glow);
+	Hunk_FreeToLowMark (mark);
+}
+
+/*
+=================
+Mod_LoadTextureJobs
+
+Keeps a bounded number of textures decoding ahead of the one being uploaded,
+so memory use doesn't grow with the number of replacement textures
+=================
+*/
+static void Mod_LoadTextureJobs (modtexjob_t *jobs, int numjobs)
+{
+	int i, next, window;
+
+	window = (Tasks_NumWorkers () + 1) * MOD_TEXJOBS_PER_THREAD;
+	for (i = next = 0; i < numjobs; i++)
+	{
+		for (; next < numjobs && next < i + window; next++)
+			Task_Dispatch (&jobs[next].group, Mod_DecodeTextureTask, &jobs[next]);
+		Task_Wait (&jobs[i].group);
+		Mod_UploadTexture (&jobs[i]);
+	}
+}
+
+/*
+=================
+Mod_FreeTextureJobs -- waits for the decoding still in flight and frees
+the images that weren't uploaded, if a Host_Error interrupted the upload
+=================
+*/
+static void Mod_FreeTextureJobs (void)
+{
+	int i;
+
+	if (!mod_texjobs)
+		return;
+
+	for (i = 0; i < mod_numtexjobs; i++)
+	{
+		Task_Wait (&mod_texjobs[i].group);
+		Mod_FreeExternalImage (&mod_texjobs[i].image);
+		Mod_FreeExternalImage (&mod_texjobs[i].glow);
+	}
+
+	free (mod_texjobs);
+	mod_texjobs = NULL;
+	mod_numtexjobs = 0;
+}
+
 /*
 =================
 Mod_LoadTextures
@@ -522,13 +949,8 @@ static void Mod_LoadTextures (lump_t *l)
 	texture_t	*altanims[10];
 	dmiptexlump_t	*m;
 //johnfitz -- more variables
-	char		texturename[64];
 	int			nummiptex;
-	src_offset_t		offset;
-	int			mark, fwidth, fheight;
-	char		filename[MAX_OSPATH], mapname[MAX_OSPATH];
-	byte		*data;
-	enum srcformat fmt;
+	char		mapname[MAX_OSPATH];
 //johnfitz
 
 	//johnfitz -- don't return early if no textures; still need to create dummy texture
@@ -549,6 +971,12 @@ static void Mod_LoadTextures (lump_t *l)
 	loadmodel->numtextures = nummiptex + 2; //johnfitz -- need 2 dummy texture chains for missing textures
 	loadmodel->textures = (texture_t **) Hunk_AllocName (loadmodel->numtextures * sizeof(*loadmodel->textures) , loadname);
 
+	COM_StripExtension (loadmodel->name + 5, mapname, sizeof(mapname));
+	Mod_FreeTextureJobs ();
+	mod_texjobs = (modtexjob_t *) calloc (q_max (nummiptex, 1), sizeof (*mod_texjobs));
+	if (!mod_texjobs)
+		Sys_Error ("Mod_LoadTextures: out of memory (%d textures)", nummiptex);
+
 	for (i=0 ; i<nummiptex ; i++)
 	{
 		m->dataofs[i] = LittleLong(m->dataofs[i]);
@@ -622,104 +1050,34 @@ static void Mod_LoadTextures (lump_t *l)
 				else
 					Sky_LoadTexture (loadmodel, tx);
 			}
-			else if (TEXTYPE_ISLIQUID (tx->type))
-			{
-				//external textures -- first look in "textures/mapname/" then look in "textures/"
-				mark = Hunk_LowMark();
-				COM_StripExtension (loadmodel->name + 5, mapname, sizeof(mapname));
-				q_snprintf (filename, sizeof(filename), "textures/%s/#%s", mapname, tx->name+1); //this also replaces the '*' with a '#'
-				data = Image_LoadImage (filename, &fwidth, &fheight, &fmt);
-				if (!data)
-				{
-					q_snprintf (filename, sizeof(filename), "textures/#%s", tx->name+1);
-					data = Image_LoadImage (filename, &fwidth, &fheight, &fmt);
-				}
-
-				//now load whatever we found
-				if (data) //load external image
-				{
-					q_strlcpy (texturename, filename, sizeof(texturename));
-					tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, fwidth, fheight,
-						fmt, data, filename, 0, TEXPREF_MIPMAP | TEXPREF_BINDLESS);
-				}
-				else //use the texture from the bsp file
-				{
-					q_snprintf (texturename, sizeof(texturename), "%s:%s", loadmodel->name, tx->name);
-					offset = (src_offset_t)(mt+1) - (src_offset_t)mod_base;
-					tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
-						SRC_INDEXED, (byte *)(tx+1), loadmodel->name, offset, TEXPREF_MIPMAP | TEXPREF_BINDLESS);
-				}
-			}
-			else //regular texture
+			else
 			{
-				int	extraflags = TEXPREF_BINDLESS;
-				if (tx->type == TEXTYPE_CUTOUT)
-					extraflags |= TEXPREF_ALPHA;
+				modtexjob_t *job = &mod_texjobs[mod_numtexjobs++];
+				job->tx = tx;
+				job->offset = (src_offset_t)(mt+1) - (src_offset_t)mod_base;
+				job->pixels = pixels;
 
 				//external textures -- first look in "textures/mapname/" then look in "textures/"
-				mark = Hunk_LowMark ();
-				COM_StripExtension (loadmodel->name + 5, mapname, sizeof(mapname));
-				q_snprintf (filename, sizeof(filename), "textures/%s/%s", mapname, tx->name);
-				data = Image_LoadImage (filename, &fwidth, &fheight, &fmt);
-				if (!data)
-				{
-					q_snprintf (filename, sizeof(filename), "textures/%s", tx->name);
-					data = Image_LoadImage (filename, &fwidth, &fheight, &fmt);
-				}
-
-				//now load whatever we found
-				if (data) //load external image
+				if (TEXTYPE_ISLIQUID (tx->type))
 				{
-					char filename2[MAX_OSPATH];
-					tx->gltexture = TexMgr_LoadImage (loadmodel, filename, fwidth, fheight,
-						fmt, data, filename, 0, TEXPREF_MIPMAP | extraflags );
-
-					//now try to load glow/luma image from the same place
-					Hunk_FreeToLowMark (mark);
-					q_snprintf (filename2, sizeof(filename2), "%s_glow", filename);
-					data = Image_LoadImage (filename2, &fwidth, &fheight, &fmt);
-					if (!data)
-					{
-						q_snprintf (filename2, sizeof(filename2), "%s_luma", filename);
-						data = Image_LoadImage (filename2, &fwidth, &fheight, &fmt);
-					}
-
-					if (data)
-						tx->fullbright = TexMgr_LoadImage (loadmodel, filename2, fwidth, fheight,
-							fmt, data, filename2, 0, TEXPREF_MIPMAP | extraflags );
+					q_snprintf (job->image.names[0], sizeof(job->image.names[0]), "textures/%s/#%s", mapname, tx->name+1); //this also replaces the '*' with a '#'
+					q_snprintf (job->image.names[1], sizeof(job->image.names[1]), "textures/#%s", tx->name+1);
 				}
-				else //use the texture from the bsp file
+				else
 				{
-					q_snprintf (texturename, sizeof(texturename), "%s:%s", loadmodel->name, tx->name);
-					offset = (src_offset_t)(mt+1) - (src_offset_t)mod_base;
-					if (Mod_CheckFullbrights ((byte *)(tx+1), pixels))
-					{
-						if (tx->type != TEXTYPE_CUTOUT)
-						{
-							tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
-								SRC_INDEXED, (byte *)(tx+1), loadmodel->name, offset, TEXPREF_MIPMAP | TEXPREF_ALPHABRIGHT | extraflags);
-						}
-						else
-						{
-							tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
-								SRC_INDEXED, (byte *)(tx+1), loadmodel->name, offset, TEXPREF_MIPMAP | TEXPREF_NOBRIGHT | extraflags);
-							q_snprintf (texturename, sizeof(texturename), "%s:%s_glow", loadmodel->name, tx->name);
-							tx->fullbright = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
-								SRC_INDEXED, (byte *)(tx+1), loadmodel->name, offset, TEXPREF_MIPMAP | TEXPREF_FULLBRIGHT | extraflags);
-						}
-					}
-					else
-					{
-						tx->gltexture = TexMgr_LoadImage (loadmodel, texturename, tx->width, tx->height,
-							SRC_INDEXED, (byte *)(tx+1), loadmodel->name, offset, TEXPREF_MIPMAP | extraflags);
-					}
+					q_snprintf (job->image.names[0], sizeof(job->image.names[0]), "textures/%s/%s", mapname, tx->name);
+					q_snprintf (job->image.names[1], sizeof(job->image.names[1]), "textures/%s", tx->name);
+					job->wantglow = true;
 				}
-				Hunk_FreeToLowMark (mark);
 			}
 		}
 		//johnfitz
 	}
 
+	// decode external images on worker threads, upload them in order here
+	Mod_LoadTextureJobs (mod_texjobs, mod_numtexjobs);
+	Mod_FreeTextureJobs ();
+
 	//johnfitz -- last 2 slots in array should be filled with dummy textures
 	loadmodel->textures[loadmodel->numtextures-2] = r_notexture_mip; //for lightmapped surfs
 	loadmodel->textures[loadmodel->numtextures-1] = r_notexture_mip2; //for SURF_DRAWTILED surfs
@@ -1139,9 +1497,11 @@ static void Mod_LoadTexinfo (lump_t *l)
 CalcSurfaceExtents
 
 Fills in s->texturemins[] and s->extents[]
+Returns false if the extents are too large
+Called from worker threads
 ================
 */
-static void CalcSurfaceExtents (msurface_t *s)
+static qboolean CalcSurfaceExtents (qmodel_t *mod, msurface_t *s)
 {
 	float	mins[2], maxs[2], val;
 	int		i,j, e;
@@ -1175,11 +1535,11 @@ static void CalcSurfaceExtents (msurface_t *s)
 	{
 		double vposition[3];
 
-		e = loadmodel->surfedges[s->firstedge+i];
+		e = mod->surfedges[s->firstedge+i];
 		if (e >= 0)
-			v = &loadmodel->vertexes[loadmodel->edges[e].v[0]];
+			v = &mod->vertexes[mod->edges[e].v[0]];
 		else
-			v = &loadmodel->vertexes[loadmodel->edges[-e].v[1]];
+			v = &mod->vertexes[mod->edges[-e].v[1]];
 
 		vposition[0] = (double) v->position[0];
 		vposition[1] = (double) v->position[1];
@@ -1222,8 +1582,10 @@ static void CalcSurfaceExtents (msurface_t *s)
 		s->extents[i] = bmax - bmin;
 
 		if ( !(tex->flags & TEX_SPECIAL) && s->extents[i] > 2000) //johnfitz -- was 512 in glquake, 256 in winquake
-			Sys_Error ("Bad surface extents");
+			return false;
 	}
+
+	return true;
 }
 
 /*
@@ -1231,7 +1593,7 @@ static void CalcSurfaceExtents (msurface_t *s)
 Mod_CalcSurfaceBounds -- johnfitz -- calculate bounding box for per-surface frustum culling
 =================
 */
-void Mod_CalcSurfaceBounds (msurface_t *s)
+static void Mod_CalcSurfaceBounds (qmodel_t *mod, msurface_t *s)
 {
 	int			i, e;
 	mvertex_t	*v;
@@ -1241,11 +1603,11 @@ void Mod_CalcSurfaceBounds (msurface_t *s)
 
 	for (i=0 ; i<s->numedges ; i++)
 	{
-		e = loadmodel->surfedges[s->firstedge+i];
+		e = mod->surfedges[s->firstedge+i];
 		if (e >= 0)
-			v = &loadmodel->vertexes[loadmodel->edges[e].v[0]];
+			v = &mod->vertexes[mod->edges[e].v[0]];
 		else
-			v = &loadmodel->vertexes[loadmodel->edges[-e].v[1]];
+			v = &mod->vertexes[mod->edges[-e].v[1]];
 
 		s->mins[0] = q_min (s->mins[0], v->position[0]);
 		s->mins[1] = q_min (s->mins[1], v->position[1]);
@@ -1257,6 +1619,25 @@ void Mod_CalcSurfaceBounds (msurface_t *s)
 	}
 }
 
+/*
+=================
+Mod_SurfaceExtentsTask -- computes extents and bounds for a range of faces
+=================
+*/
+static void Mod_SurfaceExtentsTask (void *param, int first, int last)
+{
+	qmodel_t	*mod = mod_facejob.model;
+	int			i;
+
+	for (i = first; i < last; i++)
+	{
+		msurface_t *s = &mod->surfaces[i];
+		if (!CalcSurfaceExtents (mod, s))
+			SDL_AtomicSet (&mod_facejob.badextents, 1);
+		Mod_CalcSurfaceBounds (mod, s); //johnfitz -- for per-surface frustum culling
+	}
+}
+
 /*
 =================
 Mod_LoadFaces
@@ -1335,10 +1716,6 @@ static void Mod_LoadFaces (lump_t *l, qboolean bsp2)
 
 		out->texinfo = loadmodel->texinfo + texinfon;
 
-		CalcSurfaceExtents (out);
-
-		Mod_CalcSurfaceBounds (out); //johnfitz -- for per-surface frustum culling
-
 	// lighting info
 		if (loadmodel->bspversion == BSPVERSION_QUAKE64)
 			lofs /= 2; // Q64 samples are 16bits instead 8 in normal Quake 
@@ -1391,6 +1768,12 @@ static void Mod_LoadFaces (lump_t *l, qboolean bsp2)
 		}
 		//johnfitz
 	}
+
+	// extents and bounds only depend on lumps that are already loaded,
+	// so compute them on worker threads while the rest of the bsp loads
+	mod_facejob.model = loadmodel;
+	SDL_AtomicSet (&mod_facejob.badextents, 0);
+	Task_ParallelFor (&mod_loadtasks, count, 0, Mod_SurfaceExtentsTask, NULL);
 }
 
 
@@ -1890,6 +2273,59 @@ static void Mod_FindUsedTextures (qmodel_t *mod)
 	//Con_Printf("%s: %d/%d textures\n", mod->name, count, mod->numtextures);
 }
 
+/*
+=================
+Mod_ClipnodesTask -- converts a range of clipnodes, called from worker threads
+=================
+*/
+static void Mod_ClipnodesTask (void *param, int first, int last)
+{
+	qmodel_t	*mod = mod_clipjob.model;
+	mclipnode_t	*out = mod->clipnodes + first;
+	int			i, count = mod->numclipnodes;
+
+	if (mod_clipjob.bsp2)
+	{
+		const dlclipnode_t *inl = (const dlclipnode_t *)mod_clipjob.in + first;
+		for (i=first ; i<last ; i++, out++, inl++)
+		{
+			out->planenum = LittleLong(inl->planenum);
+
+			//johnfitz -- bounds check
+			if (out->planenum < 0 || out->planenum >= mod->numplanes)
+				SDL_AtomicSet (&mod_clipjob.badplanenum, 1);
+			//johnfitz
+
+			out->children[0] = LittleLong(inl->children[0]);
+			out->children[1] = LittleLong(inl->children[1]);
+			//Spike: FIXME: bounds check
+		}
+	}
+	else
+	{
+		const dsclipnode_t *ins = (const dsclipnode_t *)mod_clipjob.in + first;
+		for (i=first ; i<last ; i++, out++, ins++)
+		{
+			out->planenum = LittleLong(ins->planenum);
+
+			//johnfitz -- bounds check
+			if (out->planenum < 0 || out->planenum >= mod->numplanes)
+				SDL_AtomicSet (&mod_clipjob.badplanenum, 1);
+			//johnfitz
+
+			//johnfitz -- support clipnodes > 32k
+			out->children[0] = (unsigned short)LittleShort(ins->children[0]);
+			out->children[1] = (unsigned short)LittleShort(ins->children[1]);
+
+			if (out->children[0] >= count)
+				out->children[0] -= 65536;
+			if (out->children[1] >= count)
+				out->children[1] -= 65536;
+			//johnfitz
+		}
+	}
+}
+
 /*
 =================
 Mod_LoadClipnodes
@@ -1901,7 +2337,7 @@ static void Mod_LoadClipnodes (lump_t *l, qboolean bsp2)
 	dlclipnode_t *inl;
 
 	mclipnode_t *out; //johnfitz -- was dclipnode_t
-	int			i, count;
+	int			count;
 	hull_t		*hull;
 
 	if (bsp2)
@@ -1956,44 +2392,11 @@ static void Mod_LoadClipnodes (lump_t *l, qboolean bsp2)
 	hull->clip_maxs[1] = 32;
 	hull->clip_maxs[2] = 64;
 
-	if (bsp2)
-	{
-		for (i=0 ; i<count ; i++, out++, inl++)
-		{
-			out->planenum = LittleLong(inl->planenum);
-
-			//johnfitz -- bounds check
-			if (out->planenum < 0 || out->planenum >= loadmodel->numplanes)
-				Host_Error ("Mod_LoadClipnodes: planenum out of bounds");
-			//johnfitz
-
-			out->children[0] = LittleLong(inl->children[0]);
-			out->children[1] = LittleLong(inl->children[1]);
-			//Spike: FIXME: bounds check
-		}
-	}
-	else
-	{
-		for (i=0 ; i<count ; i++, out++, ins++)
-		{
-			out->planenum = LittleLong(ins->planenum);
-
-			//johnfitz -- bounds check
-			if (out->planenum < 0 || out->planenum >= loadmodel->numplanes)
-				Host_Error ("Mod_LoadClipnodes: planenum out of bounds");
-			//johnfitz
-
-			//johnfitz -- support clipnodes > 32k
-			out->children[0] = (unsigned short)LittleShort(ins->children[0]);
-			out->children[1] = (unsigned short)LittleShort(ins->children[1]);
-
-			if (out->children[0] >= count)
-				out->children[0] -= 65536;
-			if (out->children[1] >= count)
-				out->children[1] -= 65536;
-			//johnfitz
-		}
-	}
+	mod_clipjob.model = loadmodel;
+	mod_clipjob.in = bsp2 ? (const void *)inl : (const void *)ins;
+	mod_clipjob.bsp2 = bsp2;
+	SDL_AtomicSet (&mod_clipjob.badplanenum, 0);
+	Task_ParallelFor (&mod_loadtasks, count, 0, Mod_ClipnodesTask, NULL);
 }
 
 /*
@@ -2466,6 +2869,13 @@ visdone:
 	Mod_LoadEntities (&header->lumps[LUMP_ENTITIES]);
 	Mod_LoadSubmodels (&header->lumps[LUMP_MODELS]);
 
+	// collect the face and clipnode jobs started above
+	Task_Wait (&mod_loadtasks);
+	if (SDL_AtomicGet (&mod_facejob.badextents))
+		Sys_Error ("Bad surface extents");
+	if (SDL_AtomicGet (&mod_clipjob.badplanenum))
+		Host_Error ("Mod_LoadClipnodes: planenum out of bounds");
+
 	Mod_MakeHull0 ();
 
 	mod->numframes = 2;		// regular and alternate animation
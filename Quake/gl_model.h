@@ -525,6 +525,7 @@ void	Mod_TouchModel (const char *name);
 
 mleaf_t *Mod_PointInLeaf (vec3_t p, qmodel_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model);
+void	Mod_DecompressLeafPVS (mleaf_t *leaf, qmodel_t *model, byte *out);
 byte	*Mod_NoVisPVS (qmodel_t *model);
 
 void Mod_SetExtraFlags (qmodel_t *mod);
@@ -24,17 +24,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "glquake.h"
+#include "texcomp.h"
 
 typedef struct {
-	GLenum		id;
-	int			ratio;
+	GLenum			id;
+	int				ratio;
+	texcompformat_t	encoder;	// used for 2D textures, others are compressed by the driver
 } glformat_t;
 
+// indexed by the gl_compress_textures mode
 static const struct {
 	glformat_t	solid, alpha;
-} glformats[2] = {
-	{{GL_RGB, 1},							{GL_RGBA, 1}},
-	{{GL_COMPRESSED_RGBA_BPTC_UNORM, 4},	{GL_COMPRESSED_RGBA_BPTC_UNORM, 4}},
+} glformats[3] = {
+	{{GL_RGB, 1, TEXCOMP_NONE},										{GL_RGBA, 1, TEXCOMP_NONE}},
+	{{GL_COMPRESSED_RGBA_BPTC_UNORM, 4, TEXCOMP_BC7},				{GL_COMPRESSED_RGBA_BPTC_UNORM, 4, TEXCOMP_BC7}},
+	{{GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8, TEXCOMP_BC1},				{GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 4, TEXCOMP_BC3}},
 };
 
 cvar_t			r_softemu = {"r_softemu", "0", CVAR_ARCHIVE};
@@ -50,6 +54,8 @@ cvar_t			gl_lodbias = {"gl_lodbias", "auto", CVAR_ARCHIVE };
 cvar_t			gl_texturemode = {"gl_texturemode", "", CVAR_ARCHIVE};
 cvar_t			gl_texture_anisotropy = {"gl_texture_anisotropy", "8", CVAR_ARCHIVE};
 cvar_t			gl_compress_textures = {"gl_compress_textures", "0", CVAR_ARCHIVE};
+static cvar_t	gl_texcache = {"gl_texcache", "0", CVAR_ARCHIVE};
+static cvar_t	gl_texcache_compressed = {"gl_texcache_compressed", "0", CVAR_ARCHIVE}; // cache only block-compressed textures
 GLint			gl_max_texture_size;
 
 static float	lodbias;
@@ -71,7 +77,10 @@ unsigned int d_8to24table_conchars[256];		//conchars palette, 0 and 255 are tran
 
 uint32_t is_fullbright[256/32];
 
+static unsigned	texmgr_palettehash; // identifies the palette/colormap the tables above were built from
+
 static void GL_DeleteTexture (gltexture_t *texture);
+static void TexMgr_TexCache_f (void);
 
 /*
 ================================================================================
@@ -546,7 +555,12 @@ void TexMgr_CompressTextures_f (cvar_t *var)
 {
 	gltexture_t	*glt;
 
-	Con_SafePrintf ("Using %s textures\n", var->value ? "compressed" : "uncompressed");
+	if (var->value >= 2.f && gl_texture_s3tc_able)
+		Con_SafePrintf ("Using BC1/BC3 compressed textures\n");
+	else if (var->value >= 2.f)
+		Con_SafePrintf ("S3TC not supported, using BC7 compressed textures\n");
+	else
+		Con_SafePrintf ("Using %s textures\n", var->value ? "BC7 compressed" : "uncompressed");
 
 	// In an attempt to reduce VRAM fragmentation, instead of unloading and reloading
 	// each texture sequentially, we first unload them all, then reload them
@@ -812,6 +826,8 @@ void TexMgr_LoadPalette (void)
 	memcpy(d_8to24table_conchars, d_8to24table, 256*4);
 	((byte *) &d_8to24table_conchars[0]) [3] = 0;
 
+	texmgr_palettehash = COM_HashBlock (pal, 768) * 31 + COM_HashBlock (colormap, 256 * 64);
+
 	Hunk_FreeToLowMark (mark);
 }
 
@@ -862,6 +878,8 @@ void TexMgr_Init (void)
 
 	Cvar_RegisterVariable (&gl_max_size);
 	Cvar_RegisterVariable (&gl_picmip);
+	Cvar_RegisterVariable (&gl_texcache);
+	Cvar_RegisterVariable (&gl_texcache_compressed);
 	gl_texturemode.string = glmodes[glmode_idx].name;
 	Cvar_RegisterVariable (&gl_texturemode);
 	Cvar_SetCallback (&gl_texturemode, &TexMgr_TextureMode_f);
@@ -882,6 +900,7 @@ void TexMgr_Init (void)
 	cmd = Cmd_AddCommand ("imagedump", &TexMgr_Imagedump_f);
 	if (cmd)
 		cmd->completion = TexMgr_Imagelist_Completion_f;
+	Cmd_AddCommand ("texcache", &TexMgr_TexCache_f);
 
 	// poll max size from hardware
 	glGetIntegerv (GL_MAX_TEXTURE_SIZE, &gl_max_texture_size);
@@ -1279,6 +1298,64 @@ static void GL_TexImage (gltexture_t *glt, GLint level, GLint internalformat, GL
 	}
 }
 
+/*
+================
+TexMgr_CompressionMode -- 0 = uncompressed, 1 = BC7, 2 = BC1/BC3
+================
+*/
+static int TexMgr_CompressionMode (gltexture_t *glt)
+{
+	int mode;
+
+	if (!TexMgr_CanCompress (glt))
+		return 0;
+	mode = CLAMP (0, (int) gl_compress_textures.value, 2);
+	if (mode == 2 && !gl_texture_s3tc_able)
+		mode = 1;
+
+	return mode;
+}
+
+/*
+================
+TexMgr_UploadFormat -- picks the internal format for 32bit data
+================
+*/
+static glformat_t TexMgr_UploadFormat (gltexture_t *glt)
+{
+	int mode = TexMgr_CompressionMode (glt);
+	glformat_t internalformat = (glt->flags & TEXPREF_HASALPHA) ? glformats[mode].alpha : glformats[mode].solid;
+	glt->compression = internalformat.ratio;
+	return internalformat;
+}
+
+static void TexMgr_CacheLevel (int level, int width, int height, texcompformat_t encoder, const void *data, size_t size);
+
+/*
+================
+TexMgr_UploadLevel -- uploads one mip level of 32bit data, block-compressing it first if needed
+================
+*/
+static void TexMgr_UploadLevel (gltexture_t *glt, int level, glformat_t format, int width, int height, const void *data)
+{
+	if (format.encoder != TEXCOMP_NONE && glt->target == GL_TEXTURE_2D && data)
+	{
+		int		mark = Hunk_LowMark ();
+		size_t	size = TexComp_Size (format.encoder, width, height);
+		byte	*blocks = (byte *) Hunk_AllocNoFill (size);
+
+		TexComp_Encode (format.encoder, (const byte *) data, width, height, blocks);
+		GL_CompressedTexImage2DFunc (glt->target, level, format.id, width, height, 0, (GLsizei) size, blocks);
+		TexMgr_CacheLevel (level, width, height, format.encoder, blocks, size);
+		Hunk_FreeToLowMark (mark);
+	}
+	else
+	{
+		GL_TexImage (glt, level, format.id, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		TexMgr_CacheLevel (level, width, height, TEXCOMP_NONE, data, (size_t) width * height * 4);
+	}
+}
+
 /*
 ================
 TexMgr_LoadImage32 -- handles 32bit source data
@@ -1288,7 +1365,6 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 {
 	int	miplevel, mipwidth, mipheight, picmip;
 	glformat_t internalformat;
-	qboolean compress;
 
 	// mipmap down
 	picmip = (glt->flags & TEXPREF_NOPICMIP) ? 0 : q_max((int)gl_picmip.value, 0);
@@ -1310,11 +1386,9 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 	}
 
 	// upload
-	compress = gl_compress_textures.value && TexMgr_CanCompress (glt);
-	internalformat = (glt->flags & TEXPREF_HASALPHA) ? glformats[compress].alpha : glformats[compress].solid;
-	glt->compression = internalformat.ratio;
+	internalformat = TexMgr_UploadFormat (glt);
 	GL_Bind (GL_TEXTURE0, glt);
-	GL_TexImage (glt, 0, internalformat.id, glt->width, glt->height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	TexMgr_UploadLevel (glt, 0, internalformat, glt->width, glt->height, data);
 
 	// upload mipmaps
 	if (glt->flags & TEXPREF_MIPMAP)
@@ -1340,7 +1414,7 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 					TexMgr_MipMapW (data, mipwidth, mipheight, glt->depth);
 					mipwidth >>= 1;
 				}
-				GL_TexImage (glt, miplevel, internalformat.id, mipwidth, mipheight, GL_RGBA, GL_UNSIGNED_BYTE, data);
+				TexMgr_UploadLevel (glt, miplevel, internalformat, mipwidth, mipheight, data);
 			}
 		}
 	}
@@ -1467,6 +1541,368 @@ static void TexMgr_LoadLightmap (gltexture_t *glt, byte *data)
 	TexMgr_SetFilterModes (glt);
 }
 
+/*
+================================================================================
+
+	TEXTURE CACHE
+
+	Stores the final mip chain of 8-bit and mipmapped 32-bit textures under
+	<userdir>/texcache/, keyed by a hash of the source pixels and of all the
+	settings that affect processing, so later loads and vid_restart can upload
+	it directly without converting, padding, edge fixing and mipmapping again.
+
+	Block-compressed textures are always cached, since encoding them is much
+	more expensive than the rest of the processing; levels are then stored as
+	BC1/BC3/BC7 blocks instead of rgba pixels.
+
+================================================================================
+*/
+
+#define TEXCACHE_VERSION	3	// 3: fixed endpoints of blocks with anti-correlated channels
+#define TEXCACHE_MINPIXELS	(64*64)	// smaller textures are cheaper to process than to look up
+
+typedef struct
+{
+	unsigned	datahash;
+	unsigned	datacrc;
+	unsigned	datasize;
+	unsigned	palettehash;
+	unsigned	flags;
+	int			format;
+	int			width;
+	int			height;
+	int			picmip;
+	int			maxsize;
+	int			fullbrights;
+	int			compression;	// gl_compress_textures mode
+} texcachekey_t;
+
+typedef struct
+{
+	char			magic[4];
+	int				version;
+	texcachekey_t	key;
+	unsigned		flags;		// final flags (TEXPREF_ALPHA can be dropped during processing)
+	int				width;		// final size of mip level 0
+	int				height;
+	int				numlevels;
+	int				encoder;	// texcompformat_t of the stored levels
+} texcacheheader_t;
+
+typedef struct
+{
+	texcacheheader_t	header;
+	byte				*data;
+	size_t				size;
+	size_t				maxsize;
+} texcachewriter_t;
+
+static texcachewriter_t	*texcache_writer; // set while an upload is being recorded
+
+static struct
+{
+	int		hits;
+	int		misses;
+	int		writes;
+} texcache_stats;
+
+/*
+================
+TexMgr_CacheKey -- returns false if the texture shouldn't be cached
+================
+*/
+static qboolean TexMgr_CacheKey (gltexture_t *glt, const byte *data, texcachekey_t *key)
+{
+	extern cvar_t gl_fullbrights;
+	unsigned size;
+	int compression = TexMgr_CompressionMode (glt);
+
+	if (!(gl_texcache.value || (gl_texcache_compressed.value && compression)) || !data || glt->target != GL_TEXTURE_2D)
+		return false;
+	if (glt->source_format == SRC_LIGHTMAP)
+		return false;
+	if (glt->source_format == SRC_RGBA && !(glt->flags & TEXPREF_MIPMAP) && !compression)
+		return false;
+	// skins and other frequently overwritten textures would just litter the cache
+	if ((glt->flags & TEXPREF_OVERWRITE) || (glt->shirt > -1 && glt->pants > -1))
+		return false;
+	if (glt->width * glt->height < TEXCACHE_MINPIXELS)
+		return false;
+
+	size = glt->width * glt->height;
+	if (glt->source_format == SRC_RGBA)
+		size *= 4;
+
+	memset (key, 0, sizeof (*key));
+	key->datahash = COM_HashBlock (data, size);
+	key->datacrc = CRC_Block (data, size);
+	key->datasize = size;
+	key->flags = glt->flags;
+	key->format = glt->source_format;
+	key->width = glt->width;
+	key->height = glt->height;
+	key->picmip = (glt->flags & TEXPREF_NOPICMIP) ? 0 : q_max ((int)gl_picmip.value, 0);
+	key->maxsize = TexMgr_SafeTextureSize (1 << 30);
+	key->compression = compression;
+	if (glt->source_format == SRC_INDEXED)
+	{
+		key->palettehash = texmgr_palettehash;
+		key->fullbrights = gl_fullbrights.value != 0.f;
+	}
+
+	return true;
+}
+
+/*
+================
+TexMgr_CachePath
+================
+*/
+static void TexMgr_CachePath (const texcachekey_t *key, const char *ext, char *path, size_t pathsize)
+{
+	q_snprintf (path, pathsize, "%s/texcache/%08x.%s", host_parms->userdir, COM_HashBlock (key, sizeof (*key)), ext);
+}
+
+/*
+================
+TexMgr_CachedLevelSize
+================
+*/
+static size_t TexMgr_CachedLevelSize (int encoder, int width, int height)
+{
+	if (encoder == TEXCOMP_NONE)
+		return (size_t) width * height * 4;
+	return TexComp_Size ((texcompformat_t) encoder, width, height);
+}
+
+/*
+================
+TexMgr_LoadCached -- uploads a cached mip chain, returns false on a cache miss
+================
+*/
+static qboolean TexMgr_LoadCached (gltexture_t *glt, const texcachekey_t *key)
+{
+	char				path[MAX_OSPATH];
+	texcacheheader_t	header;
+	glformat_t			internalformat;
+	FILE				*f;
+	byte				*data, *level;
+	size_t				size;
+	long				start, end;
+	int					i, mark, width, height;
+
+	TexMgr_CachePath (key, "tex", path, sizeof (path));
+	f = Sys_fopen (path, "rb");
+	if (!f)
+		goto miss;
+
+	if (fread (&header, sizeof (header), 1, f) != 1 ||
+		memcmp (header.magic, "QTEX", 4) != 0 ||
+		header.version != TEXCACHE_VERSION ||
+		memcmp (&header.key, key, sizeof (*key)) != 0 ||
+		// processing can pad to a power of two (or a 4x4 block), but never past the size limit
+		header.width <= 0 || header.width > q_min (q_max (key->width * 2, 4), key->maxsize) ||
+		header.height <= 0 || header.height > q_min (q_max (key->height * 2, 4), key->maxsize) ||
+		header.numlevels <= 0 || header.numlevels > 32 ||
+		header.encoder < TEXCOMP_NONE || header.encoder > TEXCOMP_BC7 ||
+		// only TEXPREF_ALPHA may have been dropped during processing
+		(header.flags != glt->flags && header.flags != (glt->flags & ~TEXPREF_ALPHA)))
+	{
+		fclose (f);
+		goto miss;
+	}
+
+	// every level is half the size of the previous one (down to 1x1)
+	for (i = 0, size = 0, width = header.width, height = header.height; i < header.numlevels; i++)
+	{
+		size += TexMgr_CachedLevelSize (header.encoder, width, height);
+		width = q_max (width >> 1, 1);
+		height = q_max (height >> 1, 1);
+	}
+
+	// a truncated or padded file is a miss, not a bogus allocation
+	start = ftell (f);
+	if (start < 0 || fseek (f, 0, SEEK_END) != 0 || (end = ftell (f)) < start ||
+		(size_t) (end - start) != size || fseek (f, start, SEEK_SET) != 0)
+	{
+		fclose (f);
+		goto miss;
+	}
+
+	mark = Hunk_LowMark ();
+	data = (byte *) Hunk_AllocNoFill (size);
+	if (fread (data, 1, size, f) != size)
+	{
+		Hunk_FreeToLowMark (mark);
+		fclose (f);
+		goto miss;
+	}
+	fclose (f);
+
+	glt->flags &= header.flags;	// at most drops TEXPREF_ALPHA, see above
+	glt->width = header.width;
+	glt->height = header.height;
+
+	internalformat = TexMgr_UploadFormat (glt);
+	if ((int) internalformat.encoder != header.encoder)
+	{
+		Hunk_FreeToLowMark (mark);
+		goto miss;
+	}
+
+	GL_Bind (GL_TEXTURE0, glt);
+	for (i = 0, level = data, width = header.width, height = header.height; i < header.numlevels; i++)
+	{
+		size = TexMgr_CachedLevelSize (header.encoder, width, height);
+		if (header.encoder != TEXCOMP_NONE)
+			GL_CompressedTexImage2DFunc (glt->target, i, internalformat.id, width, height, 0, (GLsizei) size, level);
+		else
+			GL_TexImage (glt, i, internalformat.id, width, height, GL_RGBA, GL_UNSIGNED_BYTE, level);
+		level += size;
+		width = q_max (width >> 1, 1);
+		height = q_max (height >> 1, 1);
+	}
+	TexMgr_SetFilterModes (glt);
+
+	Hunk_FreeToLowMark (mark);
+	texcache_stats.hits++;
+	return true;
+
+miss:
+	texcache_stats.misses++;
+	return false;
+}
+
+/*
+================
+TexMgr_CacheLevel -- records an uploaded mip level, if a cache entry is being written
+================
+*/
+static void TexMgr_CacheLevel (int level, int width, int height, texcompformat_t encoder, const void *data, size_t size)
+{
+	texcachewriter_t *writer = texcache_writer;
+
+	if (!writer || level != writer->header.numlevels)
+		return;
+
+	if (level == 0)
+	{
+		writer->header.width = width;
+		writer->header.height = height;
+		writer->header.encoder = encoder;
+		writer->maxsize = size * 2 + 512; // enough for the whole chain, whatever the aspect ratio or block padding
+		writer->data = (byte *) malloc (writer->maxsize);
+		if (!writer->data)
+		{
+			texcache_writer = NULL;
+			return;
+		}
+	}
+	else if (writer->size + size > writer->maxsize || (int) encoder != writer->header.encoder)
+	{
+		texcache_writer = NULL;
+		return;
+	}
+
+	memcpy (writer->data + writer->size, data, size);
+	writer->size += size;
+	writer->header.numlevels++;
+}
+
+/*
+================
+TexMgr_WriteCached
+================
+*/
+static void TexMgr_WriteCached (gltexture_t *glt, texcachewriter_t *writer)
+{
+	static qboolean	madedir = false;
+	char			path[MAX_OSPATH];
+	char			temppath[MAX_OSPATH];
+	FILE			*f;
+	qboolean		ok;
+
+	if (!writer->data || !writer->header.numlevels)
+		return;
+
+	if (!madedir)
+	{
+		Sys_mkdir (va ("%s/texcache", host_parms->userdir));
+		madedir = true;
+	}
+
+	memcpy (writer->header.magic, "QTEX", 4);
+	writer->header.version = TEXCACHE_VERSION;
+	writer->header.flags = glt->flags;
+
+	// write to a temporary file first so a partially written entry is never picked up
+	TexMgr_CachePath (&writer->header.key, "tex", path, sizeof (path));
+	TexMgr_CachePath (&writer->header.key, "tmp", temppath, sizeof (temppath));
+	f = Sys_fopen (temppath, "wb");
+	if (!f)
+		return;
+	ok = fwrite (&writer->header, sizeof (writer->header), 1, f) == 1 &&
+		fwrite (writer->data, 1, writer->size, f) == writer->size;
+	ok = (fclose (f) == 0) && ok;
+
+	Sys_remove (path);
+	if (!ok || Sys_rename (temppath, path) != 0)
+	{
+		Sys_remove (temppath);
+		return;
+	}
+
+	texcache_stats.writes++;
+}
+
+/*
+================
+TexMgr_Upload -- processes and uploads source data, going through the cache when possible
+================
+*/
+static void TexMgr_Upload (gltexture_t *glt, byte *data)
+{
+	texcachewriter_t	writer;
+	qboolean			cache;
+
+	memset (&writer, 0, sizeof (writer));
+	cache = TexMgr_CacheKey (glt, data, &writer.header.key);
+	if (cache && TexMgr_LoadCached (glt, &writer.header.key))
+		return;
+	if (cache)
+		texcache_writer = &writer;
+
+	switch (glt->source_format)
+	{
+	case SRC_INDEXED:
+		TexMgr_LoadImage8 (glt, data);
+		break;
+	case SRC_LIGHTMAP:
+		TexMgr_LoadLightmap (glt, data);
+		break;
+	case SRC_RGBA:
+		TexMgr_LoadImage32 (glt, (unsigned *)data);
+		break;
+	}
+
+	if (cache && texcache_writer == &writer)
+		TexMgr_WriteCached (glt, &writer);
+	texcache_writer = NULL;
+	free (writer.data);
+}
+
+/*
+================
+TexMgr_TexCache_f
+================
+*/
+static void TexMgr_TexCache_f (void)
+{
+	Con_Printf ("texture cache: %s\n", gl_texcache.value ? "enabled" :
+		gl_texcache_compressed.value ? "compressed textures only" : "disabled");
+	Con_Printf ("%d hits, %d misses, %d writes\n", texcache_stats.hits, texcache_stats.misses, texcache_stats.writes);
+}
+
 /*
 ================
 TexMgr_LoadImageEx -- the one entry point for loading all textures
@@ -1538,18 +1974,7 @@ gltexture_t *TexMgr_LoadImageEx (qmodel_t *owner, const char *name, int width, i
 	//upload it
 	mark = Hunk_LowMark();
 
-	switch (glt->source_format)
-	{
-	case SRC_INDEXED:
-		TexMgr_LoadImage8 (glt, data);
-		break;
-	case SRC_LIGHTMAP:
-		TexMgr_LoadLightmap (glt, data);
-		break;
-	case SRC_RGBA:
-		TexMgr_LoadImage32 (glt, (unsigned *)data);
-		break;
-	}
+	TexMgr_Upload (glt, data);
 
 	GL_ObjectLabelFunc (GL_TEXTURE, glt->texnum, -1, glt->name);
 	if (flags & TEXPREF_BINDLESS && gl_bindless_able)
@@ -1701,18 +2126,7 @@ invalid:	Con_Printf ("TexMgr_ReloadImage: invalid source for %s\n", glt->name);
 	GL_DeleteTexture (glt);
 	glGenTextures (1, &glt->texnum);
 
-	switch (glt->source_format)
-	{
-	case SRC_INDEXED:
-		TexMgr_LoadImage8 (glt, data);
-		break;
-	case SRC_LIGHTMAP:
-		TexMgr_LoadLightmap (glt, data);
-		break;
-	case SRC_RGBA:
-		TexMgr_LoadImage32 (glt, (unsigned *)data);
-		break;
-	}
+	TexMgr_Upload (glt, data);
 
 	GL_ObjectLabelFunc (GL_TEXTURE, glt->texnum, -1, glt->name);
 	if (glt->flags & TEXPREF_BINDLESS && gl_bindless_able)
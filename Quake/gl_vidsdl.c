@@ -87,6 +87,7 @@ qboolean gl_buffer_storage_able = false;
 qboolean gl_multi_bind_able = false;
 qboolean gl_bindless_able = false;
 qboolean gl_clipcontrol_able = false;
+qboolean gl_texture_s3tc_able = false;
 float gl_max_anisotropy; //johnfitz
 int gl_stencilbits;
 
@@ -1095,6 +1096,11 @@ static void GL_CheckExtensions (void)
 		GL_FindExtension ("GL_ARB_clip_control") &&
 		GL_InitFunctions (gl_arb_clip_control_functions, false)
 	;
+
+	gl_texture_s3tc_able =
+		!COM_CheckParm ("-nos3tc") &&
+		GL_FindExtension ("GL_EXT_texture_compression_s3tc")
+	;
 }
 
 /*
@@ -312,7 +312,7 @@ void Host_WriteConfigurationToFile (const char *name)
 	{
 		char fullname[MAX_OSPATH];
 		q_snprintf (fullname, sizeof (fullname), "%s/%s", com_gamedir, name);
-		f = Sys_fopen (fullname, "w");
+		f = COM_CreateFile (fullname, "w");
 		if (!f)
 		{
 			Con_Printf ("Couldn't write %s.\n", name);
@@ -651,6 +651,7 @@ void Host_ClearMemory (void)
 	}
 
 	Con_DPrintf ("Clearing memory\n");
+	COM_FlushDirCache ();
 	Mod_ClearAll ();
 	Sky_ClearAll();
 	PR_ClearProgs(&sv.qcvm);
@@ -670,20 +671,23 @@ void Host_ClearMemory (void)
 //
 //==============================================================================
 
+// Bounded multi-producer/single-consumer ring: producers claim a slot by
+// advancing the tail with a CAS and publish it through the slot's sequence
+// number, the main thread consumes in order without taking any lock.
+
 typedef struct asyncproc_s
 {
+	SDL_atomic_t		sequence;	// == index when free, index + 1 when ready to run
 	void				(*func) (void *param);
 	void				*param;
 } asyncproc_t;
 
 typedef struct asyncqueue_s
 {
-	size_t				head;
-	size_t				tail;
-	size_t				capacity;
-	qboolean			teardown;
-	SDL_mutex			*mutex;
-	SDL_cond			*notfull;
+	SDL_atomic_t		tail;		// next slot claimed by producers
+	unsigned			head;		// next slot to run, main thread only
+	unsigned			capacity;
+	SDL_atomic_t		teardown;
 	asyncproc_t			*procs;
 } asyncqueue_t;
 
@@ -691,6 +695,8 @@ static asyncqueue_t		async_queue;
 
 static void AsyncQueue_Init (asyncqueue_t *queue, size_t capacity)
 {
+	size_t i;
+
 	memset (queue, 0, sizeof (*queue));
 
 	if (!capacity)
@@ -698,66 +704,87 @@ static void AsyncQueue_Init (asyncqueue_t *queue, size_t capacity)
 	else
 		capacity = Q_nextPow2 (capacity);
 	queue->capacity = capacity;
-	capacity *= sizeof (queue->procs[0]);
-	queue->procs = (asyncproc_t *) malloc (capacity);
+	queue->procs = (asyncproc_t *) calloc (capacity, sizeof (queue->procs[0]));
 	if (!queue->procs)
-		Sys_Error ("AsyncQueue_Init: malloc failed on %" SDL_PRIu64 " bytes", (uint64_t) capacity);
-
-	queue->mutex = SDL_CreateMutex ();
-	if (!queue->mutex)
-		Sys_Error ("AsyncQueue_Init: could not create mutex");
+		Sys_Error ("AsyncQueue_Init: malloc failed on %" SDL_PRIu64 " bytes", (uint64_t) (capacity * sizeof (queue->procs[0])));
 
-	queue->notfull = SDL_CreateCond ();
-	if (!queue->notfull)
-		Sys_Error ("AsyncQueue_Init: could not create condition variable");
+	for (i = 0; i < capacity; i++)
+		SDL_AtomicSet (&queue->procs[i].sequence, (int) i);
 }
 
 static void AsyncQueue_Push (asyncqueue_t *queue, void (*func) (void *param), void *param)
 {
-	asyncproc_t *proc;
+	asyncproc_t	*proc;
+	unsigned	pos;
+	int			diff;
 
-	if (!queue->mutex)
+	if (!queue->procs)
 		return;
-	SDL_LockMutex (queue->mutex);
-	while (!queue->teardown && queue->tail - queue->head >= queue->capacity)
-		SDL_CondWait (queue->notfull, queue->mutex);
 
-	if (!queue->teardown)
+	for (;;)
 	{
-		proc = &queue->procs[(queue->tail++) & (queue->capacity - 1)];
-		proc->func = func;
-		proc->param = param;
+		if (SDL_AtomicGet (&queue->teardown))
+			return;
+
+		pos = (unsigned) SDL_AtomicGet (&queue->tail);
+		proc = &queue->procs[pos & (queue->capacity - 1)];
+		diff = (int) ((unsigned) SDL_AtomicGet (&proc->sequence) - pos);
+		if (diff == 0)
+		{
+			if (SDL_AtomicCAS (&queue->tail, (int) pos, (int) (pos + 1)))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// the ring is full, give the main thread a chance to catch up
+			SDL_Delay (1);
+		}
+		// otherwise another producer claimed the slot first, try again
 	}
 
-	SDL_UnlockMutex (queue->mutex);
+	proc->func = func;
+	proc->param = param;
+	SDL_AtomicSet (&proc->sequence, (int) (pos + 1));
 }
 
 static void AsyncQueue_Drain (asyncqueue_t *queue)
 {
-	SDL_LockMutex (queue->mutex);
-	while (queue->head != queue->tail)
+	unsigned end;
+
+	if (!queue->procs)
+		return;
+
+	// only run what was queued so far, callbacks that queue more work
+	// (directly or not) will have it run on the next frame
+	end = (unsigned) SDL_AtomicGet (&queue->tail);
+	while (queue->head != end)
 	{
-		asyncproc_t *proc = &queue->procs[(queue->head++) & (queue->capacity - 1)];
-		proc->func (proc->param);
-		SDL_CondSignal (queue->notfull);
+		asyncproc_t	*proc = &queue->procs[queue->head & (queue->capacity - 1)];
+		void		(*func) (void *param);
+		void		*param;
+
+		if ((unsigned) SDL_AtomicGet (&proc->sequence) != queue->head + 1)
+			break; // claimed, but not published yet
+
+		// free the slot before running the callback
+		func = proc->func;
+		param = proc->param;
+		SDL_AtomicSet (&proc->sequence, (int) (queue->head + queue->capacity));
+		queue->head++;
+
+		func (param);
 	}
-	SDL_UnlockMutex (queue->mutex);
 }
 
 static void AsyncQueue_Destroy (asyncqueue_t *queue)
 {
-	if (!queue->mutex)
+	if (!queue->procs)
 		return;
 
-	SDL_LockMutex (queue->mutex);
-	queue->teardown = true;
-	SDL_UnlockMutex (queue->mutex);
-	SDL_CondBroadcast (queue->notfull);
-
+	SDL_AtomicSet (&queue->teardown, 1);
 	AsyncQueue_Drain (queue);
 
-	SDL_DestroyCond (queue->notfull);
-	SDL_DestroyMutex (queue->mutex);
+	free (queue->procs);
 	memset (queue, 0, sizeof (*queue));
 }
 
@@ -1406,6 +1433,7 @@ void Host_Init (void)
 		Key_Init ();
 		Con_Init ();
 	}
+	Tasks_Init ();
 	PR_Init ();
 	Mod_Init ();
 	NET_Init ();
@@ -1501,14 +1529,15 @@ void Host_Shutdown(void)
 
 	Steam_Shutdown ();
 
+	// mod downloads can still post completions, stop them first
+	// (this also stops them before shutting down networking)
+	Tasks_Shutdown ();
+	Modlist_ShutDown ();
 	AsyncQueue_Destroy (&async_queue);
 
 	Host_ShutdownSave ();
 	Host_WriteConfiguration ();
 
-// stop downloads before shutting down networking
-	Modlist_ShutDown ();
-
 	NET_Shutdown ();
 
 	if (cls.state != ca_dedicated)
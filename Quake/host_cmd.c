@@ -1975,6 +1975,10 @@ static void Host_Map_f (void)
 	CL_Disconnect ();
 	Host_ShutdownServer(false);
 
+	// files may have been added since the last lookup (e.g. a freshly compiled map),
+	// only changelevel is allowed to rely on previously cached misses
+	COM_FlushFileCaches ();
+
 	if (cls.state != ca_dedicated)
 		IN_Activate();
 	key_dest = key_game;			// remove console or menu
@@ -2443,7 +2447,7 @@ static void Host_Savegame_f (void)
 		SDL_UnlockMutex (save_mutex);
 	}
 
-	f = Sys_fopen (name, "w");
+	f = COM_CreateFile (name, "w");
 	if (!f)
 	{
 		Con_Printf ("ERROR: couldn't open.\n");
@@ -3076,6 +3080,7 @@ static void Host_Spawn_f (void)
 		ent = host_client->edict;
 
 		memset (&ent->v, 0, qcvm->progs->entityfields * 4);
+		ED_MarkFindDirty (ent);
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = (host_client->colors & 15) + 1;
 		ent->v.netname = PR_SetEngineString(host_client->name);
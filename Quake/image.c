@@ -154,6 +154,60 @@ byte *Image_LoadImage (const char *name, int *width, int *height, enum srcformat
 	return NULL;
 }
 
+/*
+============
+Image_DecodeImage -- thread-safe version of Image_LoadImage
+
+doesn't touch the hunk or the console, so it can run on worker threads.
+returns malloc'ed RGBA data, or NULL with *deferred set to true if the image
+exists but has to go through Image_LoadImage on the main thread instead
+(pcx/lmp files, decoding errors and format warnings)
+============
+*/
+byte *Image_DecodeImage (const char *name, int *width, int *height, enum srcformat *fmt, qboolean *deferred)
+{
+	static const char *const stbi_formats[] = {"png", "tga", "jpg", NULL};
+	static const char *const other_formats[] = {"pcx", "lmp", NULL};
+	char	path[MAX_OSPATH];
+	FILE	*f;
+	int		i;
+
+	*deferred = false;
+
+	for (i = 0; stbi_formats[i]; i++)
+	{
+		const char *ext = stbi_formats[i];
+		q_snprintf (path, sizeof(path), "%s.%s", name, ext);
+		COM_FOpenFile (path, &f, NULL);
+		if (f)
+		{
+			byte *data = NULL;
+			if ((developer.value || map_checks.value) && strcmp (ext, "tga") != 0)
+				*deferred = true;
+			else if ((data = stbi_load_from_file (f, width, height, NULL, 4)) != NULL)
+				*fmt = SRC_RGBA;
+			else
+				*deferred = true;
+			fclose (f);
+			return data;
+		}
+	}
+
+	for (i = 0; other_formats[i]; i++)
+	{
+		q_snprintf (path, sizeof(path), "%s.%s", name, other_formats[i]);
+		COM_FOpenFile (path, &f, NULL);
+		if (f)
+		{
+			fclose (f);
+			*deferred = true;
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
 //==============================================================================
 //
 //  TGA
@@ -180,7 +234,7 @@ qboolean Image_WriteTGA (const char *name, byte *data, int width, int height, in
 	qboolean ret;
 
 	q_snprintf (pathname, sizeof(pathname), "%s/%s", com_gamedir, name);
-	file = Sys_fopen (pathname, "wb");
+	file = COM_CreateFile (pathname, "wb");
 	if (!file)
 		return false;
 
@@ -399,6 +453,11 @@ byte* Image_CopyFlipped (const void *src, int width, int height, int bpp)
 	return flipped;
 }
 
+static void Image_WriteToFile (void *context, void *data, int size)
+{
+	fwrite (data, 1, size, (FILE *) context);
+}
+
 /*
 ============
 Image_WriteJPG -- writes using stb_image_write
@@ -412,6 +471,7 @@ qboolean Image_WriteJPG (const char *name, byte *data, int width, int height, in
 	char	pathname[MAX_OSPATH];
 	byte	*flipped;
 	int	bytes_per_pixel;
+	FILE	*file;
 
 	if (!(bpp == 32 || bpp == 24))
 		Sys_Error ("bpp not 24 or 32");
@@ -429,7 +489,14 @@ qboolean Image_WriteJPG (const char *name, byte *data, int width, int height, in
 	else
 		flipped = data;
 
-	error = stbi_write_jpg (pathname, width, height, bytes_per_pixel, flipped, quality);
+	file = COM_CreateFile (pathname, "wb");
+	if (file)
+	{
+		error = stbi_write_jpg_to_func (Image_WriteToFile, file, width, height, bytes_per_pixel, flipped, quality);
+		fclose (file);
+	}
+	else
+		error = 0;
 	if (!upsidedown)
 		free (flipped);
 
@@ -482,7 +549,7 @@ qboolean Image_WritePNG (const char *name, byte *data, int width, int height, in
 
 	error = lodepng_encode (&png, &pngsize, flipped, width, height, &state);
 	if (error == 0)
-		error = lodepng_save_file (png, pngsize, pathname);
+		error = COM_WriteFile_OSPath (pathname, png, pngsize) ? 0 : 79; /* lodepng's "failed to open file for writing" */
 #ifdef LODEPNG_COMPILE_ERROR_TEXT
 	else Con_Printf("WritePNG: %s\n", lodepng_error_text (error));
 #endif
@@ -29,6 +29,9 @@ enum srcformat;
 //be sure to free the hunk after using this loading function
 byte *Image_LoadImage (const char *name, int *width, int *height, enum srcformat *fmt);
 
+//thread-safe, returns malloc'ed data (see comments in image.c)
+byte *Image_DecodeImage (const char *name, int *width, int *height, enum srcformat *fmt, qboolean *deferred);
+
 byte* Image_CopyFlipped (const void *src, int width, int height, int bpp);
 
 qboolean Image_WriteTGA (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown);
@@ -974,44 +974,7 @@ findradius (origin, radius)
 */
 static void PF_findradius (void)
 {
-	edict_t	*ent, *chain;
-	float	rad;
-	float	*org;
-	int		i;
-
-	chain = (edict_t *)qcvm->edicts;
-
-	org = G_VECTOR(OFS_PARM0);
-	rad = G_FLOAT(OFS_PARM1);
-	rad *= rad;
-
-	ent = NEXT_EDICT(qcvm->edicts);
-	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
-	{
-		float d, lensq;
-		if (ent->free)
-			continue;
-		if (ent->v.solid == SOLID_NOT)
-			continue;
-
-		d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
-		lensq = d * d;
-		if (lensq > rad)
-			continue;
-		d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
-		lensq += d * d;
-		if (lensq > rad)
-			continue;
-		d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
-		lensq += d * d;
-		if (lensq > rad)
-			continue;
-
-		ent->v.chain = EDICT_TO_PROG(chain);
-		chain = ent;
-	}
-
-	RETURN_EDICT(chain);
+	RETURN_EDICT(SV_FindRadius (G_VECTOR(OFS_PARM0), G_FLOAT(OFS_PARM1)));
 }
 
 /*
@@ -1072,10 +1035,12 @@ static void PF_Remove (void)
 }
 
 
+cvar_t	sv_find_index = {"sv_find_index", "1", CVAR_NONE}; // 0 = linear scan, 2 = compare both
+
 // entity (entity start, .string field, string match) find = #5;
 static void PF_Find (void)
 {
-	int		e;
+	int		e, i;
 	int		f;
 	const char	*s, *t;
 	edict_t	*ed;
@@ -1086,6 +1051,13 @@ static void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	i = sv_find_index.value ? ED_FindIndexed (e, f, s) : -1;
+	if (i >= 0 && sv_find_index.value < 2.f)
+	{
+		RETURN_EDICT(EDICT_NUM(i));
+		return;
+	}
+
 	for (e++ ; e < qcvm->num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
@@ -1095,13 +1067,15 @@ static void PF_Find (void)
 		if (!t)
 			continue;
 		if (!strcmp(t,s))
-		{
-			RETURN_EDICT(ed);
-			return;
-		}
+			break;
 	}
+	if (e == qcvm->num_edicts)
+		e = 0;
+
+	if (i >= 0 && i != e)
+		Con_Warning ("find index mismatch for \"%s\": entity %d vs %d\n", s, i, e);
 
-	RETURN_EDICT(qcvm->edicts);
+	RETURN_EDICT(EDICT_NUM(e));
 }
 
 static void PR_CheckEmptyString (const char *s)
@@ -184,6 +184,8 @@ void ED_ClearEdict (edict_t *e)
 	else
 		ED_RemoveFromFreeList (e);
 	memset (&e->v, 0, qcvm->progs->entityfields * 4);
+	SV_MarkEdictMoved (e);
+	ED_MarkFindDirty (e);
 }
 
 /*
@@ -221,6 +223,8 @@ edict_t *ED_Alloc (void)
 	e = EDICT_NUM(qcvm->num_edicts++);
 	memset(e, 0, qcvm->edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
 	e->baseline.scale = ENTSCALE_DEFAULT;
+	SV_MarkEdictMoved (e);
+	ED_MarkFindDirty (e);
 
 	return e;
 }
@@ -252,6 +256,7 @@ void ED_Free (edict_t *ed)
 	ed->scale = ENTSCALE_DEFAULT;
 
 	ed->freetime = qcvm->time;
+	ED_MarkFindDirty (ed);
 }
 
 //===========================================================================
@@ -1414,6 +1419,11 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 
 	if (!init)
 		ED_Free (ent);
+	else
+	{
+		SV_MarkEdictMoved (ent);
+		ED_MarkFindDirty (ent);
+	}
 
 	return data;
 }
@@ -1646,6 +1656,10 @@ void PR_ClearProgs(qcvm_t *vm)
 
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
+	if (qcvm->knownhunk)
+		Z_Free (qcvm->knownhunk);
+	PR_JitShutdown (qcvm);
+	PR_ProfileShutdown (qcvm);
 	free(qcvm->edicts); // ericw -- sv.edicts switched to use malloc()
 	if (qcvm->fielddefs != (ddef_t *)((byte *)qcvm->progs + qcvm->progs->ofs_fielddefs))
 		free(qcvm->fielddefs);
@@ -2090,6 +2104,369 @@ static void PR_FillOffsetTables (void)
 	}
 }
 
+/*
+===============================================================================
+
+STRING FIELD INDEX
+
+Hash tables of the string fields most commonly searched with find(), so that
+iterating over the matches of a search doesn't scan every edict each time.
+Buckets are kept sorted by edict number. Writes to the indexed fields are
+reported through ED_FieldWatched and the edicts are reindexed lazily on the
+next query. Strings whose text can change without the field being written
+(temp strings, zoned strings, engine buffers) can't be hashed up front, so
+edicts holding them go in a separate bucket that every query checks.
+
+===============================================================================
+*/
+
+#define	FIND_MAX_FIELDS		3
+#define	FIND_NUM_BUCKETS	4096				// must be a power of two
+#define	FIND_VOLATILE		FIND_NUM_BUCKETS	// edicts with mutable strings, always checked
+
+static const char *const findfieldnames[FIND_MAX_FIELDS] = {"classname", "targetname", "target"};
+
+typedef struct
+{
+	int			ofs;
+	int			*bucket;			// bucket of each edict, -1 if not indexed
+	int			*next;
+	int			*prev;
+	int			heads[FIND_NUM_BUCKETS + 1];
+	int			tails[FIND_NUM_BUCKETS + 1];
+} findfield_t;
+
+static struct
+{
+	int			maxedicts;			// size of the per-edict arrays
+	int			numfields;
+	findfield_t	fields[FIND_MAX_FIELDS];
+	byte		*dirty;
+	int			*dirtylist;
+	int			numdirty;
+	qboolean	rebuild;			// reindex everything on the next query
+} sv_find;
+
+/*
+===============
+ED_InitFindIndex -- picks the indexed fields once the progs are loaded
+===============
+*/
+static void ED_InitFindIndex (void)
+{
+	ddef_t	*def;
+	int		i;
+
+	sv_find.numfields = 0;
+	for (i = 0; i < FIND_MAX_FIELDS; i++)
+	{
+		def = ED_FindField (findfieldnames[i]);
+		if (!def || (def->type & ~DEF_SAVEGLOBAL) != ev_string || def->ofs >= qcvm->progs->entityfields)
+			continue;
+		sv_find.fields[sv_find.numfields++].ofs = def->ofs;
+		qcvm->fieldwatch[def->ofs] |= FIELDWATCH_FIND;
+	}
+	sv_find.rebuild = true;
+}
+
+/*
+===============
+ED_ClearFindIndex
+===============
+*/
+static void ED_ClearFindIndex (void)
+{
+	findfield_t	*f;
+	int			i, j;
+
+	if (sv_find.maxedicts < qcvm->max_edicts)
+	{
+		for (i = 0; i < FIND_MAX_FIELDS; i++)
+		{
+			f = &sv_find.fields[i];
+			free (f->bucket);
+			free (f->next);
+			free (f->prev);
+			f->bucket = (int *) malloc (qcvm->max_edicts * sizeof (int));
+			f->next = (int *) malloc (qcvm->max_edicts * sizeof (int));
+			f->prev = (int *) malloc (qcvm->max_edicts * sizeof (int));
+			if (!f->bucket || !f->next || !f->prev)
+				Sys_Error ("ED_ClearFindIndex: out of memory (%d edicts)", qcvm->max_edicts);
+		}
+		free (sv_find.dirty);
+		free (sv_find.dirtylist);
+
+		sv_find.maxedicts = qcvm->max_edicts;
+		sv_find.dirty = (byte *) malloc (sv_find.maxedicts);
+		sv_find.dirtylist = (int *) malloc (sv_find.maxedicts * sizeof (int));
+		if (!sv_find.dirty || !sv_find.dirtylist)
+			Sys_Error ("ED_ClearFindIndex: out of memory (%d edicts)", sv_find.maxedicts);
+	}
+
+	for (i = 0; i < sv_find.numfields; i++)
+	{
+		f = &sv_find.fields[i];
+		for (j = 0; j < sv_find.maxedicts; j++)
+			f->bucket[j] = -1;
+		for (j = 0; j <= FIND_NUM_BUCKETS; j++)
+			f->heads[j] = f->tails[j] = -1;
+	}
+	memset (sv_find.dirty, 0, sv_find.maxedicts);
+	sv_find.numdirty = 0;
+}
+
+/*
+===============
+ED_MarkFindDirty
+===============
+*/
+void ED_MarkFindDirty (edict_t *ed)
+{
+	int num;
+
+	if (qcvm != &sv.qcvm || !sv_find.dirty || sv_find.rebuild)
+		return;
+
+	num = ((byte *)ed - (byte *)qcvm->edicts) / qcvm->edict_size;
+	if (num <= 0 || num >= sv_find.maxedicts || sv_find.dirty[num])
+		return;
+
+	sv_find.dirty[num] = true;
+	sv_find.dirtylist[sv_find.numdirty++] = num;
+}
+
+/*
+===============
+ED_FindBucket
+===============
+*/
+static int ED_FindBucket (string_t num)
+{
+	const char *str;
+
+	if (num >= 0 && num < qcvm->stringssize)
+		str = qcvm->strings + num;
+	else if (num < 0 && num >= -qcvm->numknownstrings && qcvm->knownhunk[-1 - num])
+		str = qcvm->knownstrings[-1 - num];
+	else
+		return FIND_VOLATILE;
+
+	return COM_HashString (str) & (FIND_NUM_BUCKETS - 1);
+}
+
+/*
+===============
+ED_ReindexFind
+===============
+*/
+static void ED_ReindexFind (findfield_t *f, int num)
+{
+	edict_t	*ed;
+	int		pos, bucket = -1;
+	int		old = f->bucket[num];
+
+	if (num < qcvm->num_edicts)
+	{
+		ed = EDICT_NUM (num);
+		if (!ed->free)
+			bucket = ED_FindBucket (((string_t *)&ed->v)[f->ofs]);
+	}
+
+	if (bucket == old)
+		return;
+
+	if (old != -1)
+	{
+		if (f->prev[num] != -1)
+			f->next[f->prev[num]] = f->next[num];
+		else
+			f->heads[old] = f->next[num];
+		if (f->next[num] != -1)
+			f->prev[f->next[num]] = f->prev[num];
+		else
+			f->tails[old] = f->prev[num];
+	}
+
+	f->bucket[num] = bucket;
+	if (bucket == -1)
+		return;
+
+	// keep the bucket sorted, edicts are mostly (re)indexed in increasing order
+	for (pos = f->tails[bucket]; pos > num; pos = f->prev[pos])
+		;
+	f->prev[num] = pos;
+	if (pos != -1)
+	{
+		f->next[num] = f->next[pos];
+		f->next[pos] = num;
+	}
+	else
+	{
+		f->next[num] = f->heads[bucket];
+		f->heads[bucket] = num;
+	}
+	if (f->next[num] != -1)
+		f->prev[f->next[num]] = num;
+	else
+		f->tails[bucket] = num;
+}
+
+/*
+===============
+ED_RefreshFindIndex
+===============
+*/
+static void ED_RefreshFindIndex (void)
+{
+	int i, j, num;
+
+	if (sv_find.rebuild)
+	{
+		ED_ClearFindIndex ();
+		for (num = 1; num < qcvm->num_edicts; num++)
+			for (j = 0; j < sv_find.numfields; j++)
+				ED_ReindexFind (&sv_find.fields[j], num);
+		sv_find.rebuild = false;
+		return;
+	}
+
+	for (i = 0; i < sv_find.numdirty; i++)
+	{
+		num = sv_find.dirtylist[i];
+		sv_find.dirty[num] = false;
+		for (j = 0; j < sv_find.numfields; j++)
+			ED_ReindexFind (&sv_find.fields[j], num);
+	}
+	sv_find.numdirty = 0;
+}
+
+/*
+===============
+ED_FindInBucket -- returns the first match after start, or limit if there's none before it
+===============
+*/
+static int ED_FindInBucket (findfield_t *f, int bucket, int start, const char *s, int limit)
+{
+	edict_t		*ed;
+	const char	*t;
+	int			num;
+
+	// find (e, ...) loops start right where the previous match left off
+	if (start > 0 && f->bucket[start] == bucket)
+		num = f->next[start];
+	else
+		for (num = f->heads[bucket]; num != -1 && num <= start; num = f->next[num])
+			;
+
+	for ( ; num != -1 && num < limit; num = f->next[num])
+	{
+		ed = EDICT_NUM (num);
+		if (ed->free)
+			continue;
+		t = E_STRING (ed, f->ofs);
+		if (t && !strcmp (t, s))
+			return num;
+	}
+
+	return limit;
+}
+
+/*
+===============
+ED_FindIndexed
+
+Returns the number of the first edict after start whose field at ofs matches s,
+0 if there's none, or -1 if the field isn't indexed
+===============
+*/
+int ED_FindIndexed (int start, int ofs, const char *s)
+{
+	findfield_t	*f;
+	int			i, num;
+
+	if (qcvm != &sv.qcvm)
+		return -1;
+
+	for (i = 0; i < sv_find.numfields; i++)
+		if (sv_find.fields[i].ofs == ofs)
+			break;
+	if (i == sv_find.numfields)
+		return -1;
+	f = &sv_find.fields[i];
+
+	ED_RefreshFindIndex ();
+
+	num = ED_FindInBucket (f, COM_HashString (s) & (FIND_NUM_BUCKETS - 1), start, s, qcvm->num_edicts);
+	num = ED_FindInBucket (f, FIND_VOLATILE, start, s, num);
+
+	return num < qcvm->num_edicts ? num : 0;
+}
+
+/*
+===============
+PR_InitFieldWatch
+===============
+*/
+static void PR_InitFieldWatch (void)
+{
+	static const int boundsfields[] =
+	{
+		offsetof (entvars_t, origin) / 4 + 0,
+		offsetof (entvars_t, origin) / 4 + 1,
+		offsetof (entvars_t, origin) / 4 + 2,
+		offsetof (entvars_t, mins) / 4 + 0,
+		offsetof (entvars_t, mins) / 4 + 1,
+		offsetof (entvars_t, mins) / 4 + 2,
+		offsetof (entvars_t, maxs) / 4 + 0,
+		offsetof (entvars_t, maxs) / 4 + 1,
+		offsetof (entvars_t, maxs) / 4 + 2,
+		offsetof (entvars_t, solid) / 4,
+	};
+	static const int clipfields[] =
+	{
+		offsetof (entvars_t, absmin) / 4 + 0,
+		offsetof (entvars_t, absmin) / 4 + 1,
+		offsetof (entvars_t, absmin) / 4 + 2,
+		offsetof (entvars_t, absmax) / 4 + 0,
+		offsetof (entvars_t, absmax) / 4 + 1,
+		offsetof (entvars_t, absmax) / 4 + 2,
+		offsetof (entvars_t, size) / 4 + 0,
+		offsetof (entvars_t, modelindex) / 4,
+		offsetof (entvars_t, movetype) / 4,
+		offsetof (entvars_t, flags) / 4,
+		offsetof (entvars_t, owner) / 4,
+	};
+	int i;
+
+	qcvm->fieldwatch = (byte *) Hunk_AllocName (qcvm->progs->entityfields, "fieldwatch");
+
+	if (qcvm == &sv.qcvm)
+	{
+		for (i = 0; i < (int) Q_COUNTOF (boundsfields); i++)
+			qcvm->fieldwatch[boundsfields[i]] |= FIELDWATCH_BOUNDS;
+		for (i = 0; i < (int) Q_COUNTOF (clipfields); i++)
+			qcvm->fieldwatch[clipfields[i]] |= FIELDWATCH_CLIP;
+		ED_InitFindIndex ();
+	}
+}
+
+/*
+===============
+ED_FieldWatched -- called by the interpreter before a watched field is written
+===============
+*/
+void ED_FieldWatched (edict_t *ed, int ofs)
+{
+	// the write itself hasn't happened yet, but the index only looks
+	// at the new value once it's queried, after the store is done
+	if (qcvm->fieldwatch[ofs] & FIELDWATCH_BOUNDS)
+		SV_MarkEdictMoved (ed);
+	if (qcvm->fieldwatch[ofs] & FIELDWATCH_FIND)
+		ED_MarkFindDirty (ed);
+	if (qcvm->fieldwatch[ofs] & FIELDWATCH_CLIP)
+		SV_NoteClipChange (ed);
+}
+
 /*
 ===============
 PR_LoadProgs
@@ -2173,7 +2550,10 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal)
 	qcvm->stringssize = qcvm->progs->numstrings;
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
+	if (qcvm->knownhunk)
+		Z_Free (qcvm->knownhunk);
 	qcvm->knownstrings = NULL;
+	qcvm->knownhunk = NULL;
 	qcvm->firstfreeknownstring = NULL;
 	PR_SetEngineString("");
 
@@ -2245,6 +2625,9 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal)
 	PR_FindEntityFields ();
 	PR_FindFunctionRanges ();
 	PR_FillOffsetTables ();
+	PR_InitFieldWatch ();
+	PR_InitDirectExec ();
+	PR_JitInit ();
 
 	qcvm->effects_mask = PR_FindSupportedEffects ();
 
@@ -2270,6 +2653,9 @@ PR_Init
 */
 void PR_Init (void)
 {
+	extern	cvar_t	pr_directexec;
+	extern	cvar_t	pr_jit;
+	extern	cvar_t	pr_jit_threshold;
 	cmd_function_t *cmd;
 
 	cmd = Cmd_AddCommand ("edict", ED_PrintEdict_f);
@@ -2278,6 +2664,9 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_bench", PR_Bench_f);
+	Cmd_AddCommand ("pr_jitstats", PR_JitStats_f);
+	Cmd_AddCommand ("pr_profile", PR_TimeProfile_f);
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_SetCallback (&nomonsters, ED_Nomonsters_f);
 	Cvar_RegisterVariable (&gamecfg);
@@ -2290,6 +2679,9 @@ void PR_Init (void)
 	Cvar_RegisterVariable (&saved2);
 	Cvar_RegisterVariable (&saved3);
 	Cvar_RegisterVariable (&saved4);
+	Cvar_RegisterVariable (&pr_directexec);
+	Cvar_RegisterVariable (&pr_jit);
+	Cvar_RegisterVariable (&pr_jit_threshold);
 }
 
 
@@ -2352,9 +2744,11 @@ static int PR_AllocStringSlot (void)
 			qcvm->maxknownstrings += PR_STRING_ALLOCSLOTS;
 			Con_DPrintf2 ("PR_AllocStringSlot: realloc'ing for %d slots\n", qcvm->maxknownstrings);
 			qcvm->knownstrings = (const char **) Z_Realloc ((void *)qcvm->knownstrings, qcvm->maxknownstrings * sizeof(char *));
+			qcvm->knownhunk = (unsigned char *) Z_Realloc (qcvm->knownhunk, qcvm->maxknownstrings);
 		}
 	}
 
+	qcvm->knownhunk[i] = false;
 	return (int)i;
 }
 
@@ -2393,6 +2787,7 @@ void PR_ClearEngineString (int num)
 	if (num < 0 && num >= -qcvm->numknownstrings)
 	{
 		num = -1 - num;
+		qcvm->knownhunk[num] = false;
 		qcvm->knownstrings[num] = (const char*) qcvm->firstfreeknownstring;
 		qcvm->firstfreeknownstring = &qcvm->knownstrings[num];
 	}
@@ -2431,6 +2826,7 @@ int PR_AllocString (int size, char **ptr)
 		return 0;
 	i = PR_AllocStringSlot ();
 	qcvm->knownstrings[i] = (char *)Hunk_AllocName(size, "string");
+	qcvm->knownhunk[i] = true;
 	if (ptr)
 		*ptr = (char *) qcvm->knownstrings[i];
 	return -1 - i;
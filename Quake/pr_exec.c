@@ -319,6 +319,8 @@ static int PR_EnterFunction (dfunction_t *f)
 	}
 
 	qcvm->xfunction = f;
+	if (qcvm->profiler)
+		PR_ProfileEnter (f);
 	return f->first_statement - 1;	// offset the s++
 }
 
@@ -334,6 +336,9 @@ static int PR_LeaveFunction (void)
 	if (qcvm->depth <= 0)
 		Host_Error("prog stack underflow");
 
+	if (qcvm->profiler)
+		PR_ProfileLeave ();
+
 	// Restore locals from the stack
 	c = qcvm->xfunction->locals;
 	qcvm->localstack_used -= c;
@@ -383,40 +388,26 @@ static void PR_CheckBuiltinExtension (dfunction_t *func)
 
 /*
 ====================
-PR_ExecuteProgram
+PR_ExecuteSwitch
 
-The interpretation main loop
+The interpretation main loop, used when statement tracing is on.
+Runs until the function at exitdepth returns, starting after statement s.
 ====================
 */
 #define OPA ((eval_t *)&qcvm->globals[(unsigned short)st->a])
 #define OPB ((eval_t *)&qcvm->globals[(unsigned short)st->b])
 #define OPC ((eval_t *)&qcvm->globals[(unsigned short)st->c])
 
-void PR_ExecuteProgram (func_t fnum)
+static void PR_ExecuteSwitch (int s, int exitdepth, int profile)
 {
 	eval_t		*ptr;
 	dstatement_t	*st;
-	dfunction_t	*f, *newf;
-	int profile, startprofile;
+	dfunction_t	*newf;
+	int startprofile;
 	edict_t		*ed;
-	int		exitdepth;
 
-	if (!fnum || fnum >= qcvm->progs->numfunctions)
-	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
-	}
-
-	f = &qcvm->functions[fnum];
-
-	qcvm->trace = false;
-
-// make a stack frame
-	exitdepth = qcvm->depth;
-
-	st = &qcvm->statements[PR_EnterFunction(f)];
-	startprofile = profile = 0;
+	st = &qcvm->statements[s];
+	startprofile = profile;
 
     while (1)
     {
@@ -592,6 +583,8 @@ void PR_ExecuteProgram (func_t fnum)
 			PR_RunError("assignment to world entity");
 		}
 		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		if ((unsigned) OPB->_int < (unsigned) qcvm->progs->entityfields && qcvm->fieldwatch[OPB->_int])
+			ED_FieldWatched (ed, OPB->_int);
 		break;
 
 	case OP_LOAD_F:
@@ -653,7 +646,11 @@ void PR_ExecuteProgram (func_t fnum)
 			if (i >= qcvm->numbuiltins)
 				PR_RunError("Bad builtin call number %d", i);
 			PR_CheckBuiltinExtension (newf);
+			if (qcvm->profiler)
+				PR_ProfileEnter (newf);
 			qcvm->builtins[i]();
+			if (qcvm->profiler)
+				PR_ProfileLeave ();
 			break;
 		}
 		// Normal function
@@ -692,3 +689,837 @@ void PR_ExecuteProgram (func_t fnum)
 #undef OPA
 #undef OPB
 #undef OPC
+
+
+/*
+====================
+PR_ExecuteDirect
+
+Same as PR_ExecuteSwitch, but runs the pre-decoded statements with
+computed gotos where the compiler has them. The runaway and profile
+counters are only updated when control leaves a straight run of
+statements, and tracing is only checked after builtins (which is the
+only way it can get turned on), switching to PR_ExecuteSwitch then.
+PR_OP_JIT statements hand over to native code, see pr_jit.c.
+====================
+*/
+#if defined(__GNUC__) && !defined(PR_NO_COMPUTED_GOTO)
+	#define PR_COMPUTED_GOTO
+#endif
+
+#ifdef PR_COMPUTED_GOTO
+	#define OPCODE(op)		lbl_##op:
+	#define DISPATCH()		goto *dispatch[st->op]
+	#define NEXT()			do { st++; DISPATCH (); } while (0)
+#else
+	#define OPCODE(op)		case op:
+	#define DISPATCH()		continue
+	#define NEXT()			{ st++; continue; }
+#endif
+
+#define ENDBLOCK()		(profile += (int)(st - block) + 1)
+#define OPA				(st->a)
+#define OPB				(st->b)
+#define OPC				(st->c)
+
+static void PR_ExecuteDirect (int s, int exitdepth)
+{
+#ifdef PR_COMPUTED_GOTO
+	static const void *const dispatch[PR_OP_JIT + 1] =
+	{
+		&&lbl_OP_DONE,
+		&&lbl_OP_MUL_F, &&lbl_OP_MUL_V, &&lbl_OP_MUL_FV, &&lbl_OP_MUL_VF,
+		&&lbl_OP_DIV_F,
+		&&lbl_OP_ADD_F, &&lbl_OP_ADD_V,
+		&&lbl_OP_SUB_F, &&lbl_OP_SUB_V,
+		&&lbl_OP_EQ_F, &&lbl_OP_EQ_V, &&lbl_OP_EQ_S, &&lbl_OP_EQ_E, &&lbl_OP_EQ_FNC,
+		&&lbl_OP_NE_F, &&lbl_OP_NE_V, &&lbl_OP_NE_S, &&lbl_OP_NE_E, &&lbl_OP_NE_FNC,
+		&&lbl_OP_LE, &&lbl_OP_GE, &&lbl_OP_LT, &&lbl_OP_GT,
+		&&lbl_OP_LOAD_F, &&lbl_OP_LOAD_V, &&lbl_OP_LOAD_S, &&lbl_OP_LOAD_ENT, &&lbl_OP_LOAD_FLD, &&lbl_OP_LOAD_FNC,
+		&&lbl_OP_ADDRESS,
+		&&lbl_OP_STORE_F, &&lbl_OP_STORE_V, &&lbl_OP_STORE_S, &&lbl_OP_STORE_ENT, &&lbl_OP_STORE_FLD, &&lbl_OP_STORE_FNC,
+		&&lbl_OP_STOREP_F, &&lbl_OP_STOREP_V, &&lbl_OP_STOREP_S, &&lbl_OP_STOREP_ENT, &&lbl_OP_STOREP_FLD, &&lbl_OP_STOREP_FNC,
+		&&lbl_OP_RETURN,
+		&&lbl_OP_NOT_F, &&lbl_OP_NOT_V, &&lbl_OP_NOT_S, &&lbl_OP_NOT_ENT, &&lbl_OP_NOT_FNC,
+		&&lbl_OP_IF, &&lbl_OP_IFNOT,
+		&&lbl_OP_CALL0, &&lbl_OP_CALL1, &&lbl_OP_CALL2, &&lbl_OP_CALL3, &&lbl_OP_CALL4,
+		&&lbl_OP_CALL5, &&lbl_OP_CALL6, &&lbl_OP_CALL7, &&lbl_OP_CALL8,
+		&&lbl_OP_STATE,
+		&&lbl_OP_GOTO,
+		&&lbl_OP_AND, &&lbl_OP_OR,
+		&&lbl_OP_BITAND, &&lbl_OP_BITOR,
+		&&lbl_PR_OP_BAD,
+		&&lbl_PR_OP_JIT,
+	};
+#endif
+	prstatement_t	*code, *st, *block;
+	eval_t		*ptr;
+	dfunction_t	*newf;
+	int		profile, startprofile;
+	edict_t		*ed;
+
+	code = qcvm->decoded;
+	st = block = code + s;
+	profile = startprofile = 0;
+
+#ifdef PR_COMPUTED_GOTO
+	DISPATCH ();
+	{
+#else
+	while (1)
+	{
+	switch (st->op)
+	{
+#endif
+	OPCODE (OP_ADD_F)
+		OPC->_float = OPA->_float + OPB->_float;
+		NEXT ();
+	OPCODE (OP_ADD_V)
+		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
+		NEXT ();
+
+	OPCODE (OP_SUB_F)
+		OPC->_float = OPA->_float - OPB->_float;
+		NEXT ();
+	OPCODE (OP_SUB_V)
+		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
+		NEXT ();
+
+	OPCODE (OP_MUL_F)
+		OPC->_float = OPA->_float * OPB->_float;
+		NEXT ();
+	OPCODE (OP_MUL_V)
+		OPC->_float = OPA->vector[0] * OPB->vector[0] +
+			      OPA->vector[1] * OPB->vector[1] +
+			      OPA->vector[2] * OPB->vector[2];
+		NEXT ();
+	OPCODE (OP_MUL_FV)
+		OPC->vector[0] = OPA->_float * OPB->vector[0];
+		OPC->vector[1] = OPA->_float * OPB->vector[1];
+		OPC->vector[2] = OPA->_float * OPB->vector[2];
+		NEXT ();
+	OPCODE (OP_MUL_VF)
+		OPC->vector[0] = OPB->_float * OPA->vector[0];
+		OPC->vector[1] = OPB->_float * OPA->vector[1];
+		OPC->vector[2] = OPB->_float * OPA->vector[2];
+		NEXT ();
+
+	OPCODE (OP_DIV_F)
+		OPC->_float = OPA->_float / OPB->_float;
+		NEXT ();
+
+	OPCODE (OP_BITAND)
+		OPC->_float = (int)OPA->_float & (int)OPB->_float;
+		NEXT ();
+
+	OPCODE (OP_BITOR)
+		OPC->_float = (int)OPA->_float | (int)OPB->_float;
+		NEXT ();
+
+	OPCODE (OP_GE)
+		OPC->_float = OPA->_float >= OPB->_float;
+		NEXT ();
+	OPCODE (OP_LE)
+		OPC->_float = OPA->_float <= OPB->_float;
+		NEXT ();
+	OPCODE (OP_GT)
+		OPC->_float = OPA->_float > OPB->_float;
+		NEXT ();
+	OPCODE (OP_LT)
+		OPC->_float = OPA->_float < OPB->_float;
+		NEXT ();
+	OPCODE (OP_AND)
+		OPC->_float = OPA->_float && OPB->_float;
+		NEXT ();
+	OPCODE (OP_OR)
+		OPC->_float = OPA->_float || OPB->_float;
+		NEXT ();
+
+	OPCODE (OP_NOT_F)
+		OPC->_float = !OPA->_float;
+		NEXT ();
+	OPCODE (OP_NOT_V)
+		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
+		NEXT ();
+	OPCODE (OP_NOT_S)
+		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
+		NEXT ();
+	OPCODE (OP_NOT_FNC)
+		OPC->_float = !OPA->function;
+		NEXT ();
+	OPCODE (OP_NOT_ENT)
+		OPC->_float = (PROG_TO_EDICT(OPA->edict) == qcvm->edicts);
+		NEXT ();
+
+	OPCODE (OP_EQ_F)
+		OPC->_float = OPA->_float == OPB->_float;
+		NEXT ();
+	OPCODE (OP_EQ_V)
+		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
+			      (OPA->vector[1] == OPB->vector[1]) &&
+			      (OPA->vector[2] == OPB->vector[2]);
+		NEXT ();
+	OPCODE (OP_EQ_S)
+		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		NEXT ();
+	OPCODE (OP_EQ_E)
+		OPC->_float = OPA->_int == OPB->_int;
+		NEXT ();
+	OPCODE (OP_EQ_FNC)
+		OPC->_float = OPA->function == OPB->function;
+		NEXT ();
+
+	OPCODE (OP_NE_F)
+		OPC->_float = OPA->_float != OPB->_float;
+		NEXT ();
+	OPCODE (OP_NE_V)
+		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
+			      (OPA->vector[1] != OPB->vector[1]) ||
+			      (OPA->vector[2] != OPB->vector[2]);
+		NEXT ();
+	OPCODE (OP_NE_S)
+		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		NEXT ();
+	OPCODE (OP_NE_E)
+		OPC->_float = OPA->_int != OPB->_int;
+		NEXT ();
+	OPCODE (OP_NE_FNC)
+		OPC->_float = OPA->function != OPB->function;
+		NEXT ();
+
+	OPCODE (OP_STORE_F)
+	OPCODE (OP_STORE_ENT)
+	OPCODE (OP_STORE_FLD)	// integers
+	OPCODE (OP_STORE_S)
+	OPCODE (OP_STORE_FNC)	// pointers
+		OPB->_int = OPA->_int;
+		NEXT ();
+	OPCODE (OP_STORE_V)
+		OPB->vector[0] = OPA->vector[0];
+		OPB->vector[1] = OPA->vector[1];
+		OPB->vector[2] = OPA->vector[2];
+		NEXT ();
+
+	OPCODE (OP_STOREP_F)
+	OPCODE (OP_STOREP_ENT)
+	OPCODE (OP_STOREP_FLD)	// integers
+	OPCODE (OP_STOREP_S)
+	OPCODE (OP_STOREP_FNC)	// pointers
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->_int = OPA->_int;
+		NEXT ();
+	OPCODE (OP_STOREP_V)
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->vector[0] = OPA->vector[0];
+		ptr->vector[1] = OPA->vector[1];
+		ptr->vector[2] = OPA->vector[2];
+		NEXT ();
+
+	OPCODE (OP_ADDRESS)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		if (ed == (edict_t *)qcvm->edicts && sv.state == ss_active)
+		{
+			qcvm->xstatement = st - code;
+			PR_RunError("assignment to world entity");
+		}
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		if ((unsigned) OPB->_int < (unsigned) qcvm->progs->entityfields && qcvm->fieldwatch[OPB->_int])
+			ED_FieldWatched (ed, OPB->_int);
+		NEXT ();
+
+	OPCODE (OP_LOAD_F)
+	OPCODE (OP_LOAD_FLD)
+	OPCODE (OP_LOAD_ENT)
+	OPCODE (OP_LOAD_S)
+	OPCODE (OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		NEXT ();
+
+	OPCODE (OP_LOAD_V)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
+		OPC->vector[0] = ptr->vector[0];
+		OPC->vector[1] = ptr->vector[1];
+		OPC->vector[2] = ptr->vector[2];
+		NEXT ();
+
+	OPCODE (OP_IFNOT)
+		if (OPA->_int)
+			NEXT ();
+		goto jump;
+
+	OPCODE (OP_IF)
+		if (!OPA->_int)
+			NEXT ();
+		goto jump;
+
+	OPCODE (OP_GOTO)
+	jump:
+		ENDBLOCK ();
+		if (st->jump <= 0 && profile > 0x1000000)
+		{
+			qcvm->xstatement = st - code;
+			PR_RunError("runaway loop error");
+		}
+		st += st->jump;
+		block = st;
+		DISPATCH ();
+
+	OPCODE (OP_CALL0)
+	OPCODE (OP_CALL1)
+	OPCODE (OP_CALL2)
+	OPCODE (OP_CALL3)
+	OPCODE (OP_CALL4)
+	OPCODE (OP_CALL5)
+	OPCODE (OP_CALL6)
+	OPCODE (OP_CALL7)
+	OPCODE (OP_CALL8)
+		ENDBLOCK ();
+		qcvm->xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		qcvm->xstatement = st - code;
+		qcvm->argc = st->op - OP_CALL0;
+		if (!OPA->function)
+			PR_RunError("NULL function");
+		newf = &qcvm->functions[OPA->function];
+		if (newf->first_statement < 0)
+		{ // Built-in function
+			int i = -newf->first_statement;
+			if (i >= qcvm->numbuiltins)
+				PR_RunError("Bad builtin call number %d", i);
+			PR_CheckBuiltinExtension (newf);
+			if (qcvm->profiler)
+				PR_ProfileEnter (newf);
+			qcvm->builtins[i]();
+			if (qcvm->profiler)
+				PR_ProfileLeave ();
+			if (qcvm->trace)
+			{
+				PR_ExecuteSwitch (st - code, exitdepth, profile);
+				return;
+			}
+			st++;
+			block = st;
+			DISPATCH ();
+		}
+		// Normal function
+		if (qcvm->jit)
+			PR_JitEnter (newf);
+		st = block = code + PR_EnterFunction(newf) + 1;
+		DISPATCH ();
+
+	OPCODE (OP_DONE)
+	OPCODE (OP_RETURN)
+		ENDBLOCK ();
+		qcvm->xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		qcvm->xstatement = st - code;
+		qcvm->globals[OFS_RETURN] = OPA->vector[0];
+		qcvm->globals[OFS_RETURN + 1] = OPA->vector[1];
+		qcvm->globals[OFS_RETURN + 2] = OPA->vector[2];
+		st = block = code + PR_LeaveFunction() + 1;
+		if (qcvm->depth == exitdepth)
+		{ // Done
+			return;
+		}
+		DISPATCH ();
+
+	OPCODE (OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = OPA->_float;
+		ed->v.think = OPB->function;
+		NEXT ();
+
+	OPCODE (PR_OP_JIT)
+		profile += (int)(st - block);
+		s = PR_JitExecute (st - code, &profile);
+		if (s < 0)
+		{
+			qcvm->xstatement = -1 - s;
+			PR_RunError("assignment to world entity");
+		}
+		st = block = code + s;
+		if (profile > 0x1000000)
+		{
+			qcvm->xstatement = s;
+			PR_RunError("runaway loop error");
+		}
+		DISPATCH ();
+
+#ifdef PR_COMPUTED_GOTO
+	lbl_PR_OP_BAD:
+#else
+	default:
+#endif
+		qcvm->xstatement = st - code;
+		PR_RunError("Bad opcode %i", qcvm->statements[qcvm->xstatement].op);
+	}
+#ifndef PR_COMPUTED_GOTO
+	}	/* end of while(1) loop */
+#endif
+}
+
+#undef OPA
+#undef OPB
+#undef OPC
+#undef OPCODE
+#undef DISPATCH
+#undef NEXT
+#undef ENDBLOCK
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	dfunction_t	*f;
+	int		exitdepth, s;
+
+	if (!fnum || fnum >= qcvm->progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+
+	f = &qcvm->functions[fnum];
+
+	qcvm->trace = false;
+
+// make a stack frame
+	exitdepth = qcvm->depth;
+	if (qcvm->profiler && !exitdepth)
+		PR_ProfileUnwind ();
+
+	if (qcvm->jit)
+		PR_JitEnter (f);
+	s = PR_EnterFunction(f);
+	if (qcvm->decoded)
+		PR_ExecuteDirect (s + 1, exitdepth);
+	else
+		PR_ExecuteSwitch (s, exitdepth, 0);
+}
+
+/*
+====================
+PR_DecodeStatements
+====================
+*/
+static void PR_DecodeStatements (prstatement_t *out)
+{
+	dstatement_t	*st;
+	int		i;
+
+	for (i = 0; i < qcvm->progs->numstatements; i++, out++)
+	{
+		st = &qcvm->statements[i];
+		out->op = st->op <= OP_BITOR ? st->op : PR_OP_BAD;
+		out->jump = st->op == OP_GOTO ? st->a : st->b;
+		out->a = (eval_t *)&qcvm->globals[(unsigned short)st->a];
+		out->b = (eval_t *)&qcvm->globals[(unsigned short)st->b];
+		out->c = (eval_t *)&qcvm->globals[(unsigned short)st->c];
+	}
+}
+
+/*
+====================
+PR_InitDirectExec
+
+Called by PR_LoadProgs, picks the interpreter loop for the progs
+====================
+*/
+cvar_t pr_directexec = {"pr_directexec", "1", CVAR_NONE}; // 0 = switch loop, takes effect on next progs load
+
+void PR_InitDirectExec (void)
+{
+	qcvm->decoded = NULL;
+	if (!pr_directexec.value)
+		return;
+
+	qcvm->decoded = (prstatement_t *) Hunk_AllocName (qcvm->progs->numstatements * sizeof (prstatement_t), "qcdecoded");
+	PR_DecodeStatements (qcvm->decoded);
+}
+
+/*
+===============================================================================
+
+QC BENCHMARK
+
+pr_bench assembles a few small QC loops into a scratch qcvm and times
+them with both interpreter loops and the JIT, in statements per second.
+
+===============================================================================
+*/
+
+#define BENCH_ITERATIONS	100000	// per call, well below the runaway limit
+#define BENCH_STATEMENTS	256
+#define BENCH_GLOBALS		512
+#define BENCH_FIELDS		8
+#define BENCH_EDICTS		2
+
+// globals used by the benchmark, after the system globals
+enum
+{
+	BG_FIRST = 256,
+	BG_I = BG_FIRST, BG_N, BG_ONE, BG_HALF, BG_MASK, BG_X, BG_Y, BG_Z,
+	BG_T1, BG_T2, BG_T3, BG_T4, BG_PTR, BG_ENT, BG_FLD_F, BG_FLD_V,
+	BG_FNC_SQR, BG_FNC_BUILTIN, BG_LOCAL,
+	BG_V1 = BG_FIRST + 32, BG_V2 = BG_V1 + 3, BG_V3 = BG_V2 + 3,
+	BG_LAST = BG_V3 + 3,
+};
+COMPILE_TIME_ASSERT (bench_globals, sizeof (globalvars_t) <= BG_FIRST * 4 && BG_LAST <= BENCH_GLOBALS);
+
+enum
+{
+	BF_NULL,
+	BF_SQR,			// float(float x) { return x * x; }
+	BF_BUILTIN,
+	BF_FIRSTTEST,
+};
+
+typedef enum
+{
+	BENCH_SWITCH,
+	BENCH_DIRECT,
+	BENCH_JIT,
+	BENCH_NUMMODES,
+} benchmode_t;
+
+typedef struct
+{
+	const char	*name;
+	int			func;
+} benchtest_t;
+
+static benchtest_t	bench_tests[8];
+static int			bench_numtests;
+
+static qcvm_t		*bench_vm;
+static dprograms_t	bench_progs;
+static dstatement_t	bench_statements[BENCH_STATEMENTS];
+static dfunction_t	bench_functions[BF_FIRSTTEST + Q_COUNTOF (bench_tests)];
+static int			bench_functionsizes[Q_COUNTOF (bench_functions)];
+static float		bench_initglobals[BENCH_GLOBALS];
+static prstatement_t	*bench_decoded[2];		// for the interpreter, with PR_OP_JIT blocks
+static struct prjit_s	*bench_jit;
+
+/*
+====================
+PR_BenchEmit
+====================
+*/
+static int PR_BenchEmit (int op, int a, int b, int c)
+{
+	dstatement_t *st;
+
+	if (bench_progs.numstatements >= BENCH_STATEMENTS)
+		Sys_Error ("PR_BenchEmit: too many statements");
+	st = &bench_statements[bench_progs.numstatements];
+	st->op = op;
+	st->a = a;
+	st->b = b;
+	st->c = c;
+	return bench_progs.numstatements++;
+}
+
+/*
+====================
+PR_BenchBeginLoop
+
+Starts a test function that runs its body BENCH_ITERATIONS times
+====================
+*/
+static int PR_BenchBeginLoop (const char *name)
+{
+	dfunction_t	*f = &bench_functions[bench_progs.numfunctions];
+
+	bench_tests[bench_numtests].name = name;
+	bench_tests[bench_numtests].func = bench_progs.numfunctions++;
+	bench_numtests++;
+
+	f->first_statement = bench_progs.numstatements;
+	f->parm_start = BG_LOCAL;
+	PR_BenchEmit (OP_STORE_F, BG_Z, BG_I, 0);	// i = 0
+	return bench_progs.numstatements;
+}
+
+/*
+====================
+PR_BenchEndLoop
+====================
+*/
+static void PR_BenchEndLoop (int loop)
+{
+	int branch;
+
+	PR_BenchEmit (OP_ADD_F, BG_I, BG_ONE, BG_I);
+	PR_BenchEmit (OP_LT, BG_I, BG_N, BG_T4);
+	branch = PR_BenchEmit (OP_IF, BG_T4, 0, 0);
+	bench_statements[branch].b = loop - branch;
+	PR_BenchEmit (OP_DONE, 0, 0, 0);
+	bench_functionsizes[bench_progs.numfunctions - 1] = bench_progs.numstatements - loop + 1;
+}
+
+/*
+====================
+PR_BenchBuiltin
+====================
+*/
+static void PR_BenchBuiltin (void)
+{
+	G_FLOAT(OFS_RETURN) = G_FLOAT(OFS_PARM0) + 1.f;
+}
+
+/*
+====================
+PR_BenchInit
+====================
+*/
+static void PR_BenchInit (void)
+{
+	dfunction_t	*f;
+	float		*g;
+	int			loop, skip;
+
+	bench_vm = (qcvm_t *) calloc (1, sizeof (*bench_vm));
+	if (!bench_vm)
+		Sys_Error ("PR_BenchInit: out of memory");
+
+	bench_progs.numglobals = BENCH_GLOBALS;
+	bench_progs.entityfields = BENCH_FIELDS;
+	bench_progs.numstatements = 1;	// statement 0 is an error
+	bench_progs.numfunctions = BF_FIRSTTEST;
+
+	g = bench_initglobals;
+	g[BG_N] = BENCH_ITERATIONS;
+	g[BG_ONE] = 1.f;
+	g[BG_HALF] = 0.5f;
+	g[BG_MASK] = 255.f;
+	g[BG_X] = 3.f;
+	g[BG_Y] = 0.25f;
+	g[BG_V1 + 0] = 1.f;	g[BG_V1 + 1] = 2.f;	g[BG_V1 + 2] = 3.f;
+	g[BG_V2 + 0] = -4.f;	g[BG_V2 + 1] = 5.f;	g[BG_V2 + 2] = 0.5f;
+
+	// function 0 is the null function, the rest are filled in below
+	f = &bench_functions[BF_SQR];
+	f->first_statement = bench_progs.numstatements;
+	f->parm_start = BG_LOCAL;
+	f->locals = 1;
+	f->numparms = 1;
+	f->parm_size[0] = 1;
+	PR_BenchEmit (OP_MUL_F, BG_LOCAL, BG_LOCAL, BG_T3);
+	PR_BenchEmit (OP_RETURN, BG_T3, 0, 0);
+	bench_functionsizes[BF_SQR] = bench_progs.numstatements - f->first_statement;
+	((int *)g)[BG_FNC_SQR] = BF_SQR;
+
+	bench_functions[BF_BUILTIN].first_statement = -1;
+	((int *)g)[BG_FNC_BUILTIN] = BF_BUILTIN;
+
+	loop = PR_BenchBeginLoop ("float");
+	PR_BenchEmit (OP_MUL_F, BG_X, BG_HALF, BG_T1);
+	PR_BenchEmit (OP_ADD_F, BG_T1, BG_ONE, BG_X);
+	PR_BenchEmit (OP_BITAND, BG_I, BG_MASK, BG_T2);
+	PR_BenchEmit (OP_DIV_F, BG_T2, BG_X, BG_T3);
+	PR_BenchEmit (OP_GE, BG_T3, BG_Y, BG_T1);
+	PR_BenchEndLoop (loop);
+
+	loop = PR_BenchBeginLoop ("vector");
+	PR_BenchEmit (OP_ADD_V, BG_V1, BG_V2, BG_V3);
+	PR_BenchEmit (OP_MUL_VF, BG_V3, BG_HALF, BG_V1);
+	PR_BenchEmit (OP_MUL_V, BG_V1, BG_V2, BG_T1);
+	PR_BenchEmit (OP_SUB_V, BG_V3, BG_V1, BG_V2);
+	PR_BenchEmit (OP_EQ_V, BG_V1, BG_V2, BG_T2);
+	PR_BenchEndLoop (loop);
+
+	loop = PR_BenchBeginLoop ("fields");
+	PR_BenchEmit (OP_LOAD_F, BG_ENT, BG_FLD_F, BG_T1);
+	PR_BenchEmit (OP_ADD_F, BG_T1, BG_ONE, BG_T1);
+	PR_BenchEmit (OP_ADDRESS, BG_ENT, BG_FLD_F, BG_PTR);
+	PR_BenchEmit (OP_STOREP_F, BG_T1, BG_PTR, 0);
+	PR_BenchEmit (OP_LOAD_V, BG_ENT, BG_FLD_V, BG_V1);
+	PR_BenchEmit (OP_ADD_V, BG_V1, BG_V2, BG_V1);
+	PR_BenchEmit (OP_ADDRESS, BG_ENT, BG_FLD_V, BG_PTR);
+	PR_BenchEmit (OP_STOREP_V, BG_V1, BG_PTR, 0);
+	PR_BenchEndLoop (loop);
+
+	loop = PR_BenchBeginLoop ("branches");
+	PR_BenchEmit (OP_BITAND, BG_I, BG_ONE, BG_T1);
+	skip = PR_BenchEmit (OP_IFNOT, BG_T1, 0, 0);
+	PR_BenchEmit (OP_ADD_F, BG_X, BG_ONE, BG_X);
+	bench_statements[skip].b = bench_progs.numstatements - skip;
+	PR_BenchEmit (OP_NE_F, BG_T1, BG_Y, BG_T2);
+	PR_BenchEmit (OP_AND, BG_T1, BG_T2, BG_T3);
+	skip = PR_BenchEmit (OP_IF, BG_T3, 0, 0);
+	PR_BenchEmit (OP_SUB_F, BG_X, BG_ONE, BG_X);
+	bench_statements[skip].b = bench_progs.numstatements - skip;
+	PR_BenchEmit (OP_GOTO, 1, 0, 0);
+	PR_BenchEndLoop (loop);
+
+	loop = PR_BenchBeginLoop ("calls");
+	PR_BenchEmit (OP_STORE_F, BG_I, OFS_PARM0, 0);
+	PR_BenchEmit (OP_CALL1, BG_FNC_SQR, 0, 0);
+	PR_BenchEmit (OP_ADD_F, OFS_RETURN, BG_X, BG_X);
+	PR_BenchEndLoop (loop);
+
+	loop = PR_BenchBeginLoop ("builtins");
+	PR_BenchEmit (OP_STORE_F, BG_I, OFS_PARM0, 0);
+	PR_BenchEmit (OP_CALL1, BG_FNC_BUILTIN, 0, 0);
+	PR_BenchEmit (OP_ADD_F, OFS_RETURN, BG_X, BG_X);
+	PR_BenchEndLoop (loop);
+
+	bench_vm->progs = &bench_progs;
+	bench_vm->functions = bench_functions;
+	bench_vm->functionsizes = bench_functionsizes;
+	bench_vm->statements = bench_statements;
+	bench_vm->globals = (float *) calloc (BENCH_GLOBALS, sizeof (float));
+	bench_vm->strings = (char *) "";
+	bench_vm->stringssize = 1;
+	bench_vm->builtins[1] = PR_BenchBuiltin;
+	bench_vm->numbuiltins = 2;
+	bench_vm->edict_size = BENCH_FIELDS * 4 + sizeof (edict_t) - sizeof (entvars_t);
+	bench_vm->edict_size = (bench_vm->edict_size + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
+	bench_vm->edicts = (edict_t *) calloc (BENCH_EDICTS, bench_vm->edict_size);
+	bench_vm->num_edicts = bench_vm->max_edicts = BENCH_EDICTS;
+	bench_vm->fieldwatch = (byte *) calloc (BENCH_FIELDS, 1);
+	bench_decoded[0] = (prstatement_t *) calloc (BENCH_STATEMENTS, sizeof (prstatement_t));
+	bench_decoded[1] = (prstatement_t *) calloc (BENCH_STATEMENTS, sizeof (prstatement_t));
+	if (!bench_vm->globals || !bench_vm->edicts || !bench_vm->fieldwatch || !bench_decoded[0] || !bench_decoded[1])
+		Sys_Error ("PR_BenchInit: out of memory");
+
+	((int *)g)[BG_ENT] = bench_vm->edict_size;	// EDICT_TO_PROG (edict 1)
+	((int *)g)[BG_FLD_F] = 0;
+	((int *)g)[BG_FLD_V] = 1;
+}
+
+/*
+====================
+PR_BenchRun
+
+Returns statements per second, counted by the function profiles
+====================
+*/
+static double PR_BenchRun (benchtest_t *test, benchmode_t mode, int runs, float *globals, edict_t *edicts, int *count)
+{
+	double			time;
+	int				i;
+
+	memcpy (qcvm->globals, bench_initglobals, sizeof (bench_initglobals));
+	memset (qcvm->edicts, 0, BENCH_EDICTS * qcvm->edict_size);
+	for (i = 0; i < bench_progs.numfunctions; i++)
+		bench_functions[i].profile = 0;
+
+	qcvm->decoded = mode == BENCH_SWITCH ? NULL : bench_decoded[mode == BENCH_JIT];
+	qcvm->jit = mode == BENCH_JIT ? bench_jit : NULL;
+	time = Sys_DoubleTime ();
+	for (i = 0; i < runs; i++)
+		PR_ExecuteProgram (test->func);
+	time = Sys_DoubleTime () - time;
+
+	memcpy (globals, qcvm->globals, sizeof (bench_initglobals));
+	memcpy (edicts, qcvm->edicts, BENCH_EDICTS * qcvm->edict_size);
+
+	for (i = 0, *count = 0; i < bench_progs.numfunctions; i++)
+		*count += bench_functions[i].profile;
+
+	return *count / q_max (time, 1e-6);
+}
+
+/*
+====================
+PR_Bench_f
+====================
+*/
+void PR_Bench_f (void)
+{
+	static float	globals[BENCH_NUMMODES][BENCH_GLOBALS];
+	edict_t			*edicts[BENCH_NUMMODES];
+	qcvm_t			*oldvm;
+	int				i, mode, runs, nummodes, count[BENCH_NUMMODES];
+	double			rate[BENCH_NUMMODES];
+	qboolean		mismatch;
+
+	runs = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 20;
+	runs = CLAMP (1, runs, 1000);
+	nummodes = PR_JitAvailable () ? BENCH_NUMMODES : BENCH_JIT;
+
+	if (!bench_vm)
+		PR_BenchInit ();
+
+	for (mode = 0; mode < BENCH_NUMMODES; mode++)
+		edicts[mode] = (edict_t *) malloc (BENCH_EDICTS * bench_vm->edict_size);
+	if (!edicts[0] || !edicts[1] || !edicts[2])
+	{
+		for (mode = 0; mode < BENCH_NUMMODES; mode++)
+			free (edicts[mode]);
+		Con_Printf ("pr_bench: out of memory\n");
+		return;
+	}
+
+	PR_PushQCVM (bench_vm, &oldvm);
+
+	qcvm->decoded = bench_decoded[0];
+	PR_DecodeStatements (qcvm->decoded);
+
+	// compile everything up front
+	qcvm->jit = bench_jit;
+	PR_JitShutdown (qcvm);
+	bench_jit = NULL;
+	if (nummodes > BENCH_JIT)
+	{
+		qcvm->decoded = bench_decoded[1];
+		PR_DecodeStatements (qcvm->decoded);
+		PR_JitEnable ();
+		for (i = 1; i < bench_progs.numfunctions; i++)
+			PR_JitCompile (i);
+		bench_jit = qcvm->jit;
+	}
+
+#ifdef PR_COMPUTED_GOTO
+	Con_Printf ("%d x %d iterations, computed goto\n", runs, BENCH_ITERATIONS);
+#else
+	Con_Printf ("%d x %d iterations, switch dispatch\n", runs, BENCH_ITERATIONS);
+#endif
+	Con_Printf ("Mstatements/s  switch   direct           %s\n", nummodes > BENCH_JIT ? "jit" : "");
+	for (i = 0; i < bench_numtests; i++)
+	{
+		mismatch = false;
+		for (mode = 0; mode < nummodes; mode++)
+		{
+			rate[mode] = PR_BenchRun (&bench_tests[i], (benchmode_t) mode, runs, globals[mode], edicts[mode], &count[mode]);
+			if (mode > 0 && (count[mode] != count[0] ||
+				memcmp (globals[mode], globals[0], sizeof (globals[0])) != 0 ||
+				memcmp (edicts[mode], edicts[0], BENCH_EDICTS * bench_vm->edict_size) != 0))
+				mismatch = true;
+		}
+
+		Con_Printf ("%-12s %8.1f %8.1f %5.2fx", bench_tests[i].name,
+			rate[0] / 1e6, rate[1] / 1e6, rate[1] / q_max (rate[0], 1e-6));
+		if (nummodes > BENCH_JIT)
+			Con_Printf (" %8.1f %5.2fx", rate[2] / 1e6, rate[2] / q_max (rate[0], 1e-6));
+		Con_Printf ("%s\n", mismatch ? " MISMATCH" : "");
+	}
+
+	qcvm->decoded = NULL;
+	qcvm->jit = NULL;
+	PR_PopQCVM (oldvm);
+
+	for (mode = 0; mode < BENCH_NUMMODES; mode++)
+		free (edicts[mode]);
+}
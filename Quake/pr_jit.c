@@ -0,0 +1,990 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_jit.c -- native code for hot QC functions
+//
+// Once a function has run pr_jit_threshold statements (as counted by the
+// profiler), its arithmetic, comparisons, field access and branches are
+// translated to x86-64 code. Calls, returns, state and string opcodes are
+// left to PR_ExecuteDirect: native code returns the number of the first
+// statement it can't run, and the interpreter re-enters it through the
+// PR_OP_JIT statements marking the start of each native block.
+//
+// Native code keeps the same statement counts as the interpreter, so the
+// profiler and the runaway loop check work unchanged. Every float operation
+// is the same SSE instruction the compiler generates for the interpreter.
+
+#include "quakedef.h"
+
+cvar_t	pr_jit = {"pr_jit", "0", CVAR_NONE}; // 1 = compile hot functions to native code, takes effect on next progs load
+cvar_t	pr_jit_threshold = {"pr_jit_threshold", "50000", CVAR_NONE}; // statements run before a function is compiled
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(PR_NO_JIT)
+	// only the System V calling convention is implemented, and Host_Error
+	// longjmps through native frames, which needs unwind info on Win64
+	#define PR_JIT_X64
+	#include <sys/mman.h>
+#endif
+
+#define JIT_RUNAWAY		0x1000000	// same as the interpreter
+
+// native entry point: runs from the given statement, adds the statements it
+// ran to *profile, and returns the statement to resume interpreting at,
+// or -1 - statement for an assignment to the world entity
+typedef int (*prnative_t) (int statement, int *profile, byte *edicts);
+
+struct prjit_s
+{
+	byte		*tried;			// per function, compilation has been attempted
+	prnative_t	*native;		// per function, NULL if not compiled
+	size_t		*nativesize;
+	int			numcompiled;
+	size_t		totalsize;
+};
+
+/*
+===============================================================================
+
+X86-64 CODE GENERATION
+
+===============================================================================
+*/
+
+#ifdef PR_JIT_X64
+
+// registers, as used in instruction encodings
+enum { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI };
+enum { XMM0, XMM1, XMM2, XMM3, XMM4, XMM5 };
+
+// condition codes, added to 0x0F 0x80 (jcc) or 0x0F 0x90 (setcc)
+enum { CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_P = 0xA, CC_NP = 0xB, CC_G = 0xF };
+
+typedef struct
+{
+	int			pos;			// offset of the rel32 to patch
+	int			label;
+} jitfixup_t;
+
+typedef enum
+{
+	STUB_RUNAWAY,				// returns the branch statement, the interpreter raises the error
+	STUB_WORLD,					// returns -1 - statement
+} jitstubkind_t;
+
+typedef struct
+{
+	jitstubkind_t	kind;
+	int				statement;
+} jitstub_t;
+
+typedef struct
+{
+	byte		*code;
+	int			size;
+	int			maxsize;
+
+	int			first;			// first statement of the function
+	int			numstatements;
+
+	int			*labels;		// code offset of each statement, then LABEL_END, LABEL_EPILOGUE, stubs
+	jitfixup_t	*fixups;
+	int			numfixups, maxfixups;
+	jitstub_t	*stubs;
+	int			numstubs;
+} jit_t;
+
+#define LABEL_END(j)		((j)->numstatements)
+#define LABEL_EPILOGUE(j)	((j)->numstatements + 1)
+#define LABEL_STUB(j,n)		((j)->numstatements + 2 + (n))
+
+static void J_Byte (jit_t *j, int b)
+{
+	if (j->size >= j->maxsize)
+	{
+		j->maxsize = j->maxsize ? j->maxsize * 2 : 4096;
+		j->code = (byte *) realloc (j->code, j->maxsize);
+		if (!j->code)
+			Sys_Error ("J_Byte: out of memory");
+	}
+	j->code[j->size++] = b;
+}
+
+static void J_Bytes (jit_t *j, const char *bytes, int count)
+{
+	while (count-- > 0)
+		J_Byte (j, (byte) *bytes++);
+}
+
+static void J_Int (jit_t *j, int v)
+{
+	J_Byte (j, v & 255);
+	J_Byte (j, (v >> 8) & 255);
+	J_Byte (j, (v >> 16) & 255);
+	J_Byte (j, (v >> 24) & 255);
+}
+
+static void J_Ptr (jit_t *j, const void *p)
+{
+	uint64_t v = (uint64_t) (uintptr_t) p;
+	J_Int (j, (int) (v & 0xffffffffu));
+	J_Int (j, (int) (v >> 32));
+}
+
+static void J_Patch (jit_t *j, int pos, int target)
+{
+	int rel = target - (pos + 4);
+	j->code[pos + 0] = rel & 255;
+	j->code[pos + 1] = (rel >> 8) & 255;
+	j->code[pos + 2] = (rel >> 16) & 255;
+	j->code[pos + 3] = (rel >> 24) & 255;
+}
+
+// rel32 to a label, patched once all labels are known
+static void J_Rel (jit_t *j, int label)
+{
+	if (j->numfixups == j->maxfixups)
+	{
+		j->maxfixups = j->maxfixups ? j->maxfixups * 2 : 256;
+		j->fixups = (jitfixup_t *) realloc (j->fixups, j->maxfixups * sizeof (jitfixup_t));
+		if (!j->fixups)
+			Sys_Error ("J_Rel: out of memory");
+	}
+	j->fixups[j->numfixups].pos = j->size;
+	j->fixups[j->numfixups].label = label;
+	j->numfixups++;
+	J_Int (j, 0);
+}
+
+static void J_Jmp (jit_t *j, int label)
+{
+	J_Byte (j, 0xE9);
+	J_Rel (j, label);
+}
+
+static void J_Jcc (jit_t *j, int cc, int label)
+{
+	J_Byte (j, 0x0F);
+	J_Byte (j, 0x80 + cc);
+	J_Rel (j, label);
+}
+
+// forward jcc inside the current statement, returns the offset to J_Land
+static int J_JccForward (jit_t *j, int cc)
+{
+	int pos;
+	J_Byte (j, 0x0F);
+	J_Byte (j, 0x80 + cc);
+	pos = j->size;
+	J_Int (j, 0);
+	return pos;
+}
+
+static void J_Land (jit_t *j, int pos)
+{
+	J_Patch (j, pos, j->size);
+}
+
+static int J_Stub (jit_t *j, jitstubkind_t kind, int statement)
+{
+	j->stubs[j->numstubs].kind = kind;
+	j->stubs[j->numstubs].statement = statement;
+	return LABEL_STUB (j, j->numstubs++);
+}
+
+// [r12 + global*4], r12 holding the globals
+static void J_Global (jit_t *j, int reg, int global)
+{
+	J_Byte (j, 0x80 | (reg << 3) | 4);
+	J_Byte (j, 0x24);
+	J_Int (j, global * 4);
+}
+
+// prefix, REX.B (plus W if rexw), opcode bytes, then [r12 + global*4]
+static void J_GlobalOp (jit_t *j, int prefix, qboolean rexw, int op1, int op2, int reg, int global)
+{
+	if (prefix)
+		J_Byte (j, prefix);
+	J_Byte (j, rexw ? 0x49 : 0x41);
+	J_Byte (j, op1);
+	if (op2 >= 0)
+		J_Byte (j, op2);
+	J_Global (j, reg, global);
+}
+
+#define J_LoadFloat(j,x,g)		J_GlobalOp (j, 0xF3, false, 0x0F, 0x10, x, g)	// movss xmm, [g]
+#define J_StoreFloat(j,x,g)		J_GlobalOp (j, 0xF3, false, 0x0F, 0x11, x, g)	// movss [g], xmm
+#define J_FloatOp(j,op,x,g)		J_GlobalOp (j, 0xF3, false, 0x0F, op, x, g)		// addss/mulss/subss/divss xmm, [g]
+#define J_Ucomiss(j,x,g)		J_GlobalOp (j, 0, false, 0x0F, 0x2E, x, g)		// ucomiss xmm, [g]
+#define J_Truncate(j,r,g)		J_GlobalOp (j, 0xF3, false, 0x0F, 0x2C, r, g)	// cvttss2si r32, [g]
+#define J_Load(j,r,g)			J_GlobalOp (j, 0, false, 0x8B, -1, r, g)		// mov r32, [g]
+#define J_LoadSigned(j,r,g)		J_GlobalOp (j, 0, true, 0x63, -1, r, g)			// movsxd r64, [g]
+#define J_Store(j,r,g)			J_GlobalOp (j, 0, false, 0x89, -1, r, g)		// mov [g], r32
+#define J_Compare(j,r,g)		J_GlobalOp (j, 0, false, 0x3B, -1, r, g)		// cmp r32, [g]
+
+// addss/mulss/subss/divss xmm, xmm
+static void J_FloatRegOp (jit_t *j, int op, int dst, int src)
+{
+	J_Byte (j, 0xF3);
+	J_Byte (j, 0x0F);
+	J_Byte (j, op);
+	J_Byte (j, 0xC0 | (dst << 3) | src);
+}
+
+#define OP_ADDSS	0x58
+#define OP_MULSS	0x59
+#define OP_SUBSS	0x5C
+#define OP_DIVSS	0x5E
+
+static void J_Setcc (jit_t *j, int cc, int reg)
+{
+	J_Byte (j, 0x0F);
+	J_Byte (j, 0x90 + cc);
+	J_Byte (j, 0xC0 + reg);
+}
+
+// al = (xmm0 == operand), the way C compares floats (false for NaN)
+static void J_SetEqual (jit_t *j, qboolean equal)
+{
+	if (equal)
+	{
+		J_Setcc (j, CC_E, EAX);
+		J_Setcc (j, CC_NP, ECX);
+		J_Bytes (j, "\x20\xC8", 2);		// and al, cl
+	}
+	else
+	{
+		J_Setcc (j, CC_NE, EAX);
+		J_Setcc (j, CC_P, ECX);
+		J_Bytes (j, "\x08\xC8", 2);		// or al, cl
+	}
+}
+
+// al = (global == 0.f) or (global != 0.f)
+static void J_TestFloat (jit_t *j, int global, qboolean zero)
+{
+	J_LoadFloat (j, XMM0, global);
+	J_Bytes (j, "\x0F\x57\xC9", 3);		// xorps xmm1, xmm1
+	J_Bytes (j, "\x0F\x2E\xC1", 3);		// ucomiss xmm0, xmm1
+	J_SetEqual (j, zero);
+}
+
+// al = (a == b) or (a != b) as floats
+static void J_CompareFloats (jit_t *j, int a, int b, qboolean equal)
+{
+	J_LoadFloat (j, XMM0, a);
+	J_Ucomiss (j, XMM0, b);
+	J_SetEqual (j, equal);
+}
+
+// global = (float) al
+static void J_StoreBool (jit_t *j, int global)
+{
+	J_Bytes (j, "\x0F\xB6\xC0", 3);		// movzx eax, al
+	J_Bytes (j, "\xF3\x0F\x2A\xC0", 4);	// cvtsi2ss xmm0, eax
+	J_StoreFloat (j, XMM0, global);
+}
+
+// global = (float) eax
+static void J_StoreInt (jit_t *j, int global)
+{
+	J_Bytes (j, "\xF3\x0F\x2A\xC0", 4);	// cvtsi2ss xmm0, eax
+	J_StoreFloat (j, XMM0, global);
+}
+
+// rax = edicts + a->edict (r13 holding edicts)
+static void J_EdictAddress (jit_t *j, int global)
+{
+	J_LoadSigned (j, EAX, global);
+	J_Bytes (j, "\x4C\x01\xE8", 3);		// add rax, r13
+}
+
+/*
+============
+PR_JitPartialOverlap
+
+True if the vector at out overlaps the operand at in without being the same
+============
+*/
+static qboolean PR_JitPartialOverlap (int out, int in, int insize)
+{
+	if (insize == 3 && out == in)
+		return false;
+	return out < in + insize && in < out + 3;
+}
+
+/*
+============
+PR_JitSupported
+============
+*/
+static qboolean PR_JitSupported (jit_t *j, int i)
+{
+	dstatement_t *st = &qcvm->statements[j->first + i];
+	int a = (unsigned short) st->a;
+	int b = (unsigned short) st->b;
+	int c = (unsigned short) st->c;
+	int target;
+
+	switch (st->op)
+	{
+	// when the result of a vector operation partially overlaps an operand,
+	// what the interpreter computes depends on how the compiler vectorized it
+	case OP_ADD_V:
+	case OP_SUB_V:
+		return !PR_JitPartialOverlap (c, a, 3) && !PR_JitPartialOverlap (c, b, 3);
+	case OP_MUL_FV:
+		return !PR_JitPartialOverlap (c, a, 1) && !PR_JitPartialOverlap (c, b, 3);
+	case OP_MUL_VF:
+		return !PR_JitPartialOverlap (c, a, 3) && !PR_JitPartialOverlap (c, b, 1);
+	case OP_STORE_V:
+		return !PR_JitPartialOverlap (b, a, 3);
+
+	case OP_ADD_F: case OP_SUB_F:
+	case OP_MUL_F: case OP_MUL_V:
+	case OP_DIV_F: case OP_BITAND: case OP_BITOR:
+	case OP_GE: case OP_LE: case OP_GT: case OP_LT: case OP_AND: case OP_OR:
+	case OP_NOT_F: case OP_NOT_V: case OP_NOT_FNC: case OP_NOT_ENT:
+	case OP_EQ_F: case OP_EQ_V: case OP_EQ_E: case OP_EQ_FNC:
+	case OP_NE_F: case OP_NE_V: case OP_NE_E: case OP_NE_FNC:
+	case OP_STORE_F: case OP_STORE_ENT: case OP_STORE_FLD: case OP_STORE_S: case OP_STORE_FNC:
+	case OP_STOREP_F: case OP_STOREP_ENT: case OP_STOREP_FLD: case OP_STOREP_S: case OP_STOREP_FNC: case OP_STOREP_V:
+	case OP_ADDRESS:
+	case OP_LOAD_F: case OP_LOAD_FLD: case OP_LOAD_ENT: case OP_LOAD_S: case OP_LOAD_FNC: case OP_LOAD_V:
+		return true;
+
+	case OP_IF:
+	case OP_IFNOT:
+	case OP_GOTO:
+		// branches leaving the function are left to the interpreter
+		target = i + (st->op == OP_GOTO ? st->a : st->b);
+		return target >= 0 && target < j->numstatements;
+
+	default:
+		return false;
+	}
+}
+
+/*
+============
+PR_JitStatement
+============
+*/
+static void PR_JitStatement (jit_t *j, int i)
+{
+	dstatement_t	*st = &qcvm->statements[j->first + i];
+	int				a = (unsigned short) st->a;
+	int				b = (unsigned short) st->b;
+	int				c = (unsigned short) st->c;
+	int				k, skip, skip2, jump;
+
+	switch (st->op)
+	{
+	case OP_ADD_F:
+	case OP_SUB_F:
+	case OP_MUL_F:
+	case OP_DIV_F:
+		J_LoadFloat (j, XMM0, a);
+		J_FloatOp (j, st->op == OP_ADD_F ? OP_ADDSS : st->op == OP_SUB_F ? OP_SUBSS : st->op == OP_MUL_F ? OP_MULSS : OP_DIVSS, XMM0, b);
+		J_StoreFloat (j, XMM0, c);
+		break;
+
+	case OP_ADD_V:
+	case OP_SUB_V:
+		for (k = 0; k < 3; k++)
+		{
+			J_LoadFloat (j, XMM0 + k, a + k);
+			J_LoadFloat (j, XMM3 + k, b + k);
+		}
+		for (k = 0; k < 3; k++)
+			J_FloatRegOp (j, st->op == OP_ADD_V ? OP_ADDSS : OP_SUBSS, XMM0 + k, XMM3 + k);
+		for (k = 0; k < 3; k++)
+			J_StoreFloat (j, XMM0 + k, c + k);
+		break;
+
+	case OP_MUL_V:
+		J_LoadFloat (j, XMM0, a);
+		J_FloatOp (j, OP_MULSS, XMM0, b);
+		for (k = 1; k < 3; k++)
+		{
+			J_LoadFloat (j, XMM1, a + k);
+			J_FloatOp (j, OP_MULSS, XMM1, b + k);
+			J_Bytes (j, "\xF3\x0F\x58\xC1", 4);	// addss xmm0, xmm1
+		}
+		J_StoreFloat (j, XMM0, c);
+		break;
+
+	case OP_MUL_FV:
+	case OP_MUL_VF:
+		if (st->op == OP_MUL_VF)
+		{
+			k = a;	// vector in b, scale in a
+			a = b;
+			b = k;
+		}
+		J_LoadFloat (j, XMM3, a);
+		for (k = 0; k < 3; k++)
+			J_LoadFloat (j, XMM0 + k, b + k);
+		for (k = 0; k < 3; k++)
+			J_FloatRegOp (j, OP_MULSS, XMM0 + k, XMM3);
+		for (k = 0; k < 3; k++)
+			J_StoreFloat (j, XMM0 + k, c + k);
+		break;
+
+	case OP_BITAND:
+	case OP_BITOR:
+		J_Truncate (j, EAX, a);
+		J_Truncate (j, ECX, b);
+		J_Bytes (j, st->op == OP_BITAND ? "\x21\xC8" : "\x09\xC8", 2);	// and/or eax, ecx
+		J_StoreInt (j, c);
+		break;
+
+	case OP_GE:
+	case OP_GT:
+		J_LoadFloat (j, XMM0, a);
+		J_Ucomiss (j, XMM0, b);
+		J_Setcc (j, st->op == OP_GE ? CC_AE : CC_A, EAX);
+		J_StoreBool (j, c);
+		break;
+	case OP_LE:
+	case OP_LT:
+		J_LoadFloat (j, XMM0, b);
+		J_Ucomiss (j, XMM0, a);
+		J_Setcc (j, st->op == OP_LE ? CC_AE : CC_A, EAX);
+		J_StoreBool (j, c);
+		break;
+
+	case OP_AND:
+	case OP_OR:
+		J_TestFloat (j, a, false);
+		J_Bytes (j, "\x88\xC2", 2);			// mov dl, al
+		J_TestFloat (j, b, false);
+		J_Bytes (j, st->op == OP_AND ? "\x20\xD0" : "\x08\xD0", 2);	// and/or al, dl
+		J_StoreBool (j, c);
+		break;
+
+	case OP_NOT_F:
+		J_TestFloat (j, a, true);
+		J_StoreBool (j, c);
+		break;
+	case OP_NOT_V:
+		J_TestFloat (j, a, true);
+		J_Bytes (j, "\x88\xC2", 2);			// mov dl, al
+		for (k = 1; k < 3; k++)
+		{
+			J_TestFloat (j, a + k, true);
+			J_Bytes (j, "\x20\xC2", 2);		// and dl, al
+		}
+		J_Bytes (j, "\x88\xD0", 2);			// mov al, dl
+		J_StoreBool (j, c);
+		break;
+	case OP_NOT_FNC:
+	case OP_NOT_ENT:
+		J_Load (j, EAX, a);
+		J_Bytes (j, "\x85\xC0", 2);			// test eax, eax
+		J_Setcc (j, CC_E, EAX);
+		J_StoreBool (j, c);
+		break;
+
+	case OP_EQ_F:
+	case OP_NE_F:
+		J_CompareFloats (j, a, b, st->op == OP_EQ_F);
+		J_StoreBool (j, c);
+		break;
+	case OP_EQ_V:
+	case OP_NE_V:
+		J_CompareFloats (j, a, b, st->op == OP_EQ_V);
+		J_Bytes (j, "\x88\xC2", 2);			// mov dl, al
+		for (k = 1; k < 3; k++)
+		{
+			J_CompareFloats (j, a + k, b + k, st->op == OP_EQ_V);
+			J_Bytes (j, st->op == OP_EQ_V ? "\x20\xC2" : "\x08\xC2", 2);	// and/or dl, al
+		}
+		J_Bytes (j, "\x88\xD0", 2);			// mov al, dl
+		J_StoreBool (j, c);
+		break;
+	case OP_EQ_E:
+	case OP_EQ_FNC:
+	case OP_NE_E:
+	case OP_NE_FNC:
+		J_Load (j, EAX, a);
+		J_Compare (j, EAX, b);
+		J_Setcc (j, (st->op == OP_EQ_E || st->op == OP_EQ_FNC) ? CC_E : CC_NE, EAX);
+		J_StoreBool (j, c);
+		break;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		J_Load (j, EAX, a);
+		J_Store (j, EAX, b);
+		break;
+	case OP_STORE_V:
+		J_Load (j, EAX, a);
+		J_Load (j, ECX, a + 1);
+		J_Load (j, EDX, a + 2);
+		J_Store (j, EAX, b);
+		J_Store (j, ECX, b + 1);
+		J_Store (j, EDX, b + 2);
+		break;
+
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_S:
+	case OP_STOREP_FNC:
+	case OP_STOREP_V:
+		J_EdictAddress (j, b);
+		for (k = 0; k < (st->op == OP_STOREP_V ? 3 : 1); k++)
+		{
+			J_Load (j, ECX, a + k);
+			J_Bytes (j, "\x89\x48", 2);		// mov [rax + k*4], ecx
+			J_Byte (j, k * 4);
+		}
+		break;
+
+	case OP_ADDRESS:
+		// assignment to world entity while the server is active
+		J_Load (j, EAX, a);
+		J_Bytes (j, "\x85\xC0", 2);			// test eax, eax
+		skip = J_JccForward (j, CC_NE);
+		J_Bytes (j, "\x48\xBA", 2);			// mov rdx, &sv.state
+		J_Ptr (j, &sv.state);
+		J_Bytes (j, "\x81\x3A", 2);			// cmp dword [rdx], ss_active
+		J_Int (j, ss_active);
+		J_Jcc (j, CC_E, J_Stub (j, STUB_WORLD, i));
+		J_Land (j, skip);
+
+		J_LoadSigned (j, EAX, a);
+		J_LoadSigned (j, ECX, b);
+		J_Bytes (j, "\x48\x8D\x94\x88", 4);	// lea rdx, [rax + rcx*4 + offsetof (v)]
+		J_Int (j, (int) offsetof (edict_t, v));
+		J_Store (j, EDX, c);
+
+		// ED_FieldWatched (edicts + a, b) for watched fields
+		J_Bytes (j, "\x81\xF9", 2);			// cmp ecx, entityfields
+		J_Int (j, qcvm->progs->entityfields);
+		skip = J_JccForward (j, CC_AE);
+		J_Bytes (j, "\x48\xBA", 2);			// mov rdx, fieldwatch
+		J_Ptr (j, qcvm->fieldwatch);
+		J_Bytes (j, "\x80\x3C\x0A\x00", 4);	// cmp byte [rdx + rcx], 0
+		skip2 = J_JccForward (j, CC_E);
+		J_Bytes (j, "\x49\x8D\x7C\x05\x00", 5);	// lea rdi, [r13 + rax]
+		J_Bytes (j, "\x89\xCE", 2);			// mov esi, ecx
+		J_Bytes (j, "\x48\xB8", 2);			// mov rax, ED_FieldWatched
+		J_Ptr (j, (const void *) &ED_FieldWatched);
+		J_Bytes (j, "\xFF\xD0", 2);			// call rax
+		J_Land (j, skip);
+		J_Land (j, skip2);
+		break;
+
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+	case OP_LOAD_V:
+		J_EdictAddress (j, a);
+		J_LoadSigned (j, ECX, b);
+		for (k = 0; k < (st->op == OP_LOAD_V ? 3 : 1); k++)
+		{
+			J_Bytes (j, "\x8B\x94\x88", 3);	// mov edx, [rax + rcx*4 + offsetof (v) + k*4]
+			J_Int (j, (int) offsetof (edict_t, v) + k * 4);
+			J_Store (j, EDX, c + k);
+		}
+		break;
+
+	case OP_IF:
+	case OP_IFNOT:
+	case OP_GOTO:
+		jump = st->op == OP_GOTO ? st->a : st->b;
+		skip = -1;
+		if (st->op != OP_GOTO)
+		{
+			J_Load (j, EAX, a);
+			J_Bytes (j, "\x85\xC0", 2);		// test eax, eax
+			if (jump > 0)
+			{
+				J_Jcc (j, st->op == OP_IF ? CC_NE : CC_E, i + jump);
+				break;
+			}
+			skip = J_JccForward (j, st->op == OP_IF ? CC_E : CC_NE);
+		}
+		if (jump <= 0)
+		{
+			J_Bytes (j, "\x81\x3B", 2);		// cmp dword [rbx], JIT_RUNAWAY
+			J_Int (j, JIT_RUNAWAY);
+			J_Jcc (j, CC_G, J_Stub (j, STUB_RUNAWAY, i));
+		}
+		J_Jmp (j, i + jump);
+		if (skip >= 0)
+			J_Land (j, skip);
+		break;
+
+	default:
+		Sys_Error ("PR_JitStatement: unsupported opcode %d", st->op);
+	}
+}
+
+/*
+============
+PR_JitGenerate
+
+Returns false if the function has nothing worth compiling
+============
+*/
+static qboolean PR_JitGenerate (jit_t *j, byte *supported, byte *leader)
+{
+	dstatement_t	*st;
+	int				i, k, count, numsupported, table, lea;
+
+	for (i = 0, numsupported = 0; i < j->numstatements; i++)
+	{
+		supported[i] = PR_JitSupported (j, i);
+		numsupported += supported[i];
+	}
+	if (!numsupported)
+		return false;
+
+	// a native block starts at the function entry, at branch targets,
+	// after branches, and after anything left to the interpreter
+	memset (leader, 0, j->numstatements);
+	leader[0] = true;
+	for (i = 0; i < j->numstatements; i++)
+	{
+		st = &qcvm->statements[j->first + i];
+		if (!supported[i] || st->op == OP_IF || st->op == OP_IFNOT || st->op == OP_GOTO)
+		{
+			if (i + 1 < j->numstatements)
+				leader[i + 1] = true;
+			if (supported[i])
+				leader[i + (st->op == OP_GOTO ? st->a : st->b)] = true;
+		}
+	}
+
+	// prologue: save registers, load globals/profile/edicts, jump to the entry statement
+	J_Bytes (j, "\x53\x41\x54\x41\x55", 5);	// push rbx; push r12; push r13
+	J_Bytes (j, "\x48\x89\xF3", 3);			// mov rbx, rsi
+	J_Bytes (j, "\x49\x89\xD5", 3);			// mov r13, rdx
+	J_Bytes (j, "\x49\xBC", 2);				// mov r12, globals
+	J_Ptr (j, qcvm->globals);
+	J_Bytes (j, "\x81\xEF", 2);				// sub edi, first
+	J_Int (j, j->first);
+	J_Bytes (j, "\x48\x8D\x05", 3);			// lea rax, [rip + table]
+	lea = j->size;
+	J_Int (j, 0);
+	J_Bytes (j, "\x48\x63\x14\xB8", 4);		// movsxd rdx, [rax + rdi*4]
+	J_Bytes (j, "\x48\x01\xD0", 3);			// add rax, rdx
+	J_Bytes (j, "\xFF\xE0", 2);				// jmp rax
+
+	for (i = 0; i < j->numstatements; i++)
+	{
+		j->labels[i] = j->size;
+		if (!supported[i])
+		{
+			J_Byte (j, 0xB8);				// mov eax, statement
+			J_Int (j, j->first + i);
+			J_Jmp (j, LABEL_EPILOGUE (j));
+			continue;
+		}
+
+		// blocks are counted on entry, they can only be left at their end
+		if (leader[i])
+		{
+			for (k = i + 1, count = 1; k < j->numstatements && supported[k] && !leader[k]; k++)
+				count++;
+			J_Bytes (j, "\x81\x03", 2);		// add dword [rbx], count
+			J_Int (j, count);
+		}
+
+		PR_JitStatement (j, i);
+	}
+
+	// running off the end
+	j->labels[LABEL_END (j)] = j->size;
+	J_Byte (j, 0xB8);						// mov eax, statement
+	J_Int (j, j->first + j->numstatements);
+
+	j->labels[LABEL_EPILOGUE (j)] = j->size;
+	J_Bytes (j, "\x41\x5D\x41\x5C\x5B\xC3", 6);	// pop r13; pop r12; pop rbx; ret
+
+	for (i = 0; i < j->numstubs; i++)
+	{
+		j->labels[LABEL_STUB (j, i)] = j->size;
+		J_Byte (j, 0xB8);					// mov eax, result
+		if (j->stubs[i].kind == STUB_WORLD)
+			J_Int (j, -1 - (j->first + j->stubs[i].statement));
+		else
+			J_Int (j, j->first + j->stubs[i].statement);
+		J_Jmp (j, LABEL_EPILOGUE (j));
+	}
+
+	for (i = 0; i < j->numfixups; i++)
+		J_Patch (j, j->fixups[i].pos, j->labels[j->fixups[i].label]);
+
+	// entry table, offsets from its own start
+	while (j->size & 3)
+		J_Byte (j, 0xCC);
+	table = j->size;
+	J_Patch (j, lea, table);
+	for (i = 0; i < j->numstatements; i++)
+		J_Int (j, j->labels[i] - table);
+
+	return true;
+}
+
+/*
+============
+PR_JitAllocCode
+============
+*/
+static void *PR_JitAllocCode (const byte *code, size_t size)
+{
+	void *mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return NULL;
+	memcpy (mem, code, size);
+	if (mprotect (mem, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap (mem, size);
+		return NULL;
+	}
+	return mem;
+}
+
+static void PR_JitFreeCode (void *mem, size_t size)
+{
+	munmap (mem, size);
+}
+
+#endif // PR_JIT_X64
+
+/*
+===============================================================================
+
+COMPILATION
+
+===============================================================================
+*/
+
+/*
+============
+PR_JitInit
+
+Called by PR_LoadProgs, after PR_InitDirectExec
+============
+*/
+void PR_JitInit (void)
+{
+	qcvm->jit = NULL;
+	if (pr_jit.value)
+		PR_JitEnable ();
+}
+
+/*
+============
+PR_JitEnable
+
+Lets PR_JitCompile work on the current progs
+============
+*/
+void PR_JitEnable (void)
+{
+#ifdef PR_JIT_X64
+	if (qcvm->jit || !qcvm->decoded)
+		return;
+
+	qcvm->jit = (struct prjit_s *) calloc (1, sizeof (*qcvm->jit));
+	if (qcvm->jit)
+	{
+		qcvm->jit->tried = (byte *) calloc (qcvm->progs->numfunctions, 1);
+		qcvm->jit->native = (prnative_t *) calloc (qcvm->progs->numfunctions, sizeof (prnative_t));
+		qcvm->jit->nativesize = (size_t *) calloc (qcvm->progs->numfunctions, sizeof (size_t));
+	}
+	if (!qcvm->jit || !qcvm->jit->tried || !qcvm->jit->native || !qcvm->jit->nativesize)
+		Sys_Error ("PR_JitInit: out of memory");
+#endif
+}
+
+/*
+============
+PR_JitShutdown
+============
+*/
+void PR_JitShutdown (qcvm_t *vm)
+{
+	int i;
+
+	if (!vm->jit)
+		return;
+
+#ifdef PR_JIT_X64
+	for (i = 0; i < vm->progs->numfunctions; i++)
+		if (vm->jit->native[i])
+			PR_JitFreeCode ((void *) vm->jit->native[i], vm->jit->nativesize[i]);
+#else
+	(void) i;
+#endif
+
+	free (vm->jit->tried);
+	free (vm->jit->native);
+	free (vm->jit->nativesize);
+	free (vm->jit);
+	vm->jit = NULL;
+}
+
+/*
+============
+PR_JitCompile
+
+Translates the function to native code and marks the statements it can be
+entered at, returns false if it stays interpreted
+============
+*/
+qboolean PR_JitCompile (int fnum)
+{
+#ifdef PR_JIT_X64
+	dfunction_t	*f;
+	jit_t		j;
+	byte		*supported, *leader;
+	void		*native;
+	int			i;
+
+	if (!qcvm->jit || fnum <= 0 || fnum >= qcvm->progs->numfunctions)
+		return false;
+
+	qcvm->jit->tried[fnum] = true;
+	if (qcvm->jit->native[fnum])
+		return true;
+
+	f = &qcvm->functions[fnum];
+	memset (&j, 0, sizeof (j));
+	j.first = f->first_statement;
+	j.numstatements = qcvm->functionsizes[fnum];
+	if (j.first <= 0 || j.numstatements <= 0 || j.first + j.numstatements > qcvm->progs->numstatements)
+		return false;
+
+	supported = (byte *) malloc (j.numstatements * 2);
+	j.labels = (int *) malloc ((j.numstatements * 2 + 2) * sizeof (int));
+	j.stubs = (jitstub_t *) malloc (j.numstatements * sizeof (jitstub_t));
+	if (!supported || !j.labels || !j.stubs)
+		Sys_Error ("PR_JitCompile: out of memory");
+	leader = supported + j.numstatements;
+
+	native = NULL;
+	if (PR_JitGenerate (&j, supported, leader))
+		native = PR_JitAllocCode (j.code, j.size);
+
+	if (native)
+	{
+		qcvm->jit->native[fnum] = (prnative_t) native;
+		qcvm->jit->nativesize[fnum] = j.size;
+		qcvm->jit->numcompiled++;
+		qcvm->jit->totalsize += j.size;
+
+		for (i = 0; i < j.numstatements; i++)
+			if (supported[i] && leader[i])
+				qcvm->decoded[j.first + i].op = PR_OP_JIT;
+
+		Con_DPrintf2 ("JIT: compiled %s (%d statements, %d bytes)\n", PR_GetString (f->s_name), j.numstatements, j.size);
+	}
+
+	free (supported);
+	free (j.labels);
+	free (j.stubs);
+	free (j.fixups);
+	free (j.code);
+
+	return native != NULL;
+#else
+	return false;
+#endif
+}
+
+/*
+============
+PR_JitEnter
+
+Called when the interpreter enters a function, compiles it once it's hot
+============
+*/
+void PR_JitEnter (dfunction_t *f)
+{
+	int fnum = f - qcvm->functions;
+
+	if (!qcvm->jit->tried[fnum] && f->profile >= pr_jit_threshold.value && f->first_statement > 0)
+		PR_JitCompile (fnum);
+}
+
+/*
+============
+PR_JitExecute
+
+Runs the current function's native code from a PR_OP_JIT statement
+============
+*/
+int PR_JitExecute (int statement, int *profile)
+{
+	prnative_t native = qcvm->jit->native[qcvm->xfunction - qcvm->functions];
+	return native (statement, profile, (byte *) qcvm->edicts);
+}
+
+/*
+============
+PR_JitAvailable
+============
+*/
+qboolean PR_JitAvailable (void)
+{
+#ifdef PR_JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+============
+PR_JitStats_f
+============
+*/
+void PR_JitStats_f (void)
+{
+	qcvm_t *oldvm;
+
+	if (!PR_JitAvailable ())
+	{
+		Con_Printf ("QC JIT not available on this platform\n");
+		return;
+	}
+	if (!sv.active)
+	{
+		Con_Printf ("pr_jitstats: no map running\n");
+		return;
+	}
+
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+	if (!qcvm->jit)
+		Con_Printf ("QC JIT disabled (pr_jit is applied when progs are loaded)\n");
+	else
+		Con_Printf ("%d functions compiled, %.1f KB of code\n", qcvm->jit->numcompiled, qcvm->jit->totalsize / 1024.0);
+	PR_PopQCVM (oldvm);
+}
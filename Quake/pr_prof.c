@@ -0,0 +1,618 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_prof.c -- wall-clock QC profiler
+//
+// While recording, every call to a QC function or builtin is timed and added
+// to a call tree with one node per distinct call path. From it pr_profile
+// reports self and total time per function, the most expensive caller ->
+// callee edges, and writes collapsed stacks for flamegraph.pl.
+//
+// The performance counter is read on every call and return, so functions
+// making lots of small calls look somewhat slower than they are. The
+// statement counts reported by "profile" are not affected.
+
+#include "quakedef.h"
+
+#define PROF_MAXFRAMES	(MAX_STACK_DEPTH * 2 + 64)	// QC functions, builtins and the QC they call back into
+
+typedef struct
+{
+	int			func;			// index into qcvm->functions, 0 for the root
+	int			parent;
+	int			firstchild;		// 0 if none, the root is never a child
+	int			sibling;
+	int			calls;
+	uint64_t	self;			// counter ticks not spent in callees
+	uint64_t	total;
+} profnode_t;
+
+typedef struct
+{
+	int			node;
+	uint64_t	start;
+	uint64_t	children;		// counter ticks spent in callees
+} profframe_t;
+
+struct prprofiler_s
+{
+	qboolean	running;
+	profnode_t	*nodes;			// VEC, nodes[0] is the root
+	profframe_t	frames[PROF_MAXFRAMES];
+	int			depth;			// frames[0] is the root and is never left
+	int			overflow;		// calls not recorded because frames was full
+	uint64_t	started;		// counter when recording last started
+	uint64_t	elapsed;		// counter ticks recorded before that
+};
+
+typedef struct
+{
+	int			func;
+	int			calls;
+	uint64_t	self;
+	uint64_t	total;
+} proftotal_t;
+
+typedef struct
+{
+	int			caller;
+	int			callee;
+	int			calls;
+	uint64_t	total;
+} profedge_t;
+
+/*
+============
+PR_ProfileNode
+
+Returns the child of parent for calls to func, adding it if needed
+============
+*/
+static int PR_ProfileNode (struct prprofiler_s *p, int parent, int func)
+{
+	profnode_t	node;
+	int			i;
+
+	for (i = p->nodes[parent].firstchild; i; i = p->nodes[i].sibling)
+		if (p->nodes[i].func == func)
+			return i;
+
+	memset (&node, 0, sizeof (node));
+	node.func = func;
+	node.parent = parent;
+	node.sibling = p->nodes[parent].firstchild;
+	VEC_PUSH (p->nodes, node);
+
+	i = (int) VEC_SIZE (p->nodes) - 1;
+	p->nodes[parent].firstchild = i;
+	return i;
+}
+
+/*
+============
+PR_ProfileEnter
+
+Called before a QC function or builtin runs
+============
+*/
+void PR_ProfileEnter (dfunction_t *f)
+{
+	struct prprofiler_s	*p = qcvm->profiler;
+	profframe_t			*frame;
+
+	if (!p->running)
+		return;
+	if (p->depth >= PROF_MAXFRAMES)
+	{
+		p->overflow++;
+		return;
+	}
+
+	frame = &p->frames[p->depth++];
+	frame->node = PR_ProfileNode (p, frame[-1].node, f - qcvm->functions);
+	frame->children = 0;
+	frame->start = SDL_GetPerformanceCounter ();
+}
+
+/*
+============
+PR_ProfileLeave
+
+Called when the function passed to the last PR_ProfileEnter returns
+============
+*/
+void PR_ProfileLeave (void)
+{
+	struct prprofiler_s	*p = qcvm->profiler;
+	profframe_t			*frame;
+	profnode_t			*node;
+	uint64_t			ticks;
+
+	ticks = SDL_GetPerformanceCounter ();
+	if (!p->running)
+		return;
+	if (p->overflow)
+	{
+		p->overflow--;
+		return;
+	}
+	if (p->depth <= 1)
+		return;
+
+	frame = &p->frames[--p->depth];
+	ticks -= frame->start;
+	node = &p->nodes[frame->node];
+	node->calls++;
+	node->total += ticks;
+	node->self += ticks - frame->children;
+	frame[-1].children += ticks;
+}
+
+/*
+============
+PR_ProfileUnwind
+
+Drops the frames an aborted program left behind, called when the engine
+starts a new QC call
+============
+*/
+void PR_ProfileUnwind (void)
+{
+	qcvm->profiler->depth = 1;
+	qcvm->profiler->overflow = 0;
+}
+
+/*
+============
+PR_ProfileShutdown
+============
+*/
+void PR_ProfileShutdown (qcvm_t *vm)
+{
+	if (!vm->profiler)
+		return;
+
+	VEC_FREE (vm->profiler->nodes);
+	free (vm->profiler);
+	vm->profiler = NULL;
+}
+
+/*
+============
+PR_ProfileStart
+============
+*/
+static void PR_ProfileStart (void)
+{
+	struct prprofiler_s	*p = qcvm->profiler;
+	profnode_t			root;
+
+	if (!p)
+	{
+		p = (struct prprofiler_s *) calloc (1, sizeof (*p));
+		if (!p)
+			Sys_Error ("PR_ProfileStart: out of memory");
+		memset (&root, 0, sizeof (root));
+		VEC_PUSH (p->nodes, root);
+		qcvm->profiler = p;
+	}
+	if (p->running)
+		return;
+
+	p->running = true;
+	p->depth = 1;
+	p->overflow = 0;
+	p->started = SDL_GetPerformanceCounter ();
+}
+
+/*
+============
+PR_ProfileStop
+============
+*/
+static void PR_ProfileStop (void)
+{
+	struct prprofiler_s	*p = qcvm->profiler;
+
+	if (!p || !p->running)
+		return;
+
+	p->running = false;
+	p->elapsed += SDL_GetPerformanceCounter () - p->started;
+}
+
+/*
+============
+PR_ProfileClear
+
+Drops what was recorded so far; a running profile keeps recording
+============
+*/
+static void PR_ProfileClear (void)
+{
+	struct prprofiler_s	*p = qcvm->profiler;
+
+	if (!p)
+		return;
+	if (!p->running)
+	{
+		PR_ProfileShutdown (qcvm);
+		return;
+	}
+
+	VEC_POP_N (p->nodes, VEC_SIZE (p->nodes) - 1);
+	memset (&p->nodes[0], 0, sizeof (p->nodes[0]));
+	p->depth = 1;
+	p->overflow = 0;
+	p->elapsed = 0;
+	p->started = SDL_GetPerformanceCounter ();
+}
+
+/*
+============
+PR_ProfileElapsed
+
+Returns the counter ticks recorded so far
+============
+*/
+static uint64_t PR_ProfileElapsed (struct prprofiler_s *p)
+{
+	if (p->running)
+		return p->elapsed + SDL_GetPerformanceCounter () - p->started;
+	return p->elapsed;
+}
+
+/*
+============
+PR_ProfileMs
+============
+*/
+static double PR_ProfileMs (uint64_t ticks)
+{
+	return ticks * 1000.0 / SDL_GetPerformanceFrequency ();
+}
+
+/*
+============
+PR_ProfileName
+
+Builtins are shown in brackets
+============
+*/
+static const char *PR_ProfileName (int func, char *buf, size_t size)
+{
+	dfunction_t *f = &qcvm->functions[func];
+
+	if (f->first_statement < 0)
+		q_snprintf (buf, size, "[%s]", PR_GetString (f->s_name));
+	else
+		q_strlcpy (buf, PR_GetString (f->s_name), size);
+	return buf;
+}
+
+/*
+============
+PR_ProfileHasAncestor
+
+True if an ancestor of node calls func from caller (any caller if -1),
+so the time of node is already part of the ancestor's total
+============
+*/
+static qboolean PR_ProfileHasAncestor (struct prprofiler_s *p, int node, int caller, int func)
+{
+	int i;
+
+	for (i = p->nodes[node].parent; i; i = p->nodes[i].parent)
+		if (p->nodes[i].func == func && (caller < 0 || p->nodes[p->nodes[i].parent].func == caller))
+			return true;
+	return false;
+}
+
+/*
+============
+PR_CompareProfileTotals
+============
+*/
+static int PR_CompareProfileTotals (const void *pa, const void *pb)
+{
+	const proftotal_t *a = (const proftotal_t *) pa;
+	const proftotal_t *b = (const proftotal_t *) pb;
+	if (a->self != b->self)
+		return a->self < b->self ? 1 : -1;
+	return a->func - b->func;
+}
+
+/*
+============
+PR_CompareProfileEdges
+============
+*/
+static int PR_CompareProfileEdges (const void *pa, const void *pb)
+{
+	const profedge_t *a = (const profedge_t *) pa;
+	const profedge_t *b = (const profedge_t *) pb;
+	if (a->caller != b->caller)
+		return a->caller - b->caller;
+	return a->callee - b->callee;
+}
+
+/*
+============
+PR_CompareProfileEdgeTimes
+============
+*/
+static int PR_CompareProfileEdgeTimes (const void *pa, const void *pb)
+{
+	const profedge_t *a = (const profedge_t *) pa;
+	const profedge_t *b = (const profedge_t *) pb;
+	if (a->total != b->total)
+		return a->total < b->total ? 1 : -1;
+	return PR_CompareProfileEdges (pa, pb);
+}
+
+/*
+============
+PR_ProfileSummary
+============
+*/
+static void PR_ProfileSummary (struct prprofiler_s *p)
+{
+	uint64_t	qc;
+	double		elapsed;
+	int			i;
+
+	qc = 0;
+	for (i = p->nodes[0].firstchild; i; i = p->nodes[i].sibling)
+		qc += p->nodes[i].total;
+
+	elapsed = PR_ProfileMs (PR_ProfileElapsed (p));
+	Con_Printf ("%s%.1f s recorded, %.1f ms in QC (%.2f%%)\n",
+		p->running ? "recording, " : "",
+		elapsed / 1000.0, PR_ProfileMs (qc),
+		elapsed > 0.0 ? PR_ProfileMs (qc) * 100.0 / elapsed : 0.0);
+}
+
+/*
+============
+PR_ProfileReport
+
+Prints the functions with the most self time
+============
+*/
+static void PR_ProfileReport (struct prprofiler_s *p, int count)
+{
+	proftotal_t	*totals;
+	profnode_t	*node;
+	char		name[64];
+	int			i, numfunctions;
+
+	numfunctions = qcvm->progs->numfunctions;
+	totals = (proftotal_t *) calloc (numfunctions, sizeof (*totals));
+	if (!totals)
+		Sys_Error ("PR_ProfileReport: out of memory");
+
+	for (i = 0; i < numfunctions; i++)
+		totals[i].func = i;
+	for (i = 1; i < (int) VEC_SIZE (p->nodes); i++)
+	{
+		node = &p->nodes[i];
+		totals[node->func].calls += node->calls;
+		totals[node->func].self += node->self;
+		if (!PR_ProfileHasAncestor (p, i, -1, node->func))
+			totals[node->func].total += node->total;
+	}
+	qsort (totals, numfunctions, sizeof (*totals), PR_CompareProfileTotals);
+
+	PR_ProfileSummary (p);
+	Con_Printf ("     calls    self ms   total ms  function\n");
+	for (i = 0; i < numfunctions && count > 0; i++)
+	{
+		if (!totals[i].calls)
+			continue;
+		count--;
+		Con_Printf ("%10i %10.2f %10.2f  %s\n", totals[i].calls,
+			PR_ProfileMs (totals[i].self), PR_ProfileMs (totals[i].total),
+			PR_ProfileName (totals[i].func, name, sizeof (name)));
+	}
+
+	free (totals);
+}
+
+/*
+============
+PR_ProfileEdges
+
+Prints the caller -> callee pairs with the most total time
+============
+*/
+static void PR_ProfileEdges (struct prprofiler_s *p, int count)
+{
+	profedge_t	*edges;
+	profnode_t	*node;
+	char		caller[64], callee[64];
+	int			i, numedges, merged;
+
+	edges = (profedge_t *) malloc (VEC_SIZE (p->nodes) * sizeof (*edges));
+	if (!edges)
+		Sys_Error ("PR_ProfileEdges: out of memory");
+
+	numedges = 0;
+	for (i = 1; i < (int) VEC_SIZE (p->nodes); i++)
+	{
+		node = &p->nodes[i];
+		if (!node->parent)
+			continue;	// called by the engine
+		edges[numedges].caller = p->nodes[node->parent].func;
+		edges[numedges].callee = node->func;
+		edges[numedges].calls = node->calls;
+		edges[numedges].total = node->total;
+		if (PR_ProfileHasAncestor (p, i, edges[numedges].caller, node->func))
+			edges[numedges].total = 0;
+		numedges++;
+	}
+
+	// merge the call paths sharing an edge
+	if (numedges)
+	{
+		qsort (edges, numedges, sizeof (*edges), PR_CompareProfileEdges);
+		merged = 0;
+		for (i = 1; i < numedges; i++)
+		{
+			if (!PR_CompareProfileEdges (&edges[merged], &edges[i]))
+			{
+				edges[merged].calls += edges[i].calls;
+				edges[merged].total += edges[i].total;
+			}
+			else
+				edges[++merged] = edges[i];
+		}
+		numedges = merged + 1;
+		qsort (edges, numedges, sizeof (*edges), PR_CompareProfileEdgeTimes);
+	}
+
+	PR_ProfileSummary (p);
+	Con_Printf ("     calls   total ms  caller -> callee\n");
+	for (i = 0; i < numedges && i < count; i++)
+	{
+		Con_Printf ("%10i %10.2f  %s -> %s\n", edges[i].calls, PR_ProfileMs (edges[i].total),
+			PR_ProfileName (edges[i].caller, caller, sizeof (caller)),
+			PR_ProfileName (edges[i].callee, callee, sizeof (callee)));
+	}
+
+	free (edges);
+}
+
+/*
+============
+PR_ProfileFlamegraph
+
+Writes one line per call path with the microseconds spent in its last
+function, the "collapsed stack" input of flamegraph.pl and speedscope
+============
+*/
+static void PR_ProfileFlamegraph (struct prprofiler_s *p, const char *filename)
+{
+	char		relname[MAX_OSPATH];
+	char		path[MAX_OSPATH];
+	char		name[64];
+	int			stack[PROF_MAXFRAMES];
+	FILE		*f;
+	int			i, j, depth, lines;
+	uint64_t	us;
+
+	if (strstr (filename, ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+	if (filename[0] == '/' || filename[0] == '\\' || strchr (filename, ':'))
+	{
+		Con_Printf ("Absolute pathnames are not allowed.\n");
+		return;
+	}
+
+	q_strlcpy (relname, filename, sizeof (relname));
+	COM_AddExtension (relname, ".txt", sizeof (relname));
+	q_snprintf (path, sizeof (path), "%s/%s", com_gamedir, relname);
+	f = COM_CreateFile (path, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", relname);
+		return;
+	}
+
+	lines = 0;
+	for (i = 1; i < (int) VEC_SIZE (p->nodes); i++)
+	{
+		us = (uint64_t) (PR_ProfileMs (p->nodes[i].self) * 1000.0 + 0.5);
+		if (!us)
+			continue;
+
+		depth = 0;
+		for (j = i; j && depth < PROF_MAXFRAMES; j = p->nodes[j].parent)
+			stack[depth++] = p->nodes[j].func;
+		while (depth--)
+			fprintf (f, "%s%c", PR_ProfileName (stack[depth], name, sizeof (name)), depth ? ';' : ' ');
+		fprintf (f, "%llu\n", (unsigned long long) us);
+		lines++;
+	}
+
+	fclose (f);
+	Con_Printf ("Wrote %d call paths to %s\n", lines, relname);
+}
+
+/*
+============
+PR_TimeProfile_f
+
+pr_profile start|stop|clear|report [count]|edges [count]|flamegraph [file]
+============
+*/
+void PR_TimeProfile_f (void)
+{
+	qcvm_t		*oldvm;
+	const char	*cmd;
+	int			count;
+
+	if (!sv.active)
+	{
+		Con_Printf ("pr_profile: no map running\n");
+		return;
+	}
+
+	cmd = Cmd_Argc () >= 2 ? Cmd_Argv (1) : "report";
+	count = Cmd_Argc () >= 3 ? Q_atoi (Cmd_Argv (2)) : 20;
+	if (count <= 0)
+		count = 20;
+
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+
+	if (!q_strcasecmp (cmd, "start"))
+	{
+		PR_ProfileStart ();
+		Con_Printf ("QC profiling started\n");
+	}
+	else if (!q_strcasecmp (cmd, "stop"))
+	{
+		PR_ProfileStop ();
+		Con_Printf ("QC profiling stopped\n");
+	}
+	else if (!q_strcasecmp (cmd, "clear"))
+	{
+		PR_ProfileClear ();
+	}
+	else if (!q_strcasecmp (cmd, "report") || !q_strcasecmp (cmd, "edges") || !q_strcasecmp (cmd, "flamegraph"))
+	{
+		if (!qcvm->profiler)
+			Con_Printf ("No QC profile recorded, use \"pr_profile start\"\n");
+		else if (!q_strcasecmp (cmd, "report"))
+			PR_ProfileReport (qcvm->profiler, count);
+		else if (!q_strcasecmp (cmd, "edges"))
+			PR_ProfileEdges (qcvm->profiler, count);
+		else
+			PR_ProfileFlamegraph (qcvm->profiler, Cmd_Argc () >= 3 ? Cmd_Argv (2) : "qcprofile");
+	}
+	else
+	{
+		Con_Printf ("usage: pr_profile start|stop|clear|report [count]|edges [count]|flamegraph [file]\n");
+	}
+
+	PR_PopQCVM (oldvm);
+}
@@ -50,6 +50,7 @@ typedef struct edict_s
 	qboolean	free;			/* don't modify directly, use ED_AddToFreeList/ED_RemoveFromFreeList */
 	link_t		freechain;
 	link_t		area;			/* linked to a division node or leaf */
+	struct areanode_s	*areanode;	/* the node area is linked to */
 
 	int		num_leafs;
 	int		leafnums[MAX_ENT_LEAFS];
@@ -85,6 +86,17 @@ typedef struct
 	dfunction_t	*f;
 } prstack_t;
 
+// statement pre-decoded for PR_ExecuteProgram's direct dispatch loop
+typedef struct
+{
+	int		op;			// opcode_t, PR_OP_BAD, or PR_OP_JIT
+	int		jump;		// branch offset for OP_IF/OP_IFNOT/OP_GOTO
+	eval_t	*a, *b, *c;	// operands resolved to global addresses
+} prstatement_t;
+
+#define PR_OP_BAD	(OP_BITOR + 1)
+#define PR_OP_JIT	(OP_BITOR + 2)		// start of a native block, see pr_jit.c
+
 typedef struct prhashtable_s
 {
 	int			capacity;
@@ -239,6 +251,7 @@ typedef struct qcvm_s
 	int				maxknownstrings;
 	int				numknownstrings;
 	const char		**firstfreeknownstring; // free list (singly linked)
+	unsigned char	*knownhunk;			// true for PR_AllocString slots, whose text never changes
 
 	unsigned char	*knownzone;
 	size_t			knownzonesize;
@@ -279,8 +292,19 @@ typedef struct qcvm_s
 
 	int			maxglobalofs;
 	int			*ofstoglobal;		// index of global at offset, or -1
+
+	byte		*fieldwatch;		// FIELDWATCH_* flags for each field offset
+
+	prstatement_t	*decoded;		// same as statements, NULL to use the switch loop
+	struct prjit_s	*jit;			// native code for hot functions, NULL if disabled
+	struct prprofiler_s	*profiler;	// wall-clock profile, NULL unless pr_profile was started
 } qcvm_t;
 
+// fields whose writes from QC must be reported to the engine
+#define FIELDWATCH_BOUNDS	1		// origin/mins/maxs/solid, see SV_MarkEdictMoved
+#define FIELDWATCH_FIND		2		// string fields indexed for find(), see ED_MarkFindDirty
+#define FIELDWATCH_CLIP		4		// other fields traces depend on, see SV_NoteClipChange
+
 typedef struct savedata_s
 {
 	FILE			*file;
@@ -314,6 +338,22 @@ void PR_PopQCVM(qcvm_t *oldvm);
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_InitDirectExec (void);
+
+void PR_JitInit (void);
+void PR_JitEnable (void);
+void PR_JitShutdown (qcvm_t *vm);
+qboolean PR_JitAvailable (void);
+qboolean PR_JitCompile (int fnum);
+void PR_JitEnter (dfunction_t *f);
+int PR_JitExecute (int statement, int *profile);
+void PR_JitStats_f (void);
+
+void PR_ProfileEnter (dfunction_t *f);
+void PR_ProfileLeave (void);
+void PR_ProfileUnwind (void);
+void PR_ProfileShutdown (qcvm_t *vm);
+void PR_TimeProfile_f (void);
 void PR_ClearProgs(qcvm_t *vm);
 qboolean PR_LoadProgs (const char *filename, qboolean fatal);
 void PR_EnableExtensions (void);
@@ -328,6 +368,7 @@ void PR_ClearEngineString (int num);
 int PR_AllocString (int bufferlength, char **ptr);
 
 void PR_Profile_f (void);
+void PR_Bench_f (void);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
@@ -344,6 +385,10 @@ const char *ED_ParseGlobals (const char *data);
 
 void ED_LoadFromFile (const char *data);
 
+void ED_FieldWatched (edict_t *ed, int ofs);
+void ED_MarkFindDirty (edict_t *ed);
+int ED_FindIndexed (int start, int ofs, const char *s);
+
 /*
 #define EDICT_NUM(n)		((edict_t *)(sv.edicts+ (n)*pr_edict_size))
 #define NUM_FOR_EDICT(e)	(((byte *)(e) - sv.edicts) / pr_edict_size)
@@ -110,9 +110,38 @@ void S_BeginPrecaching (void);
 void S_EndPrecaching (void);
 void S_PaintChannels (int endtime);
 void S_InitPaintChannels (void);
+void S_MixBench_f (void);
 float S_GetLoFreqLevel (void);
 float S_GetHiFreqLevel (void);
 
+/* changes sent by the main thread to the mixer */
+typedef enum
+{
+	SNDCMD_START,		/* start sfx on a channel, from pos for length samples */
+	SNDCMD_VOLUME,		/* respatialized channel */
+	SNDCMD_STOP,
+	SNDCMD_STOPALL,
+} sndcmdtype_t;
+
+typedef struct
+{
+	sndcmdtype_t	type;
+	int	channel;
+	sfx_t	*sfx;
+	int	pos;
+	int	length;
+	int	leftvol;
+	int	rightvol;
+} sndcmd_t;
+
+void S_ExecuteMixerCommand (const sndcmd_t *cmd);
+
+/* held while mixing, and while the cache moves or frees sound data */
+void S_LockMixer (void);
+void S_UnlockMixer (void);
+/* paintedtime as of the last mix, safe to read without the lock */
+int S_GetPaintedTime (void);
+
 /* picks a channel based on priorities, empty slots, number of channels */
 channel_t *SND_PickChannel (int entnum, int entchannel);
 
@@ -122,6 +151,8 @@ void SND_Spatialize (channel_t *ch);
 /* music stream support */
 void S_RawSamples(int samples, int rate, int width, int channels, byte * data, float volume);
 				/* Expects data in signed 16 bit, or unsigned 8 bit format. */
+int S_RawSamplesSpace (void);	/* how many samples S_RawSamples can take now */
+void S_ClearRawSamples (void);
 
 /* initializes cycling through a DMA buffer and returns information on it */
 qboolean SNDDMA_Init(dma_t *dma);
@@ -144,6 +175,16 @@ void SNDDMA_BlockSound(void);
 /* unblocks the output upon window focus gain */
 void SNDDMA_UnblockSound(void);
 
+/* offline output (snd_file.c), used by the driver for -sndfile and -sndnull */
+qboolean SNDFile_Requested(void);
+qboolean SNDFile_Active(void);
+qboolean SNDFile_Init(dma_t *dma);
+int SNDFile_GetDMAPos(void);
+void SNDFile_Shutdown(void);
+void SNDFile_LockBuffer(void);
+void SNDFile_Submit(void);
+void SNDFile_PrintStats(void);
+
 /* ====================================================================
  * User-setable variables
  * ====================================================================
@@ -157,6 +198,8 @@ extern	channel_t	snd_channels[MAX_CHANNELS];
  * MAX_DYNAMIC_CHANNELS to MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS -1 = water, etc
  * MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS to total_channels = static sounds
  */
+extern	channel_t	snd_mixchannels[MAX_CHANNELS];	/* the mixer's copy of snd_channels */
+extern	int		snd_mixtotal;
 
 extern	volatile dma_t	*shm;
 
@@ -173,8 +216,10 @@ extern	vec3_t		listener_up;
 extern	cvar_t		sndspeed;
 extern	cvar_t		snd_mixspeed;
 extern	cvar_t		snd_filterquality;
+extern	cvar_t		snd_resamplequality;
 extern	cvar_t		sfxvolume;
 extern	cvar_t		loadas8bit;
+extern	cvar_t		snd_simd;
 
 #define	MAX_RAW_SAMPLES	8192
 extern	portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
@@ -183,6 +228,8 @@ extern	cvar_t		bgmvolume;
 
 void S_LocalSound (const char *name);
 sfxcache_t *S_LoadSound (sfx_t *s);
+void S_LoadSounds (sfx_t **sfxlist, int count);
+void S_PrintLoadStats (void);
 
 wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength);
 
@@ -265,6 +265,8 @@ typedef struct
 #define	APIENTRY
 #endif
 
+#include "tasks.h"
+
 #include "progs.h"
 #include "server.h"
 
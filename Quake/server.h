@@ -294,6 +294,10 @@ void SV_ClientPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 void SV_BroadcastPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 
 void SV_Physics (void);
+void SV_NoteClipChange (edict_t *ent);
+void SV_NoteEdictLeafs (edict_t *ent);
+void SV_ClearNetIndex (void);
+void SV_NetBench_f (void);
 
 qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
@@ -290,6 +290,19 @@ int S_CodecReadStream (snd_stream_t *stream, int bytes, void *buffer)
 
 /* Util functions (used by codecs) */
 
+void S_CodecUtilError(snd_stream_t *stream, qboolean developer, const char *fmt, ...)
+{
+	va_list argptr;
+
+	/* keep the first error, unless it was only a developer message */
+	if (stream->error[0] && (developer || !stream->error_dev))
+		return;
+	va_start(argptr, fmt);
+	q_vsnprintf(stream->error, sizeof(stream->error), fmt, argptr);
+	va_end(argptr);
+	stream->error_dev = developer;
+}
+
 snd_stream_t *S_CodecUtilOpen(const char *filename, snd_codec_t *codec, qboolean loop)
 {
 	snd_stream_t *stream;
@@ -57,6 +57,8 @@ typedef struct snd_stream_s
 	snd_codec_t *codec;	/* codec handling this stream */
 	qboolean loop;
 	void *priv;		/* data private to the codec. */
+	char error[128];	/* first problem met while decoding, see S_CodecUtilError */
+	qboolean error_dev;	/* error is a developer message */
 } snd_stream_t;
 
 
@@ -85,6 +87,10 @@ int S_CodecJumpToOrder (snd_stream_t *stream, int to);
 
 snd_stream_t *S_CodecUtilOpen(const char *filename, snd_codec_t *codec, qboolean loop);
 void S_CodecUtilClose(snd_stream_t **stream);
+void S_CodecUtilError(snd_stream_t *stream, qboolean developer, const char *fmt, ...) FUNC_PRINTF(3,4);
+	/* Records a problem met while reading or seeking instead of printing
+	 * it: music is decoded on a thread of its own, which can't use the
+	 * console. The owner of the stream reports and clears it. */
 
 
 #define CODECTYPE_NONE		0
@@ -31,9 +31,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static void S_Play (void);
 static void S_PlayVol (void);
 static void S_SoundList (void);
-static void S_Update_ (void);
+static void S_Update_ (qboolean threaded);
 void S_StopAllSounds (qboolean clear);
 static void S_StopAllSoundsC (void);
+static void S_StartMixerThread (void);
+static void S_StopMixerThread (void);
+static void S_SyncMixerChannels (void);
 
 void S_SetUnderwaterIntensity (float intensity);
 
@@ -68,6 +71,12 @@ portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 static sfx_t	*known_sfx = NULL;	// hunk allocated [MAX_SFX]
 static int	num_sfx;
 
+// sounds precached between S_BeginPrecaching and S_EndPrecaching,
+// loaded together by S_LoadSounds
+static sfx_t	*snd_precachelist[MAX_SFX];
+static int	snd_numprecache;
+static qboolean	snd_precaching;
+
 static sfx_t	*ambient_sfx[NUM_AMBIENTS];
 
 static qboolean	sound_started = false;
@@ -82,8 +91,10 @@ cvar_t		sndspeed = {"sndspeed", "11025", CVAR_NONE};
 cvar_t		snd_mixspeed = {"snd_mixspeed", "44100", CVAR_NONE};
 
 cvar_t		snd_waterfx = {"snd_waterfx", "1", CVAR_ARCHIVE};
+cvar_t		snd_simd = {"snd_simd", "1", CVAR_NONE};
 
 cvar_t		snd_filterquality = {"snd_filterquality", "5", CVAR_ARCHIVE};
+cvar_t		snd_resamplequality = {"snd_resamplequality", "0", CVAR_ARCHIVE};	// 0 = point sampling, 1-3 = windowed sinc
 
 static	cvar_t	nosound = {"nosound", "0", CVAR_NONE};
 static	cvar_t	ambient_level = {"ambient_level", "0.3", CVAR_NONE};
@@ -91,6 +102,250 @@ static	cvar_t	ambient_fade = {"ambient_fade", "100", CVAR_NONE};
 static	cvar_t	snd_noextraupdate = {"snd_noextraupdate", "0", CVAR_NONE};
 static	cvar_t	snd_show = {"snd_show", "0", CVAR_NONE};
 static	cvar_t	_snd_mixahead = {"_snd_mixahead", "0.1", CVAR_ARCHIVE};
+static	cvar_t	snd_mixthread = {"snd_mixthread", "1", CVAR_ARCHIVE};
+static	cvar_t	snd_mixthread_ahead = {"snd_mixthread_ahead", "0.03", CVAR_ARCHIVE};
+
+/*
+===============================================================================
+
+MIXER THREAD
+
+The main thread owns snd_channels. Whatever changes in them is sent to the
+mixer once per S_Update through a single-producer/single-consumer command
+ring, and the mixer plays its own copy (snd_mixchannels). With
+snd_mixthread on, the mixer runs on its own thread and keeps the DMA
+buffer topped up to snd_mixthread_ahead seconds past the device position
+no matter how long frames take. Otherwise it runs at the end of S_Update
+as before, mixing _snd_mixahead seconds ahead.
+
+The mixer lock is held while mixing. The cache takes it before dropping
+sound data, since the mixer reads sfx->cache.data without touching the LRU.
+
+===============================================================================
+*/
+
+#define	MAX_SND_COMMANDS	4096	// must be a power of two
+
+static struct
+{
+	sndcmd_t		cmds[MAX_SND_COMMANDS];
+	SDL_atomic_t	head;		// next command to run, written by the mixer
+	SDL_atomic_t	tail;		// next free slot, written by the main thread
+	SDL_mutex		*lock;
+	SDL_Thread		*thread;
+	SDL_atomic_t	quit;
+	SDL_atomic_t	wrapped;	// the mixer restarted paintedtime and dropped all channels
+	SDL_atomic_t	paintedtime;	// paintedtime as of the last mix, for the main thread
+	int				maxstep;	// largest soundtime advance seen, about the device period
+} snd_mixer;
+
+// what the mixer was last told about each channel
+static struct
+{
+	sfx_t		*sfx;
+	int			leftvol;
+	int			rightvol;
+	qboolean	restart;	// started again since, even if with the same sfx
+} snd_sent[MAX_CHANNELS];
+
+void S_LockMixer (void)
+{
+	if (snd_mixer.lock)
+		SDL_LockMutex (snd_mixer.lock);
+}
+
+void S_UnlockMixer (void)
+{
+	if (snd_mixer.lock)
+		SDL_UnlockMutex (snd_mixer.lock);
+}
+
+/*
+================
+S_GetPaintedTime
+
+The main thread's view of paintedtime, which belongs to the mixer
+================
+*/
+int S_GetPaintedTime (void)
+{
+	return SDL_AtomicGet (&snd_mixer.paintedtime);
+}
+
+/*
+================
+S_RunMixerCommands
+
+Mixer side, with the mixer lock held
+================
+*/
+static void S_RunMixerCommands (void)
+{
+	int head = SDL_AtomicGet (&snd_mixer.head);
+	int tail = SDL_AtomicGet (&snd_mixer.tail);
+
+	while (head != tail)
+	{
+		S_ExecuteMixerCommand (&snd_mixer.cmds[head & (MAX_SND_COMMANDS - 1)]);
+		head++;
+	}
+	SDL_AtomicSet (&snd_mixer.head, head);
+}
+
+/*
+================
+S_PushMixerCommand
+================
+*/
+static void S_PushMixerCommand (sndcmdtype_t type, int channel, sfx_t *sfx, int pos, int length, int leftvol, int rightvol)
+{
+	sndcmd_t	*cmd;
+	int			tail = SDL_AtomicGet (&snd_mixer.tail);
+
+	while (tail - SDL_AtomicGet (&snd_mixer.head) >= MAX_SND_COMMANDS)
+	{
+		// the ring is full: let the mixer catch up, or catch it up ourselves
+		if (snd_mixer.thread)
+			SDL_Delay (1);
+		else
+		{
+			S_LockMixer ();
+			S_RunMixerCommands ();
+			S_UnlockMixer ();
+		}
+	}
+
+	cmd = &snd_mixer.cmds[tail & (MAX_SND_COMMANDS - 1)];
+	cmd->type = type;
+	cmd->channel = channel;
+	cmd->sfx = sfx;
+	cmd->pos = pos;
+	cmd->length = length;
+	cmd->leftvol = leftvol;
+	cmd->rightvol = rightvol;
+	SDL_AtomicSet (&snd_mixer.tail, tail + 1);
+}
+
+/*
+================
+S_SyncMixerChannels
+
+Sends the mixer what changed in snd_channels since the last call
+================
+*/
+static void S_SyncMixerChannels (void)
+{
+	int			i;
+	channel_t	*ch;
+	sfxcache_t	*sc;
+
+	for (i = 0, ch = snd_channels; i < total_channels; i++, ch++)
+	{
+		if (ch->sfx != snd_sent[i].sfx || snd_sent[i].restart)
+		{
+			sc = ch->sfx ? S_LoadSound (ch->sfx) : NULL;
+			if (sc)
+				S_PushMixerCommand (SNDCMD_START, i, ch->sfx, ch->pos, sc->length - ch->pos, ch->leftvol, ch->rightvol);
+			else if (snd_sent[i].sfx)
+				S_PushMixerCommand (SNDCMD_STOP, i, NULL, 0, 0, 0, 0);
+		}
+		else if (ch->sfx && (ch->leftvol != snd_sent[i].leftvol || ch->rightvol != snd_sent[i].rightvol))
+			S_PushMixerCommand (SNDCMD_VOLUME, i, ch->sfx, 0, 0, ch->leftvol, ch->rightvol);
+
+		snd_sent[i].sfx = ch->sfx;
+		snd_sent[i].leftvol = ch->leftvol;
+		snd_sent[i].rightvol = ch->rightvol;
+		snd_sent[i].restart = false;
+	}
+}
+
+/*
+================
+S_UpdateChannelTimes
+
+Follows the mixer's progress in snd_channels: loops the end time of looping
+sounds, drops finished ones, and keeps what's playing in the cache
+================
+*/
+static void S_UpdateChannelTimes (void)
+{
+	int			i, looplen, painted;
+	channel_t	*ch;
+	sfxcache_t	*sc;
+
+	painted = S_GetPaintedTime ();
+
+	for (i = 0, ch = snd_channels; i < total_channels; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+		sc = S_LoadSound (ch->sfx);
+		if (!sc)
+			continue;
+
+		if (ch->end - painted <= 0)
+		{
+			looplen = sc->length - sc->loopstart;
+			if (sc->loopstart >= 0 && looplen > 0)
+				ch->end += ((painted - ch->end) / looplen + 1) * looplen;
+			else
+			{	// the mixer stopped it already
+				ch->sfx = snd_sent[i].sfx = NULL;
+				continue;
+			}
+		}
+		ch->pos = CLAMP (0, sc->length - (ch->end - painted), sc->length);
+	}
+}
+
+/*
+================
+S_MixerThread
+================
+*/
+static int SDLCALL S_MixerThread (void *unused)
+{
+	while (!SDL_AtomicGet (&snd_mixer.quit))
+	{
+		S_LockMixer ();
+		S_Update_ (true);
+		S_UnlockMixer ();
+		SDL_Delay (q_max (1, (int) (snd_mixthread_ahead.value * 250.f)));
+	}
+	return 0;
+}
+
+static void S_StartMixerThread (void)
+{
+	if (snd_mixer.thread || !sound_started || !snd_mixer.lock)
+		return;
+	if (SNDFile_Active ())
+		return;	// offline output has to mix in step with the frames
+
+	SDL_AtomicSet (&snd_mixer.quit, 0);
+	snd_mixer.maxstep = 0;
+	snd_mixer.thread = SDL_CreateThread (S_MixerThread, "Mixer", NULL);
+	if (!snd_mixer.thread)
+		Con_Printf ("Couldn't start the mixer thread: %s\n", SDL_GetError ());
+}
+
+static void S_StopMixerThread (void)
+{
+	if (!snd_mixer.thread)
+		return;
+
+	SDL_AtomicSet (&snd_mixer.quit, 1);
+	SDL_WaitThread (snd_mixer.thread, NULL);
+	snd_mixer.thread = NULL;
+}
+
+static void SND_Callback_snd_mixthread (cvar_t *var)
+{
+	if (var->value)
+		S_StartMixerThread ();
+	else
+		S_StopMixerThread ();
+}
 
 
 static void S_SoundInfo_f (void)
@@ -108,12 +363,15 @@ static void S_SoundInfo_f (void)
 	Con_Printf("%5d submission_chunk\n", shm->submission_chunk);
 	Con_Printf("%5d total_channels\n", total_channels);
 	Con_Printf("%p dma buffer\n", shm->buffer);
+	SNDFile_PrintStats ();
 }
 
 
 static void SND_Callback_sfxvolume (cvar_t *var)
 {
+	S_LockMixer ();
 	SND_InitScaletable ();
+	S_UnlockMixer ();
 }
 
 static void SND_Callback_snd_filterquality (cvar_t *var)
@@ -145,6 +403,8 @@ void S_Startup (void)
 	{
 		Con_Printf("Audio: %d bit, %s, %d Hz\n", shm->samplebits,
 				(shm->channels == 2) ? "stereo" : "mono", shm->speed);
+		if (snd_mixthread.value)
+			S_StartMixerThread ();
 	}
 }
 
@@ -177,7 +437,12 @@ void S_Init (void)
 	Cvar_RegisterVariable(&sndspeed);
 	Cvar_RegisterVariable(&snd_mixspeed);
 	Cvar_RegisterVariable(&snd_filterquality);
+	Cvar_RegisterVariable(&snd_resamplequality);
 	Cvar_RegisterVariable(&snd_waterfx);
+	Cvar_RegisterVariable(&snd_simd);
+	Cvar_RegisterVariable(&snd_mixthread);
+	Cvar_RegisterVariable(&snd_mixthread_ahead);
+	Cvar_SetCallback(&snd_mixthread, SND_Callback_snd_mixthread);
 
 	if (safemode || COM_CheckParm("-nosound"))
 		return;
@@ -189,6 +454,7 @@ void S_Init (void)
 	Cmd_AddCommand("stopsound", S_StopAllSoundsC);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("snd_mixbench", S_MixBench_f);
 
 	i = COM_CheckParm("-sndspeed");
 	if (i && i < com_argc-1)
@@ -216,6 +482,10 @@ void S_Init (void)
 	known_sfx = (sfx_t *) Hunk_AllocName (MAX_SFX*sizeof(sfx_t), "sfx_t");
 	num_sfx = 0;
 
+	snd_mixer.lock = SDL_CreateMutex ();
+	if (!snd_mixer.lock)
+		Sys_Error ("S_Init: couldn't create the mixer lock: %s", SDL_GetError ());
+
 	snd_initialized = true;
 
 	S_Startup ();
@@ -243,6 +513,8 @@ void S_Shutdown (void)
 	if (!sound_started)
 		return;
 
+	S_StopMixerThread ();
+
 	sound_started = 0;
 	snd_blocked = 0;
 
@@ -329,7 +601,12 @@ sfx_t *S_PrecacheSound (const char *name)
 
 // cache it in
 	if (precache.value)
-		S_LoadSound (sfx);
+	{
+		if (snd_precaching && snd_numprecache < MAX_SFX)
+			snd_precachelist[snd_numprecache++] = sfx;
+		else
+			S_LoadSound (sfx);
+	}
 
 	return sfx;
 }
@@ -349,10 +626,12 @@ channel_t *SND_PickChannel (int entnum, int entchannel)
 	int	ch_idx;
 	int	first_to_die;
 	int	life_left;
+	int	painted;
 
 // Check for replacement sound, or find the best one to replace
 	first_to_die = -1;
 	life_left = 0x7fffffff;
+	painted = S_GetPaintedTime ();
 	for (ch_idx = NUM_AMBIENTS; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS; ch_idx++)
 	{
 		if (entchannel != 0		// channel 0 never overrides
@@ -367,9 +646,9 @@ channel_t *SND_PickChannel (int entnum, int entchannel)
 		if (snd_channels[ch_idx].entnum == cl.viewentity && entnum != cl.viewentity && snd_channels[ch_idx].sfx)
 			continue;
 
-		if (snd_channels[ch_idx].end - paintedtime < life_left)
+		if (snd_channels[ch_idx].end - painted < life_left)
 		{
-			life_left = snd_channels[ch_idx].end - paintedtime;
+			life_left = snd_channels[ch_idx].end - painted;
 			first_to_die = ch_idx;
 		}
 	}
@@ -500,7 +779,8 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 
 	target_chan->sfx = sfx;
 	target_chan->pos = 0.0;
-	target_chan->end = paintedtime + sc->length;
+	target_chan->end = S_GetPaintedTime () + sc->length;
+	snd_sent[target_chan - snd_channels].restart = true;
 
 // if an identical sound has also been started this frame, offset the pos
 // a bit to keep it from just making the first one louder
@@ -561,6 +841,8 @@ void S_StopAllSounds (qboolean clear)
 	}
 
 	memset(snd_channels, 0, MAX_CHANNELS * sizeof(channel_t));
+	memset(snd_sent, 0, sizeof(snd_sent));
+	S_PushMixerCommand (SNDCMD_STOPALL, 0, NULL, 0, 0, 0, 0);
 
 	if (clear)
 		S_ClearBuffer ();
@@ -571,14 +853,17 @@ static void S_StopAllSoundsC (void)
 	S_StopAllSounds (true);
 }
 
-void S_ClearBuffer (void)
+/*
+==================
+S_ClearDMABuffer
+
+With the mixer and DMA buffer locked
+==================
+*/
+static void S_ClearDMABuffer (void)
 {
 	int		clear;
 
-	if (!sound_started || !shm)
-		return;
-
-	SNDDMA_LockBuffer ();
 	if (! shm->buffer)
 		return;
 
@@ -591,8 +876,18 @@ void S_ClearBuffer (void)
 
 	memset (shm->buffer, clear, shm->samples * shm->samplebits / 8);
 	memset (s_rawsamples, 0, sizeof (s_rawsamples));
+}
 
+void S_ClearBuffer (void)
+{
+	if (!sound_started || !shm)
+		return;
+
+	S_LockMixer ();
+	SNDDMA_LockBuffer ();
+	S_ClearDMABuffer ();
 	SNDDMA_Submit ();
+	S_UnlockMixer ();
 }
 
 
@@ -632,7 +927,8 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 	VectorCopy (origin, ss->origin);
 	ss->master_vol = (int)vol;
 	ss->dist_mult = (attenuation / 64) / sound_nominal_clip_dist;
-	ss->end = paintedtime + sc->length;
+	ss->end = S_GetPaintedTime () + sc->length;
+	snd_sent[ss - snd_channels].restart = true;
 
 	SND_Spatialize (ss);
 }
@@ -743,6 +1039,8 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data, f
 	float scale;
 	int intVolume;
 
+	S_LockMixer ();
+
 	if (s_rawend < paintedtime)
 		s_rawend = paintedtime;
 
@@ -809,6 +1107,39 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data, f
 			s_rawsamples [dst].right = (((byte *) data)[src] - 128) * intVolume;
 		}
 	}
+
+	S_UnlockMixer ();
+}
+
+/*
+===================
+S_RawSamplesSpace
+
+How many samples S_RawSamples can take before
+overwriting what the mixer hasn't played yet
+===================
+*/
+int S_RawSamplesSpace (void)
+{
+	int space;
+
+	S_LockMixer ();
+	space = MAX_RAW_SAMPLES - (q_max (s_rawend, paintedtime) - paintedtime);
+	S_UnlockMixer ();
+
+	return space;
+}
+
+/*
+===================
+S_ClearRawSamples
+===================
+*/
+void S_ClearRawSamples (void)
+{
+	S_LockMixer ();
+	s_rawend = 0;
+	S_UnlockMixer ();
 }
 
 /*
@@ -911,8 +1242,22 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 // add raw data from streamed samples
 //	BGM_Update();	// moved to the main loop just before S_Update ()
 
-// mix some sound
-	S_Update_();
+// the mixer ran out of 32 bit time and dropped everything
+	if (SDL_AtomicCAS (&snd_mixer.wrapped, 1, 0))
+		S_StopAllSounds (false);
+
+// hand the changes over to the mixer
+	S_SyncMixerChannels ();
+
+// mix some sound, unless the mixer thread does
+	if (!snd_mixer.thread)
+	{
+		S_LockMixer ();
+		S_Update_ (false);
+		S_UnlockMixer ();
+	}
+
+	S_UpdateChannelTimes ();
 }
 
 static void GetSoundtime (void)
@@ -936,7 +1281,10 @@ static void GetSoundtime (void)
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			paintedtime = fullsamples;
-			S_StopAllSounds (true);
+			memset (snd_mixchannels, 0, sizeof (snd_mixchannels));
+			snd_mixtotal = 0;
+			S_ClearDMABuffer ();
+			SDL_AtomicSet (&snd_mixer.wrapped, 1); // S_Update drops the channels on its side
 		}
 	}
 	oldsamplepos = samplepos;
@@ -946,24 +1294,39 @@ static void GetSoundtime (void)
 
 void S_ExtraUpdate (void)
 {
-	if (snd_noextraupdate.value)
+	if (snd_noextraupdate.value || snd_mixer.thread)
 		return;		// don't pollute timings
-	S_Update_();
+	S_LockMixer ();
+	S_Update_ (false);
+	S_UnlockMixer ();
 }
 
-static void S_Update_ (void)
+/*
+================
+S_Update_
+
+Runs the mixer, with the mixer lock held
+================
+*/
+static void S_Update_ (qboolean threaded)
 {
 	unsigned int	endtime;
-	int		samps;
+	int		samps, oldsoundtime, ahead;
+
+	S_RunMixerCommands ();
 
 	if (!sound_started || (snd_blocked > 0))
 		return;
 
 	SNDDMA_LockBuffer ();
 	if (! shm->buffer)
+	{
+		SNDDMA_Submit ();
 		return;
+	}
 
 // Updates DMA time
+	oldsoundtime = soundtime;
 	GetSoundtime();
 
 // check to make sure that we haven't overshot
@@ -974,11 +1337,22 @@ static void S_Update_ (void)
 	}
 
 // mix ahead of current position
-	endtime = soundtime + (unsigned int)(_snd_mixahead.value * shm->speed);
 	samps = shm->samples >> (shm->channels - 1);
+	if (threaded)
+	{
+	// the device takes whole periods at once, so stay a period ahead on top of
+	// the requested latency
+		if (soundtime - oldsoundtime < samps / 4)
+			snd_mixer.maxstep = q_max (snd_mixer.maxstep, soundtime - oldsoundtime);
+		ahead = (int)(snd_mixthread_ahead.value * shm->speed) + snd_mixer.maxstep;
+	}
+	else
+		ahead = (int)(_snd_mixahead.value * shm->speed);
+	endtime = soundtime + (unsigned int)ahead;
 	endtime = q_min(endtime, (unsigned int)(soundtime + samps));
 
 	S_PaintChannels (endtime);
+	SDL_AtomicSet (&snd_mixer.paintedtime, paintedtime);
 
 	SNDDMA_Submit ();
 }
@@ -1083,6 +1457,7 @@ static void S_SoundList (void)
 		Con_SafePrintf("(%2db) %6i : %s\n", sc->width*8, size, sfx->name); //johnfitz -- was Con_Printf
 	}
 	Con_Printf ("%i sounds, %i bytes\n", num_sfx, total); //johnfitz -- added count
+	S_PrintLoadStats ();
 }
 
 
@@ -1105,14 +1480,32 @@ void S_LocalSound (const char *name)
 }
 
 
+/*
+==================
+S_ClearPrecache
+
+Drops the sounds queued since S_BeginPrecaching, for when a Host_Error
+skipped S_EndPrecaching; they'll be loaded when first played instead
+==================
+*/
 void S_ClearPrecache (void)
 {
+	snd_precaching = false;
+	snd_numprecache = 0;
 }
 
 void S_BeginPrecaching (void)
 {
+	snd_numprecache = 0;
+	snd_precaching = true;
 }
 
 void S_EndPrecaching (void)
 {
+	if (!snd_precaching)
+		return;
+	snd_precaching = false;
+	if (sound_started && snd_numprecache)
+		S_LoadSounds (snd_precachelist, snd_numprecache);
+	snd_numprecache = 0;
 }
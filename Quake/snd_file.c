@@ -0,0 +1,308 @@
+/*
+ * snd_file.c - offline sound output: mixes without an audio device,
+ * optionally writing the mix to a wav file.
+ *
+ * Copyright (C) 1996-2001 Id Software, Inc.
+ * Copyright (C) 2010-2014 QuakeSpasm developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Selected with -sndfile <name.wav> or -sndnull, in place of the SDL
+ * driver. Instead of following a device, the output position only moves
+ * during timedemo playback, by the client time that passed since the
+ * previous update, and never past what the mixer has painted. The same
+ * demo therefore always produces the same samples, so the output can be
+ * diffed, and the time spent mixing can be benchmarked without a sound
+ * card. The mixer thread is not used with this driver. */
+
+#include "quakedef.h"
+
+#define SNDFILE_SAMPLES		(1 << 16)	/* dma buffer size, mono samples */
+#define SNDFILE_MAXSTEP		0.1		/* max seconds consumed per update */
+
+static struct
+{
+	qboolean	active;
+	FILE		*file;		/* NULL for -sndnull */
+	char		name[MAX_OSPATH];
+	int		framesize;	/* bytes per sample frame */
+	int		ringframes;	/* dma buffer size in frames */
+	unsigned int	clock;		/* frames consumed */
+	unsigned int	painted;	/* frames painted by the mixer */
+	int		lastpaintedtime;
+	double		lasttime;	/* cl.time at the previous update, < 0 if none */
+	double		fraction;	/* part of a frame carried over */
+	unsigned int	written;	/* bytes written to the file */
+	double		mixstart;
+	double		mixtime;	/* seconds spent between LockBuffer and Submit */
+} snd_file;
+
+/*
+==================
+SNDFile_Requested
+==================
+*/
+qboolean SNDFile_Requested (void)
+{
+	return COM_CheckParm ("-sndfile") || COM_CheckParm ("-sndnull");
+}
+
+/*
+==================
+SNDFile_Active
+==================
+*/
+qboolean SNDFile_Active (void)
+{
+	return snd_file.active;
+}
+
+static void SNDFile_PutLong (byte *p, int val)
+{
+	p[0] = val & 255;
+	p[1] = (val >> 8) & 255;
+	p[2] = (val >> 16) & 255;
+	p[3] = (val >> 24) & 255;
+}
+
+static void SNDFile_PutShort (byte *p, int val)
+{
+	p[0] = val & 255;
+	p[1] = (val >> 8) & 255;
+}
+
+/*
+==================
+SNDFile_WriteHeader -- (re)writes the wav header for the data written so far
+==================
+*/
+static void SNDFile_WriteHeader (void)
+{
+	byte	header[44];
+
+	memcpy (header, "RIFF", 4);
+	SNDFile_PutLong (header + 4, 36 + snd_file.written);
+	memcpy (header + 8, "WAVEfmt ", 8);
+	SNDFile_PutLong (header + 16, 16);
+	SNDFile_PutShort (header + 20, WAV_FORMAT_PCM);
+	SNDFile_PutShort (header + 22, shm->channels);
+	SNDFile_PutLong (header + 24, shm->speed);
+	SNDFile_PutLong (header + 28, shm->speed * snd_file.framesize);
+	SNDFile_PutShort (header + 32, snd_file.framesize);
+	SNDFile_PutShort (header + 34, shm->samplebits);
+	memcpy (header + 36, "data", 4);
+	SNDFile_PutLong (header + 40, snd_file.written);
+
+	fseek (snd_file.file, 0, SEEK_SET);
+	fwrite (header, 1, sizeof (header), snd_file.file);
+	fseek (snd_file.file, 0, SEEK_END);
+}
+
+/*
+==================
+SNDFile_Init
+==================
+*/
+qboolean SNDFile_Init (dma_t *dma)
+{
+	int	i;
+
+	memset (&snd_file, 0, sizeof (snd_file));
+
+	i = COM_CheckParm ("-sndfile");
+	if (i)
+	{
+		if (i >= com_argc - 1)
+		{
+			Con_Printf ("-sndfile needs a file name\n");
+			return false;
+		}
+		q_strlcpy (snd_file.name, com_argv[i + 1], sizeof (snd_file.name));
+		snd_file.file = Sys_fopen (snd_file.name, "wb");
+		if (!snd_file.file)
+		{
+			Con_Printf ("Couldn't create %s\n", snd_file.name);
+			return false;
+		}
+	}
+
+	memset ((void *) dma, 0, sizeof (dma_t));
+	shm = dma;
+
+	shm->samplebits = loadas8bit.value ? 8 : 16;
+	shm->signed8 = 0;
+	shm->speed = snd_mixspeed.value;
+	shm->channels = 2;
+	shm->samples = SNDFILE_SAMPLES;
+	shm->samplepos = 0;
+	shm->submission_chunk = 1;
+	shm->buffer = (unsigned char *) calloc (1, shm->samples * (shm->samplebits / 8));
+	if (!shm->buffer)
+	{
+		if (snd_file.file)
+			fclose (snd_file.file);
+		snd_file.file = NULL;
+		shm = NULL;
+		Con_Printf ("Failed allocating memory for offline audio\n");
+		return false;
+	}
+
+	snd_file.framesize = shm->channels * (shm->samplebits / 8);
+	snd_file.ringframes = shm->samples / shm->channels;
+	snd_file.lasttime = -1.0;
+	snd_file.active = true;
+
+	if (snd_file.file)
+	{
+		SNDFile_WriteHeader ();
+		Con_Printf ("Offline audio: writing timedemo sound to %s\n", snd_file.name);
+	}
+	else
+		Con_Printf ("Offline audio: mixing timedemo sound without output\n");
+
+	return true;
+}
+
+/*
+==================
+SNDFile_Write -- hands frames [first, first + count) of the dma buffer to the file
+==================
+*/
+static void SNDFile_Write (unsigned int first, int count)
+{
+	int	ofs, len;
+	byte	*data;
+	short	*s;
+
+	while (count > 0)
+	{
+		ofs = first % snd_file.ringframes;
+		len = q_min (count, snd_file.ringframes - ofs);
+		data = shm->buffer + ofs * snd_file.framesize;
+		if (shm->samplebits == 16 && host_bigendian)
+		{
+			for (s = (short *) data; s < (short *) data + len * shm->channels; s++)
+				*s = LittleShort (*s);
+			fwrite (data, snd_file.framesize, len, snd_file.file);
+			for (s = (short *) data; s < (short *) data + len * shm->channels; s++)
+				*s = LittleShort (*s);
+		}
+		else
+			fwrite (data, snd_file.framesize, len, snd_file.file);
+		snd_file.written += len * snd_file.framesize;
+		first += len;
+		count -= len;
+	}
+}
+
+/*
+==================
+SNDFile_GetDMAPos
+==================
+*/
+int SNDFile_GetDMAPos (void)
+{
+	double	delta;
+	int	frames;
+
+// catch up with the mixer; if it dropped back to the start of its time
+// (see GetSoundtime), it is painting from the start of our current buffer
+	if (paintedtime >= snd_file.lastpaintedtime)
+		snd_file.painted += paintedtime - snd_file.lastpaintedtime;
+	else
+		snd_file.painted = snd_file.clock - snd_file.clock % snd_file.ringframes + paintedtime;
+	snd_file.lastpaintedtime = paintedtime;
+
+// advance by the client time that passed during timedemo playback
+	frames = 0;
+	if (cls.timedemo && cls.signon == SIGNONS)
+	{
+		if (snd_file.lasttime >= 0.0 && cl.time > snd_file.lasttime)
+		{
+			delta = q_min (cl.time - snd_file.lasttime, SNDFILE_MAXSTEP);
+			snd_file.fraction += delta * shm->speed;
+			frames = (int) snd_file.fraction;
+			snd_file.fraction -= frames;
+		}
+		snd_file.lasttime = cl.time;
+	}
+	else
+		snd_file.lasttime = -1.0;
+
+	frames = q_min (frames, (int) (snd_file.painted - snd_file.clock));
+	if (frames > 0)
+	{
+		if (snd_file.file)
+			SNDFile_Write (snd_file.clock, frames);
+		snd_file.clock += frames;
+	}
+
+	shm->samplepos = (snd_file.clock % snd_file.ringframes) * shm->channels;
+	return shm->samplepos;
+}
+
+/*
+==================
+SNDFile_PrintStats
+==================
+*/
+void SNDFile_PrintStats (void)
+{
+	double	seconds;
+
+	if (!snd_file.active)
+		return;
+
+	seconds = (double) snd_file.clock / shm->speed;
+	Con_Printf ("Offline audio: %.1f seconds output, %.1f ms mixing (%.2f ms per output second)\n",
+		seconds, snd_file.mixtime * 1000.0, seconds > 0.0 ? snd_file.mixtime * 1000.0 / seconds : 0.0);
+}
+
+/*
+==================
+SNDFile_Shutdown
+==================
+*/
+void SNDFile_Shutdown (void)
+{
+	if (!snd_file.active)
+		return;
+
+	SNDFile_PrintStats ();
+	if (snd_file.file)
+	{
+		SNDFile_WriteHeader ();
+		fclose (snd_file.file);
+		snd_file.file = NULL;
+		Con_Printf ("Wrote %u bytes of audio to %s\n", snd_file.written, snd_file.name);
+	}
+
+	free (shm->buffer);
+	shm->buffer = NULL;
+	shm = NULL;
+	snd_file.active = false;
+}
+
+void SNDFile_LockBuffer (void)
+{
+	snd_file.mixstart = Sys_DoubleTime ();
+}
+
+void SNDFile_Submit (void)
+{
+	snd_file.mixtime += Sys_DoubleTime () - snd_file.mixstart;
+}
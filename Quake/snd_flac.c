@@ -69,6 +69,7 @@ typedef size_t   FLAC_SIZE_T;
 
 typedef struct {
 	FLAC__StreamDecoder *decoder;
+	snd_stream_t *stream;
 	fshandle_t *file;
 	snd_info_t *info;
 	byte *buffer;
@@ -82,7 +83,7 @@ flac_error_func (const FLAC__StreamDecoder *decoder,
 {
 	flacfile_t *ff = (flacfile_t *) client_data;
 	ff->error = -1;
-	Con_Printf ("FLAC: decoder error %i\n", status);
+	S_CodecUtilError (ff->stream, false, "FLAC: decoder error %i\n", status);
 }
 
 static FLAC__StreamDecoderReadStatus
@@ -248,6 +249,7 @@ static qboolean S_FLAC_CodecOpenStream (snd_stream_t *stream)
 	}
 
 	stream->priv = ff;
+	ff->stream = stream;
 	ff->info = & stream->info;
 	ff->file = & stream->fh;
 	ff->info->dataofs = -1; /* check for STREAMINFO metadata existence */
@@ -341,8 +343,7 @@ static int S_FLAC_CodecReadStream (snd_stream_t *stream, int len, void *buffer)
 			ff->pos += res;
 		} else if (res < 0) { /* error */
 			return -1;
-		} else {
-			Con_DPrintf ("FLAC: EOF\n");
+		} else {	/* EOF */
 			break;
 		}
 	}
@@ -23,41 +23,214 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+/*
+===============================================================================
+
+RESAMPLING
+
+Sounds are converted to the mixing rate once, when they're loaded.
+snd_resamplequality 0 keeps the original point sampling, higher values
+use a Blackman-windowed sinc filter of 8, 16 or 32 taps, read from a
+polyphase table built once per source rate on the main thread.
+
+===============================================================================
+*/
+
+#define SND_RESAMPLE_PHASES	256		// table rows per input sample
+#define MAX_SND_RESAMPLERS	16
+
+typedef struct
+{
+	int		inrate;
+	int		taps;			// coefficients per phase
+	float	*coefs;			// [SND_RESAMPLE_PHASES + 1][taps]
+} sndresampler_t;
+
+static sndresampler_t	snd_resamplers[MAX_SND_RESAMPLERS];
+static int				snd_numresamplers;
+static int				snd_resampler_outrate;
+static int				snd_resampler_quality;
+
+/*
+================
+S_BuildResampler
+================
+*/
+static void S_BuildResampler (sndresampler_t *rs, int inrate, int outrate, int quality)
+{
+	float	cutoff, *row;
+	double	t, x, sum;
+	int		half, phase, k;
+
+	// the cutoff is the lower of the two Nyquist rates, relative to the input
+	cutoff = q_min (1.f, (float) outrate / inrate);
+	half = (int) ceil ((4 << (quality - 1)) / cutoff);
+
+	rs->inrate = inrate;
+	rs->taps = half * 2;
+	rs->coefs = (float *) malloc ((SND_RESAMPLE_PHASES + 1) * rs->taps * sizeof (float));
+	if (!rs->coefs)
+		Sys_Error ("S_BuildResampler: out of memory");
+
+	for (phase = 0; phase <= SND_RESAMPLE_PHASES; phase++)
+	{
+		row = rs->coefs + phase * rs->taps;
+		sum = 0.0;
+		for (k = 0; k < rs->taps; k++)
+		{
+			t = k - half + 1 - (double) phase / SND_RESAMPLE_PHASES;
+			x = t / half;
+			row[k] = cutoff;
+			if (t != 0.0)
+				row[k] *= sin (M_PI * cutoff * t) / (M_PI * cutoff * t);
+			if (fabs (x) < 1.0)
+				row[k] *= 0.42 + 0.5 * cos (M_PI * x) + 0.08 * cos (2.0 * M_PI * x);
+			else
+				row[k] = 0.f;
+			sum += row[k];
+		}
+		// normalize each phase so constant input stays constant
+		for (k = 0; k < rs->taps; k++)
+			row[k] /= sum;
+	}
+}
+
+/*
+================
+S_GetResampler -- main thread only; returns NULL for point sampling
+================
+*/
+static const sndresampler_t *S_GetResampler (int inrate)
+{
+	int		i, quality;
+
+	quality = CLAMP (0, (int) snd_resamplequality.value, 3);
+	if (quality != snd_resampler_quality || shm->speed != snd_resampler_outrate)
+	{
+		for (i = 0; i < snd_numresamplers; i++)
+			free (snd_resamplers[i].coefs);
+		snd_numresamplers = 0;
+		snd_resampler_quality = quality;
+		snd_resampler_outrate = shm->speed;
+	}
+
+	if (!quality || inrate == shm->speed)
+		return NULL;
+
+	for (i = 0; i < snd_numresamplers; i++)
+		if (snd_resamplers[i].inrate == inrate)
+			return &snd_resamplers[i];
+
+	if (snd_numresamplers == MAX_SND_RESAMPLERS)
+		return NULL;
+
+	S_BuildResampler (&snd_resamplers[snd_numresamplers], inrate, shm->speed, quality);
+	return &snd_resamplers[snd_numresamplers++];
+}
+
+/*
+================
+S_ResampleInput -- input sample at idx, following the loop past the end
+================
+*/
+static float S_ResampleInput (const float *in, int idx, const wavinfo_t *info)
+{
+	if (idx < 0)
+		return 0.f;
+	if (idx >= info->samples)
+	{
+		if (info->loopstart < 0 || info->loopstart >= info->samples)
+			return 0.f;	// not looped, or no loop to follow
+		idx = info->loopstart + (idx - info->samples) % (info->samples - info->loopstart);
+	}
+	return in[idx];
+}
+
+/*
+================
+ResampleSfxSinc
+================
+*/
+static qboolean ResampleSfxSinc (sfxcache_t *sc, const wavinfo_t *info, const byte *data, const sndresampler_t *rs)
+{
+	float	*in, sum;
+	const float	*row, *src;
+	int		i, k, first, half, val;
+	int		srcsample, samplefrac, fracstep;
+
+	in = (float *) malloc (info->samples * sizeof (float));
+	if (!in)
+		return false;
+
+	for (i = 0; i < info->samples; i++)
+	{
+		if (info->width == 2)
+			in[i] = LittleShort (((const short *)data)[i]);
+		else
+			in[i] = (int)((unsigned char)(data[i]) - 128) << 8;
+	}
+
+	half = rs->taps / 2;
+	srcsample = samplefrac = 0;
+	fracstep = (int)((double) info->rate * 65536.0 / sc->speed);
+	for (i = 0; i < sc->length; i++)
+	{
+		row = rs->coefs + ((samplefrac + 128) >> 8) * rs->taps;
+		first = srcsample - half + 1;
+		sum = 0.f;
+		if (first >= 0 && first + rs->taps <= info->samples)
+		{
+			src = in + first;
+			for (k = 0; k < rs->taps; k++)
+				sum += src[k] * row[k];
+		}
+		else
+		{
+			for (k = 0; k < rs->taps; k++)
+				sum += S_ResampleInput (in, first + k, info) * row[k];
+		}
+
+		val = Q_rint (sum);
+		val = CLAMP (-32768, val, 32767);
+		if (sc->width == 2)
+			((short *)sc->data)[i] = val;
+		else
+			((signed char *)sc->data)[i] = val >> 8;
+
+		samplefrac += fracstep;
+		srcsample += samplefrac >> 16;
+		samplefrac &= 65535;
+	}
+
+	free (in);
+	return true;
+}
+
 /*
 ================
 ResampleSfx
+
+Fills in the samples of a cache entry set up by S_AllocSfxCache.
+Doesn't touch anything shared, so it can run on a worker thread.
 ================
 */
-static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
+static void ResampleSfx (sfxcache_t *sc, const wavinfo_t *info, const byte *data, const sndresampler_t *rs)
 {
 	int		outcount;
 	int		srcsample;
 	float	stepscale;
 	int		i;
 	int		sample, samplefrac, fracstep;
-	sfxcache_t	*sc;
 
-	sc = (sfxcache_t *) Cache_Check (&sfx->cache);
-	if (!sc)
+	if (rs && ResampleSfxSinc (sc, info, data, rs))
 		return;
 
-	stepscale = (float)inrate / shm->speed;	// this is usually 0.5, 1, or 2
-
-	outcount = sc->length / stepscale;
-	sc->length = outcount;
-	if (sc->loopstart != -1)
-		sc->loopstart = sc->loopstart / stepscale;
-
-	sc->speed = shm->speed;
-	if (loadas8bit.value)
-		sc->width = 1;
-	else
-		sc->width = inwidth;
-	sc->stereo = 0;
+	stepscale = (float)info->rate / sc->speed;	// this is usually 0.5, 1, or 2
+	outcount = sc->length;
 
 // resample / decimate to the current source rate
 
-	if (stepscale == 1 && inwidth == 1 && sc->width == 1)
+	if (stepscale == 1 && info->width == 1 && sc->width == 1)
 	{
 // fast special case
 		for (i = 0; i < outcount; i++)
@@ -70,7 +243,7 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 		fracstep = stepscale*256;
 		for (i = 0; i < outcount; i++)
 		{
-			if (inwidth == 2)
+			if (info->width == 2)
 				sample = LittleShort ( ((short *)data)[srcsample] );
 			else
 				sample = (int)( (unsigned char)(data[srcsample]) - 128) << 8;
@@ -87,6 +260,62 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 
 //=============================================================================
 
+/*
+==============
+S_AllocSfxCache
+
+Parses a mapped wav file and allocates its cache entry at the mixing rate,
+leaving the samples to ResampleSfx. Main thread only.
+==============
+*/
+static sfxcache_t *S_AllocSfxCache (sfx_t *s, byte *data, int size, wavinfo_t *info)
+{
+	int		len;
+	float	stepscale;
+	sfxcache_t	*sc;
+
+	*info = GetWavinfo (s->name, data, size);
+	if (info->channels != 1)
+	{
+		Con_Printf ("%s is a stereo sample\n",s->name);
+		return NULL;
+	}
+
+	if (info->width != 1 && info->width != 2)
+	{
+		Con_Printf("%s is not 8 or 16 bit\n", s->name);
+		return NULL;
+	}
+
+	stepscale = (float)info->rate / shm->speed;
+	len = info->samples / stepscale;
+
+	len = len * info->width * info->channels;
+
+	if (info->samples == 0 || len == 0)
+	{
+		Con_Printf("%s has zero samples\n", s->name);
+		return NULL;
+	}
+
+	sc = (sfxcache_t *) Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
+	if (!sc)
+		return NULL;
+
+	sc->length = info->samples / stepscale;
+	sc->loopstart = info->loopstart;
+	if (sc->loopstart != -1)
+		sc->loopstart = sc->loopstart / stepscale;
+	sc->speed = shm->speed;
+	if (loadas8bit.value)
+		sc->width = 1;
+	else
+		sc->width = info->width;
+	sc->stereo = 0;
+
+	return sc;
+}
+
 /*
 ==============
 S_LoadSound
@@ -97,8 +326,6 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	char	namebuffer[256];
 	byte	*data;
 	wavinfo_t	info;
-	int		len;
-	float	stepscale;
 	sfxcache_t	*sc;
 
 // see if still in memory
@@ -114,7 +341,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 //	Con_Printf ("loading %s\n",namebuffer);
 
-	data = COM_LoadMallocFile (namebuffer, NULL);
+	data = COM_MapFile (namebuffer, NULL);
 
 	if (!data)
 	{
@@ -122,51 +349,168 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
-	info = GetWavinfo (s->name, data, com_filesize);
-	if (info.channels != 1)
-	{
-		free (data);
-		Con_Printf ("%s is a stereo sample\n",s->name);
-		return NULL;
-	}
+	sc = S_AllocSfxCache (s, data, com_filesize, &info);
+	if (sc)
+		ResampleSfx (sc, &info, data + info.dataofs, S_GetResampler (info.rate));
+
+	COM_UnmapFile (data);
+
+	return sc;
+}
+
+/*
+===============================================================================
+
+PARALLEL LOADING
 
-	if (info.width != 1 && info.width != 2)
+S_LoadSounds loads a whole precache list at once: files are mapped on
+the worker threads, parsed and given their cache entries on the main
+thread (the cache and the console aren't thread-safe), then resampled
+on the workers again. Timings of the last run are shown by soundlist.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	sfx_t		*sfx;
+	byte		*data;		// mapped file, NULL if missing or rejected
+	int			size;
+	wavinfo_t	info;
+	const sndresampler_t	*resampler;
+} sndloadjob_t;
+
+static struct
+{
+	int		sounds;
+	int		bytes;
+	int		threads;
+	int		quality;
+	double	readtime;
+	double	setuptime;
+	double	resampletime;
+} snd_loadstats;
+
+/*
+==============
+S_MapSoundTask
+==============
+*/
+static void S_MapSoundTask (void *param, int first, int last)
+{
+	sndloadjob_t	*job;
+	char			namebuffer[256];
+
+	for (job = (sndloadjob_t *) param + first; first < last; first++, job++)
 	{
-		free (data);
-		Con_Printf("%s is not 8 or 16 bit\n", s->name);
-		return NULL;
+		q_strlcpy (namebuffer, "sound/", sizeof (namebuffer));
+		q_strlcat (namebuffer, job->sfx->name, sizeof (namebuffer));
+		job->data = COM_MapFile (namebuffer, NULL);
+		job->size = job->data ? (int) com_filesize : 0;
 	}
+}
 
-	stepscale = (float)info.rate / shm->speed;
-	len = info.samples / stepscale;
-
-	len = len * info.width * info.channels;
+/*
+==============
+S_ResampleSoundTask
+==============
+*/
+static void S_ResampleSoundTask (void *param, int first, int last)
+{
+	sndloadjob_t	*job;
+	sfxcache_t		*sc;
 
-	if (info.samples == 0 || len == 0)
+	for (job = (sndloadjob_t *) param + first; first < last; first++, job++)
 	{
-		free (data);
-		Con_Printf("%s has zero samples\n", s->name);
-		return NULL;
+		// read the entry directly: Cache_Check isn't thread-safe,
+		// and the entry is gone if a later allocation evicted it
+		sc = (sfxcache_t *) job->sfx->cache.data;
+		if (job->data && sc)
+			ResampleSfx (sc, &job->info, job->data + job->info.dataofs, job->resampler);
 	}
+}
 
-	sc = (sfxcache_t *) Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
-	if (!sc)
+/*
+==============
+S_LoadSounds
+==============
+*/
+void S_LoadSounds (sfx_t **sfxlist, int count)
+{
+	taskgroup_t		group;
+	sndloadjob_t	*jobs, *job;
+	sfxcache_t		*sc;
+	int				i, numjobs;
+	double			time;
+
+	jobs = (sndloadjob_t *) calloc (q_max (count, 1), sizeof (*jobs));
+	if (!jobs)
+		Sys_Error ("S_LoadSounds: out of memory (%d sounds)", count);
+	memset (&group, 0, sizeof (group));
+	memset (&snd_loadstats, 0, sizeof (snd_loadstats));
+
+	for (i = numjobs = 0; i < count; i++)
+		if (sfxlist[i] && !Cache_Check (&sfxlist[i]->cache))
+			jobs[numjobs++].sfx = sfxlist[i];
+
+	time = Sys_DoubleTime ();
+	Task_ParallelFor (&group, numjobs, 1, S_MapSoundTask, jobs);
+	Task_Wait (&group);
+	snd_loadstats.readtime = Sys_DoubleTime () - time;
+
+	time = Sys_DoubleTime ();
+	for (i = 0, job = jobs; i < numjobs; i++, job++)
 	{
-		free (data);
-		return NULL;
+		if (!job->data)
+		{
+			Con_Printf ("Couldn't load sound/%s\n", job->sfx->name);
+			continue;
+		}
+		// the same sound may be listed twice
+		if (Cache_Check (&job->sfx->cache))
+			sc = NULL;
+		else
+			sc = S_AllocSfxCache (job->sfx, job->data, job->size, &job->info);
+		if (!sc)
+		{
+			COM_UnmapFile (job->data);
+			job->data = NULL;
+			continue;
+		}
+		job->resampler = S_GetResampler (job->info.rate);
+		snd_loadstats.sounds++;
+		snd_loadstats.bytes += sc->length * sc->width;
 	}
+	snd_loadstats.setuptime = Sys_DoubleTime () - time;
 
-	sc->length = info.samples;
-	sc->loopstart = info.loopstart;
-	sc->speed = info.rate;
-	sc->width = info.width;
-	sc->stereo = info.channels;
+	time = Sys_DoubleTime ();
+	Task_ParallelFor (&group, numjobs, 1, S_ResampleSoundTask, jobs);
+	Task_Wait (&group);
+	snd_loadstats.resampletime = Sys_DoubleTime () - time;
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	for (i = 0, job = jobs; i < numjobs; i++, job++)
+		if (job->data)
+			COM_UnmapFile (job->data);
+	free (jobs);
 
-	free (data);
+	snd_loadstats.threads = Tasks_NumWorkers () + 1;
+	snd_loadstats.quality = snd_resampler_quality;
+}
 
-	return sc;
+/*
+==============
+S_PrintLoadStats
+==============
+*/
+void S_PrintLoadStats (void)
+{
+	if (!snd_loadstats.threads)
+		return;
+	Con_Printf ("last precache: %i sounds, %i bytes in %.1f ms (read %.1f, setup %.1f, resample %.1f) on %i threads, quality %i\n",
+		snd_loadstats.sounds, snd_loadstats.bytes,
+		(snd_loadstats.readtime + snd_loadstats.setuptime + snd_loadstats.resampletime) * 1000.0,
+		snd_loadstats.readtime * 1000.0, snd_loadstats.setuptime * 1000.0, snd_loadstats.resampletime * 1000.0,
+		snd_loadstats.threads, snd_loadstats.quality);
 }
 
 
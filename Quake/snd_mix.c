@@ -39,7 +39,25 @@ static void Snd_WriteLinearBlastStereo16 (void)
 	int		i;
 	int		val;
 
-	for (i = 0; i < snd_linear_count; i += 2)
+	i = 0;
+#ifdef USE_SSE2
+	if (snd_simd.value)
+	{
+		// divide by 256 rounding towards zero, then saturate to 16 bits
+		for (; i + 8 <= snd_linear_count; i += 8)
+		{
+			__m128i v0, v1;
+
+			v0 = _mm_loadu_si128 ((const __m128i *)(snd_p + i));
+			v1 = _mm_loadu_si128 ((const __m128i *)(snd_p + i + 4));
+			v0 = _mm_srai_epi32 (_mm_add_epi32 (v0, _mm_srli_epi32 (_mm_srai_epi32 (v0, 31), 24)), 8);
+			v1 = _mm_srai_epi32 (_mm_add_epi32 (v1, _mm_srli_epi32 (_mm_srai_epi32 (v1, 31), 24)), 8);
+			_mm_storeu_si128 ((__m128i *)(snd_out + i), _mm_packs_epi32 (v0, v1));
+		}
+	}
+#endif
+
+	for (; i < snd_linear_count; i += 2)
 	{
 		val = snd_p[i] / 256;
 		if (val > 0x7fff)
@@ -248,12 +266,21 @@ static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 	float *input;
 	const int kernelsize = filter->kernelsize;
 	const float *kernel = filter->kernel;
-	int mark;
 	int parity;
+	static float *scratch;
+	static size_t scratchsize;
 
-	mark = Hunk_LowMark ();
+// the mixer can run on its own thread, so it can't use the hunk
 	inputsize = sizeof(float) * (filter->kernelsize + count);
-	input = (float *) Hunk_AllocNoFill (inputsize);
+	if (inputsize > scratchsize)
+	{
+		free (scratch);
+		scratch = (float *) malloc (inputsize);
+		if (!scratch)
+			Sys_Error ("S_ApplyFilter: out of memory (%" SDL_PRIu64 " bytes)", (uint64_t) inputsize);
+		scratchsize = inputsize;
+	}
+	input = scratch;
 
 // set up the input buffer
 // memory holds the previous filter->kernelsize samples of input.
@@ -292,8 +319,6 @@ static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 	}
 
 	filter->parity = parity;
-
-	Hunk_FreeToLowMark (mark);
 }
 
 /*
@@ -423,9 +448,97 @@ CHANNEL MIXING
 ===============================================================================
 */
 
+channel_t	snd_mixchannels[MAX_CHANNELS];
+int		snd_mixtotal;
+
 static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime, int paintbufferstart);
 static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime, int paintbufferstart);
 
+/*
+==============
+S_ExecuteMixerCommand
+
+Applies a change made by the main thread to the mixer's channels
+==============
+*/
+void S_ExecuteMixerCommand (const sndcmd_t *cmd)
+{
+	channel_t	*ch;
+
+	if (cmd->type == SNDCMD_STOPALL)
+	{
+		memset (snd_mixchannels, 0, sizeof (snd_mixchannels));
+		snd_mixtotal = 0;
+		return;
+	}
+
+	ch = &snd_mixchannels[cmd->channel];
+	switch (cmd->type)
+	{
+	case SNDCMD_START:
+		memset (ch, 0, sizeof (*ch));
+		ch->sfx = cmd->sfx;
+		ch->pos = cmd->pos;
+		ch->end = paintedtime + cmd->length;
+		ch->leftvol = cmd->leftvol;
+		ch->rightvol = cmd->rightvol;
+		snd_mixtotal = q_max (snd_mixtotal, cmd->channel + 1);
+		break;
+	case SNDCMD_VOLUME:
+		ch->leftvol = cmd->leftvol;
+		ch->rightvol = cmd->rightvol;
+		break;
+	case SNDCMD_STOP:
+		ch->sfx = NULL;
+		ch->end = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+==============
+S_ClipPaintBuffer
+
+clip each sample to 0dB, then reduce by 6dB (to leave some headroom for
+the lowpass filter and the music). the lowpass will smooth out the
+clipping
+==============
+*/
+static void S_ClipPaintBuffer (int count)
+{
+	int		i;
+	int		*p = (int *) paintbuffer;
+
+	count *= 2;
+	i = 0;
+#ifdef USE_SSE2
+	if (snd_simd.value)
+	{
+		const __m128i lo = _mm_set1_epi32 (-32768 * 256);
+		const __m128i hi = _mm_set1_epi32 (32767 * 256);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i v, mask;
+
+			v = _mm_loadu_si128 ((const __m128i *)(p + i));
+			mask = _mm_cmpgt_epi32 (v, hi);
+			v = _mm_or_si128 (_mm_and_si128 (mask, hi), _mm_andnot_si128 (mask, v));
+			mask = _mm_cmplt_epi32 (v, lo);
+			v = _mm_or_si128 (_mm_and_si128 (mask, lo), _mm_andnot_si128 (mask, v));
+			// halve rounding towards zero, like the division below
+			v = _mm_srai_epi32 (_mm_add_epi32 (v, _mm_srli_epi32 (v, 31)), 1);
+			_mm_storeu_si128 ((__m128i *)(p + i), v);
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+		p[i] = CLAMP(-32768 * 256, p[i], 32767 * 256) / 2;
+}
+
 void S_PaintChannels (int endtime)
 {
 	int		i;
@@ -446,14 +559,16 @@ void S_PaintChannels (int endtime)
 		memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
 
 	// paint in the channels.
-		ch = snd_channels;
-		for (i = 0; i < total_channels; i++, ch++)
+		ch = snd_mixchannels;
+		for (i = 0; i < snd_mixtotal; i++, ch++)
 		{
 			if (!ch->sfx)
 				continue;
 			if (!ch->leftvol && !ch->rightvol)
 				continue;
-			sc = S_LoadSound (ch->sfx);
+			// the main thread keeps playing sounds loaded, the mixer only
+			// reads what's cached (see S_LockMixer)
+			sc = (sfxcache_t *) ch->sfx->cache.data;
 			if (!sc)
 				continue;
 
@@ -495,14 +610,8 @@ void S_PaintChannels (int endtime)
 			}
 		}
 
-	// clip each sample to 0dB, then reduce by 6dB (to leave some headroom for
-	// the lowpass filter and the music). the lowpass will smooth out the
-	// clipping
-		for (i=0; i<end-paintedtime; i++)
-		{
-			paintbuffer[i].left = CLAMP(-32768 * 256, paintbuffer[i].left, 32767 * 256) / 2;
-			paintbuffer[i].right = CLAMP(-32768 * 256, paintbuffer[i].right, 32767 * 256) / 2;
-		}
+	// clip to 0dB and leave 6dB of headroom
+		S_ClipPaintBuffer (end - paintedtime);
 
 	// apply a lowpass filter
 		if (sndspeed.value == 11025 && shm->speed == 44100)
@@ -564,6 +673,48 @@ void SND_InitScaletable (void)
 	}
 }
 
+#ifdef USE_SSE2
+/*
+==============
+SND_SplitScaleSSE2
+
+Packs the left and right scales as pairs of 16-bit halves for _mm_madd_epi16,
+so a sample repeated in both halves of a lane is multiplied by the full scale.
+Returns false if a scale doesn't fit in two halves.
+==============
+*/
+static qboolean SND_SplitScaleSSE2 (int lscale, int rscale, __m128i *out)
+{
+	int la = lscale >> 1, lb = lscale - la;
+	int ra = rscale >> 1, rb = rscale - ra;
+
+	if (la < -32768 || la > 32767 || lb < -32768 || lb > 32767 ||
+		ra < -32768 || ra > 32767 || rb < -32768 || rb > 32767)
+		return false;
+
+	*out = _mm_setr_epi16 (la, lb, ra, rb, la, lb, ra, rb);
+	return true;
+}
+
+/*
+==============
+SND_PaintEightSSE2
+
+Adds 8 signed 16-bit samples times the packed scales to 8 paintbuffer pairs
+==============
+*/
+static void SND_PaintEightSSE2 (portable_samplepair_t *out, __m128i samples, __m128i scale)
+{
+	__m128i	*p = (__m128i *) out;
+	__m128i	lo = _mm_unpacklo_epi16 (samples, samples);
+	__m128i	hi = _mm_unpackhi_epi16 (samples, samples);
+
+	_mm_storeu_si128 (p + 0, _mm_add_epi32 (_mm_loadu_si128 (p + 0), _mm_madd_epi16 (_mm_unpacklo_epi32 (lo, lo), scale)));
+	_mm_storeu_si128 (p + 1, _mm_add_epi32 (_mm_loadu_si128 (p + 1), _mm_madd_epi16 (_mm_unpackhi_epi32 (lo, lo), scale)));
+	_mm_storeu_si128 (p + 2, _mm_add_epi32 (_mm_loadu_si128 (p + 2), _mm_madd_epi16 (_mm_unpacklo_epi32 (hi, hi), scale)));
+	_mm_storeu_si128 (p + 3, _mm_add_epi32 (_mm_loadu_si128 (p + 3), _mm_madd_epi16 (_mm_unpackhi_epi32 (hi, hi), scale)));
+}
+#endif
 
 static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
 {
@@ -581,7 +732,24 @@ static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int
 	rscale = snd_scaletable[ch->rightvol >> 3];
 	sfx = (unsigned char *)sc->data + ch->pos;
 
-	for (i = 0; i < count; i++)
+	i = 0;
+#ifdef USE_SSE2
+	{
+		__m128i scale;
+		// the scale tables hold signed sample * scale
+		if (snd_simd.value && SND_SplitScaleSSE2 (lscale[1], rscale[1], &scale))
+		{
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i samples = _mm_loadl_epi64 ((const __m128i *)(sfx + i));
+				samples = _mm_srai_epi16 (_mm_unpacklo_epi8 (samples, samples), 8);
+				SND_PaintEightSSE2 (&paintbuffer[paintbufferstart + i], samples, scale);
+			}
+		}
+	}
+#endif
+
+	for (; i < count; i++)
 	{
 		data = sfx[i];
 		paintbuffer[paintbufferstart + i].left += lscale[data];
@@ -605,7 +773,19 @@ static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, in
 	rightvol /= 256;
 	sfx = (signed short *)sc->data + ch->pos;
 
-	for (i = 0; i < count; i++)
+	i = 0;
+#ifdef USE_SSE2
+	{
+		__m128i scale;
+		if (snd_simd.value && SND_SplitScaleSSE2 (leftvol, rightvol, &scale))
+		{
+			for (; i + 8 <= count; i += 8)
+				SND_PaintEightSSE2 (&paintbuffer[paintbufferstart + i], _mm_loadu_si128 ((const __m128i *)(sfx + i)), scale);
+		}
+	}
+#endif
+
+	for (; i < count; i++)
 	{
 		data = sfx[i];
 	// this was causing integer overflow as observed in quakespasm
@@ -621,3 +801,167 @@ static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, in
 	ch->pos += count;
 }
 
+
+/*
+==============
+S_MixBench_f
+
+Renders seconds of audio from a number of looping channels offline into a
+scratch 16-bit stereo buffer, once with the scalar mixer and once with the
+SIMD one, and checks that both produce the same output
+==============
+*/
+void S_MixBench_f (void)
+{
+	static const char	*names[2] = {"scalar", "simd"};
+	volatile dma_t	*oldshm;
+	dma_t			dma;
+	channel_t		*oldchannels, *channels;
+	sfx_t			sfx[2];
+	sfxcache_t		*sc;
+	int				oldtotal, oldpaintedtime, oldrawend;
+	int				i, j, pass, seconds, numchannels, frames, chunk, start;
+	unsigned		seed, hash[2];
+	float			oldsimd, oldlevels[2];
+	float			oldunderwater;
+	double			time, times[2];
+
+	seconds = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 10;
+	seconds = CLAMP (1, seconds, 3600);
+	numchannels = Cmd_Argc () > 2 ? Q_atoi (Cmd_Argv (2)) : 256;
+	numchannels = CLAMP (1, numchannels, MAX_CHANNELS);
+
+	memset (&dma, 0, sizeof (dma));
+	dma.channels = 2;
+	dma.samplebits = 16;
+	dma.speed = 48000; // stays clear of the 11025 Hz lowpass
+	dma.samples = PAINTBUFFER_SIZE * 2 * 4;
+	dma.submission_chunk = 1;
+	dma.buffer = (unsigned char *) calloc (dma.samples, sizeof (short));
+	oldchannels = (channel_t *) malloc (sizeof (snd_mixchannels));
+	channels = (channel_t *) calloc (numchannels, sizeof (channel_t));
+	if (!dma.buffer || !oldchannels || !channels)
+	{
+		Con_Printf ("snd_mixbench: out of memory\n");
+		free (dma.buffer);
+		free (oldchannels);
+		free (channels);
+		return;
+	}
+
+	// one second of noise at each sample width
+	memset (sfx, 0, sizeof (sfx));
+	seed = 0x1234567u;
+	for (i = 0; i < 2; i++)
+	{
+		q_snprintf (sfx[i].name, sizeof (sfx[i].name), "mixbench%d", 8 << i);
+		sc = (sfxcache_t *) Cache_Alloc (&sfx[i].cache, sizeof (sfxcache_t) + dma.speed * (i + 1), sfx[i].name);
+		if (!sc)
+		{
+			Con_Printf ("snd_mixbench: out of memory\n");
+			if (i)
+				Cache_Free (&sfx[0].cache, false);
+			free (dma.buffer);
+			free (oldchannels);
+			free (channels);
+			return;
+		}
+		sc->length = dma.speed;
+		sc->loopstart = 0;
+		sc->speed = dma.speed;
+		sc->width = i + 1;
+		sc->stereo = 0;
+		for (j = 0; j < dma.speed * (i + 1); j++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			sc->data[j] = seed >> 24;
+		}
+	}
+
+	// looping channels at staggered positions and volumes
+	for (i = 0; i < numchannels; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		channels[i].sfx = &sfx[i & 1];
+		channels[i].leftvol = (seed >> 8) & 255;
+		channels[i].rightvol = (seed >> 16) & 255;
+		channels[i].pos = (seed >> 4) % dma.speed;
+		channels[i].end = dma.speed - channels[i].pos;
+		channels[i].entnum = -1;
+	}
+
+	S_LockMixer ();
+	if (shm)
+		SNDDMA_LockBuffer ();
+
+	oldshm = shm;
+	oldtotal = snd_mixtotal;
+	oldpaintedtime = paintedtime;
+	oldrawend = s_rawend;
+	oldsimd = snd_simd.value;
+	oldunderwater = underwater.intensity;
+	oldlevels[0] = snd_lofreqlevel;
+	oldlevels[1] = snd_hifreqlevel;
+	memcpy (oldchannels, snd_mixchannels, sizeof (snd_mixchannels));
+
+	shm = &dma;
+	frames = seconds * dma.speed;
+	chunk = PAINTBUFFER_SIZE;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		Cvar_SetValueQuick (&snd_simd, pass);
+		memset (snd_mixchannels, 0, sizeof (snd_mixchannels));
+		memcpy (snd_mixchannels, channels, numchannels * sizeof (channel_t));
+		snd_mixtotal = numchannels;
+		paintedtime = 0;
+		s_rawend = -1;
+		underwater.intensity = 0.f;
+
+		hash[pass] = 2166136261u;
+		times[pass] = 0.0;
+		while (paintedtime < frames)
+		{
+			short *out;
+
+			start = paintedtime;
+			time = Sys_DoubleTime ();
+			S_PaintChannels (q_min (start + chunk, frames));
+			times[pass] += Sys_DoubleTime () - time;
+
+			out = (short *) dma.buffer + ((start & ((dma.samples >> 1) - 1)) << 1);
+			for (j = 0; j < (paintedtime - start) * 2; j++)
+				hash[pass] = (hash[pass] ^ (unsigned short) out[j]) * 16777619u;
+		}
+	}
+
+	memcpy (snd_mixchannels, oldchannels, sizeof (snd_mixchannels));
+	snd_mixtotal = oldtotal;
+	paintedtime = oldpaintedtime;
+	s_rawend = oldrawend;
+	Cvar_SetValueQuick (&snd_simd, oldsimd);
+	underwater.intensity = oldunderwater;
+	snd_lofreqlevel = oldlevels[0];
+	snd_hifreqlevel = oldlevels[1];
+	shm = oldshm;
+
+	if (shm)
+		SNDDMA_Submit ();
+	S_UnlockMixer ();
+
+	Cache_Free (&sfx[0].cache, false);
+	Cache_Free (&sfx[1].cache, false);
+	free (dma.buffer);
+	free (oldchannels);
+	free (channels);
+
+	Con_Printf ("%d channels, %d seconds at %d Hz\n", numchannels, seconds, dma.speed);
+	for (pass = 0; pass < 2; pass++)
+		Con_Printf ("%-6s %8.1f ms, %7.1f M channel samples/s, %5.1fx realtime\n", names[pass], times[pass] * 1000.0,
+			(double) frames * numchannels / q_max (times[pass], 1e-6) / 1e6, seconds / q_max (times[pass], 1e-6));
+#ifndef USE_SSE2
+	Con_Printf ("(no SIMD mixer in this build)\n");
+#endif
+	if (hash[0] != hash[1])
+		Con_Printf ("outputs differ\n");
+}
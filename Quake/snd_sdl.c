@@ -31,6 +31,7 @@
 #endif
 
 static int	buffersize;
+static qboolean	offline;	/* output goes to snd_file.c instead */
 
 
 static void SDLCALL paint_audio (void *unused, Uint8 *stream, int len)
@@ -81,6 +82,10 @@ qboolean SNDDMA_Init (dma_t *dma)
 	char	drivername[128];
 	const char *driver, *device;
 
+	offline = SNDFile_Requested();
+	if (offline)
+		return SNDFile_Init(dma);
+
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
 	{
 		Con_Printf("Couldn't init SDL audio: %s\n", SDL_GetError());
@@ -164,11 +169,18 @@ qboolean SNDDMA_Init (dma_t *dma)
 
 int SNDDMA_GetDMAPos (void)
 {
+	if (offline)
+		return SNDFile_GetDMAPos();
 	return shm->samplepos;
 }
 
 void SNDDMA_Shutdown (void)
 {
+	if (offline)
+	{
+		SNDFile_Shutdown();
+		return;
+	}
 	if (shm)
 	{
 		Con_Printf ("Shutting down SDL sound\n");
@@ -183,21 +195,29 @@ void SNDDMA_Shutdown (void)
 
 void SNDDMA_LockBuffer (void)
 {
-	SDL_LockAudio ();
+	if (offline)
+		SNDFile_LockBuffer ();
+	else
+		SDL_LockAudio ();
 }
 
 void SNDDMA_Submit (void)
 {
-	SDL_UnlockAudio();
+	if (offline)
+		SNDFile_Submit ();
+	else
+		SDL_UnlockAudio();
 }
 
 void SNDDMA_BlockSound (void)
 {
-	SDL_PauseAudio(1);
+	if (!offline)
+		SDL_PauseAudio(1);
 }
 
 void SNDDMA_UnblockSound (void)
 {
-	SDL_PauseAudio(0);
+	if (!offline)
+		SDL_PauseAudio(0);
 }
 
@@ -238,7 +238,10 @@ int S_WAV_CodecReadStream(snd_stream_t *stream, int bytes, void *buffer)
 		bytes = remaining;
 	stream->fh.pos += bytes;
 	if (fread(buffer, 1, bytes, stream->fh.file) != bytes)
-		Sys_Error ("S_WAV_CodecReadStream: read error on %d bytes (%s)", bytes, stream->name);
+	{
+		S_CodecUtilError(stream, false, "S_WAV_CodecReadStream: read error on %d bytes (%s)\n", bytes, stream->name);
+		return -1;
+	}
 	if (stream->info.width == 2)
 	{
 		samples = bytes / 2;
@@ -140,8 +140,7 @@ static int S_XMP_CodecReadStream (snd_stream_t *stream, int bytes, void *buffer)
 	if (r == 0) {
 		return bytes;
 	}
-	if (r == -XMP_END) {
-		Con_DPrintf("XMP EOF\n");
+	if (r == -XMP_END) {	/* EOF */
 		return 0;
 	}
 	return -1;
@@ -34,6 +34,7 @@ int		sv_protocol = PROTOCOL_RMQ; //johnfitz
 extern cvar_t nomonsters;
 
 static cvar_t sv_netsort = {"sv_netsort", "1", CVAR_NONE};
+static cvar_t sv_phs = {"sv_phs", "1", CVAR_NONE}; // only send sounds to clients that can hear them
 
 //============================================================================
 
@@ -151,6 +152,11 @@ void SV_Init (void)
 	extern	cvar_t	sv_altnoclip; //johnfitz
 	extern	cvar_t	sv_gameplayfix_random;
 	extern	cvar_t	sv_gameplayfix_elevators;
+	extern	cvar_t	sv_findradius_index;
+	extern	cvar_t	sv_find_index;
+	extern	cvar_t	sv_areanode_split;
+	extern	cvar_t	sv_parallelphysics;
+	extern	cvar_t	sv_netindex;
 	extern	cvar_t	sv_autoload;
 	extern	cvar_t	sv_autosave;
 	extern	cvar_t	sv_autosave_interval;
@@ -173,12 +179,20 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
 	Cvar_RegisterVariable (&sv_gameplayfix_random);
 	Cvar_RegisterVariable (&sv_gameplayfix_elevators);
+	Cvar_RegisterVariable (&sv_findradius_index);
+	Cvar_RegisterVariable (&sv_find_index);
+	Cvar_RegisterVariable (&sv_areanode_split);
+	Cvar_RegisterVariable (&sv_parallelphysics);
 	Cvar_RegisterVariable (&sv_netsort);
+	Cvar_RegisterVariable (&sv_phs);
+	Cvar_RegisterVariable (&sv_netindex);
 	Cvar_RegisterVariable (&sv_autoload);
 	Cvar_RegisterVariable (&sv_autosave);
 	Cvar_RegisterVariable (&sv_autosave_interval);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_tracebench", &SV_TraceBench_f);
+	Cmd_AddCommand ("sv_netbench", &SV_NetBench_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -208,6 +222,232 @@ void SV_Init (void)
 /*
 =============================================================================
 
+POTENTIALLY HEARABLE SET
+
+As in QuakeWorld, the PHS of a leaf is the union of the PVS of every leaf it
+can see. Sounds are written to sv.datagram as usual, but each one is also
+recorded with the leaf it starts in so SV_WriteDatagram can leave it out for
+clients whose PHS doesn't include that leaf.
+
+=============================================================================
+*/
+
+#define PHS_MAXBYTES		(32 * 1024 * 1024)	// maps needing more are sent all sounds
+#define PHS_MAXWORK			(1u << 30)			// same, for the number of words OR-ed together
+#define MAX_DATAGRAM_SOUNDS	1024				// later sounds are sent to everyone
+
+typedef struct
+{
+	int		start, end;		// bytes of sv.datagram
+	int		leafnum;		// PVS bit of the leaf the sound starts in
+} datagramsound_t;
+
+static struct
+{
+	qmodel_t	*model;
+	byte		*rows;		// [numleafs * rowbytes], NULL if not built
+	byte		*pvs;		// only while building
+	int			rowbytes;
+	SDL_atomic_t	visible;	// number of PVS bits set, while building
+	taskgroup_t	group;
+} sv_phs_data;
+
+static datagramsound_t	sv_sounds[MAX_DATAGRAM_SOUNDS];
+static int				sv_numsounds;
+
+/*
+=============
+SV_DecompressPVSTask
+=============
+*/
+static void SV_DecompressPVSTask (void *param, int first, int last)
+{
+	qmodel_t	*model = sv_phs_data.model;
+	int			i, j, k, visible;
+	byte		*pvs;
+
+	visible = 0;
+	for (i = first; i < last; i++)
+	{
+		pvs = sv_phs_data.pvs + i * sv_phs_data.rowbytes;
+		Mod_DecompressLeafPVS (&model->leafs[i + 1], model, pvs);
+		for (j = 0; j < (model->numleafs+7)>>3; j++)
+			for (k = 0; k < 8; k++)
+				visible += (pvs[j] >> k) & 1;
+	}
+	SDL_AtomicAdd (&sv_phs_data.visible, visible);
+}
+
+/*
+=============
+SV_BuildPHSTask
+=============
+*/
+static void SV_BuildPHSTask (void *param, int first, int last)
+{
+	int			rowwords = sv_phs_data.rowbytes / sizeof (uint32_t);
+	int			numbytes = (sv_phs_data.model->numleafs+7)>>3;
+	int			i, j, k, w;
+	byte		*pvs;
+	uint32_t	*phs, *src;
+
+	for (i = first; i < last; i++)
+	{
+		pvs = sv_phs_data.pvs + i * sv_phs_data.rowbytes;
+		phs = (uint32_t *) (sv_phs_data.rows + i * sv_phs_data.rowbytes);
+		memcpy (phs, pvs, sv_phs_data.rowbytes);
+
+		for (j = 0; j < numbytes; j++)
+		{
+			if (!pvs[j])
+				continue;
+			for (k = 0; k < 8; k++)
+			{
+				if (!(pvs[j] & (1u<<k)) || (j<<3) + k >= sv_phs_data.model->numleafs)
+					continue;
+				src = (uint32_t *) (sv_phs_data.pvs + ((j<<3) + k) * sv_phs_data.rowbytes);
+				for (w = 0; w < rowwords; w++)
+					phs[w] |= src[w];
+			}
+		}
+	}
+}
+
+/*
+=============
+SV_BuildPHS
+
+Computes the PHS of every leaf of the world, using all the worker threads
+=============
+*/
+static void SV_BuildPHS (qmodel_t *model)
+{
+	size_t	size;
+	double	time;
+
+	free (sv_phs_data.rows);
+	sv_phs_data.rows = NULL;
+	sv_phs_data.model = model;
+	sv_phs_data.rowbytes = (((model->numleafs+7)>>3) + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK;
+
+	size = (size_t) model->numleafs * sv_phs_data.rowbytes;
+	if (!model->visdata || !size || size > PHS_MAXBYTES)
+		return;
+
+	sv_phs_data.rows = (byte *) malloc (size);
+	sv_phs_data.pvs = (byte *) calloc (size, 1);	// keeps the alignment padding clear
+	if (!sv_phs_data.rows || !sv_phs_data.pvs)
+	{
+		free (sv_phs_data.rows);
+		free (sv_phs_data.pvs);
+		sv_phs_data.rows = sv_phs_data.pvs = NULL;
+		Con_DPrintf ("SV_BuildPHS: not enough memory for %d leafs\n", model->numleafs);
+		return;
+	}
+
+	time = Sys_DoubleTime ();
+	SDL_AtomicSet (&sv_phs_data.visible, 0);
+	Task_ParallelFor (&sv_phs_data.group, model->numleafs, 0, SV_DecompressPVSTask, NULL);
+	Task_Wait (&sv_phs_data.group);
+
+	// every visible leaf costs a row of ORs
+	if ((uint64_t) SDL_AtomicGet (&sv_phs_data.visible) * (sv_phs_data.rowbytes / sizeof (uint32_t)) > PHS_MAXWORK)
+	{
+		free (sv_phs_data.rows);
+		free (sv_phs_data.pvs);
+		sv_phs_data.rows = sv_phs_data.pvs = NULL;
+		Con_DPrintf ("SV_BuildPHS: too much vis data, sounds won't be culled\n");
+		return;
+	}
+
+	Task_ParallelFor (&sv_phs_data.group, model->numleafs, 0, SV_BuildPHSTask, NULL);
+	Task_Wait (&sv_phs_data.group);
+	free (sv_phs_data.pvs);
+	sv_phs_data.pvs = NULL;
+
+	Con_DPrintf ("Built PHS for %d leafs in %.1f ms (%.1f KB)\n", model->numleafs,
+		(Sys_DoubleTime () - time) * 1000.0, size / 1024.0);
+}
+
+/*
+=============
+SV_RecordSound
+
+Notes that the last bytes written to sv.datagram (from start on) are a sound
+heard from org, so SV_WriteDatagram can skip it for clients out of earshot
+=============
+*/
+static void SV_RecordSound (int start, vec3_t org, float attenuation)
+{
+	mleaf_t	*leaf;
+
+	if (!sv_phs_data.rows || sv_phs_data.model != sv.worldmodel || sv_numsounds == MAX_DATAGRAM_SOUNDS)
+		return;
+	if (attenuation == 0.f)
+		return;		// heard everywhere
+
+	leaf = Mod_PointInLeaf (org, sv.worldmodel);
+	if (leaf == sv.worldmodel->leafs)
+		return;
+
+	sv_sounds[sv_numsounds].start = start;
+	sv_sounds[sv_numsounds].end = sv.datagram.cursize;
+	sv_sounds[sv_numsounds].leafnum = leaf - sv.worldmodel->leafs - 1;
+	sv_numsounds++;
+}
+
+/*
+=============
+SV_WriteDatagram
+
+Appends sv.datagram to the client's message if there is space, leaving out
+the sounds it can't hear
+=============
+*/
+static void SV_WriteDatagram (client_t *client, sizebuf_t *msg)
+{
+	byte		*phs;
+	mleaf_t		*leaf;
+	vec3_t		org;
+	int			i, size, pos;
+	byte		audible[MAX_DATAGRAM_SOUNDS];
+
+	if (!sv_numsounds || !sv_phs.value || !sv_phs_data.rows || sv_phs_data.model != sv.worldmodel)
+	{
+		if (msg->cursize + sv.datagram.cursize < msg->maxsize)
+			SZ_Write (msg, sv.datagram.data, sv.datagram.cursize);
+		return;
+	}
+
+	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
+	leaf = Mod_PointInLeaf (org, sv.worldmodel);
+	phs = NULL;
+	if (leaf != sv.worldmodel->leafs)
+		phs = sv_phs_data.rows + (leaf - sv.worldmodel->leafs - 1) * sv_phs_data.rowbytes;
+
+	size = sv.datagram.cursize;
+	for (i = 0; i < sv_numsounds; i++)
+	{
+		audible[i] = !phs || (phs[sv_sounds[i].leafnum >> 3] & (1 << (sv_sounds[i].leafnum & 7)));
+		if (!audible[i])
+			size -= sv_sounds[i].end - sv_sounds[i].start;
+	}
+	if (msg->cursize + size >= msg->maxsize)
+		return;
+
+	for (i = 0, pos = 0; i < sv_numsounds; i++)
+	{
+		if (audible[i])
+			continue;
+		SZ_Write (msg, sv.datagram.data + pos, sv_sounds[i].start - pos);
+		pos = sv_sounds[i].end;
+	}
+	SZ_Write (msg, sv.datagram.data + pos, sv.datagram.cursize - pos);
+}
+
+/*
+=============================================================================
+
 EVENT MESSAGES
 
 =============================================================================
@@ -261,7 +501,8 @@ Larger attenuations will drop off.  (max 4 attenuation)
 void SV_StartSound (edict_t *entity, int channel, const char *sample, int volume, float attenuation)
 {
 	int			sound_num, ent;
-	int			i, field_mask;
+	int			i, field_mask, start;
+	vec3_t		org;
 
 	if (volume < 0 || volume > 255)
 		Host_Error ("SV_StartSound: volume = %i", volume);
@@ -314,7 +555,11 @@ void SV_StartSound (edict_t *entity, int channel, const char *sample, int volume
 	if (sv.datagram.cursize > MAX_DATAGRAM-21)
 		return;
 
+	for (i = 0; i < 3; i++)
+		org[i] = entity->v.origin[i]+0.5*(entity->v.mins[i]+entity->v.maxs[i]);
+
 // directed messages go only to the entity the are targeted on
+	start = sv.datagram.cursize;
 	MSG_WriteByte (&sv.datagram, svc_sound);
 	MSG_WriteByte (&sv.datagram, field_mask);
 	if (field_mask & SND_VOLUME)
@@ -337,7 +582,9 @@ void SV_StartSound (edict_t *entity, int channel, const char *sample, int volume
 	//johnfitz
 
 	for (i = 0; i < 3; i++)
-		MSG_WriteCoord (&sv.datagram, entity->v.origin[i]+0.5*(entity->v.mins[i]+entity->v.maxs[i]), sv.protocolflags);
+		MSG_WriteCoord (&sv.datagram, org[i], sv.protocolflags);
+
+	SV_RecordSound (start, org, attenuation);
 }
 
 /*
@@ -565,6 +812,7 @@ SV_ClearDatagram
 void SV_ClearDatagram (void)
 {
 	SZ_Clear (&sv.datagram);
+	sv_numsounds = 0;
 }
 
 /*
@@ -682,6 +930,308 @@ static uint16_t		net_edicts[MAX_NET_EDICTS];
 static byte			net_edict_dists[MAX_NET_EDICTS];
 static int			net_edict_bins[256];
 static uint16_t		net_edicts_sorted[MAX_NET_EDICTS];
+static uint16_t		net_candidates[MAX_NET_EDICTS];
+
+/*
+=============================================================================
+
+ENTITY RELEVANCE INDEX
+
+Lists of the edicts touching each leaf, so SV_WriteEntitiesToClient only
+looks at the edicts in leafs a client can see instead of all of them.
+SV_LinkEdict reports every edict whose leafs it recomputed, and those are
+relisted before the next client is sent entities. Edicts touching too many
+leafs to be vis culled go in an extra list that is always included.
+Candidates come out in edict order, so the packets are the same as with
+the full scan.
+
+=============================================================================
+*/
+
+cvar_t	sv_netindex = {"sv_netindex", "1", CVAR_NONE}; // 0 = scan all edicts, 2 = compare both
+
+typedef struct
+{
+	int		leaf;			// list the link is in
+	int		edict;
+	int		next, prev;		// in the same list, -1 at the ends
+	int		nextinedict;	// next link of the same edict, or next free link
+} netlink_t;
+
+static struct
+{
+	int			maxedicts;		// size of the per-edict arrays
+	int			numleafs;		// heads[numleafs] is the list of edicts that aren't culled
+	int			*heads;			// first link of each list, -1 if empty
+	int			*edictlinks;	// first link of each edict, -1 if none
+	byte		*dirty;
+	int			*dirtylist;
+	int			numdirty;
+	qboolean	rebuild;		// relist everything on the next query
+	netlink_t	*links;			// VEC
+	int			freelink;
+	uint32_t	*visible;		// one bit per edict
+} sv_netrel;
+
+static qboolean	net_forcescan;	// sv_netbench timing the full scan
+
+/*
+=============
+SV_ClearNetIndex
+=============
+*/
+void SV_ClearNetIndex (void)
+{
+	int i;
+
+	if (sv_netrel.maxedicts < qcvm->max_edicts)
+	{
+		free (sv_netrel.edictlinks);
+		free (sv_netrel.dirty);
+		free (sv_netrel.dirtylist);
+		free (sv_netrel.visible);
+
+		sv_netrel.maxedicts = qcvm->max_edicts;
+		sv_netrel.edictlinks = (int *) malloc (sv_netrel.maxedicts * sizeof (int));
+		sv_netrel.dirty = (byte *) malloc (sv_netrel.maxedicts);
+		sv_netrel.dirtylist = (int *) malloc (sv_netrel.maxedicts * sizeof (int));
+		sv_netrel.visible = (uint32_t *) malloc (((sv_netrel.maxedicts + 31) >> 5) * sizeof (uint32_t));
+		if (!sv_netrel.edictlinks || !sv_netrel.dirty || !sv_netrel.dirtylist || !sv_netrel.visible)
+			Sys_Error ("SV_ClearNetIndex: out of memory (%d edicts)", sv_netrel.maxedicts);
+	}
+
+	free (sv_netrel.heads);
+	sv_netrel.numleafs = sv.worldmodel->numleafs;
+	sv_netrel.heads = (int *) malloc ((sv_netrel.numleafs + 1) * sizeof (int));
+	if (!sv_netrel.heads)
+		Sys_Error ("SV_ClearNetIndex: out of memory (%d leafs)", sv_netrel.numleafs);
+
+	for (i = 0; i <= sv_netrel.numleafs; i++)
+		sv_netrel.heads[i] = -1;
+	for (i = 0; i < sv_netrel.maxedicts; i++)
+		sv_netrel.edictlinks[i] = -1;
+	memset (sv_netrel.dirty, 0, sv_netrel.maxedicts);
+	sv_netrel.numdirty = 0;
+	VEC_CLEAR (sv_netrel.links);
+	sv_netrel.freelink = -1;
+	sv_netrel.rebuild = true;
+}
+
+/*
+=============
+SV_NoteEdictLeafs
+
+Called by SV_LinkEdict once it has recomputed the leafs the edict touches
+=============
+*/
+void SV_NoteEdictLeafs (edict_t *ent)
+{
+	int num;
+
+	if (qcvm != &sv.qcvm || !sv_netrel.dirty || sv_netrel.rebuild)
+		return;
+
+	num = NUM_FOR_EDICT (ent);
+	if (num >= sv_netrel.maxedicts || sv_netrel.dirty[num])
+		return;
+
+	sv_netrel.dirty[num] = true;
+	sv_netrel.dirtylist[sv_netrel.numdirty++] = num;
+}
+
+/*
+=============
+SV_AddNetLink
+=============
+*/
+static void SV_AddNetLink (int num, int leaf)
+{
+	netlink_t	*link;
+	int			l;
+
+	if (sv_netrel.freelink != -1)
+	{
+		l = sv_netrel.freelink;
+		sv_netrel.freelink = sv_netrel.links[l].nextinedict;
+	}
+	else
+	{
+		netlink_t empty;
+		memset (&empty, 0, sizeof (empty));
+		VEC_PUSH (sv_netrel.links, empty);
+		l = (int) VEC_SIZE (sv_netrel.links) - 1;
+	}
+
+	link = &sv_netrel.links[l];
+	link->leaf = leaf;
+	link->edict = num;
+	link->prev = -1;
+	link->next = sv_netrel.heads[leaf];
+	if (link->next != -1)
+		sv_netrel.links[link->next].prev = l;
+	sv_netrel.heads[leaf] = l;
+	link->nextinedict = sv_netrel.edictlinks[num];
+	sv_netrel.edictlinks[num] = l;
+}
+
+/*
+=============
+SV_RelistNetEdict
+=============
+*/
+static void SV_RelistNetEdict (int num)
+{
+	netlink_t	*link;
+	edict_t		*ent;
+	int			i, l, next;
+
+	for (l = sv_netrel.edictlinks[num]; l != -1; l = next)
+	{
+		link = &sv_netrel.links[l];
+		next = link->nextinedict;
+		if (link->prev != -1)
+			sv_netrel.links[link->prev].next = link->next;
+		else
+			sv_netrel.heads[link->leaf] = link->next;
+		if (link->next != -1)
+			sv_netrel.links[link->next].prev = link->prev;
+		link->nextinedict = sv_netrel.freelink;
+		sv_netrel.freelink = l;
+	}
+	sv_netrel.edictlinks[num] = -1;
+
+	ent = EDICT_NUM (num);
+	if (ent->num_leafs == MAX_ENT_LEAFS)
+	{
+		SV_AddNetLink (num, sv_netrel.numleafs);
+		return;
+	}
+	for (i = 0; i < ent->num_leafs; i++)
+		if ((unsigned) ent->leafnums[i] < (unsigned) sv_netrel.numleafs)
+			SV_AddNetLink (num, ent->leafnums[i]);
+}
+
+/*
+=============
+SV_RefreshNetIndex
+=============
+*/
+static void SV_RefreshNetIndex (void)
+{
+	int i, num;
+
+	if (sv_netrel.rebuild)
+	{
+	// slots past num_edicts were never initialized; edicts allocated
+	// later get listed by SV_NoteEdictLeafs when first linked
+		for (num = 1; num < qcvm->num_edicts; num++)
+			SV_RelistNetEdict (num);
+		sv_netrel.rebuild = false;
+		return;
+	}
+
+	for (i = 0; i < sv_netrel.numdirty; i++)
+	{
+		num = sv_netrel.dirtylist[i];
+		sv_netrel.dirty[num] = false;
+		SV_RelistNetEdict (num);
+	}
+	sv_netrel.numdirty = 0;
+}
+
+/*
+=============
+SV_EdictTouchesPVS -- the original test of SV_WriteEntitiesToClient
+=============
+*/
+static qboolean SV_EdictTouchesPVS (edict_t *ent, byte *pvs)
+{
+	int i;
+
+	// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
+	//
+	// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
+	// for us to say whether it's in the PVS, so don't try to vis cull it.
+	// this commonly happens with rotators, because they often have huge bboxes
+	// spanning the entire map, or really tall lifts, etc.
+	if (ent->num_leafs == MAX_ENT_LEAFS)
+		return true;
+
+	for (i=0 ; i < ent->num_leafs ; i++)
+		if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
+			return true;
+
+	return false;
+}
+
+/*
+=============
+SV_GatherNetEdicts
+
+Fills net_candidates with the edicts that may touch the pvs, in order,
+and returns their number
+=============
+*/
+static int SV_GatherNetEdicts (byte *pvs)
+{
+	int			i, j, k, l, e, count, words;
+	uint32_t	bits;
+
+	if (!sv_netindex.value || net_forcescan || !sv_netrel.heads || sv_netrel.numleafs != sv.worldmodel->numleafs)
+	{
+		for (e = 1; e < qcvm->num_edicts; e++)
+			net_candidates[e - 1] = e;
+		return qcvm->num_edicts - 1;
+	}
+
+	SV_RefreshNetIndex ();
+
+	words = (qcvm->num_edicts + 31) >> 5;
+	memset (sv_netrel.visible, 0, words * sizeof (uint32_t));
+
+	for (l = sv_netrel.heads[sv_netrel.numleafs]; l != -1; l = sv_netrel.links[l].next)
+		sv_netrel.visible[sv_netrel.links[l].edict >> 5] |= 1u << (sv_netrel.links[l].edict & 31);
+
+	for (j = 0; j < (sv_netrel.numleafs + 7) >> 3; j++)
+	{
+		if (!pvs[j])
+			continue;
+		// the last byte can have padding bits set (see Mod_NoVisPVS)
+		for (k = 0; k < 8 && (j << 3) + k < sv_netrel.numleafs; k++)
+		{
+			if (!(pvs[j] & (1 << k)))
+				continue;
+			for (l = sv_netrel.heads[(j << 3) + k]; l != -1; l = sv_netrel.links[l].next)
+				sv_netrel.visible[sv_netrel.links[l].edict >> 5] |= 1u << (sv_netrel.links[l].edict & 31);
+		}
+	}
+
+	count = 0;
+	for (i = 0; i < words; i++)
+	{
+		for (bits = sv_netrel.visible[i], k = 0; bits; bits >>= 1, k++)
+		{
+			e = (i << 5) + k;
+			if ((bits & 1) && e > 0 && e < qcvm->num_edicts)
+				net_candidates[count++] = e;
+		}
+	}
+
+	if (sv_netindex.value >= 2)
+	{
+		edict_t *ent = NEXT_EDICT (qcvm->edicts);
+		for (e = 1; e < qcvm->num_edicts; e++, ent = NEXT_EDICT (ent))
+		{
+			if (SV_EdictTouchesPVS (ent, pvs) && !(sv_netrel.visible[e >> 5] & (1u << (e & 31))))
+			{
+				Con_Printf ("sv_netindex: edict %d missing from the index\n", e);
+				break;
+			}
+		}
+	}
+
+	return count;
+}
 
 /*
 =============
@@ -691,7 +1241,7 @@ SV_WriteEntitiesToClient
 */
 void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 {
-	int		e, i, j, numents;
+	int		e, i, j, c, numents, numcandidates;
 	int		bits;
 	byte	*pvs;
 	vec3_t	org, forward, right, up;
@@ -721,9 +1271,11 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 	numents = 1;
 
 // add all other entities that touch the pvs
-	ent = NEXT_EDICT(qcvm->edicts);
-	for (e=1 ; e<qcvm->num_edicts ; e++, ent = NEXT_EDICT(ent))
+	numcandidates = SV_GatherNetEdicts (pvs);
+	for (c=0 ; c<numcandidates ; c++)
 	{
+		e = net_candidates[c];
+		ent = EDICT_NUM (e);
 		if (ent != clent)	// clent already added before the loop
 		{
 			// ignore ents without visible models
@@ -735,17 +1287,7 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 				continue;
 
 			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->num_leafs ; i++)
-				if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-					break;
-			
-			// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
-			//
-			// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
-			// for us to say whether it's in the PVS, so don't try to vis cull it.
-			// this commonly happens with rotators, because they often have huge bboxes
-			// spanning the entire map, or really tall lifts, etc.
-			if (i == ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
+			if (!SV_EdictTouchesPVS (ent, pvs))
 				continue;		// not visible
 
 			if (sv_netsort.value)
@@ -963,6 +1505,135 @@ stats:
 	//johnfitz
 }
 
+/*
+==================
+SV_NetBench_f
+
+Sends entities to viewpoints spread over the linked edicts, once scanning
+all edicts and once through the relevance index, and checks that both
+produce the same packets
+==================
+*/
+void SV_NetBench_f (void)
+{
+	static byte	scanbuf[MAX_DATAGRAM], indexbuf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+	edict_t		*clent, *ent;
+	qcvm_t		*oldvm;
+	vec3_t		origin, view_ofs, v_angle;
+	vec3_t		*views;
+	int			i, pass, frame, numclients, frames, numlinked, linked, mismatches, bytes, scansize;
+	double		time, times[2];
+	static const char *names[2] = {"scan", "index"};
+
+	if (!sv.active || svs.maxclients < 1)
+	{
+		Con_Printf ("sv_netbench: no map running\n");
+		return;
+	}
+
+	numclients = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 16;
+	numclients = CLAMP (1, numclients, MAX_SCOREBOARD);
+	frames = Cmd_Argc () > 2 ? Q_atoi (Cmd_Argv (2)) : 1000;
+	frames = CLAMP (1, frames, 1000000);
+
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+
+	numlinked = 0;
+	for (i = 1; i < qcvm->num_edicts; i++)
+		if (EDICT_NUM (i)->area.prev)
+			numlinked++;
+
+	// look from the centers of evenly spaced linked edicts in a different direction each
+	views = (vec3_t *) calloc (numclients, sizeof (*views));
+	if (!views)
+	{
+		PR_PopQCVM (oldvm);
+		return;
+	}
+	for (i = 1, pass = 0, linked = 0; i < qcvm->num_edicts && pass < numclients; i++)
+	{
+		ent = EDICT_NUM (i);
+		if (!ent->area.prev)
+			continue;
+		if (linked++ != (pass * numlinked) / numclients)
+			continue;
+		VectorAdd (ent->v.absmin, ent->v.absmax, views[pass]);
+		VectorScale (views[pass], 0.5f, views[pass]);
+		pass++;
+	}
+	if (!pass)
+	{
+		VectorAdd (sv.worldmodel->mins, sv.worldmodel->maxs, views[0]);
+		VectorScale (views[0], 0.5f, views[0]);
+		pass = 1;
+	}
+	numclients = pass;
+
+	clent = EDICT_NUM (1);
+	VectorCopy (clent->v.origin, origin);
+	VectorCopy (clent->v.view_ofs, view_ofs);
+	VectorCopy (clent->v.v_angle, v_angle);
+	VectorSet (clent->v.view_ofs, 0, 0, 0);
+
+	mismatches = bytes = 0;
+	for (i = 0; i < numclients; i++)
+	{
+		VectorCopy (views[i], clent->v.origin);
+		VectorSet (clent->v.v_angle, 0, i * 360.f / numclients, 0);
+
+		net_forcescan = true;
+		memset (&msg, 0, sizeof (msg));
+		msg.data = scanbuf;
+		msg.maxsize = sizeof (scanbuf);
+		SV_WriteEntitiesToClient (clent, &msg);
+		net_forcescan = false;
+		scansize = msg.cursize;
+		bytes += msg.cursize;
+
+		memset (&msg, 0, sizeof (msg));
+		msg.data = indexbuf;
+		msg.maxsize = sizeof (indexbuf);
+		SV_WriteEntitiesToClient (clent, &msg);
+		if (msg.cursize != scansize || memcmp (scanbuf, indexbuf, scansize))
+			mismatches++;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		net_forcescan = !pass;
+		time = Sys_DoubleTime ();
+		for (frame = 0; frame < frames; frame++)
+		{
+			for (i = 0; i < numclients; i++)
+			{
+				VectorCopy (views[i], clent->v.origin);
+				VectorSet (clent->v.v_angle, 0, i * 360.f / numclients, 0);
+				memset (&msg, 0, sizeof (msg));
+				msg.data = indexbuf;
+				msg.maxsize = sizeof (indexbuf);
+				SV_WriteEntitiesToClient (clent, &msg);
+			}
+		}
+		times[pass] = Sys_DoubleTime () - time;
+	}
+	net_forcescan = false;
+
+	VectorCopy (origin, clent->v.origin);
+	VectorCopy (view_ofs, clent->v.view_ofs);
+	VectorCopy (v_angle, clent->v.v_angle);
+
+	Con_Printf ("%d clients, %d frames, %d edicts, %d linked, %d bytes per frame\n",
+		numclients, frames, qcvm->num_edicts, numlinked, bytes);
+	for (pass = 0; pass < 2; pass++)
+		Con_Printf ("%-6s %8.3f ms per frame\n", names[pass], times[pass] * 1000.0 / frames);
+	if (mismatches)
+		Con_Printf ("%d viewpoints got different packets\n", mismatches);
+
+	PR_PopQCVM (oldvm);
+	free (views);
+}
+
 /*
 =============
 SV_CleanupEnts
@@ -1201,8 +1872,7 @@ qboolean SV_SendClientDatagram (client_t *client)
 	SV_WriteEntitiesToClient (client->edict, &msg);
 
 // copy the server datagram if there is space
-	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
-		SZ_Write (&msg, sv.datagram.data, sv.datagram.cursize);
+	SV_WriteDatagram (client, &msg);
 
 // send the datagram
 	if (NET_SendUnreliableMessage (client->netconnection, &msg) == -1)
@@ -1978,6 +2648,7 @@ void SV_SpawnServer (const char *server)
 	sv.datagram.maxsize = sizeof(sv.datagram_buf);
 	sv.datagram.cursize = 0;
 	sv.datagram.data = sv.datagram_buf;
+	sv_numsounds = 0;
 
 	sv.reliable_datagram.maxsize = sizeof(sv.reliable_datagram_buf);
 	sv.reliable_datagram.cursize = 0;
@@ -2010,11 +2681,13 @@ void SV_SpawnServer (const char *server)
 		return;
 	}
 	sv.models[1] = sv.worldmodel;
+	SV_BuildPHS (sv.worldmodel);
 
 //
 // clear world interaction links
 //
 	SV_ClearWorld ();
+	SV_ClearNetIndex ();
 
 	sv.sound_precache[0] = dummy;
 	sv.model_precache[0] = dummy;
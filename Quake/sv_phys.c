@@ -270,6 +270,7 @@ int SV_FlyMove (edict_t *ent, float time, trace_t *steptrace)
 		if (trace.fraction > 0)
 		{	// actually covered some distance
 			VectorCopy (trace.endpos, ent->v.origin);
+			SV_MarkEdictMoved (ent);
 			VectorCopy (ent->v.velocity, original_velocity);
 			numplanes = 0;
 		}
@@ -385,6 +386,367 @@ void SV_AddGravity (edict_t *ent)
 }
 
 
+/*
+===============================================================================
+
+PARALLEL PROJECTILE TRACES
+
+Before the serial physics pass, the moves of the toss/bounce/fly entities
+that won't think this frame are predicted and traced on worker threads
+against the world as it is at the start of the frame. When SV_PushEntity
+later asks for the exact same move, the prediction is only used if nothing
+that could have changed its result has happened in the meantime: every
+edict whose clipping state changes is logged with its old abs box, and the
+trace is redone if any of them overlapped the move, either before or after
+the change. The outcome is identical to tracing serially.
+
+===============================================================================
+*/
+
+cvar_t	sv_parallelphysics = {"sv_parallelphysics", "1", CVAR_NONE}; // 0 = off, 2 = compare with serial traces
+
+#define	PREDICT_MIN_MOVES	16		// not worth the dispatch below this
+
+typedef struct
+{
+	int			num;
+	int			type;
+	int			owner;
+	qboolean	hassize;
+	vec3_t		start, mins, maxs, end;
+	vec3_t		boxmins, boxmaxs;	// area covered by the move, as in SV_Move
+	trace_t		trace;
+} predictedmove_t;
+
+static struct
+{
+	qboolean		active;				// predictions are valid for this frame
+	int				maxedicts;			// size of the per-edict arrays
+	int				*moveindex;			// predicted move of each edict, -1 if none
+	byte			*changed;			// edict is in the change log
+	int				*changelog;
+	vec3_t			*oldabsmin;			// abs box of each logged edict when it was logged
+	vec3_t			*oldabsmax;
+	int				numchanges;
+	int				areasplits;			// SV_AreaSplitCount when the moves were traced
+	predictedmove_t	*moves;
+	int				nummoves;
+	taskgroup_t		group;
+} sv_predict;
+
+/*
+================
+SV_NoteClipChange
+
+Called before anything that can change the way traces clip against an edict
+================
+*/
+void SV_NoteClipChange (edict_t *ent)
+{
+	int num;
+
+	if (!sv_predict.active || qcvm != &sv.qcvm)
+		return;
+
+	num = NUM_FOR_EDICT (ent);
+	if (num >= sv_predict.maxedicts || sv_predict.changed[num])
+		return;
+
+	sv_predict.changed[num] = true;
+	VectorCopy (ent->v.absmin, sv_predict.oldabsmin[sv_predict.numchanges]);
+	VectorCopy (ent->v.absmax, sv_predict.oldabsmax[sv_predict.numchanges]);
+	sv_predict.changelog[sv_predict.numchanges++] = num;
+}
+
+/*
+================
+SV_PushEntityType -- move type used by SV_PushEntity
+================
+*/
+static int SV_PushEntityType (edict_t *ent)
+{
+	if (ent->v.movetype == MOVETYPE_FLYMISSILE)
+		return MOVE_MISSILE;
+	else if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
+	// only clip against bmodels
+		return MOVE_NOMONSTERS;
+	else
+		return MOVE_NORMAL;
+}
+
+/*
+================
+SV_PredictPush
+
+Replicates what SV_Physics_Toss does to the entity before calling
+SV_PushEntity, returns false if it won't move or isn't worth predicting
+================
+*/
+static qboolean SV_PredictPush (edict_t *ent, vec3_t end)
+{
+	vec3_t	velocity, move;
+	eval_t	*val;
+	float	thinktime, ent_gravity;
+	int		i;
+
+	if (ent->v.movetype != MOVETYPE_TOSS
+	&& ent->v.movetype != MOVETYPE_GIB
+	&& ent->v.movetype != MOVETYPE_BOUNCE
+	&& ent->v.movetype != MOVETYPE_FLY
+	&& ent->v.movetype != MOVETYPE_FLYMISSILE)
+		return false;
+
+	// the think function could do anything
+	thinktime = ent->v.nextthink;
+	if (!(thinktime <= 0 || thinktime > qcvm->time + host_frametime))
+		return false;
+
+	if ((int)ent->v.flags & FL_ONGROUND)
+		return false;
+
+	// SV_CheckVelocity, minus the NaN warnings
+	VectorCopy (ent->v.velocity, velocity);
+	for (i=0 ; i<3 ; i++)
+	{
+		if (IS_NAN(velocity[i]) || IS_NAN(ent->v.origin[i]))
+			return false;
+		if (velocity[i] > sv_maxvelocity.value)
+			velocity[i] = sv_maxvelocity.value;
+		else if (velocity[i] < -sv_maxvelocity.value)
+			velocity[i] = -sv_maxvelocity.value;
+	}
+
+	// SV_AddGravity
+	if (ent->v.movetype != MOVETYPE_FLY
+	&& ent->v.movetype != MOVETYPE_FLYMISSILE)
+	{
+		val = GetEdictFieldValueByName(ent, "gravity");
+		if (val && val->_float)
+			ent_gravity = val->_float;
+		else
+			ent_gravity = 1.0;
+		velocity[2] -= ent_gravity * sv_gravity.value * host_frametime;
+	}
+
+	VectorScale (velocity, host_frametime, move);
+	VectorAdd (ent->v.origin, move, end);
+
+	return true;
+}
+
+/*
+================
+SV_PredictMovesTask
+
+Traces the moves through SV_MoveBatch, so that the ones sharing a world
+hull go through it together
+================
+*/
+static void SV_PredictMovesTask (void *param, int first, int last)
+{
+	svmove_t		batch[MOVE_BATCH];
+	trace_t			traces[MOVE_BATCH];
+	predictedmove_t	*move;
+	qcvm_t			*oldvm;
+	int				i, j, count;
+
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+
+	for (i = first; i < last; i += count)
+	{
+		count = q_min (last - i, MOVE_BATCH);
+		for (j = 0, move = sv_predict.moves + i; j < count; j++, move++)
+		{
+			VectorCopy (move->start, batch[j].start);
+			VectorCopy (move->mins, batch[j].mins);
+			VectorCopy (move->maxs, batch[j].maxs);
+			VectorCopy (move->end, batch[j].end);
+			batch[j].type = move->type;
+			batch[j].passedict = EDICT_NUM (move->num);
+		}
+		SV_MoveBatch (count, batch, traces);
+		for (j = 0, move = sv_predict.moves + i; j < count; j++, move++)
+			move->trace = traces[j];
+	}
+
+	PR_PopQCVM (oldvm);
+}
+
+/*
+================
+SV_PredictMoves
+
+Traces the predicted moves of the entities in [first, last) in parallel
+================
+*/
+static void SV_PredictMoves (int first, int last)
+{
+	static vec3_t	missilemins = {-15, -15, -15};
+	static vec3_t	missilemaxs = {15, 15, 15};
+	predictedmove_t	*move;
+	edict_t			*ent;
+	int				i, n;
+
+	if (!sv_parallelphysics.value || !Tasks_NumWorkers () || pr_global_struct->force_retouch)
+		return;
+
+	if (sv_predict.maxedicts < qcvm->max_edicts)
+	{
+		free (sv_predict.moveindex);
+		free (sv_predict.changed);
+		free (sv_predict.changelog);
+		free (sv_predict.oldabsmin);
+		free (sv_predict.oldabsmax);
+		free (sv_predict.moves);
+
+		sv_predict.maxedicts = qcvm->max_edicts;
+		n = sv_predict.maxedicts;
+		sv_predict.moveindex = (int *) malloc (n * sizeof (int));
+		sv_predict.changed = (byte *) calloc (n, 1);
+		sv_predict.changelog = (int *) malloc (n * sizeof (int));
+		sv_predict.oldabsmin = (vec3_t *) malloc (n * sizeof (vec3_t));
+		sv_predict.oldabsmax = (vec3_t *) malloc (n * sizeof (vec3_t));
+		sv_predict.moves = (predictedmove_t *) malloc (n * sizeof (predictedmove_t));
+		if (!sv_predict.moveindex || !sv_predict.changed || !sv_predict.changelog ||
+			!sv_predict.oldabsmin || !sv_predict.oldabsmax || !sv_predict.moves)
+			Sys_Error ("SV_PredictMoves: out of memory (%d edicts)", n);
+		for (i = 0; i < n; i++)
+			sv_predict.moveindex[i] = -1;
+	}
+
+	// traces against a broken bmodel end in Host_Error, which can't happen on a worker
+	for (i = 1, ent = EDICT_NUM (1); i < qcvm->num_edicts; i++, ent = NEXT_EDICT (ent))
+	{
+		if (!ent->free && ent->v.solid == SOLID_BSP && ent->area.prev &&
+			(ent->v.movetype != MOVETYPE_PUSH || !sv.models[(int)ent->v.modelindex] ||
+			 sv.models[(int)ent->v.modelindex]->type != mod_brush))
+			return;
+	}
+
+	sv_predict.nummoves = 0;
+	for (i = first, ent = EDICT_NUM (first); i < last; i++, ent = NEXT_EDICT (ent))
+	{
+		if (ent->free)
+			continue;
+
+		move = &sv_predict.moves[sv_predict.nummoves];
+		if (!SV_PredictPush (ent, move->end))
+			continue;
+
+		move->num = i;
+		move->type = SV_PushEntityType (ent);
+		move->owner = ent->v.owner;
+		move->hassize = ent->v.size[0] != 0;
+		VectorCopy (ent->v.origin, move->start);
+		VectorCopy (ent->v.mins, move->mins);
+		VectorCopy (ent->v.maxs, move->maxs);
+		if (move->type == MOVE_MISSILE)
+			SV_MoveBounds (move->start, missilemins, missilemaxs, move->end, move->boxmins, move->boxmaxs);
+		else
+			SV_MoveBounds (move->start, move->mins, move->maxs, move->end, move->boxmins, move->boxmaxs);
+		sv_predict.moveindex[i] = sv_predict.nummoves++;
+	}
+
+	if (sv_predict.nummoves < PREDICT_MIN_MOVES)
+	{
+		for (i = 0; i < sv_predict.nummoves; i++)
+			sv_predict.moveindex[sv_predict.moves[i].num] = -1;
+		sv_predict.nummoves = 0;
+		return;
+	}
+
+	sv_predict.areasplits = SV_AreaSplitCount ();
+	Task_ParallelFor (&sv_predict.group, sv_predict.nummoves, 0, SV_PredictMovesTask, NULL);
+	Task_Wait (&sv_predict.group);
+
+	sv_predict.numchanges = 0;
+	sv_predict.active = true;
+}
+
+/*
+================
+SV_EndPredictedMoves
+================
+*/
+static void SV_EndPredictedMoves (void)
+{
+	int i;
+
+	if (!sv_predict.active)
+		return;
+
+	for (i = 0; i < sv_predict.nummoves; i++)
+		sv_predict.moveindex[sv_predict.moves[i].num] = -1;
+	for (i = 0; i < sv_predict.numchanges; i++)
+		sv_predict.changed[sv_predict.changelog[i]] = false;
+	sv_predict.nummoves = 0;
+	sv_predict.numchanges = 0;
+	sv_predict.active = false;
+}
+
+/*
+================
+SV_BoxesOverlap -- same test as SV_ClipToLinks
+================
+*/
+static qboolean SV_BoxesOverlap (const vec3_t boxmins, const vec3_t boxmaxs, const vec3_t absmin, const vec3_t absmax)
+{
+	return !(boxmins[0] > absmax[0]
+		|| boxmins[1] > absmax[1]
+		|| boxmins[2] > absmax[2]
+		|| boxmaxs[0] < absmin[0]
+		|| boxmaxs[1] < absmin[1]
+		|| boxmaxs[2] < absmin[2]);
+}
+
+/*
+================
+SV_PredictedMove
+
+Returns the trace computed in advance for this exact move, if it's still valid
+================
+*/
+static qboolean SV_PredictedMove (edict_t *ent, vec3_t end, int type, trace_t *trace)
+{
+	predictedmove_t	*move;
+	edict_t			*check;
+	int				i, num;
+
+	if (!sv_predict.active)
+		return false;
+
+	num = NUM_FOR_EDICT (ent);
+	if (num >= sv_predict.maxedicts || sv_predict.moveindex[num] < 0)
+		return false;
+	move = &sv_predict.moves[sv_predict.moveindex[num]];
+	sv_predict.moveindex[num] = -1;	// only valid once
+
+	// the move itself must be the one that was traced
+	if (move->type != type || move->owner != ent->v.owner || move->hassize != (ent->v.size[0] != 0) ||
+		!VectorCompare (move->start, ent->v.origin) || !VectorCompare (move->end, end) ||
+		!VectorCompare (move->mins, ent->v.mins) || !VectorCompare (move->maxs, ent->v.maxs))
+		return false;
+
+	// node splits reorder the edicts the trace visits
+	if (sv_predict.areasplits != SV_AreaSplitCount ())
+		return false;
+
+	// and nothing it could have hit may have changed
+	for (i = 0; i < sv_predict.numchanges; i++)
+	{
+		if (sv_predict.changelog[i] == num)
+			continue;	// never clips against itself
+		if (SV_BoxesOverlap (move->boxmins, move->boxmaxs, sv_predict.oldabsmin[i], sv_predict.oldabsmax[i]))
+			return false;
+		check = EDICT_NUM (sv_predict.changelog[i]);
+		if (SV_BoxesOverlap (move->boxmins, move->boxmaxs, check->v.absmin, check->v.absmax))
+			return false;
+	}
+
+	*trace = move->trace;
+	return true;
+}
+
 /*
 ===============================================================================
 
@@ -400,21 +762,55 @@ SV_PushEntity
 Does not change the entities velocity at all
 ============
 */
+static trace_t SV_FinishPush (edict_t *ent, trace_t trace);
+
 trace_t SV_PushEntity (edict_t *ent, vec3_t push)
 {
 	trace_t	trace;
 	vec3_t	end;
 
 	VectorAdd (ent->v.origin, push, end);
+	trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, SV_PushEntityType (ent), ent);
 
-	if (ent->v.movetype == MOVETYPE_FLYMISSILE)
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_MISSILE, ent);
-	else if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
-	// only clip against bmodels
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NOMONSTERS, ent);
-	else
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NORMAL, ent);
+	return SV_FinishPush (ent, trace);
+}
+
+/*
+============
+SV_PushPredictedEntity
 
+Same as SV_PushEntity, but uses the trace from SV_PredictMoves if it's still valid
+============
+*/
+static trace_t SV_PushPredictedEntity (edict_t *ent, vec3_t push)
+{
+	trace_t	trace, check;
+	vec3_t	end;
+	int		type;
+
+	VectorAdd (ent->v.origin, push, end);
+	type = SV_PushEntityType (ent);
+
+	if (!SV_PredictedMove (ent, end, type, &trace))
+		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, type, ent);
+	else if (sv_parallelphysics.value >= 2)
+	{
+		check = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, type, ent);
+		if (memcmp (&check, &trace, sizeof (trace)) != 0)
+			Con_Warning ("predicted trace mismatch on edict %d\n", NUM_FOR_EDICT (ent));
+		trace = check;
+	}
+
+	return SV_FinishPush (ent, trace);
+}
+
+/*
+============
+SV_FinishPush
+============
+*/
+static trace_t SV_FinishPush (edict_t *ent, trace_t trace)
+{
 	VectorCopy (trace.endpos, ent->v.origin);
 	SV_LinkEdict (ent, true);
 
@@ -532,8 +928,10 @@ void SV_PushMove (edict_t *pusher, float movetime)
 			solid_backup == SOLID_SLIDEBOX)
 		{
 			pusher->v.solid = SOLID_NOT;
+			SV_MarkEdictMoved (pusher);
 			SV_PushEntity (check, move);
 			pusher->v.solid = solid_backup;
+			SV_MarkEdictMoved (pusher);
 		}
 
 	// if it is still inside the pusher, block
@@ -546,6 +944,7 @@ void SV_PushMove (edict_t *pusher, float movetime)
 			{	// corpse
 				check->v.mins[0] = check->v.mins[1] = 0;
 				VectorCopy (check->v.mins, check->v.maxs);
+				SV_MarkEdictMoved (check);
 				continue;
 			}
 
@@ -555,6 +954,7 @@ void SV_PushMove (edict_t *pusher, float movetime)
 				(sv_gameplayfix_elevators.value && e <= svs.maxclients)))
 			{
 				check->v.origin[2] += DIST_EPSILON;
+				SV_MarkEdictMoved (check);
 				if (!SV_TestEntityPosition (check))
 				{
 					// notify developer about potential issue
@@ -1136,7 +1536,7 @@ void SV_Physics_Toss (edict_t *ent)
 
 // move origin
 	VectorScale (ent->v.velocity, host_frametime, move);
-	trace = SV_PushEntity (ent, move);
+	trace = SV_PushPredictedEntity (ent, move);
 	if (trace.fraction == 1)
 		return;
 	if (ent->free)
@@ -1247,6 +1647,8 @@ void SV_Physics (void)
 	else
 	  entity_cap = qcvm->num_edicts;
 
+	SV_PredictMoves (svs.maxclients + 1, entity_cap);
+
 	//for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	for (i=0 ; i<entity_cap ; i++, ent = NEXT_EDICT(ent))
 	{
@@ -1290,6 +1692,8 @@ void SV_Physics (void)
 	//johnfitz
 	}
 
+	SV_EndPredictedMoves ();
+
 	if (pr_global_struct->force_retouch)
 		pr_global_struct->force_retouch--;
 
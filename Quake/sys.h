@@ -79,11 +79,25 @@ qfileofs_t Sys_FileOpenRead (const char *path, int *hndl);
 // Returns a file handle
 int Sys_FileOpenWrite (const char *path);
 
+// Returns a handle to an anonymous read/write file that
+// is deleted when closed, or -1 on failure
+int Sys_FileOpenTemp (void);
+
+// Same as Sys_FileOpenTemp, as a FILE pointer (NULL on failure)
+FILE *Sys_tmpfile (void);
+
 void Sys_FileClose (int handle);
 void Sys_FileSeek (int handle, int position);
 int Sys_FileRead (int handle, void *dest, int count);
 int Sys_FileWrite (int handle,const void *data, int count);
 qboolean Sys_FileExists (const char *path);
+
+// Maps length bytes at offset of a file opened with Sys_FileOpenRead.
+// The view is private (copy-on-write): writes never reach the file.
+// Returns a pointer to the requested data or NULL on failure;
+// *base and *basesize receive what must be passed to Sys_UnmapFile.
+void *Sys_MapFile (int handle, qfileofs_t offset, size_t length, void **base, size_t *basesize);
+void Sys_UnmapFile (void *base, size_t basesize);
 qboolean Sys_GetFileTime (const char *path, time_t *out);
 void Sys_mkdir (const char *path);
 FILE *Sys_fopen (const char *path, const char *mode);
@@ -34,6 +34,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <time.h>
 #include <dirent.h>
@@ -173,6 +174,25 @@ int Sys_FileOpenWrite (const char *path)
 	return i;
 }
 
+FILE *Sys_tmpfile (void)
+{
+	return tmpfile ();
+}
+
+int Sys_FileOpenTemp (void)
+{
+	FILE	*f;
+	int		i;
+
+	i = findhandle ();
+	f = Sys_tmpfile ();
+	if (!f)
+		return -1;
+
+	sys_handles[i] = f;
+	return i;
+}
+
 void Sys_FileClose (int handle)
 {
 	fclose (sys_handles[handle]);
@@ -199,6 +219,38 @@ qboolean Sys_FileExists (const char *path)
 	return access (path, F_OK) == 0;
 }
 
+void *Sys_MapFile (int handle, qfileofs_t offset, size_t length, void **base, size_t *basesize)
+{
+	long	pagesize = sysconf (_SC_PAGESIZE);
+	off_t	aligned;
+	size_t	delta;
+	void	*view;
+
+	if (handle < 0 || !sys_handles[handle] || !length || offset < 0 || pagesize <= 0)
+		return NULL;
+
+	aligned = (off_t) (offset - offset % pagesize);
+	delta = (size_t) (offset - aligned);
+	view = mmap (NULL, length + delta, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno (sys_handles[handle]), aligned);
+	if (view == MAP_FAILED)
+		return NULL;
+
+#ifdef POSIX_MADV_WILLNEED
+	posix_madvise (view, length + delta, POSIX_MADV_WILLNEED);
+#endif
+
+	*base = view;
+	*basesize = length + delta;
+
+	return (byte *) view + delta;
+}
+
+void Sys_UnmapFile (void *base, size_t basesize)
+{
+	if (base)
+		munmap (base, basesize);
+}
+
 int Sys_FileType (const char *path)
 {
 	/*
@@ -226,6 +226,52 @@ int Sys_FileOpenWrite (const char *path)
 	return i;
 }
 
+FILE *Sys_tmpfile (void)
+{
+	FILE	*f;
+	int		fd;
+	HANDLE	h;
+	WCHAR	dir[MAX_PATH + 1];
+	WCHAR	path[MAX_PATH + 1];
+
+	// tmpfile() creates its file in the root of the current drive,
+	// which regular users usually can't write to
+	if (!GetTempPathW (countof (dir), dir) || !GetTempFileNameW (dir, L"iw", 0, path))
+		return NULL;
+	h = CreateFileW (path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+	{
+		DeleteFileW (path);
+		return NULL;
+	}
+	fd = _open_osfhandle ((intptr_t) h, 0);
+	if (fd == -1)
+	{
+		CloseHandle (h);
+		return NULL;
+	}
+	f = _fdopen (fd, "w+b");
+	if (!f)
+		_close (fd);
+
+	return f;
+}
+
+int Sys_FileOpenTemp (void)
+{
+	FILE	*f;
+	int		i;
+
+	i = findhandle ();
+	f = Sys_tmpfile ();
+	if (!f)
+		return -1;
+
+	sys_handles[i] = f;
+	return i;
+}
+
 void Sys_FileClose (int handle)
 {
 	fclose (sys_handles[handle]);
@@ -276,6 +322,45 @@ qboolean Sys_FileExists (const char *path)
 	return attr != INVALID_FILE_ATTRIBUTES && !(attr & (FILE_ATTRIBUTE_DIRECTORY|FILE_ATTRIBUTE_DEVICE));
 }
 
+void *Sys_MapFile (int handle, qfileofs_t offset, size_t length, void **base, size_t *basesize)
+{
+	SYSTEM_INFO	info;
+	HANDLE		file, mapping;
+	qfileofs_t	aligned;
+	size_t		delta;
+	void		*view;
+
+	if (handle < 0 || !sys_handles[handle] || !length || offset < 0)
+		return NULL;
+
+	file = (HANDLE) _get_osfhandle (_fileno (sys_handles[handle]));
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	GetSystemInfo (&info);
+	aligned = offset - offset % info.dwAllocationGranularity;
+	delta = (size_t) (offset - aligned);
+
+	mapping = CreateFileMappingW (file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (!mapping)
+		return NULL;
+	view = MapViewOfFile (mapping, FILE_MAP_COPY, (DWORD) ((uint64_t) aligned >> 32), (DWORD) aligned, length + delta);
+	CloseHandle (mapping); // the view keeps the mapping alive
+	if (!view)
+		return NULL;
+
+	*base = view;
+	*basesize = length + delta;
+
+	return (byte *) view + delta;
+}
+
+void Sys_UnmapFile (void *base, size_t basesize)
+{
+	if (base)
+		UnmapViewOfFile (base);
+}
+
 qboolean Sys_GetFileTime (const char *path, time_t *out)
 {
 	wchar_t		wpath[MAX_PATH];
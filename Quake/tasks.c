@@ -0,0 +1,454 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// tasks.c -- worker thread pool
+//
+// Every worker owns a deque: tasks dispatched from a worker go to the bottom
+// of its own deque and are popped back in LIFO order, while idle threads steal
+// the oldest tasks from the top of other deques. The main thread (and any
+// other thread outside the pool) shares deque 0.
+
+#include "quakedef.h"
+
+#define MAX_TASK_WORKERS	32
+#define TASK_DEQUE_SIZE		1024	// per thread, must be a power of two
+#define TASK_BATCHES_PER_THREAD	4
+
+typedef struct task_s
+{
+	taskfunc_t		func;
+	void			*param;
+	int				first;
+	int				last;
+	taskgroup_t		*group;
+} task_t;
+
+typedef struct
+{
+	SDL_SpinLock	lock;
+	unsigned		top;		// oldest task, stolen by other threads
+	unsigned		bottom;		// newest task, popped by the owner
+	task_t			tasks[TASK_DEQUE_SIZE];
+
+	SDL_atomic_t	executed;
+	SDL_atomic_t	stolen;
+} taskdeque_t;
+
+static struct
+{
+	qboolean		shutdown;
+	SDL_mutex		*mutex;
+	SDL_cond		*work;		// signaled when tasks are queued
+	SDL_cond		*done;		// signaled when a group completes
+	SDL_atomic_t	queued;		// tasks sitting in the deques
+	SDL_atomic_t	sleeping;	// workers waiting on the work condition
+	SDL_atomic_t	waiting;	// threads waiting on the done condition
+	taskdeque_t		*deques;	// numworkers + 1
+	int				numworkers;
+	SDL_Thread		*workers[MAX_TASK_WORKERS];
+
+	SDL_atomic_t	dispatched;
+	SDL_atomic_t	inlined;	// ran right away because the deque was full
+} tasks;
+
+static THREAD_LOCAL int			task_thread;	// deque index, 0 for threads outside the pool
+static THREAD_LOCAL unsigned	task_seed;
+
+/*
+==================
+Task_Finish
+==================
+*/
+static void Task_Finish (taskgroup_t *group)
+{
+	qboolean	completed;
+
+	// the decrement happens under the group lock so that waiters can
+	// make sure we're done touching the group before they return
+	SDL_AtomicLock (&group->lock);
+	completed = SDL_AtomicDecRef (&group->pending);
+	SDL_AtomicUnlock (&group->lock);
+
+	if (!completed)
+		return;
+
+	if (SDL_AtomicGet (&tasks.waiting) > 0)
+	{
+		SDL_LockMutex (tasks.mutex);
+		SDL_CondBroadcast (tasks.done);
+		SDL_UnlockMutex (tasks.mutex);
+	}
+}
+
+/*
+==================
+Task_Run
+==================
+*/
+static void Task_Run (const task_t *task)
+{
+	task->func (task->param, task->first, task->last);
+	if (tasks.deques)
+		SDL_AtomicIncRef (&tasks.deques[task_thread].executed);
+	Task_Finish (task->group);
+}
+
+/*
+==================
+Task_Pop -- takes the newest task from our own deque, or steals the oldest one from another thread
+==================
+*/
+static qboolean Task_Pop (task_t *task)
+{
+	taskdeque_t	*deque;
+	qboolean	found = false;
+	int			i, count, victim;
+
+	if (!tasks.deques || SDL_AtomicGet (&tasks.queued) == 0)
+		return false;
+
+	deque = &tasks.deques[task_thread];
+	SDL_AtomicLock (&deque->lock);
+	if (deque->bottom != deque->top)
+	{
+		*task = deque->tasks[(--deque->bottom) & (TASK_DEQUE_SIZE - 1)];
+		found = true;
+	}
+	SDL_AtomicUnlock (&deque->lock);
+
+	if (found)
+	{
+		SDL_AtomicAdd (&tasks.queued, -1);
+		return true;
+	}
+
+	// start at a random victim so that idle threads don't all contend for the same deque
+	count = tasks.numworkers + 1;
+	task_seed = task_seed * 1103515245 + 12345;
+	victim = (task_seed >> 16) % count;
+	for (i = 0; i < count; i++, victim = (victim + 1) % count)
+	{
+		if (victim == task_thread)
+			continue;
+		deque = &tasks.deques[victim];
+		SDL_AtomicLock (&deque->lock);
+		if (deque->bottom != deque->top)
+		{
+			*task = deque->tasks[(deque->top++) & (TASK_DEQUE_SIZE - 1)];
+			found = true;
+		}
+		SDL_AtomicUnlock (&deque->lock);
+
+		if (found)
+		{
+			SDL_AtomicAdd (&tasks.queued, -1);
+			SDL_AtomicIncRef (&tasks.deques[task_thread].stolen);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+==================
+Task_Worker
+==================
+*/
+static int Task_Worker (void *param)
+{
+	task_t		task;
+	qboolean	shutdown;
+
+	task_thread = (int)(intptr_t) param;
+	task_seed = task_thread;
+
+	for (;;)
+	{
+		if (Task_Pop (&task))
+		{
+			Task_Run (&task);
+			continue;
+		}
+
+		SDL_LockMutex (tasks.mutex);
+		SDL_AtomicIncRef (&tasks.sleeping);
+		while (!tasks.shutdown && SDL_AtomicGet (&tasks.queued) == 0)
+			SDL_CondWait (tasks.work, tasks.mutex);
+		SDL_AtomicAdd (&tasks.sleeping, -1);
+		shutdown = tasks.shutdown && SDL_AtomicGet (&tasks.queued) == 0;
+		SDL_UnlockMutex (tasks.mutex);
+
+		if (shutdown)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+==================
+Task_Enqueue -- queues a task whose group has already been incremented
+==================
+*/
+static void Task_Enqueue (const task_t *task)
+{
+	taskdeque_t	*deque;
+	qboolean	queued = false;
+
+	SDL_AtomicIncRef (&tasks.dispatched);
+
+	if (tasks.numworkers > 0)
+	{
+		deque = &tasks.deques[task_thread];
+		SDL_AtomicLock (&deque->lock);
+		if (deque->bottom - deque->top < TASK_DEQUE_SIZE)
+		{
+			deque->tasks[(deque->bottom++) & (TASK_DEQUE_SIZE - 1)] = *task;
+			queued = true;
+		}
+		SDL_AtomicUnlock (&deque->lock);
+	}
+
+	if (!queued)
+	{
+		// deque is full (or there are no workers), run the task right away
+		SDL_AtomicIncRef (&tasks.inlined);
+		Task_Run (task);
+		return;
+	}
+
+	SDL_AtomicIncRef (&tasks.queued);
+	if (SDL_AtomicGet (&tasks.sleeping) > 0)
+	{
+		SDL_LockMutex (tasks.mutex);
+		SDL_CondSignal (tasks.work);
+		SDL_UnlockMutex (tasks.mutex);
+	}
+}
+
+/*
+==================
+Task_Push
+==================
+*/
+static void Task_Push (taskgroup_t *group, taskfunc_t func, void *param, int first, int last)
+{
+	task_t task;
+
+	task.func = func;
+	task.param = param;
+	task.first = first;
+	task.last = last;
+	task.group = group;
+
+	SDL_AtomicIncRef (&group->pending);
+	Task_Enqueue (&task);
+}
+
+/*
+==================
+Task_Dispatch
+==================
+*/
+void Task_Dispatch (taskgroup_t *group, taskfunc_t func, void *param)
+{
+	Task_Push (group, func, param, 0, 1);
+}
+
+/*
+==================
+Task_ParallelFor
+==================
+*/
+void Task_ParallelFor (taskgroup_t *group, int count, int batchsize, taskfunc_t func, void *param)
+{
+	int first;
+
+	if (count <= 0)
+		return;
+
+	if (batchsize <= 0)
+	{
+		int numbatches = (tasks.numworkers + 1) * TASK_BATCHES_PER_THREAD;
+		batchsize = (count + numbatches - 1) / numbatches;
+	}
+
+	for (first = 0; first < count; first += batchsize)
+		Task_Push (group, func, param, first, q_min (first + batchsize, count));
+}
+
+/*
+==================
+Task_WaitForLock -- makes sure the thread that completed the group is done touching it
+==================
+*/
+static void Task_WaitForLock (taskgroup_t *group)
+{
+	SDL_AtomicLock (&group->lock);
+	SDL_AtomicUnlock (&group->lock);
+}
+
+/*
+==================
+Task_Wait
+==================
+*/
+void Task_Wait (taskgroup_t *group)
+{
+	task_t task;
+
+	while (SDL_AtomicGet (&group->pending) > 0)
+	{
+		if (Task_Pop (&task))
+		{
+			Task_Run (&task);
+			continue;
+		}
+
+		SDL_LockMutex (tasks.mutex);
+		SDL_AtomicIncRef (&tasks.waiting);
+		if (SDL_AtomicGet (&group->pending) > 0 && SDL_AtomicGet (&tasks.queued) == 0)
+			SDL_CondWait (tasks.done, tasks.mutex);
+		SDL_AtomicAdd (&tasks.waiting, -1);
+		SDL_UnlockMutex (tasks.mutex);
+	}
+
+	Task_WaitForLock (group);
+}
+
+/*
+==================
+Tasks_NumWorkers
+==================
+*/
+int Tasks_NumWorkers (void)
+{
+	return tasks.numworkers;
+}
+
+/*
+==================
+Tasks_IsWorker
+==================
+*/
+qboolean Tasks_IsWorker (void)
+{
+	return task_thread != 0;
+}
+
+/*
+==================
+Tasks_Stats_f
+==================
+*/
+static void Tasks_Stats_f (void)
+{
+	int i, executed, stolen;
+
+	Con_Printf ("%d worker thread%s, %d task%s queued\n",
+		tasks.numworkers, tasks.numworkers == 1 ? "" : "s",
+		SDL_AtomicGet (&tasks.queued), SDL_AtomicGet (&tasks.queued) == 1 ? "" : "s");
+	Con_Printf ("%d dispatched, %d ran inline\n",
+		SDL_AtomicGet (&tasks.dispatched), SDL_AtomicGet (&tasks.inlined));
+
+	for (i = 0; i <= tasks.numworkers; i++)
+	{
+		executed = SDL_AtomicGet (&tasks.deques[i].executed);
+		stolen = SDL_AtomicGet (&tasks.deques[i].stolen);
+		Con_Printf ("%-6s %2d: %8d executed, %8d stolen\n", i ? "worker" : "main", i, executed, stolen);
+	}
+}
+
+/*
+==================
+Tasks_Init
+==================
+*/
+void Tasks_Init (void)
+{
+	int i, numthreads;
+
+	tasks.mutex = SDL_CreateMutex ();
+	if (!tasks.mutex)
+		Sys_Error ("Tasks_Init: could not create mutex");
+	tasks.work = SDL_CreateCond ();
+	tasks.done = SDL_CreateCond ();
+	if (!tasks.work || !tasks.done)
+		Sys_Error ("Tasks_Init: could not create condition variable");
+
+	// -threads <n> sets the total thread count, main thread included
+	i = COM_CheckParm ("-threads");
+	if (i && i < com_argc - 1)
+		numthreads = Q_atoi (com_argv[i + 1]);
+	else
+		numthreads = SDL_GetCPUCount ();
+	numthreads = CLAMP (1, numthreads, MAX_TASK_WORKERS + 1);
+
+	tasks.deques = (taskdeque_t *) calloc (numthreads, sizeof (taskdeque_t));
+	if (!tasks.deques)
+		Sys_Error ("Tasks_Init: out of memory");
+
+	for (i = 0; i < numthreads - 1; i++)
+	{
+		// workers use deques 1..numworkers, deque 0 belongs to the main thread
+		tasks.workers[tasks.numworkers] = SDL_CreateThread (Task_Worker, "Worker", (void *)(intptr_t)(tasks.numworkers + 1));
+		if (!tasks.workers[tasks.numworkers])
+		{
+			Con_Printf ("Tasks_Init: could not create worker thread: %s\n", SDL_GetError ());
+			break;
+		}
+		tasks.numworkers++;
+	}
+
+	Cmd_AddCommand ("tasks", Tasks_Stats_f);
+
+	Con_Printf ("Task system: %d worker thread%s\n", tasks.numworkers, tasks.numworkers == 1 ? "" : "s");
+}
+
+/*
+==================
+Tasks_Shutdown
+==================
+*/
+void Tasks_Shutdown (void)
+{
+	int i;
+
+	if (!tasks.mutex)
+		return;
+
+	SDL_LockMutex (tasks.mutex);
+	tasks.shutdown = true;
+	SDL_CondBroadcast (tasks.work);
+	SDL_UnlockMutex (tasks.mutex);
+
+	for (i = 0; i < tasks.numworkers; i++)
+		SDL_WaitThread (tasks.workers[i], NULL);
+	tasks.numworkers = 0;
+
+	SDL_DestroyCond (tasks.done);
+	SDL_DestroyCond (tasks.work);
+	SDL_DestroyMutex (tasks.mutex);
+	tasks.mutex = NULL;
+
+	free (tasks.deques);
+	tasks.deques = NULL;
+}
@@ -0,0 +1,60 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_TASKS_H
+#define _QUAKE_TASKS_H
+
+// tasks.h -- worker thread pool
+
+// Task callbacks receive the half-open range [first, last) they should process.
+// They run on arbitrary threads, so they must not touch the hunk, the console
+// or anything else that isn't thread-safe, and must never call Host_Error.
+typedef void (*taskfunc_t) (void *param, int first, int last);
+
+// A group tracks a set of dispatched tasks so they can be waited on together.
+// Groups must be zero-initialized before their first use.
+typedef struct taskgroup_s
+{
+	SDL_atomic_t		pending;
+	SDL_SpinLock		lock;
+} taskgroup_t;
+
+void Tasks_Init (void);
+void Tasks_Shutdown (void);
+
+// number of worker threads (not counting the main thread)
+int Tasks_NumWorkers (void);
+
+// true when called from one of the worker threads
+qboolean Tasks_IsWorker (void);
+
+// queues func(param, 0, 1) for execution on a worker thread
+void Task_Dispatch (taskgroup_t *group, taskfunc_t func, void *param);
+
+// splits [0, count) into batches of (at most) batchsize items and queues them
+// for execution on worker threads; a batchsize <= 0 picks one automatically
+void Task_ParallelFor (taskgroup_t *group, int count, int batchsize, taskfunc_t func, void *param);
+
+// blocks until all the tasks in the group have completed,
+// helping out with queued tasks in the meantime
+void Task_Wait (taskgroup_t *group);
+
+#endif /* _QUAKE_TASKS_H */
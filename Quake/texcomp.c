@@ -0,0 +1,474 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// texcomp.c -- block compression encoders
+//
+// Simple single-pass encoders: endpoints come from the principal axis of
+// each 4x4 block and every pixel picks the closest palette entry. BC7 only
+// uses mode 6 (one subset, rgba endpoints, 4-bit indices), which is a good
+// fit for smooth game textures and a lot cheaper to search than all modes.
+
+#include "quakedef.h"
+#include "texcomp.h"
+
+#define TEXCOMP_MIN_PARALLEL_BLOCKS	1024
+
+typedef byte texblock_t[16][4];
+
+static const int bc7_weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/*
+==================
+TexComp_FetchBlock -- copies a 4x4 block, replicating edge pixels past the image bounds
+==================
+*/
+static void TexComp_FetchBlock (const byte *rgba, int width, int height, int bx, int by, texblock_t block)
+{
+	int x, y;
+
+	for (y = 0; y < 4; y++)
+	{
+		int sy = q_min (by * 4 + y, height - 1);
+		for (x = 0; x < 4; x++)
+		{
+			int sx = q_min (bx * 4 + x, width - 1);
+			memcpy (block[y * 4 + x], rgba + ((size_t) sy * width + sx) * 4, 4);
+		}
+	}
+}
+
+/*
+==================
+TexComp_Endpoints
+
+Fits a line through the block's colors (using the first numchannels channels)
+and returns the extremes of the projected colors
+==================
+*/
+static void TexComp_Endpoints (texblock_t block, int numchannels, float e0[4], float e1[4])
+{
+	float	mean[4] = {0.f, 0.f, 0.f, 0.f};
+	float	cov[4][4];
+	float	axis[4] = {0.f, 0.f, 0.f, 0.f};
+	float	tmin = FLT_MAX, tmax = -FLT_MAX, len;
+	int		i, j, k, maxchannel;
+
+	for (i = 0; i < 16; i++)
+		for (j = 0; j < numchannels; j++)
+			mean[j] += block[i][j];
+	for (j = 0; j < numchannels; j++)
+		mean[j] *= 1.f / 16.f;
+
+	memset (cov, 0, sizeof (cov));
+	for (i = 0; i < 16; i++)
+	{
+		float d[4];
+		for (j = 0; j < numchannels; j++)
+			d[j] = block[i][j] - mean[j];
+		for (j = 0; j < numchannels; j++)
+			for (k = j; k < numchannels; k++)
+				cov[j][k] += d[j] * d[k];
+	}
+	for (j = 0; j < numchannels; j++)
+		for (k = 0; k < j; k++)
+			cov[j][k] = cov[k][j];
+
+	// power iteration for the principal axis, starting from the covariance
+	// row of the channel that varies most: unlike a fixed seed, it can't be
+	// orthogonal to the axis (e.g. with anti-correlated channels)
+	for (j = maxchannel = 0; j < numchannels; j++)
+		if (cov[j][j] > cov[maxchannel][maxchannel])
+			maxchannel = j;
+	for (j = 0; j < numchannels; j++)
+		axis[j] = cov[maxchannel][j];
+
+	for (i = 0; i < 8; i++)
+	{
+		float v[4] = {0.f, 0.f, 0.f, 0.f};
+		float maxv = 0.f;
+		for (j = 0; j < numchannels; j++)
+		{
+			for (k = 0; k < numchannels; k++)
+				v[j] += cov[j][k] * axis[k];
+			maxv = q_max (maxv, fabsf (v[j]));
+		}
+		if (maxv < 1e-6f)
+			break;
+		for (j = 0; j < numchannels; j++)
+			axis[j] = v[j] / maxv;
+	}
+
+	for (j = 0, len = 0.f; j < numchannels; j++)
+		len += axis[j] * axis[j];
+	if (len < 1e-6f)
+	{	// flat block
+		for (j = 0; j < numchannels; j++)
+			e0[j] = e1[j] = mean[j];
+		return;
+	}
+
+	for (i = 0; i < 16; i++)
+	{
+		float t = 0.f;
+		for (j = 0; j < numchannels; j++)
+			t += (block[i][j] - mean[j]) * axis[j];
+		tmin = q_min (tmin, t);
+		tmax = q_max (tmax, t);
+	}
+	tmin /= len;
+	tmax /= len;
+
+	for (j = 0; j < numchannels; j++)
+	{
+		e0[j] = CLAMP (0.f, mean[j] + tmin * axis[j], 255.f);
+		e1[j] = CLAMP (0.f, mean[j] + tmax * axis[j], 255.f);
+	}
+}
+
+/*
+==================
+TexComp_BestIndex -- returns the palette entry closest to the given color
+==================
+*/
+static int TexComp_BestIndex (const byte color[4], const int palette[][4], int numentries, int numchannels)
+{
+	int i, j, best = 0, besterr = INT_MAX;
+
+	for (i = 0; i < numentries; i++)
+	{
+		int err = 0;
+		for (j = 0; j < numchannels; j++)
+		{
+			int d = color[j] - palette[i][j];
+			err += d * d;
+		}
+		if (err < besterr)
+		{
+			besterr = err;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/*
+==================
+TexComp_To565
+==================
+*/
+static int TexComp_To565 (const float c[3])
+{
+	int r = (int)(c[0] * (31.f / 255.f) + 0.5f);
+	int g = (int)(c[1] * (63.f / 255.f) + 0.5f);
+	int b = (int)(c[2] * (31.f / 255.f) + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+/*
+==================
+TexComp_From565
+==================
+*/
+static void TexComp_From565 (int c, int out[4])
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+	out[3] = 255;
+}
+
+/*
+==================
+TexComp_EncodeColorBlock -- BC1 color block, always in 4-color mode
+==================
+*/
+static void TexComp_EncodeColorBlock (texblock_t block, byte out[8])
+{
+	float		e0[4], e1[4], inset;
+	int			c0, c1, palette[4][4];
+	unsigned	indices = 0;
+	int			i, j;
+
+	TexComp_Endpoints (block, 3, e0, e1);
+
+	// pull the endpoints in a bit to reduce the error around the middle
+	for (j = 0; j < 3; j++)
+	{
+		inset = (e1[j] - e0[j]) / 16.f;
+		e0[j] += inset;
+		e1[j] -= inset;
+	}
+
+	c0 = TexComp_To565 (e1);
+	c1 = TexComp_To565 (e0);
+	if (c0 < c1)
+	{
+		int tmp = c0;
+		c0 = c1;
+		c1 = tmp;
+	}
+
+	if (c0 != c1)
+	{
+		TexComp_From565 (c0, palette[0]);
+		TexComp_From565 (c1, palette[1]);
+		for (j = 0; j < 3; j++)
+		{
+			palette[2][j] = (2 * palette[0][j] + palette[1][j]) / 3;
+			palette[3][j] = (palette[0][j] + 2 * palette[1][j]) / 3;
+		}
+		for (i = 0; i < 16; i++)
+			indices |= TexComp_BestIndex (block[i], (const int (*)[4]) palette, 4, 3) << (i * 2);
+	}
+
+	out[0] = c0 & 255;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 255;
+	out[3] = c1 >> 8;
+	out[4] = indices & 255;
+	out[5] = (indices >> 8) & 255;
+	out[6] = (indices >> 16) & 255;
+	out[7] = indices >> 24;
+}
+
+/*
+==================
+TexComp_EncodeAlphaBlock -- BC3 alpha block, always in 8-value mode
+==================
+*/
+static void TexComp_EncodeAlphaBlock (texblock_t block, byte out[8])
+{
+	int			amin = 255, amax = 0, palette[8][4];
+	uint64_t	indices = 0;
+	int			i;
+
+	for (i = 0; i < 16; i++)
+	{
+		amin = q_min (amin, block[i][3]);
+		amax = q_max (amax, block[i][3]);
+	}
+
+	if (amin != amax)
+	{
+		palette[0][0] = amax;
+		palette[1][0] = amin;
+		for (i = 2; i < 8; i++)
+			palette[i][0] = ((8 - i) * amax + (i - 1) * amin) / 7;
+		for (i = 0; i < 16; i++)
+		{
+			byte alpha[4] = {block[i][3], 0, 0, 0};
+			indices |= (uint64_t) TexComp_BestIndex (alpha, (const int (*)[4]) palette, 8, 1) << (i * 3);
+		}
+	}
+
+	out[0] = amax;
+	out[1] = amin;
+	for (i = 0; i < 6; i++)
+		out[2 + i] = (indices >> (i * 8)) & 255;
+}
+
+/*
+==================
+TexComp_PutBits
+==================
+*/
+static void TexComp_PutBits (byte *out, int *pos, unsigned value, int numbits)
+{
+	int i;
+
+	for (i = 0; i < numbits; i++, (*pos)++)
+		if (value & (1u << i))
+			out[*pos >> 3] |= 1 << (*pos & 7);
+}
+
+/*
+==================
+TexComp_EncodeBC7Block -- mode 6: 7.7.7.7 endpoints + unique p-bits, 4-bit indices
+==================
+*/
+static void TexComp_EncodeBC7Block (texblock_t block, byte out[16])
+{
+	float	e[2][4];
+	int		q[2][4], p[2], palette[16][4], indices[16];
+	int		i, j, pos;
+
+	TexComp_Endpoints (block, 4, e[0], e[1]);
+
+	// quantize each endpoint to 7 bits per channel plus a shared lsb
+	for (i = 0; i < 2; i++)
+	{
+		int besterr = INT_MAX;
+		for (p[i] = 0, j = 0; j < 2; j++)
+		{
+			int c, err = 0, v[4];
+			for (c = 0; c < 4; c++)
+			{
+				int d;
+				v[c] = CLAMP (0, (int)((e[i][c] - j) * 0.5f + 0.5f), 127);
+				d = (v[c] * 2 + j) - (int)(e[i][c] + 0.5f);
+				err += d * d;
+			}
+			if (err < besterr)
+			{
+				besterr = err;
+				p[i] = j;
+				memcpy (q[i], v, sizeof (v));
+			}
+		}
+	}
+
+	for (i = 0; i < 16; i++)
+	{
+		for (j = 0; j < 4; j++)
+		{
+			int v0 = q[0][j] * 2 + p[0];
+			int v1 = q[1][j] * 2 + p[1];
+			palette[i][j] = ((64 - bc7_weights4[i]) * v0 + bc7_weights4[i] * v1 + 32) >> 6;
+		}
+	}
+
+	for (i = 0; i < 16; i++)
+		indices[i] = TexComp_BestIndex (block[i], (const int (*)[4]) palette, 16, 4);
+
+	// the msb of the first index is implicit, swap the endpoints if needed
+	if (indices[0] & 8)
+	{
+		int tmp[4];
+		memcpy (tmp, q[0], sizeof (tmp));
+		memcpy (q[0], q[1], sizeof (tmp));
+		memcpy (q[1], tmp, sizeof (tmp));
+		j = p[0];
+		p[0] = p[1];
+		p[1] = j;
+		for (i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+
+	memset (out, 0, 16);
+	pos = 0;
+	TexComp_PutBits (out, &pos, 1 << 6, 7);
+	for (j = 0; j < 4; j++)
+	{
+		TexComp_PutBits (out, &pos, q[0][j], 7);
+		TexComp_PutBits (out, &pos, q[1][j], 7);
+	}
+	TexComp_PutBits (out, &pos, p[0], 1);
+	TexComp_PutBits (out, &pos, p[1], 1);
+	TexComp_PutBits (out, &pos, indices[0], 3);
+	for (i = 1; i < 16; i++)
+		TexComp_PutBits (out, &pos, indices[i], 4);
+}
+
+/*
+==================
+TexComp_BlockSize
+==================
+*/
+static int TexComp_BlockSize (texcompformat_t format)
+{
+	return format == TEXCOMP_BC1 ? 8 : 16;
+}
+
+/*
+==================
+TexComp_Size
+==================
+*/
+size_t TexComp_Size (texcompformat_t format, int width, int height)
+{
+	return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * TexComp_BlockSize (format);
+}
+
+typedef struct
+{
+	texcompformat_t	format;
+	const byte		*rgba;
+	int				width;
+	int				height;
+	byte			*out;
+} texcompjob_t;
+
+/*
+==================
+TexComp_EncodeRows -- encodes the block rows [first, last)
+==================
+*/
+static void TexComp_EncodeRows (void *param, int first, int last)
+{
+	const texcompjob_t	*job = (const texcompjob_t *) param;
+	int					blocksize = TexComp_BlockSize (job->format);
+	int					numblocksx = (job->width + 3) / 4;
+	texblock_t			block;
+	byte				*out;
+	int					bx, by;
+
+	for (by = first; by < last; by++)
+	{
+		out = job->out + (size_t) by * numblocksx * blocksize;
+		for (bx = 0; bx < numblocksx; bx++, out += blocksize)
+		{
+			TexComp_FetchBlock (job->rgba, job->width, job->height, bx, by, block);
+			switch (job->format)
+			{
+			case TEXCOMP_BC1:
+				TexComp_EncodeColorBlock (block, out);
+				break;
+			case TEXCOMP_BC3:
+				TexComp_EncodeAlphaBlock (block, out);
+				TexComp_EncodeColorBlock (block, out + 8);
+				break;
+			case TEXCOMP_BC7:
+			default:
+				TexComp_EncodeBC7Block (block, out);
+				break;
+			}
+		}
+	}
+}
+
+/*
+==================
+TexComp_Encode
+==================
+*/
+void TexComp_Encode (texcompformat_t format, const byte *rgba, int width, int height, byte *out)
+{
+	texcompjob_t	job;
+	int				numblocksx = (width + 3) / 4;
+	int				numblocksy = (height + 3) / 4;
+
+	job.format = format;
+	job.rgba = rgba;
+	job.width = width;
+	job.height = height;
+	job.out = out;
+
+	if (numblocksx * numblocksy >= TEXCOMP_MIN_PARALLEL_BLOCKS && Tasks_NumWorkers () > 0)
+	{
+		taskgroup_t group;
+		memset (&group, 0, sizeof (group));
+		Task_ParallelFor (&group, numblocksy, 0, TexComp_EncodeRows, &job);
+		Task_Wait (&group);
+	}
+	else
+		TexComp_EncodeRows (&job, 0, numblocksy);
+}
@@ -0,0 +1,42 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_TEXCOMP_H
+#define _QUAKE_TEXCOMP_H
+
+// texcomp.h -- block compression encoders
+
+typedef enum
+{
+	TEXCOMP_NONE = -1,
+	TEXCOMP_BC1,		// opaque rgb, 4 bits per pixel
+	TEXCOMP_BC3,		// rgb + interpolated alpha, 8 bits per pixel
+	TEXCOMP_BC7,		// rgba (mode 6 only), 8 bits per pixel
+} texcompformat_t;
+
+// returns the size in bytes of a width x height image in the given format
+size_t TexComp_Size (texcompformat_t format, int width, int height);
+
+// encodes 32-bit rgba pixels, out must hold TexComp_Size bytes
+// large images are split across worker threads
+void TexComp_Encode (texcompformat_t format, const byte *rgba, int width, int height, byte *out);
+
+#endif /* _QUAKE_TEXCOMP_H */
@@ -56,9 +56,10 @@ HULL BOXES
 */
 
 
-static	hull_t		box_hull;
-static	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
-static	mplane_t	box_planes[6];
+// per thread, since parallel physics traces from worker threads
+static	THREAD_LOCAL hull_t			box_hull;
+static	THREAD_LOCAL mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
+static	THREAD_LOCAL mplane_t		box_planes[6];
 
 /*
 ===================
@@ -107,6 +108,9 @@ BSP trees instead of being compared directly.
 */
 hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
 {
+	if (!box_hull.clipnodes)
+		SV_InitBoxHull ();
+
 	box_planes[0].dist = maxs[0];
 	box_planes[1].dist = mins[0];
 	box_planes[2].dist = maxs[1];
@@ -190,14 +194,56 @@ typedef struct areanode_s
 	struct areanode_s	*children[2];
 	link_t	trigger_edicts;
 	link_t	solid_edicts;
+	vec3_t	mins, maxs;
+	int		depth;
+	int		numedicts;	// number of edicts linked directly to this node
 } areanode_t;
 
 // Note: changing this can affect droptofloor
 #define	AREA_DEPTH	4
-#define	AREA_NODES	(2<<AREA_DEPTH)
+
+// leaves holding more than sv_areanode_split edicts are split further, so that
+// big or crowded maps don't end up with hundreds of edicts per node
+#define	AREA_MAX_DEPTH	12
+#define	AREA_MIN_SIZE	128		// don't split nodes into halves smaller than this
+#define	AREA_NODES	4096	// splitting stops once the pool runs out
+
+#define	AREA_DEFAULT_SPLIT	32	// what sv_tracebench tries when splitting is off
+
+// off by default: splitting changes the order in which edicts are visited
+cvar_t	sv_areanode_split = {"sv_areanode_split", "0", CVAR_NONE}; // 0 = fixed tree
 
 static	areanode_t	sv_areanodes[AREA_NODES];
 static	int			sv_numareanodes;
+static	int			sv_areasplit;		// sv_areanode_split value the tree was built with
+static	int			sv_areasplits;		// number of SV_SplitAreaNode calls since the map started
+static	THREAD_LOCAL int	sv_areachecks;	// edicts looked at by SV_ClipToLinks, for sv_tracebench
+
+areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs);
+
+/*
+===============
+SV_DivideAreaNode
+
+Turns a leaf into a node with two empty leaves
+===============
+*/
+static void SV_DivideAreaNode (areanode_t *anode, int axis)
+{
+	vec3_t		mins1, maxs1, mins2, maxs2;
+
+	anode->axis = axis;
+	anode->dist = 0.5 * (anode->maxs[axis] + anode->mins[axis]);
+	VectorCopy (anode->mins, mins1);
+	VectorCopy (anode->mins, mins2);
+	VectorCopy (anode->maxs, maxs1);
+	VectorCopy (anode->maxs, maxs2);
+
+	maxs1[axis] = mins2[axis] = anode->dist;
+
+	anode->children[0] = SV_CreateAreaNode (anode->depth+1, mins2, maxs2);
+	anode->children[1] = SV_CreateAreaNode (anode->depth+1, mins1, maxs1);
+}
 
 /*
 ===============
@@ -208,42 +254,127 @@ SV_CreateAreaNode
 areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 {
 	areanode_t	*anode;
-	vec3_t		size;
-	vec3_t		mins1, maxs1, mins2, maxs2;
 
 	anode = &sv_areanodes[sv_numareanodes];
 	sv_numareanodes++;
 
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
+	VectorCopy (mins, anode->mins);
+	VectorCopy (maxs, anode->maxs);
+	anode->depth = depth;
+	anode->numedicts = 0;
+	anode->axis = -1;
+	anode->children[0] = anode->children[1] = NULL;
+
+	if (depth < AREA_DEPTH)
+		SV_DivideAreaNode (anode, anode->maxs[0] - anode->mins[0] > anode->maxs[1] - anode->mins[1] ? 0 : 1);
+
+	return anode;
+}
+
+/*
+===============
+SV_AreaNodeForEdict -- finds the first node that the ent's box crosses
+===============
+*/
+static areanode_t *SV_AreaNodeForEdict (edict_t *ent)
+{
+	areanode_t	*node = sv_areanodes;
 
-	if (depth == AREA_DEPTH)
+	while (1)
 	{
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
+		if (node->axis == -1)
+			break;
+		if (ent->v.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (ent->v.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
 	}
 
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1])
-		anode->axis = 0;
-	else
-		anode->axis = 1;
+	return node;
+}
+
+/*
+===============
+SV_SplitAreaNode
+
+Divides a crowded leaf along its longest axis and moves down the edicts
+that fit entirely on one side, keeping their relative order
+===============
+*/
+static void SV_SplitAreaNode (areanode_t *node)
+{
+	link_t		*lists[2] = {&node->trigger_edicts, &node->solid_edicts};
+	link_t		*l, *next;
+	edict_t		*ent;
+	areanode_t	*child;
+	vec3_t		size;
+	int			i, axis;
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy (mins, mins1);
-	VectorCopy (mins, mins2);
-	VectorCopy (maxs, maxs1);
-	VectorCopy (maxs, maxs2);
+	if (node->depth >= AREA_MAX_DEPTH || sv_numareanodes + 2 > AREA_NODES)
+		return;
 
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+	VectorSubtract (node->maxs, node->mins, size);
+	axis = 0;
+	for (i = 1; i < 3; i++)
+		if (size[i] > size[axis])
+			axis = i;
+	if (!(size[axis] >= 2 * AREA_MIN_SIZE))
+		return;
 
-	anode->children[0] = SV_CreateAreaNode (depth+1, mins2, maxs2);
-	anode->children[1] = SV_CreateAreaNode (depth+1, mins1, maxs1);
+	SV_DivideAreaNode (node, axis);
+	sv_areasplits++;
 
-	return anode;
+	for (i = 0; i < 2; i++)
+	{
+		for (l = lists[i]->next; l != lists[i]; l = next)
+		{
+			next = l->next;
+			ent = EDICT_FROM_AREA (l);
+			if (ent->v.absmin[axis] > node->dist)
+				child = node->children[0];
+			else if (ent->v.absmax[axis] < node->dist)
+				child = node->children[1];
+			else
+				continue;
+			RemoveLink (&ent->area);
+			InsertLinkBefore (&ent->area, i ? &child->solid_edicts : &child->trigger_edicts);
+			ent->areanode = child;
+			node->numedicts--;
+			child->numedicts++;
+		}
+	}
+
+	for (i = 0; i < 2; i++)
+		if (node->children[i]->numedicts > sv_areasplit)
+			SV_SplitAreaNode (node->children[i]);
+}
+
+/*
+===============
+SV_InsertAreaEdict -- links an edict with an up to date abs box into the area tree
+===============
+*/
+static void SV_InsertAreaEdict (edict_t *ent)
+{
+	areanode_t	*node = SV_AreaNodeForEdict (ent);
+
+	if (ent->v.solid == SOLID_TRIGGER)
+		InsertLinkBefore (&ent->area, &node->trigger_edicts);
+	else
+		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	ent->areanode = node;
+	node->numedicts++;
+
+	if (sv_areasplit > 0 && node->axis == -1 && node->numedicts > sv_areasplit)
+		SV_SplitAreaNode (node);
 }
 
+static void SV_ClearRadiusIndex (void);
+
 /*
 ===============
 SV_ClearWorld
@@ -253,12 +384,25 @@ SV_ClearWorld
 void SV_ClearWorld (void)
 {
 	SV_InitBoxHull ();
+	SV_ClearRadiusIndex ();
 
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
+	sv_areasplit = (int) sv_areanode_split.value;
+	sv_areasplits = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
 }
 
+/*
+===============
+SV_AreaSplitCount -- changes whenever edicts that didn't move get relinked to other nodes
+===============
+*/
+int SV_AreaSplitCount (void)
+{
+	return sv_areasplits;
+}
+
 
 /*
 ===============
@@ -268,10 +412,13 @@ SV_UnlinkEdict
 */
 void SV_UnlinkEdict (edict_t *ent)
 {
+	SV_MarkEdictMoved (ent);
 	if (!ent->area.prev)
 		return;		// not linked in anywhere
 	RemoveLink (&ent->area);
 	ent->area.prev = ent->area.next = NULL;
+	ent->areanode->numedicts--;
+	ent->areanode = NULL;
 }
 
 
@@ -466,8 +613,7 @@ SV_LinkEdict
 */
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 {
-	areanode_t	*node;
-
+	SV_MarkEdictMoved (ent);
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 
@@ -507,30 +653,13 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	ent->num_leafs = 0;
 	if (ent->v.modelindex)
 		SV_FindTouchedLeafs (ent, sv.worldmodel->nodes);
+	SV_NoteEdictLeafs (ent);
 
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-
 // link it in
-
-	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	SV_InsertAreaEdict (ent);
 
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -634,11 +763,11 @@ LINE TESTING IN HULLS
 
 /*
 ==================
-SV_RecursiveHullCheck
+SV_HullCheckRecursive
 
 ==================
 */
-qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+static qboolean SV_HullCheckRecursive (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
 {
 	mclipnode_t	*node; //johnfitz -- was dclipnode_t
 	mplane_t	*plane;
@@ -687,14 +816,14 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 
 #if 1
 	if (t1 >= 0 && t2 >= 0)
-		return SV_RecursiveHullCheck (hull, node->children[0], p1f, p2f, p1, p2, trace);
+		return SV_HullCheckRecursive (hull, node->children[0], p1f, p2f, p1, p2, trace);
 	if (t1 < 0 && t2 < 0)
-		return SV_RecursiveHullCheck (hull, node->children[1], p1f, p2f, p1, p2, trace);
+		return SV_HullCheckRecursive (hull, node->children[1], p1f, p2f, p1, p2, trace);
 #else
 	if ( (t1 >= DIST_EPSILON && t2 >= DIST_EPSILON) || (t2 > t1 && t1 >= 0) )
-		return SV_RecursiveHullCheck (hull, node->children[0], p1f, p2f, p1, p2, trace);
+		return SV_HullCheckRecursive (hull, node->children[0], p1f, p2f, p1, p2, trace);
 	if ( (t1 <= -DIST_EPSILON && t2 <= -DIST_EPSILON) || (t2 < t1 && t1 <= 0) )
-		return SV_RecursiveHullCheck (hull, node->children[1], p1f, p2f, p1, p2, trace);
+		return SV_HullCheckRecursive (hull, node->children[1], p1f, p2f, p1, p2, trace);
 #endif
 
 // put the crosspoint DIST_EPSILON pixels on the near side
@@ -714,7 +843,7 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 	side = (t1 < 0);
 
 // move up to the node
-	if (!SV_RecursiveHullCheck (hull, node->children[side], p1f, midf, p1, mid, trace) )
+	if (!SV_HullCheckRecursive (hull, node->children[side], p1f, midf, p1, mid, trace) )
 		return false;
 
 #ifdef PARANOID
@@ -729,7 +858,7 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 	if (SV_HullPointContents (hull, node->children[side^1], mid)
 	!= CONTENTS_SOLID)
 // go past the node
-		return SV_RecursiveHullCheck (hull, node->children[side^1], midf, p2f, mid, p2, trace);
+		return SV_HullCheckRecursive (hull, node->children[side^1], midf, p2f, mid, p2, trace);
 
 	if (trace->allsolid)
 		return false;		// never got out of the solid area
@@ -756,7 +885,8 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 		{
 			trace->fraction = midf;
 			VectorCopy (mid, trace->endpos);
-			Con_DPrintf ("backup past 0\n");
+			if (!Tasks_IsWorker ())
+				Con_DPrintf ("backup past 0\n");
 			return false;
 		}
 		midf = p1f + (p2f - p1f)*frac;
@@ -770,6 +900,296 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 	return false;
 }
 
+/*
+==================
+SV_RecursiveHullCheck
+
+Same traversal as SV_HullCheckRecursive, but with an explicit stack of the
+nodes where the line was split, so deep hulls don't recurse on every node
+==================
+*/
+#define	HULL_STACK_SIZE	256
+
+typedef struct
+{
+	int		num;			// node the line was split at
+	int		side;			// side of the node p1 is on
+	float	frac;
+	float	p1f, p2f, midf;
+	vec3_t	p1, p2, mid;
+} hullframe_t;
+
+qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+{
+	hullframe_t	stack[HULL_STACK_SIZE];
+	hullframe_t	*frame;
+	mclipnode_t	*node;
+	mplane_t	*plane;
+	float		t1, t2;
+	float		frac;
+	int			i;
+	int			depth = 0;
+	qboolean	result;
+	vec3_t		start, end;
+
+	VectorCopy (p1, start);
+	VectorCopy (p2, end);
+
+	while (1)
+	{
+	// move down to a leaf, splitting the line where it crosses a node
+		while (num >= 0)
+		{
+			if (num < hull->firstclipnode || num > hull->lastclipnode)
+				Sys_Error ("SV_RecursiveHullCheck: bad node number");
+
+			node = hull->clipnodes + num;
+			plane = hull->planes + node->planenum;
+
+			if (plane->type < 3)
+			{
+				t1 = start[plane->type] - plane->dist;
+				t2 = end[plane->type] - plane->dist;
+			}
+			else
+			{
+				t1 = DoublePrecisionDotProduct (plane->normal, start) - plane->dist;
+				t2 = DoublePrecisionDotProduct (plane->normal, end) - plane->dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0)
+			{
+				num = node->children[0];
+				continue;
+			}
+			if (t1 < 0 && t2 < 0)
+			{
+				num = node->children[1];
+				continue;
+			}
+
+			if (depth == HULL_STACK_SIZE)
+			{
+				result = SV_HullCheckRecursive (hull, num, p1f, p2f, start, end, trace);
+				goto unwind;
+			}
+
+		// put the crosspoint DIST_EPSILON pixels on the near side
+			if (t1 < 0)
+				frac = (t1 + DIST_EPSILON)/(t1-t2);
+			else
+				frac = (t1 - DIST_EPSILON)/(t1-t2);
+			if (frac < 0)
+				frac = 0;
+			if (frac > 1)
+				frac = 1;
+
+			frame = &stack[depth++];
+			frame->num = num;
+			frame->side = (t1 < 0);
+			frame->frac = frac;
+			frame->p1f = p1f;
+			frame->p2f = p2f;
+			frame->midf = p1f + (p2f - p1f)*frac;
+			VectorCopy (start, frame->p1);
+			VectorCopy (end, frame->p2);
+			for (i=0 ; i<3 ; i++)
+				frame->mid[i] = start[i] + frac*(end[i] - start[i]);
+
+		// move up to the node
+			num = node->children[frame->side];
+			p2f = frame->midf;
+			VectorCopy (frame->mid, end);
+		}
+
+	// reached a leaf
+		if (num != CONTENTS_SOLID)
+		{
+			trace->allsolid = false;
+			if (num == CONTENTS_EMPTY)
+				trace->inopen = true;
+			else
+				trace->inwater = true;
+		}
+		else
+			trace->startsolid = true;
+		result = true;
+
+unwind:
+		if (!result)
+			return false;
+		if (!depth)
+			return true;
+
+		frame = &stack[depth - 1];
+		node = hull->clipnodes + frame->num;
+
+		if (SV_HullPointContents (hull, node->children[frame->side^1], frame->mid)
+		!= CONTENTS_SOLID)
+		{
+		// go past the node
+			num = node->children[frame->side^1];
+			p1f = frame->midf;
+			p2f = frame->p2f;
+			VectorCopy (frame->mid, start);
+			VectorCopy (frame->p2, end);
+			depth--;
+			continue;
+		}
+
+		if (trace->allsolid)
+			return false;		// never got out of the solid area
+
+	//==================
+	// the other side of the node is solid, this is the impact point
+	//==================
+		plane = hull->planes + node->planenum;
+		if (!frame->side)
+		{
+			VectorCopy (plane->normal, trace->plane.normal);
+			trace->plane.dist = plane->dist;
+		}
+		else
+		{
+			VectorSubtract (vec3_origin, plane->normal, trace->plane.normal);
+			trace->plane.dist = -plane->dist;
+		}
+
+		frac = frame->frac;
+		while (SV_HullPointContents (hull, hull->firstclipnode, frame->mid)
+		== CONTENTS_SOLID)
+		{ // shouldn't really happen, but does occasionally
+			frac -= 0.1;
+			if (frac < 0)
+			{
+				trace->fraction = frame->midf;
+				VectorCopy (frame->mid, trace->endpos);
+				if (!Tasks_IsWorker ())
+					Con_DPrintf ("backup past 0\n");
+				return false;
+			}
+			frame->midf = frame->p1f + (frame->p2f - frame->p1f)*frac;
+			for (i=0 ; i<3 ; i++)
+				frame->mid[i] = frame->p1[i] + frac*(frame->p2[i] - frame->p1[i]);
+		}
+
+		trace->fraction = frame->midf;
+		VectorCopy (frame->mid, trace->endpos);
+
+		return false;
+	}
+}
+
+#if defined(USE_SSE2) && (defined(__x86_64__) || defined(_M_X64) || defined(__SSE2_MATH__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+// the packet tests below only give the same answers as the scalar
+// code when the scalar code does its float math with SSE2 too
+#define USE_SSE2_HULLCHECK
+
+/*
+==================
+SV_PlaneDist4 -- DoublePrecisionDotProduct (plane->normal, p) - plane->dist for 4 points
+==================
+*/
+static __m128 SV_PlaneDist4 (const mplane_t *plane, __m128 x, __m128 y, __m128 z)
+{
+	__m128d	n0 = _mm_set1_pd (plane->normal[0]);
+	__m128d	n1 = _mm_set1_pd (plane->normal[1]);
+	__m128d	n2 = _mm_set1_pd (plane->normal[2]);
+	__m128d	dist = _mm_set1_pd (plane->dist);
+	__m128d	lo, hi;
+
+	lo = _mm_mul_pd (n0, _mm_cvtps_pd (x));
+	hi = _mm_mul_pd (n0, _mm_cvtps_pd (_mm_movehl_ps (x, x)));
+	lo = _mm_add_pd (lo, _mm_mul_pd (n1, _mm_cvtps_pd (y)));
+	hi = _mm_add_pd (hi, _mm_mul_pd (n1, _mm_cvtps_pd (_mm_movehl_ps (y, y))));
+	lo = _mm_add_pd (lo, _mm_mul_pd (n2, _mm_cvtps_pd (z)));
+	hi = _mm_add_pd (hi, _mm_mul_pd (n2, _mm_cvtps_pd (_mm_movehl_ps (z, z))));
+	lo = _mm_sub_pd (lo, dist);
+	hi = _mm_sub_pd (hi, dist);
+
+	return _mm_movelh_ps (_mm_cvtpd_ps (lo), _mm_cvtpd_ps (hi));
+}
+
+/*
+==================
+SV_HullCheckPacket
+
+Walks down the hull with up to 4 lines at once for as long as they all stay
+on the same side of every node, then finishes each line on its own
+==================
+*/
+static void SV_HullCheckPacket (hull_t *hull, int count, vec3_t *p1, vec3_t *p2, trace_t *traces)
+{
+	__m128		start[3], end[3], t1, t2, zero = _mm_setzero_ps ();
+	mclipnode_t	*node;
+	mplane_t	*plane;
+	int			i, j, num, front, back, mask;
+
+	// unused lanes repeat the first line so they never disagree with it
+	for (i = 0; i < 3; i++)
+	{
+		start[i] = _mm_setr_ps (p1[0][i], p1[count > 1][i], p1[count > 2 ? 2 : 0][i], p1[count > 3 ? 3 : 0][i]);
+		end[i] = _mm_setr_ps (p2[0][i], p2[count > 1][i], p2[count > 2 ? 2 : 0][i], p2[count > 3 ? 3 : 0][i]);
+	}
+	mask = 15;
+
+	num = hull->firstclipnode;
+	while (num >= 0)
+	{
+		if (num < hull->firstclipnode || num > hull->lastclipnode)
+			Sys_Error ("SV_HullCheckPacket: bad node number");
+
+		node = hull->clipnodes + num;
+		plane = hull->planes + node->planenum;
+
+		if (plane->type < 3)
+		{
+			__m128 dist = _mm_set1_ps (plane->dist);
+			t1 = _mm_sub_ps (start[plane->type], dist);
+			t2 = _mm_sub_ps (end[plane->type], dist);
+		}
+		else
+		{
+			t1 = SV_PlaneDist4 (plane, start[0], start[1], start[2]);
+			t2 = SV_PlaneDist4 (plane, end[0], end[1], end[2]);
+		}
+
+		front = _mm_movemask_ps (_mm_and_ps (_mm_cmpge_ps (t1, zero), _mm_cmpge_ps (t2, zero)));
+		back = _mm_movemask_ps (_mm_and_ps (_mm_cmplt_ps (t1, zero), _mm_cmplt_ps (t2, zero)));
+		if (front == mask)
+			num = node->children[0];
+		else if (back == mask)
+			num = node->children[1];
+		else
+			break;
+	}
+
+	for (j = 0; j < count; j++)
+		SV_RecursiveHullCheck (hull, num, 0, 1, p1[j], p2[j], &traces[j]);
+}
+#endif
+
+/*
+==================
+SV_HullCheckBatch
+
+Traces count lines through the same hull, with the same results as calling
+SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, ...) for each of them
+==================
+*/
+void SV_HullCheckBatch (hull_t *hull, int count, vec3_t *p1, vec3_t *p2, trace_t *traces)
+{
+	int i;
+
+#ifdef USE_SSE2_HULLCHECK
+	for (i = 0; i < count; i += 4)
+		SV_HullCheckPacket (hull, q_min (count - i, 4), p1 + i, p2 + i, traces + i);
+#else
+	for (i = 0; i < count; i++)
+		SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, p1[i], p2[i], &traces[i]);
+#endif
+}
+
 
 /*
 ==================
@@ -832,6 +1252,7 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 	{
 		next = l->next;
 		touch = EDICT_FROM_AREA(l);
+		sv_areachecks++;
 		if (touch->v.solid == SOLID_NOT)
 			continue;
 		if (touch == clip->passedict)
@@ -927,18 +1348,17 @@ boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
 
 /*
 ==================
-SV_Move
+SV_ClipMoveToLinks -- clips a move that was already traced against the world to the other entities
 ==================
 */
-trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+static trace_t SV_ClipMoveToLinks (trace_t worldtrace, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
 {
 	moveclip_t	clip;
 	int			i;
 
 	memset ( &clip, 0, sizeof ( moveclip_t ) );
 
-// clip to world
-	clip.trace = SV_ClipMoveToEntity ( qcvm->edicts, start, mins, maxs, end );
+	clip.trace = worldtrace;
 
 	clip.start = start;
 	clip.end = end;
@@ -970,3 +1390,744 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	return clip.trace;
 }
 
+/*
+==================
+SV_Move
+==================
+*/
+trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+// clip to world
+	trace_t trace = SV_ClipMoveToEntity ( qcvm->edicts, start, mins, maxs, end );
+
+// clip to entities
+	return SV_ClipMoveToLinks ( trace, start, mins, maxs, end, type, passedict );
+}
+
+/*
+==================
+SV_MoveBatch
+
+Same as calling SV_Move for each move, but the moves that use the same
+world hull are traced through it together
+==================
+*/
+void SV_MoveBatch (int count, svmove_t *moves, trace_t *traces)
+{
+	vec3_t		offsets[MOVE_BATCH], starts[MOVE_BATCH], ends[MOVE_BATCH];
+	vec3_t		p1[MOVE_BATCH], p2[MOVE_BATCH];
+	hull_t		*hulls[MOVE_BATCH], *hull;
+	trace_t		batch[MOVE_BATCH], *trace;
+	int			index[MOVE_BATCH];
+	svmove_t	*move;
+	int			i, j, first, num, numhull;
+
+	for (first = 0; first < count; first += MOVE_BATCH)
+	{
+		num = q_min (count - first, MOVE_BATCH);
+
+	// fill in default traces and get the clipping hulls, like SV_ClipMoveToEntity
+		for (i = 0; i < num; i++)
+		{
+			move = &moves[first + i];
+			trace = &traces[first + i];
+			memset (trace, 0, sizeof(trace_t));
+			trace->fraction = 1;
+			trace->allsolid = true;
+			VectorCopy (move->end, trace->endpos);
+
+			hulls[i] = SV_HullForEntity (qcvm->edicts, move->mins, move->maxs, offsets[i]);
+			VectorSubtract (move->start, offsets[i], starts[i]);
+			VectorSubtract (move->end, offsets[i], ends[i]);
+		}
+
+	// trace the moves sharing a hull together
+		for (i = 0; i < num; i++)
+		{
+			if (!hulls[i])
+				continue;
+			hull = hulls[i];
+			numhull = 0;
+			for (j = i; j < num; j++)
+			{
+				if (hulls[j] != hull)
+					continue;
+				hulls[j] = NULL;
+				index[numhull] = j;
+				VectorCopy (starts[j], p1[numhull]);
+				VectorCopy (ends[j], p2[numhull]);
+				batch[numhull] = traces[first + j];
+				numhull++;
+			}
+			SV_HullCheckBatch (hull, numhull, p1, p2, batch);
+			for (j = 0; j < numhull; j++)
+				traces[first + index[j]] = batch[j];
+		}
+
+		for (i = 0; i < num; i++)
+		{
+			move = &moves[first + i];
+			trace = &traces[first + i];
+
+		// fix trace up by the offset
+			if (trace->fraction != 1)
+				VectorAdd (trace->endpos, offsets[i], trace->endpos);
+
+		// did we clip the move?
+			if (trace->fraction < 1 || trace->startsolid)
+				trace->ent = qcvm->edicts;
+
+		// clip to entities
+			*trace = SV_ClipMoveToLinks (*trace, move->start, move->mins, move->maxs, move->end, move->type, move->passedict);
+		}
+	}
+}
+
+/*
+===============================================================================
+
+AREA TREE BENCHMARK
+
+===============================================================================
+*/
+
+/*
+==================
+SV_CollectAreaEdicts -- lists the linked edicts in the order traces visit them
+==================
+*/
+static void SV_CollectAreaEdicts (areanode_t *node, edict_t **list, int *count)
+{
+	link_t	*l;
+
+	for (l = node->trigger_edicts.next; l != &node->trigger_edicts; l = l->next)
+		list[(*count)++] = EDICT_FROM_AREA (l);
+	for (l = node->solid_edicts.next; l != &node->solid_edicts; l = l->next)
+		list[(*count)++] = EDICT_FROM_AREA (l);
+
+	if (node->axis == -1)
+		return;
+
+	SV_CollectAreaEdicts (node->children[0], list, count);
+	SV_CollectAreaEdicts (node->children[1], list, count);
+}
+
+/*
+==================
+SV_RebuildAreaNodes
+
+Builds a new area tree with the given split threshold and relinks
+every edict into it, without touching their abs boxes
+==================
+*/
+static void SV_RebuildAreaNodes (int split)
+{
+	edict_t	**list;
+	int		i, count = 0;
+
+	list = (edict_t **) malloc (qcvm->num_edicts * sizeof (*list));
+	if (!list)
+		Sys_Error ("SV_RebuildAreaNodes: out of memory (%d edicts)", qcvm->num_edicts);
+	SV_CollectAreaEdicts (sv_areanodes, list, &count);
+
+	memset (sv_areanodes, 0, sizeof(sv_areanodes));
+	sv_numareanodes = 0;
+	sv_areasplit = split;
+	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	for (i = 0; i < count; i++)
+	{
+		list[i]->area.prev = list[i]->area.next = NULL;
+		SV_InsertAreaEdict (list[i]);
+	}
+
+	free (list);
+}
+
+// a copy of the area tree, for sv_tracebench
+typedef struct
+{
+	areanode_t	*nodes;
+	link_t		*links;
+	areanode_t	**edictnodes;
+	int			numedicts;
+	int			numnodes;
+	int			split;
+	int			splits;
+} areatreesave_t;
+
+/*
+==================
+SV_SaveAreaTree
+
+Copies the area tree along with every edict's place in it, so that
+SV_RestoreAreaTree can put back the exact same links afterwards
+==================
+*/
+static qboolean SV_SaveAreaTree (areatreesave_t *save)
+{
+	int i;
+
+	save->numedicts = qcvm->num_edicts;
+	save->nodes = (areanode_t *) malloc (sizeof (sv_areanodes));
+	save->links = (link_t *) malloc (save->numedicts * sizeof (*save->links));
+	save->edictnodes = (areanode_t **) malloc (save->numedicts * sizeof (*save->edictnodes));
+	if (!save->nodes || !save->links || !save->edictnodes)
+	{
+		free (save->nodes);
+		free (save->links);
+		free (save->edictnodes);
+		return false;
+	}
+
+	memcpy (save->nodes, sv_areanodes, sizeof (sv_areanodes));
+	for (i = 0; i < save->numedicts; i++)
+	{
+		save->links[i] = EDICT_NUM (i)->area;
+		save->edictnodes[i] = EDICT_NUM (i)->areanode;
+	}
+	save->numnodes = sv_numareanodes;
+	save->split = sv_areasplit;
+	save->splits = sv_areasplits;
+
+	return true;
+}
+
+/*
+==================
+SV_RestoreAreaTree
+==================
+*/
+static void SV_RestoreAreaTree (areatreesave_t *save)
+{
+	int i;
+
+	memcpy (sv_areanodes, save->nodes, sizeof (sv_areanodes));
+	for (i = 0; i < save->numedicts; i++)
+	{
+		EDICT_NUM (i)->area = save->links[i];
+		EDICT_NUM (i)->areanode = save->edictnodes[i];
+	}
+	sv_numareanodes = save->numnodes;
+	sv_areasplit = save->split;
+	sv_areasplits = save->splits;
+
+	free (save->nodes);
+	free (save->links);
+	free (save->edictnodes);
+}
+
+/*
+==================
+SV_AreaTreeStats
+==================
+*/
+static void SV_AreaTreeStats (areanode_t *node, int *leafs, int *maxdepth, int *maxedicts)
+{
+	if (node->numedicts > *maxedicts)
+		*maxedicts = node->numedicts;
+	if (node->axis == -1)
+	{
+		(*leafs)++;
+		if (node->depth > *maxdepth)
+			*maxdepth = node->depth;
+		return;
+	}
+	SV_AreaTreeStats (node->children[0], leafs, maxdepth, maxedicts);
+	SV_AreaTreeStats (node->children[1], leafs, maxdepth, maxedicts);
+}
+
+/*
+==================
+SV_RunTraceBench
+==================
+*/
+static void SV_RunTraceBench (const char *name, svmove_t *moves, int count, qboolean batched)
+{
+	trace_t		traces[MOVE_BATCH];
+	double		time;
+	int			i, leafs = 0, maxdepth = 0, maxedicts = 0;
+
+	SV_AreaTreeStats (sv_areanodes, &leafs, &maxdepth, &maxedicts);
+
+	sv_areachecks = 0;
+	time = Sys_DoubleTime ();
+	if (batched)
+	{
+		for (i = 0; i < count; i += MOVE_BATCH)
+			SV_MoveBatch (q_min (count - i, MOVE_BATCH), moves + i, traces);
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+			SV_Move (moves[i].start, moves[i].mins, moves[i].maxs, moves[i].end, moves[i].type, moves[i].passedict);
+	}
+	time = Sys_DoubleTime () - time;
+
+	Con_Printf ("%-8s %5d nodes, %5d leafs, depth %2d, max %4d edicts/node: %9.0f traces/sec, %6.1f edicts/trace\n",
+		name, sv_numareanodes, leafs, maxdepth, maxedicts,
+		count / q_max (time, 1e-6), (double) sv_areachecks / count);
+}
+
+static float SV_BenchRandom (unsigned *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) * (1.f / (1 << 24));
+}
+
+/*
+==================
+SV_TraceBench_f
+
+Runs the same random traces against the fixed area tree and the adaptive one,
+then against the adaptive one again through SV_MoveBatch. The live tree is
+put back as it was afterwards.
+==================
+*/
+void SV_TraceBench_f (void)
+{
+	svmove_t		*moves;
+	edict_t			*ent;
+	qcvm_t			*oldvm;
+	areatreesave_t	save;
+	unsigned		seed = 0x1234567u;
+	int				i, j, count, numlinked, split;
+	float			range;
+
+	if (!sv.active)
+	{
+		Con_Printf ("sv_tracebench: no map running\n");
+		return;
+	}
+
+	count = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 100000;
+	count = CLAMP (1, count, 10000000);
+	moves = (svmove_t *) calloc (count, sizeof (*moves));
+	if (!moves)
+	{
+		Con_Printf ("sv_tracebench: couldn't allocate %d traces\n", count);
+		return;
+	}
+
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+
+	numlinked = 0;
+	for (i = 1; i < qcvm->num_edicts; i++)
+		if (EDICT_NUM (i)->area.prev)
+			numlinked++;
+
+	// start next to random linked edicts, or anywhere in the world if there are none,
+	// and move up to a quarter of the world size in a random direction
+	for (i = 0; i < count; i++)
+	{
+		ent = NULL;
+		if (numlinked)
+		{
+			do
+				ent = EDICT_NUM (1 + (int) (SV_BenchRandom (&seed) * (qcvm->num_edicts - 1)));
+			while (!ent->area.prev);
+		}
+		for (j = 0; j < 3; j++)
+		{
+			range = sv.worldmodel->maxs[j] - sv.worldmodel->mins[j];
+			if (ent)
+				moves[i].start[j] = (ent->v.absmin[j] + ent->v.absmax[j]) * 0.5f;
+			else
+				moves[i].start[j] = sv.worldmodel->mins[j] + SV_BenchRandom (&seed) * range;
+			moves[i].end[j] = moves[i].start[j] + (SV_BenchRandom (&seed) - 0.5f) * 0.5f * range;
+		}
+		// half points, half player sized boxes
+		if (SV_BenchRandom (&seed) < 0.5f)
+		{
+			VectorSet (moves[i].mins, -16, -16, -24);
+			VectorSet (moves[i].maxs, 16, 16, 32);
+		}
+		moves[i].type = MOVE_NORMAL;
+	}
+
+	if (!SV_SaveAreaTree (&save))
+	{
+		Con_Printf ("sv_tracebench: couldn't save the area tree\n");
+		PR_PopQCVM (oldvm);
+		free (moves);
+		return;
+	}
+
+	Con_Printf ("%d traces, %d linked edicts\n", count, numlinked);
+
+	split = sv_areanode_split.value > 0 ? (int) sv_areanode_split.value : AREA_DEFAULT_SPLIT;
+	SV_RebuildAreaNodes (0);
+	SV_RunTraceBench ("fixed", moves, count, false);
+	SV_RebuildAreaNodes (split);
+	SV_RunTraceBench ("adaptive", moves, count, false);
+	SV_RunTraceBench ("batched", moves, count, true);
+	SV_RestoreAreaTree (&save);
+
+	PR_PopQCVM (oldvm);
+	free (moves);
+}
+
+
+/*
+===============================================================================
+
+ENTITY RADIUS INDEX
+
+Hashed 2D grid of entity centers used by findradius. Entities are reindexed
+lazily: anything that can change an entity's origin, size, solidity or free
+state calls SV_MarkEdictMoved, and the next query refreshes its cell.
+Queries return the exact same chain as the linear scan.
+
+===============================================================================
+*/
+
+#define	RADIUS_CELL_SIZE	256
+#define	RADIUS_NUM_BUCKETS	4096				// must be a power of two
+#define	RADIUS_UNBOUNDED	RADIUS_NUM_BUCKETS	// entities with a non-finite or huge center, always checked
+#define	RADIUS_MAX_COORD	1e6f
+#define	RADIUS_MAX_CELLS	1024				// bigger queries use the linear scan
+
+cvar_t	sv_findradius_index = {"sv_findradius_index", "1", CVAR_NONE}; // 0 = linear scan, 2 = compare both
+
+static struct
+{
+	int			maxedicts;			// size of the per-edict arrays
+	int			*bucket;			// bucket of each edict, -1 if not indexed
+	int			*next;
+	int			*prev;
+	byte		*moved;
+	int			*movedlist;
+	int			nummoved;
+	qboolean	rebuild;			// reindex everything on the next query
+	int			*results;
+	int			*check;				// for sv_findradius_index 2
+	int			heads[RADIUS_NUM_BUCKETS + 1];
+	unsigned	stamps[RADIUS_NUM_BUCKETS + 1];
+	unsigned	stamp;
+} sv_radius;
+
+/*
+===============
+SV_ClearRadiusIndex
+===============
+*/
+static void SV_ClearRadiusIndex (void)
+{
+	int i;
+
+	if (sv_radius.maxedicts < qcvm->max_edicts)
+	{
+		free (sv_radius.bucket);
+		free (sv_radius.next);
+		free (sv_radius.prev);
+		free (sv_radius.moved);
+		free (sv_radius.movedlist);
+		free (sv_radius.results);
+		free (sv_radius.check);
+
+		sv_radius.maxedicts = qcvm->max_edicts;
+		sv_radius.bucket = (int *) malloc (sv_radius.maxedicts * sizeof (int));
+		sv_radius.next = (int *) malloc (sv_radius.maxedicts * sizeof (int));
+		sv_radius.prev = (int *) malloc (sv_radius.maxedicts * sizeof (int));
+		sv_radius.moved = (byte *) malloc (sv_radius.maxedicts);
+		sv_radius.movedlist = (int *) malloc (sv_radius.maxedicts * sizeof (int));
+		sv_radius.results = (int *) malloc (sv_radius.maxedicts * sizeof (int));
+		sv_radius.check = (int *) malloc (sv_radius.maxedicts * sizeof (int));
+		if (!sv_radius.bucket || !sv_radius.next || !sv_radius.prev || !sv_radius.moved ||
+			!sv_radius.movedlist || !sv_radius.results || !sv_radius.check)
+			Sys_Error ("SV_ClearRadiusIndex: out of memory (%d edicts)", sv_radius.maxedicts);
+	}
+
+	for (i = 0; i < sv_radius.maxedicts; i++)
+		sv_radius.bucket[i] = -1;
+	memset (sv_radius.moved, 0, sv_radius.maxedicts);
+	for (i = 0; i <= RADIUS_NUM_BUCKETS; i++)
+		sv_radius.heads[i] = -1;
+	memset (sv_radius.stamps, 0, sizeof (sv_radius.stamps));
+	sv_radius.stamp = 0;
+	sv_radius.nummoved = 0;
+	sv_radius.rebuild = true;
+}
+
+/*
+===============
+SV_MarkEdictMoved
+===============
+*/
+void SV_MarkEdictMoved (edict_t *ent)
+{
+	int num;
+
+	SV_NoteClipChange (ent);
+
+	if (qcvm != &sv.qcvm || !sv_radius.moved || sv_radius.rebuild)
+		return;
+
+	num = ((byte *)ent - (byte *)qcvm->edicts) / qcvm->edict_size;
+	if (num <= 0 || num >= sv_radius.maxedicts || sv_radius.moved[num])
+		return;
+
+	sv_radius.moved[num] = true;
+	sv_radius.movedlist[sv_radius.nummoved++] = num;
+}
+
+/*
+===============
+SV_EdictInRadius -- the original findradius test
+===============
+*/
+static qboolean SV_EdictInRadius (edict_t *ent, const float *org, float radsq)
+{
+	float d, lensq;
+
+	if (ent->free)
+		return false;
+	if (ent->v.solid == SOLID_NOT)
+		return false;
+
+	d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
+	lensq = d * d;
+	if (lensq > radsq)
+		return false;
+	d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
+	lensq += d * d;
+	if (lensq > radsq)
+		return false;
+	d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
+	lensq += d * d;
+	if (lensq > radsq)
+		return false;
+
+	return true;
+}
+
+/*
+===============
+SV_RadiusHash
+===============
+*/
+static int SV_RadiusHash (int x, int y)
+{
+	return (((unsigned) x * 73856093u) ^ ((unsigned) y * 19349663u)) & (RADIUS_NUM_BUCKETS - 1);
+}
+
+/*
+===============
+SV_RadiusBucket
+===============
+*/
+static int SV_RadiusBucket (edict_t *ent)
+{
+	float x = ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5f;
+	float y = ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5f;
+
+	// also catches NaNs, which always pass the radius test
+	if (!(fabs (x) < RADIUS_MAX_COORD && fabs (y) < RADIUS_MAX_COORD))
+		return RADIUS_UNBOUNDED;
+
+	return SV_RadiusHash ((int) floor (x / RADIUS_CELL_SIZE), (int) floor (y / RADIUS_CELL_SIZE));
+}
+
+/*
+===============
+SV_ReindexEdict
+===============
+*/
+static void SV_ReindexEdict (int num)
+{
+	edict_t	*ent;
+	int		bucket = -1;
+	int		old = sv_radius.bucket[num];
+
+	if (num < qcvm->num_edicts)
+	{
+		ent = EDICT_NUM (num);
+		if (!ent->free && ent->v.solid != SOLID_NOT)
+			bucket = SV_RadiusBucket (ent);
+	}
+
+	if (bucket == old)
+		return;
+
+	if (old != -1)
+	{
+		if (sv_radius.prev[num] != -1)
+			sv_radius.next[sv_radius.prev[num]] = sv_radius.next[num];
+		else
+			sv_radius.heads[old] = sv_radius.next[num];
+		if (sv_radius.next[num] != -1)
+			sv_radius.prev[sv_radius.next[num]] = sv_radius.prev[num];
+	}
+
+	sv_radius.bucket[num] = bucket;
+	if (bucket != -1)
+	{
+		sv_radius.prev[num] = -1;
+		sv_radius.next[num] = sv_radius.heads[bucket];
+		if (sv_radius.heads[bucket] != -1)
+			sv_radius.prev[sv_radius.heads[bucket]] = num;
+		sv_radius.heads[bucket] = num;
+	}
+}
+
+/*
+===============
+SV_RefreshRadiusIndex
+===============
+*/
+static void SV_RefreshRadiusIndex (void)
+{
+	int i, num;
+
+	if (sv_radius.rebuild)
+	{
+		for (num = 1; num < sv_radius.maxedicts; num++)
+			SV_ReindexEdict (num);
+		sv_radius.rebuild = false;
+		return;
+	}
+
+	// physics can move self/other right before calling into QC without relinking them
+	SV_MarkEdictMoved (PROG_TO_EDICT (pr_global_struct->self));
+	SV_MarkEdictMoved (PROG_TO_EDICT (pr_global_struct->other));
+
+	for (i = 0; i < sv_radius.nummoved; i++)
+	{
+		num = sv_radius.movedlist[i];
+		sv_radius.moved[num] = false;
+		SV_ReindexEdict (num);
+	}
+	sv_radius.nummoved = 0;
+}
+
+/*
+===============
+SV_ScanRadius -- linear scan over all edicts
+===============
+*/
+static int SV_ScanRadius (const float *org, float radsq, int *results)
+{
+	edict_t	*ent;
+	int		i, count = 0;
+
+	ent = NEXT_EDICT (qcvm->edicts);
+	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT (ent))
+		if (SV_EdictInRadius (ent, org, radsq))
+			results[count++] = i;
+
+	return count;
+}
+
+/*
+===============
+SV_QueryRadiusBucket
+===============
+*/
+static int SV_QueryRadiusBucket (int bucket, const float *org, float radsq, int *results, int count)
+{
+	int num;
+
+	if (sv_radius.stamps[bucket] == sv_radius.stamp)
+		return count; // several cells can share a bucket
+	sv_radius.stamps[bucket] = sv_radius.stamp;
+
+	for (num = sv_radius.heads[bucket]; num != -1; num = sv_radius.next[num])
+		if (SV_EdictInRadius (EDICT_NUM (num), org, radsq))
+			results[count++] = num;
+
+	return count;
+}
+
+static int SV_CompareEdictNums (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+===============
+SV_QueryRadius -- returns -1 if the index can't be used for this query
+===============
+*/
+static int SV_QueryRadius (const float *org, float radsq, int *results)
+{
+	double	radius = sqrt (radsq);
+	double	mins[2], maxs[2];
+	int		i, x, y, cellmins[2], cellmaxs[2], count;
+
+	if (!sv_radius.moved || !(radius < RADIUS_MAX_COORD))
+		return -1;
+	for (i = 0; i < 2; i++)
+	{
+		if (!(fabs (org[i]) < RADIUS_MAX_COORD))
+			return -1;
+		// one extra unit to absorb rounding differences with SV_RadiusBucket
+		mins[i] = floor ((org[i] - radius - 1.0) / RADIUS_CELL_SIZE);
+		maxs[i] = floor ((org[i] + radius + 1.0) / RADIUS_CELL_SIZE);
+	}
+	if ((maxs[0] - mins[0] + 1.0) * (maxs[1] - mins[1] + 1.0) > RADIUS_MAX_CELLS)
+		return -1;
+	for (i = 0; i < 2; i++)
+	{
+		cellmins[i] = (int) mins[i];
+		cellmaxs[i] = (int) maxs[i];
+	}
+
+	SV_RefreshRadiusIndex ();
+
+	if (++sv_radius.stamp == 0)
+	{
+		memset (sv_radius.stamps, 0, sizeof (sv_radius.stamps));
+		sv_radius.stamp = 1;
+	}
+
+	count = SV_QueryRadiusBucket (RADIUS_UNBOUNDED, org, radsq, results, 0);
+	for (y = cellmins[1]; y <= cellmaxs[1]; y++)
+		for (x = cellmins[0]; x <= cellmaxs[0]; x++)
+			count = SV_QueryRadiusBucket (SV_RadiusHash (x, y), org, radsq, results, count);
+
+	// the linear scan builds the chain in edict order
+	qsort (results, count, sizeof (results[0]), SV_CompareEdictNums);
+
+	return count;
+}
+
+/*
+===============
+SV_FindRadius
+
+Returns a chain (linked through the chain field) of the non-solid_not entities
+whose center is within the given distance of org, in decreasing edict order
+===============
+*/
+edict_t *SV_FindRadius (const float *org, float radius)
+{
+	edict_t	*chain;
+	float	radsq = radius * radius;
+	int		i, count = -1;
+
+	if (sv_findradius_index.value)
+		count = SV_QueryRadius (org, radsq, sv_radius.results);
+	if (count < 0)
+		count = SV_ScanRadius (org, radsq, sv_radius.results);
+	else if (sv_findradius_index.value >= 2.f)
+	{
+		int checkcount = SV_ScanRadius (org, radsq, sv_radius.check);
+		if (checkcount != count || memcmp (sv_radius.check, sv_radius.results, count * sizeof (int)) != 0)
+		{
+			Con_Warning ("findradius index mismatch at (%.1f %.1f %.1f) radius %.1f: %d vs %d entities\n",
+				org[0], org[1], org[2], radius, count, checkcount);
+			memcpy (sv_radius.results, sv_radius.check, checkcount * sizeof (int));
+			count = checkcount;
+		}
+	}
+
+	chain = (edict_t *)qcvm->edicts;
+	for (i = 0; i < count; i++)
+	{
+		edict_t *ent = EDICT_NUM (sv_radius.results[i]);
+		ent->v.chain = EDICT_TO_PROG (chain);
+		chain = ent;
+	}
+
+	return chain;
+}
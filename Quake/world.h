@@ -47,6 +47,9 @@ typedef struct
 
 
 void SV_ClearWorld (void);
+
+int SV_AreaSplitCount (void);
+// number of area nodes split since the world was cleared
 // called after the world model has been loaded, before linking any entities
 
 void SV_UnlinkEdict (edict_t *ent);
@@ -60,6 +63,13 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+void SV_MarkEdictMoved (edict_t *ent);
+// call after changing an entity's origin, mins, maxs, solid or free state
+// without relinking it, so that findradius picks up the change
+
+edict_t *SV_FindRadius (const float *org, float radius);
+// returns a chain of the entities whose center is within radius of org
+
 int SV_PointContents (vec3_t p);
 int SV_TruePointContents (vec3_t p);
 // returns the CONTENTS_* value from the world at the given point.
@@ -68,6 +78,9 @@ int SV_TruePointContents (vec3_t p);
 
 edict_t	*SV_TestEntityPosition (edict_t *ent);
 
+void SV_MoveBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t boxmins, vec3_t boxmaxs);
+// box covered by a move, as used by SV_Move to find the edicts it may touch
+
 trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
 // mins and maxs are reletive
 
@@ -81,7 +94,25 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+typedef struct
+{
+	vec3_t		start, mins, maxs, end;
+	int			type;
+	edict_t		*passedict;
+} svmove_t;
+
+#define	MOVE_BATCH	64	// most moves SV_MoveBatch traces together
+
+void SV_MoveBatch (int count, svmove_t *moves, trace_t *traces);
+// same results as calling SV_Move for each move, but traces the world
+// hull for several moves at once
+
+void SV_TraceBench_f (void);
+// times random traces against the fixed and the adaptive area trees
+
 qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
+void SV_HullCheckBatch (hull_t *hull, int count, vec3_t *p1, vec3_t *p2, trace_t *traces);
+// traces each p1[i] -> p2[i] from the top of the hull, with SSE2 when available
 
 #endif	/* _QUAKE_WORLD_H */
 
@@ -931,7 +931,10 @@ void Cache_Free (cache_user_t *c, qboolean freetextures) //johnfitz -- added sec
 	cs->next->prev = cs->prev;
 	cs->next = cs->prev = NULL;
 
+	// the mixer may be reading sound data right now
+	S_LockMixer ();
 	c->data = NULL;
+	S_UnlockMixer ();
 
 	Cache_UnlinkLRU (cs);
 